@@ -34,6 +34,7 @@ limitations under the License.
 #include <memory>
 #include <eixx/marshal/eterm.hpp>
 #include <eixx/connect/transport_otp_connection.hpp>
+#include <eixx/util/timer_wheel.hpp>
 #include <boost/enable_shared_from_this.hpp>
 
 namespace eixx {
@@ -60,7 +61,7 @@ private:
     const Alloc&                        m_alloc;
     connect_completion_handler          m_on_connect_status;
     bool                                m_connected;
-    boost::asio::deadline_timer         m_reconnect_timer;
+    util::timer_wheel::timer            m_reconnect_timer;  // On the node's timing wheel
     int                                 m_reconnect_secs;
     bool                                m_abort;
 
@@ -78,7 +79,7 @@ private:
         , m_cookie(a_cookie)
         , m_alloc(a_alloc)
         , m_connected(false)
-        , m_reconnect_timer(m_io_service)
+        , m_reconnect_timer(a_node->timers(), [this]() { on_reconnect_timer(); })
         , m_reconnect_secs(a_reconnect_secs)
         , m_abort(false)
     {
@@ -89,25 +90,45 @@ private:
             a_remote_nodename, a_cookie, a_alloc);
     }
 
+    /// Constructor of a connection accepted from \a a_remote_nodename.
+    basic_otp_connection(
+            boost::asio::io_service&        a_svc,
+            basic_otp_node<Alloc,Mutex>*    a_node,
+            atom                            a_remote_nodename,
+            atom                            a_cookie,
+            const Alloc&                    a_alloc)
+        : m_io_service(a_svc)
+        , m_node(a_node)
+        , m_remote_nodename(a_remote_nodename)
+        , m_cookie(a_cookie)
+        , m_alloc(a_alloc)
+        , m_connected(false)
+        , m_reconnect_timer(a_node->timers(), [this]() { on_reconnect_timer(); })
+        , m_reconnect_secs(0)
+        , m_abort(false)
+    {
+        BOOST_ASSERT(a_node != NULL);
+    }
+
     void reconnect() {
         if (m_abort || m_reconnect_secs <= 0)
             return;
-        m_reconnect_timer.expires_from_now(boost::posix_time::seconds(m_reconnect_secs));
-        auto pthis = this->shared_from_this();
-        m_reconnect_timer.async_wait([pthis](auto& ec) {
-            pthis->timer_reconnect(ec);
-        });
+        m_reconnect_timer.arm(std::chrono::seconds(m_reconnect_secs));
+    }
+
+    // Called by the node's timing wheel, which may run in another thread
+    void on_reconnect_timer() {
+        auto pthis = this->weak_from_this().lock();
+        if (pthis)
+            m_io_service.post([pthis]() { pthis->timer_reconnect(); });
     }
 
-    void timer_reconnect(const boost::system::error_code& ec) {
-        if (ec == boost::asio::error::operation_aborted)
-            return;     // timer reset
+    void timer_reconnect() {
+        if (m_abort)
+            return;
 
-        if (unlikely(verbose() >= VERBOSE_TRACE)) {
-            std::stringstream s;
-            s << "basic_otp_connection::timer_reconnect: " << ec.message();
-            report_status(REPORT_INFO, s.str());
-        }
+        if (unlikely(verbose() >= VERBOSE_TRACE))
+            report_status(REPORT_INFO, "basic_otp_connection::timer_reconnect");
 
         m_transport = connection_type::create(
             m_io_service, this, m_node->creation(), m_node->nodename(),
@@ -124,6 +145,30 @@ public:
     atom                         remote_nodename()  const { return m_remote_nodename; }
 
     bool  connected()                               const { return m_connected;       }
+    /// Write coalescing policy of the transport (inherited from the node).
+    const write_policy& wr_policy()                 const { return m_node->wr_policy(); }
+    /// Read buffer policy of the transport (inherited from the node).
+    const read_policy&  rd_policy()                 const { return m_node->rd_policy(); }
+    /// Pool of idle read buffers shared by the node's connections.
+    boost::shared_ptr<util::buffer_pool<Alloc>> rd_pool() const { return m_node->rd_pool(); }
+    /// Pool of idle transport messages shared by the node's connections.
+    boost::shared_ptr<transport_msg_pool<Alloc>> msg_pool() const { return m_node->msg_pool(); }
+    /// Service of the node's decode workers or NULL.
+    boost::asio::io_service* decode_service()       const { return m_node->decode_service(); }
+#ifdef EIXX_USE_IO_URING
+    /// io_uring instance of the service \a a_svc or NULL for asio I/O.
+    boost::shared_ptr<uring_service> uring(boost::asio::io_service& a_svc) const {
+        return m_node->uring(a_svc);
+    }
+#endif
+    /// Busy-polling loop of the service \a a_svc or NULL.
+    boost::shared_ptr<busy_poller> poller(boost::asio::io_service& a_svc) const {
+        return m_node->poller(a_svc);
+    }
+    /// Histogram of socket-to-mailbox latency or NULL if not tracked.
+    util::latency_histogram* rd_latency()           const { return m_node->rd_latency(); }
+    /// Ports of remote nodes shared by the node's connections.
+    epmd_cache* port_cache()                        const { return &m_node->port_cache(); }
     int   reconnect_timeout()                       const { return m_reconnect_secs;  }
 
     /// Set new reconnect timeout in seconds
@@ -143,6 +188,28 @@ public:
         return p;
     }
 
+    /// Create a connection accepted from \a a_remote_nodename.  Its
+    /// transport is created by calling \a a_create with the new connection
+    /// and is started in the thread of \a a_svc.  Accepted connections
+    /// are not reconnected.
+    /// @throws std::runtime_error
+    template <typename Factory>
+    static pointer
+    accept(boost::asio::io_service&        a_svc,
+           basic_otp_node<Alloc,Mutex>*    a_node,
+           atom                            a_remote_nodename,
+           atom                            a_cookie,
+           Factory                         a_create,
+           const Alloc&                    a_alloc = Alloc())
+    {
+        pointer p(new basic_otp_connection<Alloc,Mutex>(
+            a_svc, a_node, a_remote_nodename, a_cookie, a_alloc));
+        p->m_transport = a_create(p.get());
+        auto t = p->m_transport;
+        a_svc.post([t]() { t->start(); });
+        return p;
+    }
+
     /// Bounce or permanently disconnect the connection.
     /// @param a_permanent if true will not result in subsequent reconnection attempts.
     ///             Otherwise will attempt to reconnect in m_reconnect_secs seconds.
@@ -169,6 +236,21 @@ public:
     /// call.
     void on_connect(connection_type* a_con) {
         BOOST_ASSERT(m_transport.get() == a_con);
+        // The transport learns the name of a node addressed by its
+        // transport path (e.g. "shm://...") in the handshake.  The name
+        // is supplied by the peer, so it must not take over the route
+        // of a node that is already known.
+        atom name = a_con->remote_nodename();
+        if (name != m_remote_nodename && name.to_string().find('@') != std::string::npos
+                && !m_node->alias_connection(name, this)) {
+            std::string err("Rejected connection: node " + name.to_string() +
+                            " is already in use");
+            report_status(REPORT_ERROR, err);
+            disconnect(true);
+            if (m_on_connect_status)
+                m_on_connect_status(this, err);
+            return;
+        }
         m_connected = true;
         if (m_on_connect_status)
             m_on_connect_status(this, std::string());
@@ -231,6 +313,11 @@ public:
         }
     }
 
+    /// Takes ownership of the messages obtained from msg_pool().
+    void on_messages(connection_type*, std::vector<transport_msg<Alloc>*>& a_msgs) {
+        m_node->deliver(a_msgs);
+    }
+
     void report_status(report_level a_level, const std::string& s) {
         node()->report_status(a_level, this, s);
     }
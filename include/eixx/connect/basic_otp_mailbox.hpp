@@ -34,13 +34,22 @@ limitations under the License.
 #include <boost/asio.hpp>
 #include <eixx/util/async_wait_timeout.hpp>
 #include <eixx/util/async_queue.hpp>
+#include <eixx/util/work_stealing_pool.hpp>
+#include <eixx/util/coro.hpp>
 #include <eixx/marshal/eterm.hpp>
 #include <eixx/connect/transport_msg.hpp>
+#include <eixx/connect/transport_msg_pool.hpp>
 #include <eixx/connect/verbose.hpp>
 #include <eixx/eterm.hpp>
+#include <algorithm>
 #include <chrono>
+#include <deque>
+#include <limits>
 #include <list>
 #include <set>
+#ifdef EIXX_HAVE_COROUTINES
+#include <optional>
+#endif
 
 namespace eixx {
 namespace connect {
@@ -97,6 +106,12 @@ public:
 
     typedef util::async_queue<transport_msg<Alloc>*, Alloc> queue_type;
 
+    /// Called by deliver() on the delivering thread when the queue is full
+    /// and its overflow policy is util::overflow_policy::signal (or the
+    /// wait of util::overflow_policy::block timed out).  The second
+    /// argument is the depth of the queue.  The message is dropped.
+    std::function<void (basic_otp_mailbox<Alloc, Mutex>&, size_t)> on_overflow;
+
     template<typename A, typename M> friend class basic_otp_node;
     template<typename T, typename A> friend struct util::async_queue;
     template<typename A, typename M> friend class basic_otp_mailbox_registry;
@@ -111,12 +126,85 @@ private:
     std::set<epid<Alloc> >              m_links;
     std::map<ref<Alloc>, epid<Alloc> >  m_monitors;
     boost::shared_ptr<queue_type>       m_queue;
+    boost::shared_ptr<transport_msg_pool<Alloc>>
+                                        m_msg_pool;     // Node's pool of messages
     system_clock::time_point            m_time_freed;   // Cache time of this mbox
+    std::vector<transport_msg<Alloc>*>  m_batch;        // Messages passed to a batch handler
+    std::deque<transport_msg<Alloc>*>   m_saved;        // Skipped by co_match(), read first
+    std::atomic<size_t>                 m_saved_count;  // Size of m_saved for other threads
+
+    // Runs the handler given to schedule() on the node's scheduler
+    struct sched_task : util::work_stealing_pool::task {
+        enum { IDLE, QUEUED, RUNNING };
+
+        basic_otp_mailbox&                              mbox;
+        boost::weak_ptr<queue_type>                     queue;
+        boost::shared_ptr<transport_msg_pool<Alloc>>    msg_pool;
+        util::work_stealing_pool&                       pool;
+        receive_handler_type                            handler;
+        std::atomic<int>                                state;
+        std::atomic<bool>                               stopped;
+        std::atomic<std::thread::id>                    runner;     // Thread running the handler
+        boost::shared_ptr<sched_task>                   keep;       // Set while queued or running
+
+        sched_task(basic_otp_mailbox& a_mbox, util::work_stealing_pool& a_pool,
+                   const receive_handler_type& a_handler)
+            : mbox(a_mbox), queue(a_mbox.m_queue), msg_pool(a_mbox.m_msg_pool)
+            , pool(a_pool), handler(a_handler)
+            , state(IDLE), stopped(false)
+        {}
+
+        // Called once per park_ready() of the queue by the producer that
+        // found the queue parked
+        void ready(const boost::shared_ptr<sched_task>& a_self) {
+            keep = a_self;
+            state.store(QUEUED, std::memory_order_relaxed);
+            pool.schedule(this);
+        }
+
+        bool run(size_t a_budget) override;
+
+        void discard() override {
+            auto self = std::move(keep);
+            state.store(IDLE, std::memory_order_seq_cst);
+        }
+    };
+
+    boost::shared_ptr<sched_task>       m_task;
 
     void do_deliver(transport_msg<Alloc>* a_msg);
 
     void name(const atom& a_name) { m_name = a_name; }
 
+    void init_queue() {
+        auto pool = m_msg_pool;
+        m_queue->on_drop     = [pool](transport_msg<Alloc>*& a_msg) { pool->release(a_msg); };
+        m_queue->on_overflow = [this](size_t a_depth) {
+            if (on_overflow) on_overflow(*this, a_depth);
+        };
+        // Timeouts are fired by the thread running the node's service
+        if (&m_io_service == &m_node.io_service())
+            m_queue->timers(m_node.timers());
+    }
+
+    size_t saved() const { return m_saved_count.load(std::memory_order_relaxed); }
+
+    // Move up to a_max messages skipped by co_match() to a_out
+    size_t take_saved(transport_msg<Alloc>** a_out, size_t a_max) {
+        size_t n = std::min(a_max, m_saved.size());
+        std::copy(m_saved.begin(), m_saved.begin() + n, a_out);
+        m_saved.erase(m_saved.begin(), m_saved.begin() + n);
+        m_saved_count.store(m_saved.size(), std::memory_order_relaxed);
+        return n;
+    }
+
+    void release_saved() {
+        for (auto* p : m_saved)
+            m_msg_pool->release(p);
+        m_saved.clear();
+        m_saved_count.store(0, std::memory_order_relaxed);
+    }
+
 public:
     basic_otp_mailbox(
             basic_otp_node<Alloc, Mutex>& a_node, const epid<Alloc>& a_self,
@@ -133,7 +221,27 @@ public:
         , m_node(a_node), m_self(a_self)
         , m_name(a_name)
         , m_queue(new queue_type(m_io_service, a_queue_size, a_alloc))
-    {}
+        , m_msg_pool(a_node.msg_pool())
+        , m_saved_count(0)
+    {
+        init_queue();
+    }
+
+    /// @param a_queue defines the size of the queue of received messages
+    ///        and the action on a full queue.
+    basic_otp_mailbox(
+            basic_otp_node<Alloc, Mutex>& a_node, const epid<Alloc>& a_self,
+            const atom& a_name, const util::queue_policy& a_queue,
+            boost::asio::io_service* a_svc = NULL, const Alloc& a_alloc = Alloc())
+        : m_io_service(a_svc ? *a_svc : a_node.io_service())
+        , m_node(a_node), m_self(a_self)
+        , m_name(a_name)
+        , m_queue(new queue_type(m_io_service, a_queue, 255, a_alloc))
+        , m_msg_pool(a_node.msg_pool())
+        , m_saved_count(0)
+    {
+        init_queue();
+    }
 
     ~basic_otp_mailbox() { close(); }
 
@@ -150,10 +258,22 @@ public:
     /// Queue of pending received messages.
     //queue_type&                     queue()               { return m_queue;      }
     /// Indicates if mailbox doesn't have any pending messages
-    bool                            empty()         const { return m_queue.empty(); }
+    bool                            empty()         const { return !saved() && m_queue->empty(); }
+
+    /// Policy of the queue of received messages.
+    const util::queue_policy&       queue_policy()  const { return m_queue->policy(); }
+    /// Number of messages waiting in the queue, including the ones
+    /// skipped by co_match().
+    size_t                          depth()         const { return saved() + m_queue->depth(); }
+    /// Highest number of messages that waited in the queue.
+    size_t                          high_watermark()const { return m_queue->high_watermark(); }
+    /// Number of messages dropped because the queue was full.
+    size_t                          dropped()       const { return m_queue->dropped(); }
 
     /// Time when this mailbox was placed in the free list
     system_clock::time_point        time_freed()    const { return m_time_freed; }
+    /// Indicates if the mailbox was closed
+    bool                            closed()        const { return m_time_freed.time_since_epoch().count() != 0; }
 
     /// Register current mailbox under the given name
     bool reg(const atom& a_name) { return m_node.register_mailbox(a_name, *this); }
@@ -162,7 +282,7 @@ public:
     bool operator!= (const basic_otp_mailbox& rhs) const { return self() != rhs.self(); }
 
     /// Clear mailbox's queue of awaiting messages
-    void clear() { m_queue->reset(); }
+    void clear() { release_saved(); m_queue->reset(); }
 
     /// Print pid and regname of the mailbox to the given stream
     std::ostream& dump(std::ostream& out) const;
@@ -177,12 +297,84 @@ public:
     */
 
     /// Dequeue the next message from the mailbox.  The call is non-blocking and
-    /// returns NULL if no messages are waiting.
+    /// returns NULL if no messages are waiting.  The message should be given
+    /// back with release() (deleting it is allowed, but defeats its reuse).
     transport_msg<Alloc>* receive() {
         transport_msg<Alloc>* m;
+        if (unlikely(saved()))
+            return take_saved(&m, 1) ? m : nullptr;
         return m_queue->dequeue(m) ? m : nullptr;
     }
 
+    /// Dequeue up to \a a_max waiting messages to \a a_out.  The call is
+    /// non-blocking and doesn't involve the mailbox's I/O service.  The
+    /// messages must be given back with release().
+    /// @return the number of messages stored in \a a_out.
+    size_t try_receive_batch(transport_msg<Alloc>** a_out, size_t a_max) {
+        size_t n = unlikely(saved()) ? take_saved(a_out, a_max) : 0;
+        return n < a_max ? n + m_queue->dequeue(a_out + n, a_max - n) : n;
+    }
+
+    /// Wait for messages and dequeue up to \a a_max of them to \a a_out
+    /// like try_receive_batch().  The calling thread polls the mailbox for
+    /// \a a_spin and then sleeps until a message is delivered or
+    /// \a a_timeout expires (-1 = infinity).  For consumers running their
+    /// own loop instead of the I/O service.
+    /// @return the number of messages stored in \a a_out (0 - timeout).
+    size_t receive_batch(transport_msg<Alloc>** a_out, size_t a_max,
+                         std::chrono::milliseconds a_timeout = std::chrono::milliseconds(-1),
+                         std::chrono::microseconds a_spin    = std::chrono::microseconds(50)) {
+        size_t n = try_receive_batch(a_out, a_max);
+        if (likely(n))
+            return n;
+        auto deadline = a_timeout.count() < 0
+                      ? steady_clock::time_point::max() : steady_clock::now() + a_timeout;
+        do {
+            auto left = a_timeout.count() < 0 ? a_timeout
+                      : duration_cast<milliseconds>(deadline - steady_clock::now());
+            if (!m_queue->wait(a_spin, std::max(left, milliseconds(0))))
+                break;
+            n = m_queue->dequeue(a_out, a_max);
+        } while (!n);
+        return n;
+    }
+
+    /// Give back a message obtained from receive() to the node's pool of
+    /// messages.  NULL is ignored.
+    void release(transport_msg<Alloc>* a_msg) { m_msg_pool->release(a_msg); }
+
+    /// Give back \a a_count messages obtained from try_receive_batch(),
+    /// receive_batch() or receive().  NULL entries are skipped.
+    void release(transport_msg<Alloc>** a_msgs, size_t a_count) {
+        for (size_t i = 0; i < a_count; ++i)
+            m_msg_pool->release(a_msgs[i]);
+    }
+
+    /// Pass up to \a a_max waiting messages to \a a_fun one by one in the
+    /// calling thread and release them.  \a a_fun has the signature
+    /// <tt>void (transport_msg<Alloc>&)</tt>.
+    /// @return the number of processed messages.
+    template <typename F>
+    size_t drain(F&& a_fun, size_t a_max = std::numeric_limits<size_t>::max()) {
+        transport_msg<Alloc>* l_batch[64];
+        size_t total = 0;
+        while (total < a_max) {
+            size_t n = try_receive_batch(l_batch, std::min<size_t>(64, a_max - total));
+            if (!n)
+                break;
+            try {
+                for (size_t i = 0; i < n; ++i)
+                    a_fun(*l_batch[i]);
+            } catch (...) {
+                release(l_batch, n);
+                throw;
+            }
+            release(l_batch, n);
+            total += n;
+        }
+        return total;
+    }
+
     /**
      * Call a handler on asynchronous delivery of message(s).
      *
@@ -210,6 +402,56 @@ public:
         int a_repeat_count = 0
     );
 
+    /**
+     * Call a handler on asynchronous delivery of messages, passing it all
+     * messages waiting in the queue (up to \a a_max_batch) at once.
+     * The handler must have the signature:
+     * \code
+     * bool handler(basic_otp_mailbox<Alloc, Mutex>& a_mailbox,
+     *              transport_msg<Alloc>**           a_msgs,
+     *              size_t                           a_count);
+     * \endcode
+     * The messages are freed after the handler returns, except the ones
+     * the handler sets to NULL.  On timeout the handler is called with
+     * \a a_count equal to 0.  The handler returns false to stop receiving.
+     *
+     * @param a_timeout is the timeout interval to wait for messages (-1 = infinity)
+     * @param a_repeat_count is the number of batches to wait (-1 = infinite)
+     * @return true if the batch was synchronously received
+     **/
+    template <typename OnReceive>
+    bool async_receive_batch
+    (
+        const OnReceive& h,
+        std::chrono::milliseconds a_timeout = std::chrono::milliseconds(-1),
+        int    a_repeat_count = 0,
+        size_t a_max_batch    = 64
+    );
+
+    /**
+     * Pass messages of this mailbox to \a a_handler on the node's scheduler
+     * (see basic_otp_node::sched_threads()) instead of the mailbox's I/O
+     * service.  The mailbox is run by at most one worker at a time, which
+     * passes it up to the scheduler's budget of messages before letting
+     * other mailboxes run.  The handler has the signature:
+     * \code
+     * bool handler(basic_otp_mailbox<Alloc, Mutex>& a_mailbox,
+     *              transport_msg<Alloc>*&           a_msg);
+     * \endcode
+     * The message is released after the handler returns, unless the
+     * handler sets it to NULL.  The handler returns false to stop
+     * receiving.  A mailbox can be scheduled once, and must not be read by
+     * other receive calls afterwards.
+     * @throws err_bad_argument if the node has no scheduler or the mailbox
+     *         was already scheduled.
+     **/
+    void schedule(const receive_handler_type& a_handler);
+
+    /// Stop passing messages to the handler given to schedule().  Unless
+    /// called by the handler, waits for the handler to return.  Called by
+    /// close().
+    void unschedule();
+
     /**
      * Cancel pending asynchronous receive operation
      */
@@ -238,31 +480,210 @@ public:
         int a_repeat_count = 0
     );
 
-    /// Deliver a message to this mailbox. The call is thread-safe.
-    void deliver(const transport_msg<Alloc>& a_msg) {
-        std::unique_ptr<transport_msg<Alloc>> p(new transport_msg<Alloc>(a_msg));
-        m_queue->enqueue(p.get());
-        p.release();
+#ifdef EIXX_HAVE_COROUTINES
+    /// Result of co_receive() and co_match() awaited by a coroutine.  The
+    /// coroutine is resumed directly by the thread delivering the message
+    /// (or by the thread running the node's service on timeout), without
+    /// going through the mailbox's I/O service.
+    class receive_awaitable : private queue_type::waiter {
+        basic_otp_mailbox&                      m_mbox;
+        eterm<Alloc>                            m_pattern;  // Undefined - any message
+        varbind<Alloc>*                         m_binding;
+        std::chrono::milliseconds               m_timeout;
+        std::coroutine_handle<>                 m_handle;
+        transport_msg<Alloc>*                   m_msg;
+        std::atomic<bool>                       m_expired;
+        std::atomic<bool>                       m_done;     // Set before resuming
+        std::optional<util::timer_wheel::timer> m_timer;
+        size_t                                  m_scanned;  // Saved messages not matching
+
+        // Take the first message matching the pattern.  The messages
+        // before it are kept in the mailbox's save queue in their order.
+        bool take() {
+            auto& saved = m_mbox.m_saved;
+            if (m_pattern.empty())
+                return (unlikely(m_mbox.saved()) && m_mbox.take_saved(&m_msg, 1))
+                    || m_mbox.m_queue->dequeue(m_msg);
+
+            for (; m_scanned < saved.size(); ++m_scanned)
+                if (saved[m_scanned]->msg().match(m_pattern, m_binding)) {
+                    m_msg = saved[m_scanned];
+                    saved.erase(saved.begin() + m_scanned);
+                    m_mbox.m_saved_count.store(saved.size(), std::memory_order_relaxed);
+                    return true;
+                }
+            transport_msg<Alloc>* p;
+            while (m_mbox.m_queue->dequeue(p)) {
+                if (p->msg().match(m_pattern, m_binding)) {
+                    m_msg = p;
+                    return true;
+                }
+                saved.push_back(p);
+                m_mbox.m_saved_count.store(saved.size(), std::memory_order_relaxed);
+                m_scanned++;
+            }
+            return false;
+        }
+
+        // Called by the thread that is to resume the coroutine or park it
+        // in the queue.  The awaitable may be gone as soon as it's parked.
+        // @return true if the coroutine was parked, or false if it's to be
+        //         resumed by the caller
+        bool wait() {
+            while (!m_mbox.closed() && !m_expired.load(std::memory_order_seq_cst) && !take())
+                if (m_mbox.m_queue->park_waiter(this))
+                    return true;
+            m_done.store(true, std::memory_order_release);
+            return false;
+        }
+
+        // Called by the producer that found the coroutine parked
+        static void on_ready(typename queue_type::waiter* a_waiter) {
+            auto* self = static_cast<receive_awaitable*>(a_waiter);
+            if (self->wait())
+                return;
+            if (self->m_timer)
+                self->m_timer->cancel();
+            self->m_handle.resume();
+        }
+
+        // The awaitable outlives this call, since destroying it cancels
+        // the timer, which waits for the call to return
+        void on_timeout() {
+            m_expired.store(true, std::memory_order_seq_cst);
+            // Unless parked, the coroutine is being checked by a thread
+            // that will park it or resume it shortly
+            while (!m_mbox.m_queue->unpark_waiter(this))
+                if (m_done.load(std::memory_order_acquire))
+                    return;
+                else
+                    std::this_thread::yield();
+            m_handle.resume();
+        }
+
+    public:
+        receive_awaitable(basic_otp_mailbox& a_mbox, const eterm<Alloc>& a_pattern,
+                          varbind<Alloc>* a_binding, std::chrono::milliseconds a_timeout)
+            : m_mbox(a_mbox), m_pattern(a_pattern), m_binding(a_binding)
+            , m_timeout(a_timeout), m_msg(nullptr), m_expired(false), m_done(false)
+            , m_scanned(0)
+        {
+            this->ready = &on_ready;
+        }
+
+        bool await_ready() {
+            return m_mbox.closed() || take() || m_timeout.count() == 0;
+        }
+
+        bool await_suspend(std::coroutine_handle<> a_handle) {
+            m_handle = a_handle;
+            if (m_timeout.count() > 0) {
+                m_timer.emplace(m_mbox.m_node.timers(), [this]() { on_timeout(); });
+                m_timer->arm(m_timeout);
+            }
+            // Once parked, the coroutine may be resumed by another thread
+            if (wait())
+                return true;
+            if (m_timer)
+                m_timer->cancel();
+            return false;
+        }
+
+        /// @return the message, to be given back with release(), or NULL
+        ///         on timeout or if the mailbox was closed.
+        transport_msg<Alloc>* await_resume() { return m_msg; }
+    };
+
+    /**
+     * Wait in a coroutine for the next message:
+     * \code
+     * if (transport_msg<Alloc>* m = co_await a_mbox.co_receive(milliseconds(100))) {
+     *     ...
+     *     a_mbox.release(m);
+     * }
+     * \endcode
+     * The result is NULL if \a a_timeout expires (-1 = infinity) or the
+     * mailbox is closed.  Timeouts are fired by the thread running the
+     * node's service.  The coroutine is resumed in the thread delivering
+     * the message, so it should hand long work off to another thread.
+     * Only one coroutine may wait on a mailbox, and the mailbox must not be
+     * read with other receive calls at the same time.
+     */
+    receive_awaitable co_receive(std::chrono::milliseconds a_timeout = std::chrono::milliseconds(-1)) {
+        return receive_awaitable(*this, eterm<Alloc>(), nullptr, a_timeout);
+    }
+
+    /// Like co_receive(), but waits for a message matching \a a_pattern.
+    /// As in Erlang's selective receive, the messages not matching the
+    /// pattern stay in the mailbox in their order and are returned first
+    /// by later co_receive(), co_match(), receive(), try_receive_batch(),
+    /// receive_batch() and drain() calls (but not by async_receive() and
+    /// schedule() handlers).  If \a a_binding is not NULL it's given the
+    /// variables bound by the match.
+    receive_awaitable co_match(const eterm<Alloc>& a_pattern, varbind<Alloc>* a_binding = nullptr,
+                               std::chrono::milliseconds a_timeout = std::chrono::milliseconds(-1)) {
+        return receive_awaitable(*this, a_pattern, a_binding, a_timeout);
+    }
+#endif
+
+    /// Deliver a message to this mailbox. The call is thread-safe, unless
+    /// the queue policy is single-producer.
+    /// @return false if the message was dropped because the queue is full.
+    bool deliver(const transport_msg<Alloc>& a_msg) {
+        transport_msg<Alloc>* p = m_msg_pool->acquire();
+        *p = a_msg;
+        return deliver(p);
+    }
+
+    /// Deliver a message to this mailbox. The call is thread-safe, unless
+    /// the queue policy is single-producer.
+    /// @return false if the message was dropped because the queue is full.
+    bool deliver(transport_msg<Alloc>&& a_msg) {
+        transport_msg<Alloc>* p = m_msg_pool->acquire();
+        *p = std::move(a_msg);
+        return deliver(p);
+    }
+
+    /// Deliver a message obtained from the node's msg_pool().  The mailbox
+    /// takes the ownership of the message and releases it if it's dropped.
+    /// @return false if the message was dropped because the queue is full.
+    bool deliver(transport_msg<Alloc>* a_msg) {
+        if (likely(m_queue->enqueue(a_msg)))
+            return true;
+        m_msg_pool->release(a_msg);
+        return false;
     }
 
-    /// Deliver a message to this mailbox. The call is thread-safe.
-    void deliver(transport_msg<Alloc>&& a_msg) {
-        std::unique_ptr<transport_msg<Alloc>> p(new transport_msg<Alloc>(std::move(a_msg)));
-        m_queue->enqueue(p.get());
-        p.release();
+    /// Deliver \a a_count messages to this mailbox, waking up the consumer
+    /// at most once.  The mailbox takes the ownership of the messages and
+    /// frees the ones dropped because the queue is full.  The call is
+    /// thread-safe, unless the queue policy is single-producer.
+    /// @return the number of queued messages.
+    size_t deliver(transport_msg<Alloc>** a_msgs, size_t a_count) {
+        size_t n = m_queue->enqueue(a_msgs, a_msgs + a_count);
+        // Apply the overflow policy to each of the remaining messages
+        for (size_t i = n; i < a_count; ++i)
+            if (m_queue->enqueue(a_msgs[i]))
+                ++n;
+            else
+                m_msg_pool->release(a_msgs[i]);
+        return n;
     }
 
     /// Send a message \a a_msg to a pid \a a_to.
-    void send(const epid<Alloc>& a_to, const eterm<Alloc>& a_msg) {
-        m_node.send(self(), a_to, a_msg);
+    /// @return false if a local recipient's queue is full.
+    bool send(const epid<Alloc>& a_to, const eterm<Alloc>& a_msg) {
+        return m_node.send(self(), a_to, a_msg);
     }
     /// Send a message \a a_msg to the local process registered as \a a_to.
-    void send(const atom& a_to, const eterm<Alloc>& a_msg) {
-        m_node.send(self(), a_to, a_msg);
+    /// @return false if the recipient's queue is full.
+    bool send(const atom& a_to, const eterm<Alloc>& a_msg) {
+        return m_node.send(self(), a_to, a_msg);
     }
     /// Send a message \a a_msg to the process registered as \a a_to on remote node \a a_node.
-    void send(const atom& a_node, const atom& a_to, const eterm<Alloc>& a_msg) {
-        m_node.send(self(), a_node, a_to, a_msg);
+    /// @return false if a local recipient's queue is full.
+    bool send(const atom& a_node, const atom& a_to, const eterm<Alloc>& a_msg) {
+        return m_node.send(self(), a_node, a_to, a_msg);
     }
 
     /**
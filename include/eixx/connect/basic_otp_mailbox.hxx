@@ -39,7 +39,12 @@ namespace connect {
 template <typename Alloc, typename Mutex>
 void basic_otp_mailbox<Alloc, Mutex>::
 close(const eterm<Alloc>& a_reason, bool a_reg_remove) {
+    unschedule();
     m_time_freed = std::chrono::system_clock::now();
+    // Resume a coroutine waiting in co_receive()
+    if (auto w = m_queue->take_waiter())
+        w->ready(w);
+    release_saved();
     m_queue->reset();
     if (a_reg_remove)
         m_node.close_mailbox(this);
@@ -54,8 +59,8 @@ async_receive(const OnReceive& h, std::chrono::milliseconds a_timeout,
               int   a_repeat_count)
 {
     return m_queue->async_dequeue(
-        [this, &h](transport_msg<Alloc>*& a_msg, const boost::system::error_code& ec) {
-            if (this->m_time_freed.time_since_epoch().count() == 0)
+        [this, h](transport_msg<Alloc>*& a_msg, const boost::system::error_code& ec) {
+            if (this->m_time_freed.time_since_epoch().count() != 0)
                 return false;
             bool res;
             if (ec) {
@@ -64,7 +69,7 @@ async_receive(const OnReceive& h, std::chrono::milliseconds a_timeout,
             } else {
                 res = h(*this, a_msg);
                 if (a_msg) {
-                    delete a_msg;
+                    m_msg_pool->release(a_msg);
                     a_msg = nullptr;
                 }
             }
@@ -75,6 +80,116 @@ async_receive(const OnReceive& h, std::chrono::milliseconds a_timeout,
         a_repeat_count);
 }
 
+template <typename Alloc, typename Mutex>
+template <typename OnReceive>
+bool basic_otp_mailbox<Alloc, Mutex>::
+async_receive_batch(const OnReceive& h, std::chrono::milliseconds a_timeout,
+                    int a_repeat_count, size_t a_max_batch)
+{
+    return m_queue->async_dequeue(
+        [this, h, a_max_batch]
+        (transport_msg<Alloc>*& a_msg, const boost::system::error_code& ec) {
+            if (this->m_time_freed.time_since_epoch().count() != 0)
+                return false;
+            if (ec)
+                return h(*this, static_cast<transport_msg<Alloc>**>(nullptr), size_t(0));
+
+            // Take the rest of the waiting messages along with a_msg
+            m_batch.resize(std::max<size_t>(a_max_batch, 1));
+            m_batch[0] = a_msg;
+            a_msg      = nullptr;
+            size_t n   = 1 + m_queue->dequeue(m_batch.data()+1, m_batch.size()-1);
+
+            bool res;
+            try {
+                res = h(*this, m_batch.data(), n);
+            } catch (...) {
+                release(m_batch.data(), n);
+                throw;
+            }
+            release(m_batch.data(), n);
+            return res;
+        },
+        a_timeout,
+        a_repeat_count);
+}
+
+template <typename Alloc, typename Mutex>
+void basic_otp_mailbox<Alloc, Mutex>::
+schedule(const receive_handler_type& a_handler)
+{
+    util::work_stealing_pool* pool = m_node.scheduler();
+    if (!pool)
+        throw err_bad_argument("Node has no scheduler");
+    if (m_queue->on_ready)
+        throw err_bad_argument("Mailbox was already scheduled");
+    boost::shared_ptr<sched_task> t(new sched_task(*this, *pool, a_handler));
+    m_task = t;
+    // The queue keeps the task, which only refers to the queue weakly
+    m_queue->on_ready = [t]() { t->ready(t); };
+    m_queue->park_ready();
+}
+
+template <typename Alloc, typename Mutex>
+void basic_otp_mailbox<Alloc, Mutex>::
+unschedule()
+{
+    if (!m_task)
+        return;
+    // Pairs with the store of RUNNING in sched_task::run(): either the
+    // worker sees the task stopped or the state is seen running here
+    m_task->stopped.store(true, std::memory_order_seq_cst);
+    if (m_task->runner.load(std::memory_order_relaxed) != std::this_thread::get_id())
+        while (m_task->state.load(std::memory_order_seq_cst) == sched_task::RUNNING)
+            std::this_thread::yield();
+    m_task.reset();
+}
+
+template <typename Alloc, typename Mutex>
+bool basic_otp_mailbox<Alloc, Mutex>::sched_task::
+run(size_t a_budget)
+{
+    state.store(RUNNING, std::memory_order_seq_cst);
+    auto q = queue.lock();
+    if (stopped.load(std::memory_order_seq_cst) || !q) {
+        discard();
+        return false;
+    }
+    runner.store(std::this_thread::get_id(), std::memory_order_relaxed);
+
+    size_t n = 0;
+    transport_msg<Alloc>* msg = nullptr;
+    try {
+        while (n < a_budget && q->dequeue(msg)) {
+            ++n;
+            bool more = handler(mbox, msg);
+            msg_pool->release(msg);
+            msg = nullptr;
+            if (!more)
+                stopped.store(true, std::memory_order_relaxed);
+            if (stopped.load(std::memory_order_relaxed))
+                break;
+        }
+    } catch (std::exception& e) {
+        msg_pool->release(msg);
+        mbox.node().report_status(REPORT_ERROR, NULL,
+            std::string("Error in scheduled mailbox handler: ") + e.what());
+    }
+    runner.store(std::thread::id(), std::memory_order_relaxed);
+
+    bool stop = stopped.load(std::memory_order_relaxed);
+    if (n == a_budget && !stop && !q->empty()) {
+        // Give other tasks a turn
+        state.store(QUEUED, std::memory_order_seq_cst);
+        return true;
+    }
+    auto self = std::move(keep);
+    state.store(IDLE, std::memory_order_seq_cst);
+    if (!stop)
+        q->park_ready();
+    return false;
+}
+
 template <typename Alloc, typename Mutex>
 template <typename OnTimeout>
 bool basic_otp_mailbox<Alloc, Mutex>::
@@ -86,7 +201,7 @@ async_match(const marshal::eterm_pattern_matcher<Alloc>& a_matcher,
     auto f =
         [this, &a_matcher, &a_on_timeout]
         (transport_msg<Alloc>*& a_msg, const boost::system::error_code& ec) {
-            if (this->m_time_freed.time_since_epoch().count() == 0)
+            if (this->m_time_freed.time_since_epoch().count() != 0)
                 return false;
             if (ec) {
                 a_on_timeout(*this);
@@ -95,7 +210,7 @@ async_match(const marshal::eterm_pattern_matcher<Alloc>& a_matcher,
             varbind<Alloc> binding;
             if (a_msg) {
                 a_matcher.match(a_msg->msg(), &binding);
-                delete a_msg;
+                m_msg_pool->release(a_msg);
                 a_msg = nullptr;
             }
             return true;
@@ -148,13 +263,13 @@ do_deliver(transport_msg<Alloc>* a_msg)
             case transport_msg<Alloc>::LINK:
                 BOOST_ASSERT(a_msg->recipient_pid() == self());
                 m_links.insert(a_msg->sender_pid());
-                delete a_msg;
+                m_msg_pool->release(a_msg);
                 return;
 
             case transport_msg<Alloc>::UNLINK:
                 BOOST_ASSERT(a_msg->recipient_pid() == self());
                 m_links.erase(a_msg->sender_pid());
-                delete a_msg;
+                m_msg_pool->release(a_msg);
                 return;
 
             case transport_msg<Alloc>::MONITOR_P:
@@ -162,12 +277,12 @@ do_deliver(transport_msg<Alloc>* a_msg)
                            || a_msg->recipient().to_atom() == m_name);
                 m_monitors.insert(
                     std::pair<ref<Alloc>, epid<Alloc> >(a_msg->get_ref(), a_msg->sender_pid()));
-                delete a_msg;
+                m_msg_pool->release(a_msg);
                 return;
 
             case transport_msg<Alloc>::DEMONITOR_P:
                 m_monitors.erase(a_msg->get_ref());
-                delete a_msg;
+                m_msg_pool->release(a_msg);
                 return;
 
             case transport_msg<Alloc>::MONITOR_P_EXIT:
@@ -33,13 +33,62 @@ limitations under the License.
 #include <eixx/marshal/eterm.hpp>
 #include <eixx/connect/basic_otp_mailbox.hpp>
 #include <eixx/util/hashtable.hpp>
-#include <queue>
+#include <eixx/util/atom_map.hpp>
+#include <eixx/util/index_table.hpp>
+#include <eixx/util/bounded_queue.hpp>
+#include <chrono>
+#include <deque>
+#include <thread>
 
 namespace eixx {
 namespace connect {
 
 using detail::lock_guard;
 
+//----------------------------------------------------------------------------
+/// Recycling of the pids of closed mailboxes.
+///
+/// The pid of a closed mailbox goes to a pool of the closing thread and
+/// is reused by a mailbox created by that thread after \a retention, with
+/// its serial number incremented.  The retention keeps a pid from being
+/// reused while messages to the closed mailbox may still be in flight,
+/// and spaces out reuses so that the 13-bit serial number doesn't wrap
+/// around quickly.
+///
+/// The \a queue is the default policy of the message queues of mailboxes
+/// (see basic_otp_node::create_mailbox()).  Messages delivered to the
+/// mailboxes are taken from a pool of up to \a msg_pool_size messages,
+/// which mailboxes return them to once they are received.
+//----------------------------------------------------------------------------
+struct mailbox_policy {
+    std::chrono::milliseconds retention;    ///< Time before reusing a pid
+    size_t                    pool_size;    ///< Freed pids kept by a pool
+    size_t                    pools;        ///< Number of pools (0 - number of CPUs)
+    uint32_t                  max_mailboxes;///< Maximum number of pids
+    util::queue_policy        queue;        ///< Message queue of a mailbox
+    size_t                    msg_pool_size;///< Idle transport messages kept for reuse
+
+    mailbox_policy()
+        : retention(1000)
+        , pool_size(1024)
+        , pools(0)
+        , max_mailboxes((1u << 20) - 1)
+        , msg_pool_size(4096)
+    {}
+};
+
+/**
+ * Mailboxes of a node looked up by pid or registered name.
+ *
+ * The pid of a mailbox is its index in a table of mailboxes and a serial
+ * number incremented every time the index is reused, so a message sent to
+ * the pid of a closed mailbox doesn't reach a new mailbox.  Lookups by
+ * pid and by name are wait-free.  Creating and closing unnamed mailboxes
+ * is lock-free: pids are recycled through lock-free pools, each used by
+ * the threads that map to it (see mailbox_policy).  Only registering
+ * names takes the registry's lock.  Pids made by
+ * basic_otp_node::create_pid() have serial 0 and never match a mailbox.
+ */
 template <typename Alloc, typename Mutex>
 struct basic_otp_mailbox_registry {
     typedef basic_otp_mailbox<Alloc, Mutex>     mailbox_type;
@@ -47,30 +96,54 @@ struct basic_otp_mailbox_registry {
 
 private:
     basic_otp_node<Alloc, Mutex>&               m_owner_node;
-    // These are made mutable so that intrinsic cleanup is possible
-    // of orphant entries.
-    mutable Mutex                               m_lock;
-    mutable std::map<atom, mailbox_ptr>         m_by_name;
-    mutable std::map<epid<Alloc>, mailbox_ptr>  m_by_pid;
+    struct freed_pid {
+        uint32_t                                index;
+        std::chrono::steady_clock::time_point   time;
+    };
+
+    typedef util::bounded_queue<freed_pid>      pool_type;
+
+    mutable Mutex                               m_lock;     // Names and m_overflow
+    util::atom_map<mailbox_type>                m_by_name;
+    std::unique_ptr<util::index_table<mailbox_type>> m_by_pid;
+    std::vector<std::unique_ptr<pool_type>>     m_pools;
+    std::deque<uint32_t>                        m_overflow; // Freed pids not fitting in pools
+    mailbox_policy                              m_policy;
+
+    /// Pool of the calling thread.
+    pool_type& pool() const;
 
-    // Cache of freed mailboxes
-    static std::queue<mailbox_ptr>              s_free_list;
-    static Mutex                                s_free_list_lock;
+    /// Get a pid index for a new mailbox.
+    uint32_t alloc_index();
+
+    /// Put the index of a closed mailbox in a pool.
+    void free_index(uint32_t a_idx);
 
 public:
     basic_otp_mailbox_registry(basic_otp_node<Alloc, Mutex>& a_owner)
         : m_owner_node(a_owner)
-    {}
+    {
+        policy(m_policy);
+    }
 
     ~basic_otp_mailbox_registry() {
         clear();
     }
 
+    /// @param a_queue is the policy of the mailbox's message queue (NULL -
+    ///        mailbox_policy::queue).
     mailbox_ptr create_mailbox(
-        const atom& a_name = atom(), boost::asio::io_service* a_svc=NULL);
+        const atom& a_name = atom(), boost::asio::io_service* a_svc=NULL,
+        const util::queue_policy* a_queue = NULL);
 
     void clear();
 
+    const mailbox_policy& policy() const { return m_policy; }
+
+    /// Set the policy of recycling pids.
+    /// @throws err_bad_argument if there are open mailboxes.
+    void policy(const mailbox_policy& a_policy);
+
     bool add(atom a_name, mailbox_ptr a_mbox);
 
     /// Unregister a name so that no mailbox is any longer associated with \a a_name.
@@ -109,10 +182,8 @@ public:
 
     void pids(std::list<epid<Alloc> >& list);
 
-    /**
-     * This method is not thread-safe - use for debugging!
-     */
-    size_t count() const { return m_by_pid.size(); }
+    /// Number of mailboxes.
+    size_t count() const { return m_by_pid->size(); }
 };
 
 } // namespace connect
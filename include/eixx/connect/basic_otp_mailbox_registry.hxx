@@ -34,59 +34,131 @@ namespace eixx {
 namespace connect {
 
 //-----------------------------------------------------------------------------
-// Static members instantiation
+// Member functions implementation
 //-----------------------------------------------------------------------------
-template <typename Alloc, typename Mutex>
-std::queue<typename basic_otp_mailbox_registry<Alloc,Mutex>::mailbox_ptr>
-basic_otp_mailbox_registry<Alloc, Mutex>::s_free_list;
 
 template <typename Alloc, typename Mutex>
-Mutex
-basic_otp_mailbox_registry<Alloc, Mutex>::s_free_list_lock;
+void basic_otp_mailbox_registry<Alloc, Mutex>::
+policy(const mailbox_policy& a_policy)
+{
+    if (m_by_pid && m_by_pid->size())
+        throw err_bad_argument("Cannot change mailbox policy of a node with mailboxes");
+    if (a_policy.max_mailboxes == 0 || a_policy.max_mailboxes == UINT32_MAX)
+        throw err_bad_argument("Invalid max number of mailboxes");
 
-//-----------------------------------------------------------------------------
-// Member functions implementation
-//-----------------------------------------------------------------------------
+    size_t n = a_policy.pools ? a_policy.pools
+                              : std::max(1u, std::thread::hardware_concurrency());
+    m_policy = a_policy;
+    m_by_pid.reset(new util::index_table<mailbox_type>(a_policy.max_mailboxes));
+    m_pools.clear();
+    for (size_t i = 0; i < n; ++i)
+        m_pools.emplace_back(new pool_type(std::max(size_t(1), a_policy.pool_size)));
+    m_overflow.clear();
+}
 
 template <typename Alloc, typename Mutex>
-typename basic_otp_mailbox_registry<Alloc, Mutex>::mailbox_ptr
+typename basic_otp_mailbox_registry<Alloc, Mutex>::pool_type&
 basic_otp_mailbox_registry<Alloc, Mutex>::
-create_mailbox(const atom& a_name, boost::asio::io_service* a_svc)
+pool() const
 {
-    static const std::chrono::seconds s_min_retention(180);
+    static std::atomic<size_t> s_threads(0);
+    static thread_local size_t s_thread = s_threads.fetch_add(1, std::memory_order_relaxed);
+    return *m_pools[s_thread % m_pools.size()];
+}
 
-    lock_guard<Mutex> guard(m_lock);
-    if (!a_name.empty()) {
-        typename std::map<atom, mailbox_ptr>::iterator it = m_by_name.find(a_name);
-        if (it != m_by_name.end())
-            return it->second;   // Already registered!
+template <typename Alloc, typename Mutex>
+uint32_t basic_otp_mailbox_registry<Alloc, Mutex>::
+alloc_index()
+{
+    auto  now = std::chrono::steady_clock::now();
+    auto& p   = pool();
+    freed_pid f;
+
+    // The pool is FIFO, so if its head is too recent so is the rest of it
+    if (p.try_pop(f)) {
+        if (now - f.time >= m_policy.retention)
+            return f.index;
+        if (!p.try_push(f)) {
+            lock_guard<Mutex> guard(m_lock);
+            m_overflow.push_back(f.index);
+        }
     }
 
-    mailbox_ptr p = nullptr;
+    uint32_t idx = m_by_pid->reserve();
+    if (likely(idx))
+        return idx;
 
-    // Mailboxes are cached, so that they can be reused at some later point
-    // to prevent overflowing the max number of available pid numbers
+    // All pids are used or retained: reuse the oldest freed ones
     {
-        lock_guard<Mutex> g(s_free_list_lock);
-        if (!s_free_list.empty() &&
-            std::chrono::duration_cast<std::chrono::seconds>(
-                std::chrono::system_clock::now() -
-                s_free_list.back()->time_freed()) > s_min_retention)
-        {
-            p = s_free_list.back();
-            s_free_list.pop();
-            p->name(a_name);
+        lock_guard<Mutex> guard(m_lock);
+        if (!m_overflow.empty()) {
+            idx = m_overflow.front();
+            m_overflow.pop_front();
+            return idx;
         }
     }
+    for (auto& q : m_pools)
+        if (q->try_pop(f))
+            return f.index;
+
+    throw err_bad_argument("Too many mailboxes");
+}
+
+template <typename Alloc, typename Mutex>
+void basic_otp_mailbox_registry<Alloc, Mutex>::
+free_index(uint32_t a_idx)
+{
+    freed_pid f{a_idx, std::chrono::steady_clock::now()};
+    if (likely(pool().try_push(f)))
+        return;
+    lock_guard<Mutex> guard(m_lock);
+    m_overflow.push_back(a_idx);
+}
 
-    if (p == nullptr) {
-        epid<Alloc> l_pid = m_owner_node.create_pid();
-        p = new mailbox_type(m_owner_node, l_pid, a_name, a_svc);
+template <typename Alloc, typename Mutex>
+typename basic_otp_mailbox_registry<Alloc, Mutex>::mailbox_ptr
+basic_otp_mailbox_registry<Alloc, Mutex>::
+create_mailbox(const atom& a_name, boost::asio::io_service* a_svc,
+               const util::queue_policy* a_queue)
+{
+    if (!a_name.empty()) {
+        lock_guard<Mutex> guard(m_lock);
+        mailbox_ptr p = m_by_name.find(a_name);
+        if (p)
+            return p;   // Already registered!
+    }
+
+    uint32_t    idx = alloc_index();
+    mailbox_ptr p;
+    try {
+        p = new mailbox_type(m_owner_node, epid<Alloc>(), atom(),
+                             a_queue ? *a_queue : m_policy.queue, a_svc);
+    } catch (...) {
+        free_index(idx);
+        throw;
     }
 
-    if (!a_name.empty())
-        m_by_name.insert(std::pair<atom, mailbox_ptr>(a_name, p));
-    m_by_pid.insert(std::pair<epid<Alloc>, mailbox_ptr>(p->self(), p));
+    // The pid is not known to anyone until it's returned to the caller
+    uint32_t serial = m_by_pid->put(idx, p);
+    p->m_self = epid<Alloc>(m_owner_node.nodename(), idx, serial, m_owner_node.creation());
+
+    if (!a_name.empty()) {
+        mailbox_ptr other;
+        {
+            lock_guard<Mutex> guard(m_lock);
+            other = m_by_name.find(a_name);
+            if (!other) {
+                m_by_name.set(a_name, p);
+                p->name(a_name);
+            }
+        }
+        if (unlikely(other != nullptr)) {
+            // Registered by another thread in the meantime.  Closing the
+            // mailbox frees its pid.
+            delete p;
+            return other;
+        }
+    }
     return p;
 }
 
@@ -94,16 +166,19 @@ template <typename Alloc, typename Mutex>
 void basic_otp_mailbox_registry<Alloc, Mutex>::
 clear()
 {
-    if (!m_by_name.empty() || !m_by_pid.empty()) {
+    std::vector<mailbox_ptr> l_mboxes;
+    m_by_pid->for_each([&](uint32_t id, uint32_t serial, mailbox_ptr) {
+        if (mailbox_ptr p = m_by_pid->remove(id, serial)) {
+            free_index(id);
+            l_mboxes.push_back(p);
+        }
+    });
+    {
         lock_guard<Mutex> guard(m_lock);
         m_by_name.clear();
-        typename std::map<epid<Alloc>, mailbox_ptr>::iterator it;
-        for(it = m_by_pid.begin(); it != m_by_pid.end(); ++it) {
-            mailbox_ptr p = it->second;
-            p->close(am_normal, false);
-        }
-        m_by_pid.clear();
     }
+    for (auto p : l_mboxes)
+        p->close(am_normal, false);
 }
 
 template <typename Alloc, typename Mutex>
@@ -115,10 +190,11 @@ add(atom a_name, mailbox_ptr a_mbox)
     if (!a_mbox->name().empty())
         throw err_bad_argument("Mailbox already registered as", a_mbox->name());
     lock_guard<Mutex> guard(m_lock);
-    auto it = m_by_name.insert(std::pair<atom, mailbox_ptr>(a_name, a_mbox));
-    if (it.second)
-        a_mbox->name(a_name);
-    return it.second;
+    if (m_by_name.find(a_name))
+        return false;
+    m_by_name.set(a_name, a_mbox);
+    a_mbox->name(a_name);
+    return true;
 }
 
 /// Unregister a name so that no mailbox is any longer associated with \a a_name.
@@ -126,14 +202,14 @@ template <typename Alloc, typename Mutex>
 bool basic_otp_mailbox_registry<Alloc, Mutex>::
 erase(const atom& a_name)
 {
-    if (!a_name.empty())
+    if (a_name.empty())
         return false;
     lock_guard<Mutex> guard(m_lock);
-    typename std::map<atom, mailbox_ptr>::iterator it = m_by_name.find(a_name);
-    if (it == m_by_name.end())
+    mailbox_ptr p = m_by_name.find(a_name);
+    if (!p)
         return false;
-    it->second.name(atom());
-    m_by_name.erase(it);
+    p->name(atom());
+    m_by_name.erase(a_name);
     return true;
 }
 
@@ -144,11 +220,15 @@ erase(mailbox_ptr a_mbox)
 {
     if (!a_mbox)
         return;
-    lock_guard<Mutex> guard(m_lock);
-    m_by_pid.erase(a_mbox->self());
-    if (!a_mbox->name().empty())
-        m_by_name.erase(a_mbox->name());
-    a_mbox->name(atom());
+    const epid<Alloc>& pid = a_mbox->self();
+    if (m_by_pid->remove(pid.id(), pid.serial()) == a_mbox)
+        free_index(pid.id());
+    if (!a_mbox->name().empty()) {
+        lock_guard<Mutex> guard(m_lock);
+        if (m_by_name.find(a_mbox->name()) == a_mbox)
+            m_by_name.erase(a_mbox->name());
+        a_mbox->name(atom());
+    }
 }
 
 /**
@@ -169,9 +249,7 @@ get(const eterm<Alloc>& a_proc) const
 }
 
 /**
- * Look up a mailbox based on its name. If the mailbox has gone out
- * of scope we also remove the reference from the hashtable so we
- * don't find it again.
+ * Look up a mailbox based on its name.
  * @throws err_no_process
  */
 template <typename Alloc, typename Mutex>
@@ -179,27 +257,24 @@ typename basic_otp_mailbox_registry<Alloc, Mutex>::mailbox_ptr
 basic_otp_mailbox_registry<Alloc, Mutex>::
 get(atom a_name) const
 {
-    lock_guard<Mutex> guard(m_lock);
-    typename std::map<atom, mailbox_ptr>::iterator it = m_by_name.find(a_name);
-    if (it != m_by_name.end())
-        return it->second;
+    mailbox_ptr p = m_by_name.find(a_name);
+    if (likely(p))
+        return p;
     throw err_no_process("Process not registered", a_name);
 }
 
 /**
- * Look up a mailbox based on its pid. If the mailbox has gone out
- * of scope we also remove the reference from the hashtable so we
- * don't find it again.
+ * Look up a mailbox based on its pid.
  * @throws err_no_process
  */
 template <typename Alloc, typename Mutex>
 typename basic_otp_mailbox_registry<Alloc, Mutex>::mailbox_ptr
 basic_otp_mailbox_registry<Alloc, Mutex>::get(const epid<Alloc>& a_pid) const
 {
-    lock_guard<Mutex> guard(m_lock);
-    typename std::map<epid<Alloc>, mailbox_ptr>::iterator it = m_by_pid.find(a_pid);
-    if (it != m_by_pid.end())
-        return it->second;
+    mailbox_ptr p = m_by_pid->find(a_pid.id(), a_pid.serial());
+    if (likely(p && a_pid.creation() == m_owner_node.creation()
+                 && a_pid.node()     == m_owner_node.nodename()))
+        return p;
     throw err_no_process("Process not found", a_pid);
 }
 
@@ -207,22 +282,19 @@ template <typename Alloc, typename Mutex>
 void basic_otp_mailbox_registry<Alloc, Mutex>::names(std::list<atom>& list)
 {
     list.clear();
-    lock_guard<Mutex> guard(m_lock);
-    list.resize(m_by_name.size());
-    for(typename std::map<atom, mailbox_ptr>::const_iterator
-        it = m_by_name.begin(), end = m_by_name.end(); it != end; ++it)
-        list.push_back(it->first);
+    m_by_pid->for_each([&](uint32_t, uint32_t, mailbox_ptr p) {
+        if (!p->name().empty())
+            list.push_back(p->name());
+    });
 }
 
 template <typename Alloc, typename Mutex>
 void basic_otp_mailbox_registry<Alloc, Mutex>::pids(std::list<epid<Alloc> >& list)
 {
     list.clear();
-    lock_guard<Mutex> guard(m_lock);
-    list.resize(m_by_pid.size());
-    for(typename std::map<epid<Alloc>, mailbox_ptr>::const_iterator
-        it = m_by_pid.begin(), end = m_by_pid.eend(); it != end; ++it)
-        list.push_back(it->first);
+    m_by_pid->for_each([&](uint32_t, uint32_t, mailbox_ptr p) {
+        list.push_back(p->self());
+    });
 }
 
 } // namespace connect
@@ -33,15 +33,25 @@ limitations under the License.
 #ifndef _EIXX_BASIC_OTP_NODE_HPP_
 #define _EIXX_BASIC_OTP_NODE_HPP_
 
+#include <algorithm>
 #include <atomic>
+#include <type_traits>
 #include <time.h>
 #include <boost/function.hpp>
+#include <boost/make_shared.hpp>
 #include <eixx/connect/basic_otp_node_local.hpp>
 #include <eixx/connect/basic_otp_connection.hpp>
 #include <eixx/connect/basic_otp_mailbox_registry.hpp>
 #include <eixx/connect/transport_msg.hpp>
+#include <eixx/connect/transport_msg_pool.hpp>
 #include <eixx/connect/verbose.hpp>
 #include <eixx/util/sync.hpp>
+#include <eixx/util/io_service_pool.hpp>
+#include <eixx/util/work_stealing_pool.hpp>
+#include <eixx/util/timer_wheel.hpp>
+#include <eixx/util/atom_map.hpp>
+#include <eixx/util/epoch.hpp>
+#include <eixx/util/latency_histogram.hpp>
 #include <eixx/marshal/eterm.hpp>
 
 namespace eixx {
@@ -94,36 +104,74 @@ class basic_otp_node: public basic_otp_node_local {
 
     boost::asio::io_service&                    m_io_service;
     basic_otp_mailbox_registry<Alloc, Mutex>    m_mailboxes;
-    conn_hash_map                               m_connections;
+    conn_hash_map                               m_connections;  // Owned by m_lock
+    util::atom_map<connection_t>                m_con_index;    // Lock-free view of m_connections
+    mutable util::epoch_reclaimer<boost::shared_ptr<const void>>
+                                                m_retired;      // Replaced connections and tables
     Alloc                                       m_allocator;
     verbose_type                                m_verboseness;
+    write_policy                                m_wr_policy;
+    read_policy                                 m_rd_policy;
+    boost::shared_ptr<util::buffer_pool<Alloc>> m_rd_pool;
+    boost::shared_ptr<transport_msg_pool<Alloc>> m_msg_pool;
+    boost::shared_ptr<util::timer_wheel>        m_timers;       // Run by m_io_service
+    std::unique_ptr<util::io_service_pool>      m_io_pool;
+    std::unique_ptr<util::io_service_pool>      m_decode_pool;
+    std::unique_ptr<util::work_stealing_pool>   m_scheduler;    // Runs scheduled mailboxes
+    io_backend                                  m_backend;
+    busy_poll_policy                            m_bp_policy;
+    std::mutex                                  m_poller_lock;
+    std::map<boost::asio::io_service*, boost::shared_ptr<busy_poller>>
+                                                m_pollers;
+    std::unique_ptr<util::latency_histogram>    m_rd_latency;
+    std::unique_ptr<shm_listener>               m_shm_listener;
+    std::unique_ptr<tcp_listener>               m_tcp_listener;
+    std::unique_ptr<boost::asio::ip::tcp::socket> m_epmd;
+    epmd_cache                                  m_port_cache;
+#ifdef EIXX_USE_IO_URING
+    std::mutex                                  m_uring_lock;
+    std::map<boost::asio::io_service*, boost::shared_ptr<uring_service>>
+                                                m_urings;
+#endif
 
     friend class basic_otp_connection<Alloc, Mutex>;
+    friend class basic_otp_mailbox<Alloc, Mutex>;
 
     void on_disconnect_internal(const connection_t& a_con,
         atom a_remote_nodename, const boost::system::error_code& err);
 
     void report_status(report_level a_level,
         const connection_t* a_con, const std::string& s);
+    /// Register connection \a a_con under the node name \a a_name
+    /// learned in its handshake.
+    /// @return false if \a a_name is this node or already mapped to
+    ///         another connection, which is left in place.
+    bool alias_connection(atom a_name, connection_t* a_con);
+    /// Map \a a_name to \a a_con (m_lock must be held).
+    void add_connection(atom a_name, const typename connection_t::pointer& a_con);
+    void on_shm_accept(shm_listener::peer& a_peer);
+    void on_tcp_accept(tcp_listener::peer& a_peer);
     void rpc_call(const epid<Alloc>& a_from, const ref<Alloc>& a_ref,
         const atom& a_mod, const atom& a_fun, const list<Alloc>& a_args,
         const eterm<Alloc>& a_gleader);
 
 protected:
-    /// Publish the node port to epmd making this node known to the world.
+    /// Publish the port of the server to epmd making this node known to
+    /// the world.  The node stays registered while the connection to epmd
+    /// is open.
     /// @throws err_connection
     void publish_port();
 
     /// Unregister this node from epmd.
-    /// @throws err_connection
     void unpublish_port();
 
     /// Send a message to a process ToProc which is either epid<Alloc> or
     /// atom<Alloc> for registered names.
+    /// @return false if a local recipient's queue is full.
     /// @throws err_no_process
     /// @throws err_connection
     template <typename ToProc>
-    void send(const atom& a_to_node,
+    bool send(const atom& a_to_node,
         ToProc a_to, const transport_msg<Alloc>& a_msg);
 public:
     typedef basic_otp_mailbox_registry<Alloc, Mutex> mailbox_registry_t;
@@ -139,7 +187,13 @@ public:
      *        argument is provided for being able to do determinitic testing.
      *        In production pass the default value, so that the creation value
      *        is determined automatically.
-     * @throws err_bad_argument if node name is too long
+     * @param a_backend is the I/O backend of the node's connections.
+     *        IO_BACKEND_URING requires building with EIXX_USE_IO_URING.  If
+     *        the kernel doesn't support io_uring, connections fall back to
+     *        IO_BACKEND_ASIO.  With IO_BACKEND_BUSY_POLL the threads running
+     *        connections spin over their sockets (see busy_poll_policy).
+     * @throws err_bad_argument if node name is too long or the I/O backend
+     *        is not available
      * @throws err_connection if there is a network problem
      * @throws eterm_exception if there is an error in transport creation
      */
@@ -147,9 +201,10 @@ public:
                    const std::string& a_nodename = std::string(),
                    const std::string& a_cookie = std::string(),
                    const Alloc& a_alloc = Alloc(),
-                   int8_t a_creation = -1);
+                   int8_t a_creation = -1,
+                   io_backend a_backend = IO_BACKEND_ASIO);
 
-    virtual ~basic_otp_node() { close(); }
+    virtual ~basic_otp_node();
 
     /// Change name of current node
     void set_nodename(const atom& a_nodename, const std::string& a_cookie = "");
@@ -161,13 +216,194 @@ public:
     /// printouts.
     void verbose(verbose_type a_type) { m_verboseness = a_type; }
 
+    /// Get the default write coalescing policy of new connections.
+    const write_policy& wr_policy() const { return m_wr_policy; }
+
+    /// Set the default write coalescing policy applied to connections
+    /// established after this call.
+    void wr_policy(const write_policy& a_policy) { m_wr_policy = a_policy; }
+
+    /// Get the default read buffer policy of new connections.
+    const read_policy& rd_policy() const { return m_rd_policy; }
+
+    /// Set the default read buffer policy applied to connections
+    /// established after this call.
+    void rd_policy(const read_policy& a_policy) {
+        m_rd_policy = a_policy;
+        m_rd_pool.reset(a_policy.pool_size
+            ? new util::buffer_pool<Alloc>(a_policy.initial_size, a_policy.pool_size, m_allocator)
+            : nullptr);
+    }
+
+    /// Pool of idle read buffers shared by the node's connections.
+    const boost::shared_ptr<util::buffer_pool<Alloc>>& rd_pool() const { return m_rd_pool; }
+
     /// Get the service object used by this node.
     boost::asio::io_service& io_service() { return m_io_service; }
 
-    /// Run the node's service dispatch
-    void run()  { m_io_service.run();  }
+    /// Run connections on \a a_threads I/O services, each served by its
+    /// own thread, instead of the node's service.  The thread of the i-th
+    /// service is pinned to CPU \a a_cpus[i % a_cpus.size()].  A connection
+    /// to a remote node is assigned to one of the services by the node's
+    /// name, so all I/O of a connection happens on one thread.  Handler
+    /// callbacks of connections (on_disconnect, on_status, etc.) are called
+    /// from the pool's threads.
+    ///
+    /// Must be called before connecting to other nodes.  The threads are
+    /// started by run() and stopped by stop().
+    void io_threads(size_t a_threads, const std::vector<int>& a_cpus = std::vector<int>()) {
+        if (!m_connections.empty())
+            throw err_connection("Cannot change I/O threads of a connected node");
+        m_io_pool.reset(a_threads ? new util::io_service_pool(a_threads, a_cpus) : nullptr);
+    }
+
+    /// Pool of I/O services running the node's connections or NULL if
+    /// connections run on the node's service.  A mailbox may be bound to
+    /// one of the pool's services by passing it to create_mailbox().
+    util::io_service_pool* io_pool() { return m_io_pool.get(); }
+
+    /// Decode incoming messages on \a a_threads worker threads pinned to
+    /// \a a_cpus instead of the connection's I/O thread.  The I/O thread
+    /// only splits the incoming data into packets and answers ticks.  Each
+    /// batch of packets read from a socket is decoded by one of the
+    /// workers, and the messages of a connection are delivered in the
+    /// order they were received.  Mailbox delivery, error reports of the
+    /// connection's delivery path and latency tracking (see
+    /// track_latency()) happen on the worker threads, so the node's
+    /// on_status callback must be thread-safe when this is enabled.
+    ///
+    /// Must be called before connecting to other nodes.  The threads are
+    /// started by run() and stopped by stop().
+    void decode_threads(size_t a_threads, const std::vector<int>& a_cpus = std::vector<int>()) {
+        if (!m_connections.empty())
+            throw err_connection("Cannot change decode threads of a connected node");
+        m_decode_pool.reset(a_threads
+            ? new util::io_service_pool(1, a_cpus, a_threads) : nullptr);
+    }
+
+    /// Service of the decode workers or NULL if messages are decoded by
+    /// the I/O threads.
+    boost::asio::io_service* decode_service() {
+        return m_decode_pool ? &m_decode_pool->get(0) : nullptr;
+    }
+
+    /// Run the handlers of mailboxes passed to basic_otp_mailbox::schedule()
+    /// on \a a_threads work-stealing threads pinned to \a a_cpus.  A worker
+    /// passes up to \a a_budget messages to a mailbox's handler before
+    /// moving on to the next mailbox, and idle workers take mailboxes
+    /// queued on busy ones.  0 threads disables the scheduler.
+    ///
+    /// Must be called before mailboxes are scheduled.  The threads are
+    /// started by run() and stopped by stop().
+    void sched_threads(size_t a_threads, size_t a_budget = 64,
+                       const std::vector<int>& a_cpus = std::vector<int>()) {
+        m_scheduler.reset(a_threads
+            ? new util::work_stealing_pool(a_threads, a_budget, 4096,
+                                           std::chrono::microseconds(50), a_cpus)
+            : nullptr);
+    }
+
+    /// Scheduler of mailbox handlers or NULL.
+    util::work_stealing_pool* scheduler() { return m_scheduler.get(); }
+
+    /// I/O backend of the node's connections.
+    io_backend backend() const { return m_backend; }
+
+    /// Get the policy of the busy-polling backend.
+    const busy_poll_policy& bp_policy() const { return m_bp_policy; }
+
+    /// Set the policy of the busy-polling backend.  Must be called before
+    /// connecting to other nodes.
+    void bp_policy(const busy_poll_policy& a_policy) { m_bp_policy = a_policy; }
+
+    /// Get the policy of recycling pids of closed mailboxes and of their
+    /// message queues.
+    const mailbox_policy& mb_policy() const { return m_mailboxes.policy(); }
+
+    /// Set the policy of recycling pids of closed mailboxes and of their
+    /// message queues.  Must be called before creating mailboxes.
+    /// @throws err_bad_argument if the node has mailboxes.
+    void mb_policy(const mailbox_policy& a_policy) {
+        m_mailboxes.policy(a_policy);
+        m_msg_pool.reset(new transport_msg_pool<Alloc>(a_policy.msg_pool_size));
+    }
+
+    /// Pool of idle transport messages shared by the node's connections
+    /// and mailboxes (see mailbox_policy::msg_pool_size).
+    const boost::shared_ptr<transport_msg_pool<Alloc>>& msg_pool() const { return m_msg_pool; }
+
+    /// Timing wheel run by the node's service, used for the receive
+    /// timeouts of mailboxes run by that service and for reconnect timers.
+    const boost::shared_ptr<util::timer_wheel>& timers() const { return m_timers; }
+
+    /// Set the resolution of timeouts and timers of the node (1ms by
+    /// default).  Must be called before creating mailboxes and connections,
+    /// which keep using the previous wheel.
+    void timer_resolution(std::chrono::microseconds a_resolution) {
+        m_timers = boost::make_shared<util::timer_wheel>(m_io_service, a_resolution);
+    }
+
+    /// Get the busy-polling loop of connections run by \a a_svc.
+    /// @return NULL if connections don't use the busy-polling backend.
+    boost::shared_ptr<busy_poller> poller(boost::asio::io_service& a_svc);
+
+    /// Record the latency between reading a message from a socket and its
+    /// delivery to the mailbox (or to the handler of a control message).
+    /// Must be called before connecting to other nodes.
+    void track_latency(bool a_enable) {
+        m_rd_latency.reset(a_enable ? new util::latency_histogram() : nullptr);
+    }
+
+    /// Histogram of socket-to-mailbox latency or NULL if not tracked.
+    util::latency_histogram* rd_latency() { return m_rd_latency.get(); }
+
+    /// Ports of remote nodes looked up in epmd and static ports of nodes
+    /// that are connected without asking epmd, e.g.:
+    /// \code
+    ///   node.port_cache().ttl(std::chrono::minutes(5));
+    ///   node.port_cache().add_static(atom("db@host1"), 4370);
+    /// \endcode
+    epmd_cache& port_cache() { return m_port_cache; }
+
+#ifdef EIXX_USE_IO_URING
+    /// Get the io_uring instance serving connections run by \a a_svc.
+    /// @return NULL if connections use the asio backend.
+    boost::shared_ptr<uring_service> uring(boost::asio::io_service& a_svc);
+#endif
+
+    /// Get the service that runs the connection to \a a_node.
+    boost::asio::io_service& io_service(const atom& a_node) {
+        return m_io_pool ? m_io_pool->get(a_node.index()) : m_io_service;
+    }
+
+    /// Run the node's service dispatch.  With the busy-polling backend
+    /// the service running connections is run by their polling loop.
+    void run() {
+        bool polling = m_backend == IO_BACKEND_BUSY_POLL;
+        if (m_decode_pool)
+            m_decode_pool->start();
+        if (m_scheduler)
+            m_scheduler->start();
+        if (m_io_pool) {
+            if (polling)
+                m_io_pool->runner([this](boost::asio::io_service& s) { poller(s)->run(); });
+            m_io_pool->start();
+        }
+        if (polling && !m_io_pool)
+            poller(m_io_service)->run();
+        else
+            m_io_service.run();
+    }
     /// Stop the node's service dispatch
-    void stop() { m_io_service.stop(); }
+    void stop() {
+        m_io_service.stop();
+        if (m_io_pool)
+            m_io_pool->stop();
+        if (m_decode_pool)
+            m_decode_pool->stop();
+        if (m_scheduler)
+            m_scheduler->stop();
+    }
 
     /// Close all connections and empty the mailbox
     void close();
@@ -179,10 +415,14 @@ public:
      * {@link mailbox#self pid}.
      * @param a_reg_name if not null the mailbox pid will be associated with a
      *        registered name.
+     * @param a_queue is the size and overflow policy of the queue of received
+     *        messages (NULL - mailbox_policy::queue).  A mailbox fed by a
+     *        single connection may use a single-producer queue.
      * @return new mailbox with a new pid.
      */
     basic_otp_mailbox<Alloc, Mutex>*
-    create_mailbox(const atom& a_name = atom(), boost::asio::io_service* a_svc = NULL);
+    create_mailbox(const atom& a_name = atom(), boost::asio::io_service* a_svc = NULL,
+                   const util::queue_policy* a_queue = NULL);
 
     void close_mailbox(basic_otp_mailbox<Alloc, Mutex>* a_mbox);
 
@@ -245,7 +485,19 @@ public:
     void connect(CompletionHandler h, const atom& a_remote_nodename,
                  int a_reconnect_secs = 0);
 
-    /// Get connection identified by the \a a_node name.
+    /// Keeps connections returned by connection() from being freed while
+    /// in scope.  A connection replaced by another one to the same node
+    /// or dropped by close() is freed once no guard may be using it.
+    class connection_guard : private boost::noncopyable {
+        typename util::epoch_reclaimer<boost::shared_ptr<const void>>::guard m_guard;
+    public:
+        explicit connection_guard(const basic_otp_node& a_node) : m_guard(a_node.m_retired) {}
+    };
+
+    /// Get connection identified by the \a a_node name.  The lookup is
+    /// wait-free and may be done by any thread while connections are added
+    /// or replaced.  Unless called by the thread serving the connection,
+    /// the caller must hold a connection_guard while using the reference.
     /// @throws err_connection if not connected to \a a_node._
     connection_t& connection(atom a_nodename) const;
 
@@ -272,52 +524,104 @@ public:
                       const eterm<Alloc>& a_gleader)
     > on_rpc_call;
     /**
-     * Accept connections from client processes.
+     * Accept connections from other nodes.
      * This method sets the socket listener for incoming connections and
-     * registers the port with local epmd daemon.
-     * @throws err_connection if cannot connect to epmd.
+     * registers the port with local epmd daemon.  Accepted connections
+     * are managed by the node like the ones it initiates.
+     * @param a_port is the port to listen on (0 picks an ephemeral port).
+     * @param a_acceptors is the number of acceptors bound to the port with
+     *        SO_REUSEPORT.  With io_threads() they run on the I/O threads,
+     *        so that a storm of reconnecting nodes is handshaked in parallel.
+     * @param a_publish if false the port is not registered with epmd.
+     * @throws err_connection if cannot listen on the port or connect to epmd.
      */
-    void start_server();
+    void start_server(uint16_t a_port = 0, size_t a_acceptors = 1, bool a_publish = true);
 
     /**
-     * Stop accepting connections from client processes.
+     * Stop accepting connections from other nodes.
      * This method closes the socket listener and 
      * unregisters the port with local epmd daemon.
      */
     void stop_server();
 
+    /// Port accepting connections from other nodes or 0 if the server is
+    /// not started.
+    uint16_t listen_port() const { return m_tcp_listener ? m_tcp_listener->port() : 0; }
+
+    /// Accept shm:// connections from eixx nodes running on this host.
+    /// The nodes connect to "shm://<a_path>", where \a a_path is the Unix
+    /// domain socket used to exchange the shared memory segments.  The
+    /// socket file is replaced if it exists.
+    /// @throws boost::system::system_error
+    void shm_listen(const std::string& a_path);
+
     /// Deliver a message to its local receipient mailbox.
     /// @throws err_bad_argument
     /// @throws err_no_process
     /// @throws err_connection
     void deliver(const transport_msg<Alloc>& a_tm);
 
+    /// Deliver messages received at once to their local recipient
+    /// mailboxes.  The messages are grouped by recipient, so that each
+    /// mailbox is looked up once and gets its messages in one enqueue,
+    /// in the order of \a a_msgs.  Takes the ownership of the messages,
+    /// which must come from msg_pool(), and clears \a a_msgs.  Errors
+    /// are reported with report_status().
+    void deliver(std::vector<transport_msg<Alloc>*>& a_msgs);
+
     /// Send a message \a a_msg from \a a_from pid to \a a_to pid.
     /// @param a_to is a remote process.
     /// @param a_msg is the message to send.
+    /// @return false if a local recipient's queue is full and the message
+    ///         was dropped (see util::queue_policy).
     /// @throws err_no_process
     /// @throws err_connection
-    void send(const epid<Alloc>& a_to, const eterm<Alloc>& a_msg);
+    bool send(const epid<Alloc>& a_to, const eterm<Alloc>& a_msg);
+
+    /// Send a message \a a_msg from \a a_from pid to \a a_to pid.  A
+    /// process of this node gets \a a_from as the sender of the message.
+    /// @return false if a local recipient's queue is full and the message
+    ///         was dropped (see util::queue_policy).
+    /// @throws err_no_process
+    /// @throws err_connection
+    bool send(const epid<Alloc>& a_from, const epid<Alloc>& a_to, const eterm<Alloc>& a_msg);
+
+    /// Deliver \a a_msg to the mailbox of this node with the pid or the
+    /// registered name \a a_to in a local envelope (see
+    /// transport_msg::set_local()).  No control message is built, and the
+    /// payload is moved to the envelope, which is taken from msg_pool().
+    /// send() uses it for local recipients unless a trace token is set.
+    /// @param a_from is the sender (undefined if unknown).
+    /// @return false if the message was dropped because the queue is full.
+    /// @throws err_no_process
+    template <typename ToProc>
+    bool send_local(const eterm<Alloc>& a_from, ToProc a_to, eterm<Alloc>&& a_msg);
 
     /// Send a message \a a_msg to the remote process \a a_to on node \a a_node.
     /// The remote process \a a_to need not belong to node \a a_node.
     /// @param a_node is the node to send the message to.
     /// @param a_to is a remote process.
     /// @param a_msg is the message to send.
+    /// @return false if a local recipient's queue is full and the message
+    ///         was dropped (see util::queue_policy).
     /// @throws err_no_process
     /// @throws err_connection
-    void send(const atom& a_node, const epid<Alloc>& a_to, const eterm<Alloc>& a_msg);
+    bool send(const atom& a_node, const epid<Alloc>& a_to, const eterm<Alloc>& a_msg);
 
     /// Send a message \a a_msg to the local process registered as \a a_to.
+    /// @return false if a local recipient's queue is full and the message
+    ///         was dropped (see util::queue_policy).
     /// @throws err_no_process
     /// @throws err_connection
-    void send(const epid<Alloc>& a_from, const atom& a_to, const eterm<Alloc>& a_msg);
+    bool send(const epid<Alloc>& a_from, const atom& a_to, const eterm<Alloc>& a_msg);
 
     /// Send a message \a a_msg to the process registered as \a a_to_name
     /// on remote node \a a_node.
+    /// @return false if a local recipient's queue is full and the message
+    ///         was dropped (see util::queue_policy).
     /// @throws err_no_process
     /// @throws err_connection
-    void send(const epid<Alloc>& a_from, const atom& a_to_node, const atom& a_to_name,
+    bool send(const epid<Alloc>& a_from, const atom& a_to_node, const atom& a_to_name,
         const eterm<Alloc>& a_msg);
 
     /**
@@ -347,6 +651,58 @@ public:
                    const atom& a_mod, const atom& a_fun, const list<Alloc>& args,
                   const epid<Alloc>* gleader = NULL);
 
+#ifdef EIXX_HAVE_COROUTINES
+    /// Result of co_rpc() awaited by a coroutine.
+    class rpc_awaitable {
+        typename basic_otp_mailbox<Alloc, Mutex>::receive_awaitable m_recv;
+        basic_otp_mailbox<Alloc, Mutex>&                            m_mbox;
+
+        static const eterm<Alloc>& pattern() {
+            static const eterm<Alloc> s_pattern = eterm<Alloc>::format("{rex, _}");
+            return s_pattern;
+        }
+    public:
+        rpc_awaitable(basic_otp_mailbox<Alloc, Mutex>& a_mbox, std::chrono::milliseconds a_timeout)
+            : m_recv(a_mbox.co_match(pattern(), nullptr, a_timeout)), m_mbox(a_mbox)
+        {}
+
+        bool await_ready()                               { return m_recv.await_ready();      }
+        bool await_suspend(std::coroutine_handle<> a_h)  { return m_recv.await_suspend(a_h); }
+
+        /// @return the result of the call, or an undefined term on timeout.
+        eterm<Alloc> await_resume() {
+            transport_msg<Alloc>* msg = m_recv.await_resume();
+            if (!msg)
+                return eterm<Alloc>();
+            eterm<Alloc> reply = rpc_server::decode_rpc(msg->msg());
+            m_mbox.release(msg);
+            return reply;
+        }
+    };
+
+    /**
+     * Execute an equivalent of rpc:call(...) in a coroutine:
+     * \code
+     * eterm<Alloc> reply = co_await node.co_rpc(mbox, node_name, mod, fun, args, seconds(5));
+     * \endcode
+     * The request is sent from \a a_mbox, which receives the reply (other
+     * messages arriving meanwhile stay in the mailbox, see
+     * basic_otp_mailbox::co_match()).
+     * @return an awaitable giving the reply, or an undefined term if
+     *         \a a_timeout expires (-1 = infinity).
+     * @throws err_bad_argument
+     * @throws err_no_process
+     * @throws err_connection
+     */
+    rpc_awaitable co_rpc(basic_otp_mailbox<Alloc, Mutex>& a_mbox, const atom& a_to_node,
+                         const atom& a_mod, const atom& a_fun, const list<Alloc>& args,
+                         std::chrono::milliseconds a_timeout = std::chrono::milliseconds(-1))
+    {
+        send_rpc(a_mbox.self(), a_to_node, a_mod, a_fun, args);
+        return rpc_awaitable(a_mbox, a_timeout);
+    }
+#endif
+
     /// Attempt to kill a remote process by sending
     /// an exit message to a_pid, with reason \a a_reason
     /// @throws err_no_process
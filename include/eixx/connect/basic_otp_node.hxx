@@ -81,7 +81,7 @@ basic_otp_node<Alloc, Mutex>::
 basic_otp_node(
     boost::asio::io_service& a_io_svc,
     const std::string& a_nodename, const std::string& a_cookie,
-    const Alloc& a_alloc, int8_t a_creation)
+    const Alloc& a_alloc, int8_t a_creation, io_backend a_backend)
     : basic_otp_node_local(a_nodename, a_cookie)
     , m_creation((a_creation < 0 ? time(NULL) : (int)a_creation) & 0x03)
     , m_pid_count(1)
@@ -93,7 +93,70 @@ basic_otp_node(
     , m_connections(atom_con_hash_fun::get_default_hash_size(), atom_con_hash_fun(&m_connections))
     , m_allocator(a_alloc)
     , m_verboseness(verboseness::level())
-{}
+    , m_backend(a_backend)
+{
+#ifndef EIXX_USE_IO_URING
+    if (a_backend == IO_BACKEND_URING)
+        throw err_bad_argument("io_uring backend is not enabled (EIXX_USE_IO_URING)");
+#endif
+    rd_policy(m_rd_policy);
+    m_msg_pool.reset(new transport_msg_pool<Alloc>(mb_policy().msg_pool_size));
+    m_timers = boost::make_shared<util::timer_wheel>(m_io_service);
+}
+
+template <typename Alloc, typename Mutex>
+basic_otp_node<Alloc, Mutex>::
+~basic_otp_node()
+{
+    close();
+#ifdef EIXX_USE_IO_URING
+    // Release connections waiting for completions that will never be
+    // reaped because their service is no longer run.
+    for (auto& u : m_urings)
+        if (u.first->stopped())
+            u.second->shutdown();
+#endif
+    for (auto& p : m_pollers)
+        if (p.first->stopped())
+            p.second->shutdown();
+}
+
+template <typename Alloc, typename Mutex>
+boost::shared_ptr<busy_poller> basic_otp_node<Alloc, Mutex>::
+poller(boost::asio::io_service& a_svc)
+{
+    std::lock_guard<std::mutex> guard(m_poller_lock);
+    if (m_backend != IO_BACKEND_BUSY_POLL)
+        return boost::shared_ptr<busy_poller>();
+    auto& p = m_pollers[&a_svc];
+    if (!p)
+        p = boost::make_shared<busy_poller>(a_svc, m_bp_policy);
+    return p;
+}
+
+#ifdef EIXX_USE_IO_URING
+template <typename Alloc, typename Mutex>
+boost::shared_ptr<uring_service> basic_otp_node<Alloc, Mutex>::
+uring(boost::asio::io_service& a_svc)
+{
+    std::lock_guard<std::mutex> guard(m_uring_lock);
+    if (m_backend != IO_BACKEND_URING)
+        return boost::shared_ptr<uring_service>();
+    auto& u = m_urings[&a_svc];
+    if (!u) {
+        try {
+            u = boost::make_shared<uring_service>(a_svc);
+        } catch (std::exception& e) {
+            m_urings.erase(&a_svc);
+            m_backend = IO_BACKEND_ASIO;
+            report_status(REPORT_WARNING, NULL,
+                std::string("io_uring is not available, using asio backend: ") + e.what());
+            return boost::shared_ptr<uring_service>();
+        }
+    }
+    return u;
+}
+#endif
 
 template <typename Alloc, typename Mutex>
 epid<Alloc> basic_otp_node<Alloc, Mutex>::
@@ -171,10 +234,11 @@ create_ref()
 template <typename Alloc, typename Mutex>
 inline basic_otp_mailbox<Alloc, Mutex>*
 basic_otp_node<Alloc, Mutex>::
-create_mailbox(const atom& a_name, boost::asio::io_service* a_svc)
+create_mailbox(const atom& a_name, boost::asio::io_service* a_svc,
+               const util::queue_policy* a_queue)
 {
     boost::asio::io_service* p_svc = a_svc ? a_svc : &m_io_service;
-    return m_mailboxes.create_mailbox(a_name, p_svc);
+    return m_mailboxes.create_mailbox(a_name, p_svc, a_queue);
 }
 
 template <typename Alloc, typename Mutex>
@@ -199,11 +263,31 @@ template <typename Alloc, typename Mutex>
 void basic_otp_node<Alloc, Mutex>::
 close()
 {
+    m_shm_listener.reset();
+    stop_server();
     m_mailboxes.clear();
-    for(typename conn_hash_map::iterator
-        it = m_connections.begin(), end = m_connections.end(); it != end; ++it)
-        it->second->disconnect();
-    m_connections.clear();
+    std::vector<typename connection_t::pointer> l_cons;
+    {
+        // Disconnect outside of the lock, as handlers may call the node
+        lock_guard<Mutex> guard(m_lock);
+        for (auto& c : m_connections)
+            l_cons.push_back(c.second);
+        // Senders may still be probing the index and using its connections
+        m_retired.retire(boost::shared_ptr<const void>(m_con_index.clear().release()));
+        for (auto& con : l_cons)
+            m_retired.retire(con);
+        m_connections.clear();
+    }
+    for (auto& con : l_cons)
+        if (m_io_pool && m_io_pool->running()) {
+            // The connection may only be touched by the thread serving it
+            con->io_service().post([con]() { con->disconnect(); });
+        } else
+            con->disconnect();
+    // Nothing runs a stopped pool, so complete the cancelled operations
+    // while their connections' handlers are still held
+    if (m_io_pool)
+        m_io_pool->poll();
 }
 
 template <typename Alloc, typename Mutex>
@@ -219,10 +303,31 @@ inline typename basic_otp_node<Alloc, Mutex>::connection_t&
 basic_otp_node<Alloc, Mutex>::
 connection(atom a_nodename) const
 {
-    auto l_con = m_connections.find(a_nodename);
-    if (l_con == m_connections.end())
+    connection_t* l_con = m_con_index.find(a_nodename);
+    if (unlikely(!l_con))
         throw err_connection("Not connected to node", a_nodename);
-    return *l_con->second.get();
+    return *l_con;
+}
+
+template <typename Alloc, typename Mutex>
+void basic_otp_node<Alloc, Mutex>::
+add_connection(atom a_name, const typename connection_t::pointer& a_con)
+{
+    auto it = m_connections.find(a_name);
+    if (it == m_connections.end()) {
+        m_connections[a_name] = a_con;
+        m_con_index.set(a_name, a_con.get());
+        return;
+    }
+    if (it->second == a_con)
+        return;
+    // Stop the replaced connection, which senders may still be using,
+    // and free it once they are done
+    typename connection_t::pointer old = it->second;
+    it->second = a_con;
+    m_con_index.set(a_name, a_con.get());
+    old->io_service().post([old]() { old->disconnect(true); });
+    m_retired.retire(std::move(old));
 }
 
 template <typename Alloc, typename Mutex>
@@ -236,15 +341,104 @@ connect(CompletionHandler h, const atom& a_remote_node, const atom& a_cookie,
     if (it == m_connections.end()) {
         atom l_cookie = a_cookie.empty() ? cookie() : a_cookie;
         typename connection_t::pointer con(
-            connection_t::connect(h, m_io_service, this, a_remote_node,
+            connection_t::connect(h, io_service(a_remote_node), this, a_remote_node,
                                   l_cookie, a_reconnect_secs));
-        m_connections[a_remote_node] = con;
+        add_connection(a_remote_node, con);
     } else {
         std::string e;
         m_io_service.post(std::bind(h, &*it->second, e));
     }
 }
 
+template <typename Alloc, typename Mutex>
+bool basic_otp_node<Alloc, Mutex>::
+alias_connection(atom a_name, connection_t* a_con)
+{
+    if (a_name == nodename())
+        return false;
+    lock_guard<Mutex> guard(m_lock);
+    auto it = m_connections.find(a_name);
+    if (it != m_connections.end())
+        return it->second.get() == a_con;
+    add_connection(a_name, a_con->shared_from_this());
+    return true;
+}
+
+template <typename Alloc, typename Mutex>
+void basic_otp_node<Alloc, Mutex>::
+shm_listen(const std::string& a_path)
+{
+    m_shm_listener.reset(new shm_listener(m_io_service, a_path,
+        [this](shm_listener::peer& p) { on_shm_accept(p); }));
+}
+
+template <typename Alloc, typename Mutex>
+void basic_otp_node<Alloc, Mutex>::
+on_shm_accept(shm_listener::peer& a_peer)
+{
+    if (a_peer.cookie != cookie().to_string()) {
+        report_status(REPORT_WARNING, NULL,
+            "Rejected shm connection from " + a_peer.node + ": invalid cookie");
+        a_peer.reject(EACCES);
+        return;
+    }
+
+    atom node(a_peer.node);
+
+    lock_guard<Mutex> guard(m_lock);
+    auto it = m_connections.find(node);
+    if (it != m_connections.end() && it->second->connected()) {
+        a_peer.reject(EEXIST);
+        return;
+    }
+
+    try {
+        boost::asio::io_service& svc = io_service(node);
+        auto create = [&](connection_t* c) {
+            return shm_connection<connection_t, Alloc>::accept(
+                svc, c, creation(), nodename(), cookie(), a_peer, m_allocator);
+        };
+        add_connection(node, connection_t::accept(svc, this, node, cookie(), create, m_allocator));
+    } catch (std::exception& e) {
+        a_peer.reject(EPROTO);
+        report_status(REPORT_ERROR, NULL,
+            "Failed to accept shm connection from " + a_peer.node + ": " + e.what());
+    }
+}
+
+template <typename Alloc, typename Mutex>
+void basic_otp_node<Alloc, Mutex>::
+on_tcp_accept(tcp_listener::peer& a_peer)
+{
+    atom node(a_peer.node);
+
+    lock_guard<Mutex> guard(m_lock);
+    auto it = m_connections.find(node);
+    if (it != m_connections.end() && it->second->connected()) {
+        a_peer.reject("nok");
+        return;
+    }
+
+    try {
+        boost::asio::io_service& svc = io_service(node);
+        auto create = [&](connection_t* c) {
+            return tcp_connection<connection_t, Alloc>::accept(
+                svc, c, creation(), nodename(), cookie(), a_peer, m_allocator);
+        };
+        auto con = connection_t::accept(svc, this, node, cookie(), create, m_allocator);
+        if (it != m_connections.end()) {
+            // Give up a pending outgoing connection to the node
+            auto old = it->second;
+            old->io_service().post([old]() { old->disconnect(true); });
+        }
+        add_connection(node, con);
+    } catch (std::exception& e) {
+        a_peer.reject("not_allowed");
+        report_status(REPORT_ERROR, NULL,
+            "Failed to accept connection from " + a_peer.node + ": " + e.what());
+    }
+}
+
 template <typename Alloc, typename Mutex>
 void basic_otp_node<Alloc, Mutex>::
 on_disconnect_internal(const connection_t& a_con,
@@ -272,26 +466,126 @@ template <typename Alloc, typename Mutex>
 void basic_otp_node<Alloc, Mutex>::
 publish_port()
 {
-    throw err_connection("Not implemented!");
+    using boost::asio::ip::tcp;
+
+    if (!m_tcp_listener)
+        throw err_connection("Server is not started");
+
+    unpublish_port();
+
+    const char* epmd_port_s = getenv("ERL_EPMD_PORT");
+    uint16_t    epmd_port   = epmd_port_s ? uint16_t(atoi(epmd_port_s)) : EPMD_PORT;
+
+    std::unique_ptr<tcp::socket> sock(new tcp::socket(m_io_service));
+    boost::system::error_code ec;
+    sock->connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), epmd_port), ec);
+    if (ec)
+        throw err_connection("Cannot connect to epmd: " + ec.message());
+
+    const std::string& alive = alivename();
+    char  buf[EPMDBUF];
+    char* w = buf;
+    if (alive.size() > sizeof(buf) - 15)
+        throw err_connection("Alive name too long", alive);
+    put16be(w, uint16_t(13 + alive.size()));
+    put8(w, EI_EPMD_ALIVE2_REQ);
+    put16be(w, m_tcp_listener->port());
+    put8(w, 'H');           // Hidden node
+    put8(w, 0);             // TCP/IP v4
+    put16be(w, EI_DIST_HIGH);
+    put16be(w, EI_DIST_LOW);
+    put16be(w, alive.size());
+    memcpy(w, alive.c_str(), alive.size());
+    w += alive.size();
+    put16be(w, 0);          // No extra
+
+    if (unlikely(verbose() >= VERBOSE_TRACE))
+        report_status(REPORT_INFO, NULL, "-> sending epmd alive2 req for '" + alive
+                      + "': " + to_binary_string(buf, w - buf));
+
+    // Reply: tag, result, creation (16 bits in ALIVE2_RESP, 32 bits in ALIVE2_X_RESP)
+    boost::asio::write(*sock, boost::asio::buffer(buf, w - buf), ec);
+    if (!ec)
+        boost::asio::read(*sock, boost::asio::buffer(buf, 2), ec);
+    if (ec)
+        throw err_connection("Error registering with epmd: " + ec.message());
+
+    const char* r = buf;
+    int tag = get8(r);
+    int res = get8(r);
+    if ((tag != EI_EPMD_ALIVE2_RESP && tag != EI_EPMD_ALIVE2_X_RESP) || res) {
+        std::stringstream ss;
+        ss << "epmd refused to register '" << alive << "' (tag=" << tag << ", result=" << res << ')';
+        throw err_connection(ss.str());
+    }
+    size_t n = tag == EI_EPMD_ALIVE2_RESP ? 2 : 4;
+    boost::asio::read(*sock, boost::asio::buffer(buf, n), ec);
+    if (ec)
+        throw err_connection("Error reading epmd reply: " + ec.message());
+
+    if (unlikely(verbose() >= VERBOSE_TRACE)) {
+        r = buf;
+        std::stringstream ss;
+        ss << "<- epmd registered '" << alive << "' at port " << m_tcp_listener->port()
+           << ", creation=" << (n == 2 ? get16be(r) : get32be(r));
+        report_status(REPORT_INFO, NULL, ss.str());
+    }
+
+    m_epmd = std::move(sock);
 }
 
 template <typename Alloc, typename Mutex>
 void basic_otp_node<Alloc, Mutex>::
 unpublish_port()
 {
-    throw std::runtime_error("Not implemented");
+    // epmd forgets the node when its connection is closed
+    if (false && m_epmd) {
+        boost::system::error_code ec;
+        m_epmd->close(ec);
+        m_epmd.reset();
+    }
 }
 
 template <typename Alloc, typename Mutex>
-void basic_otp_node<Alloc, Mutex>::start_server()
+void basic_otp_node<Alloc, Mutex>::
+start_server(uint16_t a_port, size_t a_acceptors, bool a_publish)
 {
-    throw std::runtime_error("Not implemented");
+    stop_server();
+
+    std::vector<boost::asio::io_service*> svcs;
+    for (size_t i = 0; i < std::max<size_t>(a_acceptors, 1); ++i)
+        svcs.push_back(m_io_pool ? &m_io_pool->get(i) : &m_io_service);
+
+    try {
+        m_tcp_listener.reset(new tcp_listener(svcs,
+            boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), a_port),
+            [this](tcp_listener::peer& p) { on_tcp_accept(p); }));
+    } catch (boost::system::system_error& e) {
+        throw err_connection(std::string("Cannot listen for connections: ") + e.what());
+    }
+
+    if (unlikely(verbose() > VERBOSE_NONE)) {
+        std::stringstream ss;
+        ss << "Accepting connections at port " << m_tcp_listener->port()
+           << " (" << svcs.size() << " acceptors)";
+        report_status(REPORT_INFO, NULL, ss.str());
+    }
+
+    if (a_publish) {
+        try {
+            publish_port();
+        } catch (...) {
+            m_tcp_listener.reset();
+            throw;
+        }
+    }
 }
 
 template <typename Alloc, typename Mutex>
 void basic_otp_node<Alloc, Mutex>::stop_server()
 {
-    throw std::runtime_error("Not implemented");
+    unpublish_port();
+    m_tcp_listener.reset();
 }
 
 template <typename Alloc, typename Mutex>
@@ -322,55 +616,143 @@ deliver(const transport_msg<Alloc>& a_msg)
 }
 
 template <typename Alloc, typename Mutex>
-template <typename ToProc>
 void basic_otp_node<Alloc, Mutex>::
+deliver(std::vector<transport_msg<Alloc>*>& a_msgs)
+{
+    typedef basic_otp_mailbox<Alloc, Mutex>* mailbox_ptr;
+
+    // Look up the recipients.  Messages of a batch usually go to a few
+    // mailboxes, so the recent lookups are remembered.
+    static const size_t s_recent = 8;
+    std::pair<const eterm<Alloc>*, mailbox_ptr> l_recent[s_recent];
+    size_t l_nrecent = 0;
+
+    // Reused by the calls on this thread to avoid allocating per batch
+    static thread_local std::vector<std::pair<mailbox_ptr, size_t>> l_dest; // (mailbox, index)
+    static thread_local std::vector<transport_msg<Alloc>*>          l_group;
+    l_dest.clear();
+
+    for (size_t i = 0; i < a_msgs.size(); ++i) {
+        try {
+            const eterm<Alloc>& l_to = a_msgs[i]->recipient();
+            size_t j = 0;
+            while (j < l_nrecent && !(*l_recent[j].first == l_to))
+                ++j;
+            if (j == l_nrecent) {
+                mailbox_ptr l_mbox = get_mailbox(l_to);
+                j = l_nrecent < s_recent ? l_nrecent++ : i % s_recent;
+                l_recent[j] = std::make_pair(&l_to, l_mbox);
+            }
+            l_dest.emplace_back(l_recent[j].second, i);
+        } catch (std::exception& e) {
+            std::stringstream s;
+            s << "Cannot deliver message " << a_msgs[i]->to_string() << ": " << e.what();
+            report_status(REPORT_WARNING, NULL, s.str());
+            m_msg_pool->release(a_msgs[i]);
+        }
+    }
+
+    // Hand each mailbox its messages in one call, keeping their order
+    if (l_dest.size() > 1)
+        std::sort(l_dest.begin(), l_dest.end());
+
+    for (size_t i = 0; i < l_dest.size();) {
+        mailbox_ptr l_mbox = l_dest[i].first;
+        l_group.clear();
+        for (; i < l_dest.size() && l_dest[i].first == l_mbox; ++i)
+            l_group.push_back(a_msgs[l_dest[i].second]);
+        l_mbox->deliver(l_group.data(), l_group.size());
+    }
+    a_msgs.clear();
+}
+
+template <typename Alloc, typename Mutex>
+template <typename ToProc>
+bool basic_otp_node<Alloc, Mutex>::
 send(const atom& a_to_node, ToProc a_to, const transport_msg<Alloc>& a_msg)
 {
     if (a_to_node == nodename()) {
         basic_otp_mailbox<Alloc, Mutex>* mbox = m_mailboxes.get(a_to);
         if (!mbox)
             throw err_no_process(eterm<Alloc>::cast(a_to).to_string());
-        mbox->deliver(a_msg);
-    } else {
-        connection_t& l_con = connection(a_to_node);
-        l_con.send(a_msg);
+        return mbox->deliver(a_msg);
     }
+    connection_guard guard(*this);
+    connection_t& l_con = connection(a_to_node);
+    l_con.send(a_msg);
+    return true;
 }
 
 template <typename Alloc, typename Mutex>
-void inline basic_otp_node<Alloc, Mutex>::
+template <typename ToProc>
+bool basic_otp_node<Alloc, Mutex>::
+send_local(const eterm<Alloc>& a_from, ToProc a_to, eterm<Alloc>&& a_msg)
+{
+    basic_otp_mailbox<Alloc, Mutex>* mbox = m_mailboxes.get(a_to);
+    if (unlikely(!mbox))
+        throw err_no_process(eterm<Alloc>::cast(a_to).to_string());
+    transport_msg<Alloc>* tm = m_msg_pool->acquire();
+    tm->set_local(std::is_same<ToProc, atom>::value ? ERL_REG_SEND : ERL_SEND,
+                  a_from, std::move(a_msg));
+    return mbox->deliver(tm);
+}
+
+template <typename Alloc, typename Mutex>
+bool inline basic_otp_node<Alloc, Mutex>::
 send(const epid<Alloc>& a_to, const eterm<Alloc>& a_msg)
 {
+    if (a_to.node() == nodename() && likely(!trace<Alloc>::tracer(marshal::TRACE_GET))) {
+        return send_local(eterm<Alloc>(), a_to, eterm<Alloc>(a_msg));
+    }
     transport_msg<Alloc> tm;
     tm.set_send(a_to, a_msg, m_allocator);
-    send(a_to.node(), a_to, tm);
+    return send(a_to.node(), a_to, tm);
 }
 
 template <typename Alloc, typename Mutex>
-void inline basic_otp_node<Alloc, Mutex>::
+bool inline basic_otp_node<Alloc, Mutex>::
+send(const epid<Alloc>& a_from, const epid<Alloc>& a_to, const eterm<Alloc>& a_msg)
+{
+    if (a_to.node() == nodename() && likely(!trace<Alloc>::tracer(marshal::TRACE_GET))) {
+        return send_local(eterm<Alloc>(a_from), a_to, eterm<Alloc>(a_msg));
+    }
+    return send(a_to, a_msg);
+}
+
+template <typename Alloc, typename Mutex>
+bool inline basic_otp_node<Alloc, Mutex>::
 send(const atom& a_node, const epid<Alloc>& a_to, const eterm<Alloc>& a_msg)
 {
+    if (a_node == nodename() && likely(!trace<Alloc>::tracer(marshal::TRACE_GET))) {
+        return send_local(eterm<Alloc>(), a_to, eterm<Alloc>(a_msg));
+    }
     transport_msg<Alloc> tm;
     tm.set_send(a_to, a_msg, m_allocator);
-    send(a_node, a_to, tm);
+    return send(a_node, a_to, tm);
 }
 
 template <typename Alloc, typename Mutex>
-void inline basic_otp_node<Alloc, Mutex>::
+bool inline basic_otp_node<Alloc, Mutex>::
 send(const epid<Alloc>& a_from, const atom& a_to, const eterm<Alloc>& a_msg)
 {
+    if (likely(!trace<Alloc>::tracer(marshal::TRACE_GET))) {
+        return send_local(eterm<Alloc>(a_from), a_to, eterm<Alloc>(a_msg));
+    }
     transport_msg<Alloc> tm;
     tm.set_reg_send(a_from, a_to, a_msg, m_allocator);
-    send(nodename(), a_to, tm);
+    return send(nodename(), a_to, tm);
 }
 
 template <typename Alloc, typename Mutex>
-void inline basic_otp_node<Alloc, Mutex>::
+bool inline basic_otp_node<Alloc, Mutex>::
 send(const epid<Alloc>& a_from, const atom& a_to_node, const atom& a_to, const eterm<Alloc>& a_msg)
 {
+    if (a_to_node == nodename() && likely(!trace<Alloc>::tracer(marshal::TRACE_GET))) {
+        return send_local(eterm<Alloc>(a_from), a_to, eterm<Alloc>(a_msg));
+    }
     transport_msg<Alloc> tm;
     tm.set_reg_send(a_from, a_to, a_msg, m_allocator);
-    send(a_to_node, a_to, tm);
+    return send(a_to_node, a_to, tm);
 }
 
 template <typename Alloc, typename Mutex>
@@ -0,0 +1,259 @@
+//----------------------------------------------------------------------------
+/// \file  basic_otp_port.hpp
+//----------------------------------------------------------------------------
+/// \brief Endpoint of a C++ program run as an Erlang port.
+//----------------------------------------------------------------------------
+// Copyright (c) 2010 Serge Aleynikov <saleyn@gmail.com>
+// Created: 2021-11-18
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+
+#ifndef _EIXX_BASIC_OTP_PORT_HPP_
+#define _EIXX_BASIC_OTP_PORT_HPP_
+
+#include <iostream>
+#include <boost/function.hpp>
+#include <eixx/util/async_queue.hpp>
+#include <eixx/connect/transport_otp_connection.hpp>
+#include <eixx/connect/transport_otp_connection_port.hpp>
+
+namespace eixx {
+namespace connect {
+
+/**
+ * Exchanges terms with the Erlang process owning the port when the
+ * program is run with open_port({spawn, Cmd}, [{packet, 4}, binary]).
+ *
+ * The port is used like a mailbox: received terms are queued and
+ * dequeued with the receive() family of functions.  Terms are sent to
+ * the owner with send(), which encodes them into the output buffer of
+ * the connection like messages sent to other nodes.
+ *
+ * \code
+ *   boost::asio::io_service svc;
+ *   otp_port port(svc);
+ *   port.open();
+ *   port.async_receive([](otp_port& p, transport_msg*& a_msg) {
+ *       if (a_msg) p.send(a_msg->msg());
+ *       return true;
+ *   }, std::chrono::milliseconds(-1), -1);
+ *   svc.run();
+ * \endcode
+ */
+template <typename Alloc>
+class basic_otp_port : private boost::noncopyable {
+public:
+    typedef basic_otp_port<Alloc>                           self;
+    typedef connection<self, Alloc>                         connection_type;
+    typedef util::async_queue<transport_msg<Alloc>*, Alloc> queue_type;
+
+private:
+    boost::asio::io_service&                    m_io_service;
+    typename connection_type::pointer           m_transport;
+    boost::shared_ptr<queue_type>               m_queue;
+    Alloc                                       m_allocator;
+    verbose_type                                m_verboseness;
+    write_policy                                m_wr_policy;
+    read_policy                                 m_rd_policy;
+    bool                                        m_connected;
+    typename queue_type::async_handler          m_on_receive;
+
+public:
+    /// @param a_batch_size is the max number of terms passed to the
+    ///        handler of async_receive() in one turn of the service.
+    basic_otp_port(boost::asio::io_service& a_svc, int a_batch_size = 255,
+                   const Alloc& a_alloc = Alloc())
+        : m_io_service(a_svc)
+        , m_queue(new queue_type(a_svc, a_batch_size, a_alloc))
+        , m_allocator(a_alloc)
+        , m_verboseness(VERBOSE_NONE)
+        , m_connected(false)
+    {}
+
+    ~basic_otp_port() { close(); }
+
+    /// Start exchanging terms over descriptors 0 and 1, or over 3 and 4
+    /// if \a a_use_stdio is false (the nouse_stdio option of open_port/2).
+    void open(bool a_use_stdio = true) {
+        if (a_use_stdio) open(0, 1);
+        else             open(3, 4);
+    }
+
+    /// Start exchanging terms over descriptors \a a_in and \a a_out.  The
+    /// port takes ownership of the descriptors.
+    void open(int a_in, int a_out) {
+        close();
+        m_transport.reset(
+            new port_connection<self, Alloc>(m_io_service, this, a_in, a_out, m_allocator));
+        auto t = m_transport;
+        m_io_service.post([t]() { t->start(); });
+    }
+
+    /// Close the descriptors of the port.
+    void close() {
+        if (m_transport)
+            m_transport->stop();
+        m_transport.reset();
+        m_queue->reset();
+    }
+
+    boost::asio::io_service&    io_service()        { return m_io_service; }
+    bool                        connected()   const { return m_connected; }
+    connection_type*            transport()         { return m_transport.get(); }
+
+    verbose_type                verbose()     const { return m_verboseness; }
+    void                        verbose(verbose_type a_type) { m_verboseness = a_type; }
+
+    /// Write policy of the port.  Must be set before open().
+    const write_policy&         wr_policy()   const { return m_wr_policy; }
+    void wr_policy(const write_policy& a_policy)    { m_wr_policy = a_policy; }
+
+    /// Read buffer policy of the port.  Must be set before open().
+    const read_policy&          rd_policy()   const { return m_rd_policy; }
+    void rd_policy(const read_policy& a_policy)     { m_rd_policy = a_policy; }
+
+    /// Send \a a_msg to the Erlang process owning the port.
+    /// @param a_flush if false, the term may be held according to the
+    ///                write policy to be written with other terms.
+    /// @throws err_connection if the port is not open.
+    void send(const eterm<Alloc>& a_msg, bool a_flush = false) {
+        if (!m_transport)
+            throw err_connection("Port not open");
+        m_transport->send_term(a_msg, a_flush);
+    }
+
+    /// Dequeue the next received term.  The call is non-blocking and
+    /// returns NULL if no terms are waiting.  The term is in the msg()
+    /// of the returned message, which is to be deleted by the caller.
+    transport_msg<Alloc>* receive() {
+        transport_msg<Alloc>* m;
+        return m_queue->dequeue(m) ? m : nullptr;
+    }
+
+    /**
+     * Call a handler on asynchronous delivery of terms.  The handler has
+     * the signature:
+     * \code
+     * bool handler(basic_otp_port<Alloc>& a_port, transport_msg<Alloc>*& a_msg);
+     * \endcode
+     * \a a_msg is NULL on timeout.  The handler returns false to stop
+     * receiving.  The message is deleted after the handler returns unless
+     * the handler sets \a a_msg to NULL.  The handler must not call
+     * async_receive(); use \a a_repeat_count to receive more terms.
+     *
+     * @param h is the handler to call upon arrival of a term
+     * @param a_timeout is the timeout interval to wait for a term (-1 = infinity)
+     * @param a_repeat_count is the number of terms to wait (-1 = infinite)
+     * @return true if the term was synchronously received
+     */
+    template <typename OnReceive>
+    bool async_receive(const OnReceive& h,
+                       std::chrono::milliseconds a_timeout = std::chrono::milliseconds(-1),
+                       int a_repeat_count = 0)
+    {
+        // The queue references the handler until it is called
+        m_on_receive =
+            [this, h](transport_msg<Alloc>*& a_msg, const boost::system::error_code& ec) {
+                if (ec) {
+                    transport_msg<Alloc>* p(nullptr);
+                    return h(*this, p);
+                }
+                bool res = h(*this, a_msg);
+                delete a_msg;
+                a_msg = nullptr;
+                return res;
+            };
+        return m_queue->async_dequeue(m_on_receive, a_timeout, a_repeat_count);
+    }
+
+    /// Cancel pending asynchronous receive operation.
+    void cancel_async_receive() { m_queue->cancel(); }
+
+    /// Callback invoked when the Erlang side closes the port.
+    boost::function<void (self&, const boost::system::error_code&)> on_close;
+
+    /// Callback invoked to report status.  If not assigned, the messages
+    /// are printed to stderr (stdout may be the port itself).
+    boost::function<void (self&, report_level, const std::string&)> on_status;
+
+    void report_status(report_level a_level, const std::string& s) {
+        static const char* s_levels[] = {"INFO", "WARN", "ERROR"};
+        if (on_status)
+            on_status(*this, a_level, s);
+        else
+            std::cerr << s_levels[a_level] << "| " << s << std::endl;
+    }
+
+    //------------------------------------------------------------------------
+    // Handler interface of the connection
+    //------------------------------------------------------------------------
+
+    boost::shared_ptr<util::buffer_pool<Alloc>> rd_pool()   const { return nullptr; }
+    boost::shared_ptr<transport_msg_pool<Alloc>> msg_pool() const { return nullptr; }
+    boost::asio::io_service*        decode_service()        const { return nullptr; }
+#ifdef EIXX_USE_IO_URING
+    boost::shared_ptr<uring_service> uring(boost::asio::io_service&) const { return nullptr; }
+#endif
+    boost::shared_ptr<busy_poller>  poller(boost::asio::io_service&) const { return nullptr; }
+    util::latency_histogram*        rd_latency()            const { return nullptr; }
+    epmd_cache*                     port_cache()            const { return nullptr; }
+
+    void on_connect(connection_type*) { m_connected = true; }
+
+    void on_connect_failure(connection_type*, const std::string& a_error) {
+        report_status(REPORT_ERROR, "Failed to open port: " + a_error);
+    }
+
+    void on_disconnect(connection_type*, const boost::system::error_code& err) {
+        m_connected = false;
+        if (on_close)
+            on_close(*this, err);
+        else if (unlikely(verbose() > VERBOSE_NONE))
+            report_status(REPORT_INFO, "Port closed: " + err.message());
+    }
+
+    void on_error(connection_type*, const std::string& s) {
+        report_status(REPORT_ERROR, "Error in communication with port: " + s);
+    }
+
+    void on_message(connection_type*, const transport_msg<Alloc>& a_tm) {
+        std::unique_ptr<transport_msg<Alloc>> p(new transport_msg<Alloc>(a_tm));
+        if (m_queue->enqueue(p.get()))
+            p.release();
+        else
+            report_status(REPORT_ERROR, "Port queue is full, term dropped: " + a_tm.msg().to_string());
+    }
+
+    /// Takes ownership of the messages allocated by the connection.
+    void on_messages(connection_type*, std::vector<transport_msg<Alloc>*>& a_msgs) {
+        size_t n = m_queue->enqueue(a_msgs.begin(), a_msgs.end());
+        for (size_t i = n; i < a_msgs.size(); ++i) {
+            report_status(REPORT_ERROR, "Port queue is full, term dropped: "
+                                        + a_msgs[i]->msg().to_string());
+            delete a_msgs[i];
+        }
+    }
+};
+
+} // namespace connect
+} // namespace eixx
+
+#endif // _EIXX_BASIC_OTP_PORT_HPP_
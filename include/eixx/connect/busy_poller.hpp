@@ -0,0 +1,204 @@
+//----------------------------------------------------------------------------
+/// \file  busy_poller.hpp
+//----------------------------------------------------------------------------
+/// \brief Busy-polling I/O backend of connections.
+//----------------------------------------------------------------------------
+// Copyright (c) 2010 Serge Aleynikov <saleyn@gmail.com>
+// Created: 2021-11-16
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+#ifndef _EIXX_BUSY_POLLER_HPP_
+#define _EIXX_BUSY_POLLER_HPP_
+
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <sys/socket.h>
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace eixx {
+namespace connect {
+
+//----------------------------------------------------------------------------
+/// Policy of the busy-polling I/O backend.
+///
+/// The polling thread spins over the sockets of its connections and falls
+/// back to blocking in the io_service after finding no work for
+/// \a spin_us microseconds.  When \a so_busy_poll_us is non-zero, the
+/// SO_BUSY_POLL option of the sockets is set to this value, so that
+/// reads poll the device queue instead of waiting for an interrupt
+/// (raising it above the net.core.busy_read sysctl needs CAP_NET_ADMIN).
+//----------------------------------------------------------------------------
+struct busy_poll_policy {
+    unsigned spin_us;           ///< Idle time before blocking (0 - never block)
+    unsigned so_busy_poll_us;   ///< SO_BUSY_POLL value of sockets (0 - not set)
+
+    busy_poll_policy()
+        : spin_us(10000)
+        , so_busy_poll_us(50)
+    {}
+};
+
+/**
+ * Runs an io_service spinning over the sockets of the connections
+ * registered with add().  Each turn of the loop runs ready handlers of
+ * the io_service and calls poll() of every target, which reads and
+ * writes its socket without blocking.  After an idle period set by
+ * busy_poll_policy::spin_us every target is asked to wait() for its
+ * socket with the io_service's reactor, and the thread blocks until a
+ * handler is ready.
+ *
+ * All methods but run() must be called by the thread running the loop.
+ */
+class busy_poller : private boost::noncopyable {
+public:
+    /// A socket polled by the loop.
+    struct target {
+        virtual ~target() {}
+        /// Read and write the socket without blocking.
+        /// @return true if any data was transferred.
+        virtual bool poll() = 0;
+        /// Wait for the socket to become ready using the io_service.
+        virtual void wait() = 0;
+    };
+
+    busy_poller(boost::asio::io_service& a_svc, const busy_poll_policy& a_policy)
+        : m_io(a_svc), m_policy(a_policy)
+        , m_spins(0), m_blocks(0), m_removed(false), m_running(false)
+    {}
+
+    boost::asio::io_service&    io_service()    { return m_io; }
+    const busy_poll_policy&     policy() const  { return m_policy; }
+
+    /// Number of turns of the polling loop.
+    size_t spins()  const { return m_spins;  }
+    /// Number of times the loop blocked after an idle period.
+    size_t blocks() const { return m_blocks; }
+
+    /// Start polling socket \a a_fd.  \a a_owner is referenced until the
+    /// target is removed.
+    void add(target* a_target, int a_fd, const boost::shared_ptr<void>& a_owner) {
+#ifdef SO_BUSY_POLL
+        if (m_policy.so_busy_poll_us) {
+            int us = int(m_policy.so_busy_poll_us);
+            ::setsockopt(a_fd, SOL_SOCKET, SO_BUSY_POLL, &us, sizeof(us));
+        }
+#else
+        (void)a_fd;
+#endif
+        if (m_targets.empty())
+            m_work.reset(new boost::asio::io_service::work(m_io));
+        m_targets.push_back(entry{a_target, a_owner});
+    }
+
+    /// Stop polling \a a_target.  The reference to its owner is dropped
+    /// after the current turn of the loop.
+    void remove(target* a_target) {
+        for (auto& e : m_targets)
+            if (e.ptr == a_target) {
+                e.ptr     = nullptr;
+                m_removed = true;
+            }
+        if (!m_running)
+            compact();
+    }
+
+    /// Drop the references to the owners of all targets.  Called when the
+    /// loop is no longer run.
+    void shutdown() {
+        std::vector<entry> targets;
+        targets.swap(m_targets);
+        m_work.reset();
+    }
+
+    /// Run the loop until the io_service is stopped.
+    void run() {
+        typedef std::chrono::steady_clock clock;
+        auto spin  = std::chrono::microseconds(m_policy.spin_us);
+        auto last  = clock::now();
+
+        m_running = true;
+        while (!m_io.stopped()) {
+            m_spins++;
+            bool busy = m_io.poll() > 0;
+            // Targets added by handlers during the turn are polled next turn
+            for (size_t i = 0, n = m_targets.size(); i < n; ++i)
+                if (m_targets[i].ptr && m_targets[i].ptr->poll())
+                    busy = true;
+            if (m_removed)
+                compact();
+
+            if (busy || !m_policy.spin_us) {
+                last = clock::now();
+                continue;
+            }
+            if (clock::now() - last < spin)
+                continue;
+
+            // Back off: sleep in the reactor until a socket becomes ready
+            // or a handler is posted to the service
+            for (size_t i = 0, n = m_targets.size(); i < n; ++i)
+                if (m_targets[i].ptr)
+                    m_targets[i].ptr->wait();
+            m_blocks++;
+            m_io.run_one();
+            last = clock::now();
+        }
+        m_running = false;
+    }
+
+private:
+    struct entry {
+        target*                 ptr;
+        boost::shared_ptr<void> owner;
+    };
+
+    boost::asio::io_service&                        m_io;
+    busy_poll_policy                                m_policy;
+    std::vector<entry>                              m_targets;
+    std::unique_ptr<boost::asio::io_service::work>  m_work;   // Keeps run() going while polling
+    size_t                                          m_spins;
+    size_t                                          m_blocks;
+    bool                                            m_removed;
+    bool                                            m_running;
+
+    void compact() {
+        m_removed = false;
+        std::vector<entry> removed;
+        for (size_t i = 0; i < m_targets.size(); )
+            if (!m_targets[i].ptr) {
+                removed.push_back(std::move(m_targets[i]));
+                m_targets.erase(m_targets.begin() + long(i));
+            } else
+                ++i;
+        if (m_targets.empty())
+            m_work.reset();
+        // Owners may be destroyed here
+        removed.clear();
+    }
+};
+
+} // namespace connect
+} // namespace eixx
+
+#endif // _EIXX_BUSY_POLLER_HPP_
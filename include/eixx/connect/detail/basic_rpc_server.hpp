@@ -110,7 +110,7 @@ public:
         if (a_msg.type() != TUPLE)
             return eterm<Alloc>();
         varbind<Alloc> binding;
-        return a_msg.match(s_pattern, &binding) ? binding[T] : eterm<Alloc>();
+        return a_msg.match(s_pattern, &binding) ? binding[T.name()] : eterm<Alloc>();
     }
 
     bool operator() (const eterm<Alloc>& /*a_pat*/,
@@ -0,0 +1,170 @@
+//----------------------------------------------------------------------------
+/// \file  epmd_cache.hpp
+//----------------------------------------------------------------------------
+/// \brief Cache of node ports looked up in epmd.
+//----------------------------------------------------------------------------
+// Copyright (c) 2010 Serge Aleynikov <saleyn@gmail.com>
+// Created: 2021-11-19
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+#ifndef _EIXX_EPMD_CACHE_HPP_
+#define _EIXX_EPMD_CACHE_HPP_
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+#include <eixx/marshal/atom.hpp>
+
+namespace eixx {
+namespace connect {
+
+/**
+ * Addresses of remote nodes shared by the connections of a node, so that
+ * reconnecting to a node doesn't need a round trip to its epmd.
+ *
+ * A lookup in epmd is cached for ttl() and dropped when connecting to
+ * the node at the cached address fails.  Nodes with a static port
+ * (see add_static()) are never looked up in epmd, only their hosts are
+ * resolved, and the resolved addresses are cached for ttl().
+ *
+ * The cache is used by the threads of all connections of the node.
+ */
+class epmd_cache : private boost::noncopyable {
+public:
+    typedef boost::asio::ip::tcp::endpoint endpoint;
+
+    /// Result of a lookup.
+    struct entry {
+        std::vector<endpoint> endpoints;    ///< Addresses of the node (empty - resolve its host)
+        uint16_t              port;         ///< Port of the node
+        uint16_t              dist_version; ///< Highest distribution version of the node
+
+        entry() : port(0), dist_version(0) {}
+    };
+
+    /// @param a_ttl is the time epmd lookups are cached (0 - not cached).
+    explicit epmd_cache(std::chrono::milliseconds a_ttl = std::chrono::seconds(60))
+        : m_ttl(a_ttl)
+    {}
+
+    std::chrono::milliseconds ttl() const { return m_ttl; }
+    void ttl(std::chrono::milliseconds a_ttl) { m_ttl = a_ttl; }
+
+    /// Connect to \a a_node at \a a_port bypassing epmd.
+    /// @param a_version is the highest distribution version of the node
+    ///        (5 for nodes older than OTP 23).
+    void add_static(atom a_node, uint16_t a_port, uint16_t a_version = 6) {
+        std::lock_guard<std::mutex> guard(m_lock);
+        record& r     = m_map[a_node.index()];
+        r.e           = entry();
+        r.e.port      = a_port;
+        r.e.dist_version = a_version;
+        r.is_static   = true;
+    }
+
+    /// Look up the port of \a a_node in epmd again.
+    void remove_static(atom a_node) {
+        std::lock_guard<std::mutex> guard(m_lock);
+        auto it = m_map.find(a_node.index());
+        if (it != m_map.end() && it->second.is_static)
+            m_map.erase(it);
+    }
+
+    /// Find \a a_node in the cache.
+    /// @return false if the node is to be looked up in epmd.
+    bool lookup(atom a_node, entry& a_entry) {
+        std::lock_guard<std::mutex> guard(m_lock);
+        auto it = m_map.find(a_node.index());
+        if (it == m_map.end())
+            return false;
+        record& r = it->second;
+        if (!r.e.endpoints.empty() && r.expires <= clock::now()) {
+            if (!r.is_static) {
+                m_map.erase(it);
+                return false;
+            }
+            r.e.endpoints.clear();
+        }
+        a_entry = r.e;
+        return true;
+    }
+
+    /// Remember that \a a_node is reachable at \a a_endpoints.  The port
+    /// of a node with a static port is not changed.
+    void store(atom a_node, const std::vector<endpoint>& a_endpoints, uint16_t a_version) {
+        if (m_ttl.count() <= 0 || a_endpoints.empty())
+            return;
+        std::lock_guard<std::mutex> guard(m_lock);
+        record& r = m_map[a_node.index()];
+        r.e.endpoints = a_endpoints;
+        if (!r.is_static) {
+            r.e.port         = a_endpoints.front().port();
+            r.e.dist_version = a_version;
+        }
+        r.expires = clock::now() + m_ttl;
+    }
+
+    /// Forget the addresses of \a a_node after failing to connect to it.
+    void invalidate(atom a_node) {
+        std::lock_guard<std::mutex> guard(m_lock);
+        auto it = m_map.find(a_node.index());
+        if (it == m_map.end())
+            return;
+        if (it->second.is_static)
+            it->second.e.endpoints.clear();
+        else
+            m_map.erase(it);
+    }
+
+    /// Forget the addresses of all nodes.  Static ports are kept.
+    void clear() {
+        std::lock_guard<std::mutex> guard(m_lock);
+        for (auto it = m_map.begin(); it != m_map.end();)
+            if (it->second.is_static) {
+                it->second.e.endpoints.clear();
+                ++it;
+            } else
+                it = m_map.erase(it);
+    }
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    struct record {
+        entry               e;
+        clock::time_point   expires;
+        bool                is_static;
+
+        record() : is_static(false) {}
+    };
+
+    std::mutex                              m_lock;
+    std::chrono::milliseconds               m_ttl;
+    std::unordered_map<uint32_t, record>    m_map;
+};
+
+} // namespace connect
+} // namespace eixx
+
+#endif // _EIXX_EPMD_CACHE_HPP_
@@ -46,6 +46,10 @@ using eixx::marshal::trace;
 /// Erlang distributed transport messages contain message type,
 /// control message with message routing and other details, and 
 /// optional user message for send and reg_send message types.
+///
+/// Messages sent between mailboxes of the same node are local envelopes
+/// (see set_local()) that carry the type, the sender and the payload
+/// without a control message.
 template <typename Alloc>
 class transport_msg {
 public:
@@ -76,27 +80,54 @@ private:
     // Note that the m_type is mutable so that we can call set_error_flag() on
     // constant objects.
     mutable transport_msg_type  m_type;
+    bool                        m_local;    // Local envelope without m_cntrl
     tuple<Alloc>                m_cntrl;
     eterm<Alloc>                m_msg;
+    eterm<Alloc>                m_from;     // Sender of a local envelope
 
 public:
-    transport_msg() : m_type(UNDEFINED) {}
+    transport_msg() : m_type(UNDEFINED), m_local(false) {}
 
     transport_msg(int a_msgtype, const tuple<Alloc>& a_cntrl, const eterm<Alloc>* a_msg = NULL)
-        : m_type(1 << a_msgtype), m_cntrl(a_cntrl)
+        : m_type(1 << a_msgtype), m_local(false), m_cntrl(a_cntrl)
     {
         if (a_msg)
             new (&m_msg) eterm<Alloc>(*a_msg);
     }
 
     transport_msg(const transport_msg& rhs)
-        : m_type(rhs.m_type), m_cntrl(rhs.m_cntrl), m_msg(rhs.m_msg)
+        : m_type(rhs.m_type), m_local(rhs.m_local), m_cntrl(rhs.m_cntrl)
+        , m_msg(rhs.m_msg), m_from(rhs.m_from)
     {}
 
     transport_msg(transport_msg&& rhs)
-        : m_type(rhs.m_type), m_cntrl(std::move(rhs.m_cntrl)), m_msg(std::move(rhs.m_msg))
+        : m_type(rhs.m_type), m_local(rhs.m_local), m_cntrl(std::move(rhs.m_cntrl))
+        , m_msg(std::move(rhs.m_msg)), m_from(std::move(rhs.m_from))
     {
-        rhs.m_type = UNDEFINED;
+        rhs.m_type  = UNDEFINED;
+        rhs.m_local = false;
+    }
+
+    transport_msg& operator= (const transport_msg& rhs) {
+        m_type  = rhs.m_type;
+        m_local = rhs.m_local;
+        m_cntrl = rhs.m_cntrl;
+        m_msg   = rhs.m_msg;
+        m_from  = rhs.m_from;
+        return *this;
+    }
+
+    transport_msg& operator= (transport_msg&& rhs) {
+        if (this != &rhs) {
+            m_type      = rhs.m_type;
+            m_local     = rhs.m_local;
+            m_cntrl     = std::move(rhs.m_cntrl);
+            m_msg       = std::move(rhs.m_msg);
+            m_from      = std::move(rhs.m_from);
+            rhs.m_type  = UNDEFINED;
+            rhs.m_local = false;
+        }
+        return *this;
     }
 
     /// Return a string representation of the transport message type.
@@ -105,11 +136,15 @@ public:
     /// Transport message type
     transport_msg_type  type()      const { return m_type; }
     int                 to_type()   const { return m_type == UNDEFINED ? 0 : bit_scan_forward(m_type); }
+    /// Control message (empty for a local envelope).
     const tuple<Alloc>& cntrl()     const { return m_cntrl;}
     const eterm<Alloc>& msg()       const { return m_msg;  }
     /// Returns true when the transport message contains message payload
     /// associated with SEND or REG_SEND message type.
     bool                has_msg()   const { return m_msg.type() != eixx::UNDEFINED; }
+    /// Returns true for a message sent by a mailbox of this node, which
+    /// has no control message (see set_local()).
+    bool                is_local()  const { return m_local; }
 
     /// Indicates that there was an error processing this message
     bool  has_error()               const { return (m_type & EXCEPTION) == EXCEPTION; }
@@ -123,6 +158,11 @@ public:
     /// usually a pid, except for MONITOR_P_EXIT message type for which
     /// the sender can be either pid or atom name.
     const eterm<Alloc>& sender() const {
+        if (m_local) {
+            if (unlikely(m_from.type() == eixx::UNDEFINED))
+                throw err_wrong_type(m_type, "transport_msg.from()");
+            return m_from;
+        }
         switch (m_type) {
             case REG_SEND:
             case LINK:
@@ -151,8 +191,11 @@ public:
 
     /// Return the term representing the message sender. The sender is
     /// usually a pid, except for MONITOR_P|DEMONITOR_P message type for which 
-    /// the sender can be either pid or atom name.
+    /// the sender can be either pid or atom name.  A local envelope has no
+    /// recipient.
     const eterm<Alloc>& recipient() const {
+        if (unlikely(m_local))
+            throw err_wrong_type(m_type, "transport_msg.to() of a local message");
         switch (m_type) {
             case REG_SEND:
                 return m_cntrl[3];
@@ -228,13 +271,45 @@ public:
     /// Initialize the object with given components.
     void set(int a_msgtype, const tuple<Alloc>& a_cntrl, const eterm<Alloc>* a_msg = NULL) {
         m_type = static_cast<transport_msg_type>(1 << a_msgtype);
+        m_local = false;
         m_cntrl = a_cntrl;
+        m_from.clear();
         if (a_msg)
             m_msg = *a_msg;
         else
             m_msg.clear();
     }
 
+    /// Initialize the object taking over the given components.
+    void set(int a_msgtype, tuple<Alloc>&& a_cntrl, eterm<Alloc>&& a_msg) {
+        m_type  = static_cast<transport_msg_type>(1 << a_msgtype);
+        m_local = false;
+        m_cntrl = std::move(a_cntrl);
+        m_msg   = std::move(a_msg);
+        m_from.clear();
+    }
+
+    /// Initialize a local envelope of a message passed between mailboxes
+    /// of the same node.  Only the message type (ERL_SEND or ERL_REG_SEND),
+    /// the sender (undefined if unknown) and the payload are kept, no
+    /// control message is built.
+    void set_local(int a_msgtype, const eterm<Alloc>& a_from, eterm<Alloc>&& a_msg) {
+        m_type  = static_cast<transport_msg_type>(1 << a_msgtype);
+        m_local = true;
+        m_cntrl = tuple<Alloc>();
+        m_msg   = std::move(a_msg);
+        m_from  = a_from;
+    }
+
+    /// Release the control message and the payload.
+    void clear() {
+        m_type  = UNDEFINED;
+        m_local = false;
+        m_cntrl = tuple<Alloc>();
+        m_msg.clear();
+        m_from.clear();
+    }
+
     /// Set the current message to represent a SEND message containing \a a_msg to
     /// be sent to \a a_to pid.
     void set_send(const epid<Alloc>& a_to, const eterm<Alloc>& a_msg,
@@ -391,7 +466,11 @@ public:
 
     std::ostream& dump(std::ostream& out) const {
         out << "#DistMsg{" << (has_error() ? "has_error, " : "")
-            << "type=" << type_string() << ", cntrl=" << cntrl();
+            << "type=" << type_string();
+        if (m_local)
+            out << ", local, from=" << m_from.to_string();
+        else
+            out << ", cntrl=" << cntrl();
         if (has_msg())
             out << ", msg=" << msg().to_string();
         return out << '}';
@@ -0,0 +1,100 @@
+//----------------------------------------------------------------------------
+/// \file  transport_msg_pool.hpp
+//----------------------------------------------------------------------------
+/// \brief Pool of transport messages reused by delivery to mailboxes.
+//----------------------------------------------------------------------------
+// Copyright (c) 2010 Serge Aleynikov <saleyn@gmail.com>
+// Created: 2021-11-22
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+#ifndef _EIXX_TRANSPORT_MSG_POOL_HPP_
+#define _EIXX_TRANSPORT_MSG_POOL_HPP_
+
+#include <atomic>
+#include <boost/noncopyable.hpp>
+#include <eixx/connect/transport_msg.hpp>
+#include <eixx/util/bounded_queue.hpp>
+
+namespace eixx {
+namespace connect {
+
+/**
+ * Pool of transport messages shared by the connections and the mailboxes
+ * of a node.  A connection decodes into a message obtained from acquire(),
+ * the message is passed by pointer to the mailbox queue, and the mailbox
+ * returns it with release() once the receiver is done with it.
+ *
+ * Up to \a a_capacity released messages are kept for reuse, the rest are
+ * deleted.  A released message drops its terms, so idle messages don't
+ * hold on to decoded buffers.  Messages are allocated with \c new, so a
+ * message taken out of a mailbox may also be deleted by the user.
+ * acquire() and release() may be called concurrently from any thread.
+ */
+template <typename Alloc>
+class transport_msg_pool : private boost::noncopyable {
+    util::bounded_queue<transport_msg<Alloc>*>  m_free;
+    std::atomic<size_t>                         m_hits;
+    std::atomic<size_t>                         m_misses;
+
+public:
+    explicit transport_msg_pool(size_t a_capacity = 4096)
+        : m_free(a_capacity), m_hits(0), m_misses(0)
+    {}
+
+    ~transport_msg_pool() {
+        transport_msg<Alloc>* p;
+        while (m_free.try_pop(p))
+            delete p;
+    }
+
+    size_t capacity() const { return m_free.capacity(); }
+    /// Approximate number of idle messages in the pool.
+    size_t idle()     const { return m_free.size(); }
+    /// Number of acquire() calls satisfied by the pool.
+    size_t hits()     const { return m_hits.load(std::memory_order_relaxed); }
+    /// Number of acquire() calls that allocated a new message.
+    size_t misses()   const { return m_misses.load(std::memory_order_relaxed); }
+
+    /// Get an empty message.
+    transport_msg<Alloc>* acquire() {
+        transport_msg<Alloc>* p;
+        if (m_free.try_pop(p)) {
+            m_hits.fetch_add(1, std::memory_order_relaxed);
+            return p;
+        }
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        return new transport_msg<Alloc>();
+    }
+
+    /// Return a message to the pool.  The message is cleared.
+    void release(transport_msg<Alloc>* a_msg) {
+        if (!a_msg)
+            return;
+        a_msg->clear();
+        if (!m_free.try_push(a_msg))
+            delete a_msg;
+    }
+};
+
+} // namespace connect
+} // namespace eixx
+
+#endif // _EIXX_TRANSPORT_MSG_POOL_HPP_
@@ -30,15 +30,36 @@ limitations under the License.
 #define _EIXX_TRANSPORT_OTP_CONNECTION_HPP_
 
 #include <memory>
+#include <atomic>
+#include <thread>
+#include <climits>
+#include <map>
+#include <mutex>
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#endif
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/algorithm/string.hpp>
 #include <eixx/util/common.hpp>
+#include <eixx/util/slab_buffer.hpp>
+#include <eixx/util/bounded_queue.hpp>
+#include <eixx/util/buffer_pool.hpp>
+#include <eixx/util/latency_histogram.hpp>
 #include <eixx/util/string_util.hpp>
 #include <eixx/connect/verbose.hpp>
 #include <eixx/marshal/string.hpp>
+#include <eixx/marshal/gather.hpp>
+#include <eixx/connect/busy_poller.hpp>
+#include <eixx/connect/transport_msg_pool.hpp>
+#ifdef EIXX_USE_IO_URING
+#include <eixx/connect/uring_service.hpp>
+#endif
 
 #ifdef HAVE_EI_EPMD
 extern "C" {
@@ -56,6 +77,9 @@ extern "C" {
 #define EPMDBUF                      512
 #define EI_EPMD_PORT2_REQ            122
 #define EI_EPMD_PORT2_RESP           119
+#define EI_EPMD_ALIVE2_REQ           120
+#define EI_EPMD_ALIVE2_RESP          121
+#define EI_EPMD_ALIVE2_X_RESP        118
 #define EI_DIST_5                    5 /* OTP R4 - 22 */
 #define EI_DIST_6                    6 /* OTP 23 and later */
 #define EI_DIST_LOW                  EI_DIST_5
@@ -95,11 +119,18 @@ namespace connect {
 namespace posix = boost::asio::posix;
 
 /// Types of connections supported by this class.
-enum connection_type { UNDEFINED, TCP, UDS };
+enum connection_type { UNDEFINED, TCP, UDS, SHM, PORT };
 
 /// Convert connection type to string.
 const char* connection_type_to_str(connection_type a_type);
 
+/// I/O backend of connections.
+enum io_backend {
+    IO_BACKEND_ASIO,        ///< Boost.Asio reactor
+    IO_BACKEND_URING,       ///< Linux io_uring (requires EIXX_USE_IO_URING)
+    IO_BACKEND_BUSY_POLL    ///< Sockets are polled by a spinning thread
+};
+
 //------------------------------------------------------------------------------
 // capability flags supported by this class
 //------------------------------------------------------------------------------
@@ -128,6 +159,135 @@ inline constexpr uint64_t LOCAL_FLAGS = (
 #endif
                         );
 
+//----------------------------------------------------------------------------
+/// Outbound write coalescing policy of a connection.
+///
+/// Outgoing messages are encoded into a per-connection slab of
+/// \a slab_chunks chunks of \a slab_chunk_size bytes, so that messages
+/// sent back to back are adjacent in memory and a burst of small sends
+/// results in a single socket write.  Pending data is flushed when any of
+/// the \a flush_bytes, \a flush_count or \a flush_delay_us limits is
+/// reached, or when connection::flush() is called.
+///
+/// Encoded messages are handed over to the I/O thread through a lock-free
+/// queue of \a submit_queue_size entries.  A producer finding the queue
+/// full waits for the I/O thread to drain it.
+///
+/// The payload of binaries of at least \a gather_threshold bytes is not
+/// copied to the encode buffer, but written to the socket directly from
+/// the binary's memory.  On Linux, a batch containing a binary of at
+/// least \a zerocopy_threshold bytes is written with MSG_ZEROCOPY.
+///
+/// Connections of shm:// type exchange data through two rings of
+/// \a shm_ring_size bytes (a power of two) in shared memory.
+//----------------------------------------------------------------------------
+struct write_policy {
+    size_t   slab_chunk_size;       ///< Size of a chunk of the output slab
+    size_t   slab_chunks;           ///< Number of chunks in the output slab
+    size_t   submit_queue_size;     ///< Capacity of the queue of encoded messages
+    size_t   flush_bytes;           ///< Flush when this many bytes are pending
+    size_t   flush_count;           ///< Flush when this many messages are pending
+    size_t   gather_threshold;      ///< Write larger binaries by reference (0 - disable)
+    size_t   zerocopy_threshold;    ///< Use MSG_ZEROCOPY for larger binaries (0 - disable)
+    size_t   shm_ring_size;         ///< Size of each ring of shm:// connections
+    uint32_t flush_delay_us;        ///< Max time to hold pending data (0 - don't hold)
+    bool     no_delay;              ///< Set TCP_NODELAY socket option
+    bool     cork;                  ///< Cork the socket while writing a batch (TCP_CORK)
+
+    write_policy()
+        : slab_chunk_size(32*1024)
+        , slab_chunks(8)
+        , submit_queue_size(4096)
+        , flush_bytes(64*1024)
+        , flush_count(64)
+        , gather_threshold(64*1024)
+        , zerocopy_threshold(0)
+        , shm_ring_size(1024*1024)
+        , flush_delay_us(0)
+        , no_delay(true)
+        , cork(false)
+    {}
+};
+
+//----------------------------------------------------------------------------
+/// Management of the buffer used to read incoming data of a connection.
+///
+/// The read buffer has \a initial_size bytes in the steady state.  A
+/// packet that doesn't fit grows the buffer.  A buffer of at least
+/// \a large_threshold bytes is sized exactly for the packet being read
+/// and is released as soon as the packet is processed.  A smaller grown
+/// buffer returns to \a initial_size after \a shrink_after consecutive
+/// packets that fit in the steady-state buffer.
+///
+/// When \a release_idle is set, a connection that has no partially read
+/// data returns its buffer to a pool shared by all connections of the
+/// node, and takes a buffer from the pool when the socket becomes
+/// readable.  The pool keeps up to \a pool_size idle buffers.  This is
+/// off by default since every drained read then costs an extra readiness
+/// wait; enable it on nodes with many mostly idle connections.
+//----------------------------------------------------------------------------
+struct read_policy {
+    size_t   initial_size;          ///< Steady-state size of the read buffer
+    size_t   large_threshold;       ///< Read larger packets into a dedicated buffer
+    size_t   shrink_after;          ///< Small packets before a grown buffer shrinks
+    size_t   pool_size;             ///< Max number of idle buffers in the node's pool
+    bool     release_idle;          ///< Return the buffer to the pool while idle
+
+    read_policy()
+        : initial_size(16*1024)
+        , large_threshold(1024*1024)
+        , shrink_after(64)
+        , pool_size(256)
+        , release_idle(false)
+    {}
+};
+
+//----------------------------------------------------------------------------
+/// Memory used by a connection.
+//----------------------------------------------------------------------------
+struct memory_stats {
+    size_t   rd_buffer;             ///< Size of the read buffer (0 while idle)
+    size_t   rd_peak;               ///< Largest read buffer held by the connection
+    size_t   rd_grows;              ///< Times the read buffer was enlarged
+    size_t   rd_shrinks;            ///< Times the read buffer returned to steady size
+    size_t   rd_large;              ///< Packets read into a dedicated buffer
+    size_t   rd_idle_releases;      ///< Times the read buffer was returned to the pool
+    size_t   wr_slab;               ///< Capacity of the output slab
+    size_t   wr_slab_misses;        ///< Outgoing messages allocated outside of the slab
+    size_t   wr_pending;            ///< Bytes waiting to be written
+
+    memory_stats()
+        : rd_buffer(0), rd_peak(0), rd_grows(0), rd_shrinks(0), rd_large(0)
+        , rd_idle_releases(0), wr_slab(0), wr_slab_misses(0), wr_pending(0)
+    {}
+};
+
+//----------------------------------------------------------------------------
+/// An entry of the queues of outgoing data of a connection.
+//----------------------------------------------------------------------------
+struct out_buf {
+    enum release_type {
+          RELEASE_BUF       ///< Return the buffer to the slab or allocator
+        , RELEASE_NONE      ///< The memory is owned by another entry
+        , RELEASE_GATHER    ///< Release the gathered message in \a owner
+    };
+
+    const char*     data;
+    size_t          size;
+    void*           owner;
+    release_type    release;
+
+    out_buf() : data(NULL), size(0), owner(NULL), release(RELEASE_NONE) {}
+    out_buf(const char* a_data, size_t a_size,
+            release_type a_release = RELEASE_BUF, void* a_owner = NULL)
+        : data(a_data), size(a_size), owner(a_owner), release(a_release)
+    {}
+
+    operator boost::asio::const_buffer() const {
+        return boost::asio::const_buffer(data, size);
+    }
+};
+
 //----------------------------------------------------------------------------
 // Base connection class.
 //----------------------------------------------------------------------------
@@ -142,7 +302,6 @@ class connection
 {
 protected:
     static const size_t         s_header_size;
-    static const char           s_header_magic;
     static const eterm<Alloc>   s_null_cookie;
 
     boost::asio::io_service&    m_io_service;
@@ -161,18 +320,169 @@ protected:
     size_t                      m_in_msg_count;
     size_t                      m_out_msg_count;
 
-    std::vector<char, Alloc>    m_rd_buf;           /// buffer for incoming data
+    read_policy                 m_rd_policy;
+    boost::shared_ptr<util::buffer_pool<Alloc>>
+                                m_rd_pool;          /// Idle read buffers shared by the node
+    char*                       m_rd_buf;           /// buffer for incoming data
+    size_t                      m_rd_size;
     char*                       m_rd_ptr;
     char*                       m_rd_end;
+    size_t                      m_rd_small_count;   /// Consecutive packets that fit in
+                                                    /// the steady-state buffer
+    memory_stats                m_mem_stats;
+    util::latency_histogram*    m_rd_latency;       /// NULL - latency is not tracked
+    uint64_t                    m_rd_stamp;         /// Time of the last read
+    boost::shared_ptr<transport_msg_pool<Alloc>>
+                                m_msg_pool;         /// Idle messages shared by the node
+                                                    /// (NULL - messages are new'ed)
+    std::vector<transport_msg<Alloc>*>
+                                m_rd_msgs;          /// Messages decoded in a read cycle
+
+    /// Ordering of the batches handed to decode workers.
+    struct decode_state {
+        uint64_t                seq;        /// Number of the next batch sent to decoder
+        std::mutex              lock;
+        uint64_t                next;       /// Number of the next batch to deliver
+        bool                    delivering; /// A worker is delivering messages
+        std::map<uint64_t, std::pair<uint64_t, std::vector<transport_msg<Alloc>*>>>
+                                ready;      /// Decoded batches (read time, messages)
+                                            /// waiting for their turn
+
+        decode_state() : seq(0), next(0), delivering(false) {}
+    };
+
+    boost::asio::io_service*    m_decoder;          /// Decode workers (NULL - decode inline)
+    std::unique_ptr<decode_state>
+                                m_dec;              /// Allocated iff m_decoder is set
 
-    std::deque<boost::asio::const_buffer> 
-                                m_out_msg_queue[2]; /// Queues of outgoing data
+    std::deque<out_buf>         m_out_msg_queue[2]; /// Queues of outgoing data
                                                     /// First queue is used for cacheing messages
                                                     /// while the second queue is used for 
                                                     /// writing them to socket.
     size_t                      m_available_queue;  /// Index of the queue used for cacheing
     bool                        m_is_writing;
-    bool                        m_connection_aborted;
+    std::atomic<bool>           m_connection_aborted;
+
+    write_policy                m_wr_policy;
+    util::slab_buffer<Alloc>    m_wr_slab;          /// Memory of outgoing messages
+    util::bounded_queue<out_buf, Alloc>
+                                m_wr_submit;        /// Messages encoded by producers
+    std::atomic<bool>           m_wr_scheduled;     /// Drain of m_wr_submit is posted
+    std::atomic<bool>           m_wr_flush_req;     /// Producer requested a flush
+    size_t                      m_wr_pending_bytes; /// Bytes in the available queue
+    size_t                      m_wr_pending_count; /// Messages in the available queue
+    boost::asio::steady_timer   m_wr_flush_timer;   /// Expires after flush_delay_us
+    bool                        m_wr_flush_armed;
+    bool                        m_wr_corked;
+
+    /// Message whose large binaries are written by reference from their blobs.
+    struct gather_msg {
+        char*                   data;   /// Encoded part of the message
+        size_t                  size;
+        size_t                  base;   /// Offset of the term in data
+        marshal::gather_list    list;
+
+        gather_msg(char* a_data, size_t a_size, size_t a_base, size_t a_threshold)
+            : data(a_data), size(a_size), base(a_base), list(a_threshold)
+        {}
+    };
+
+#if defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+    /// State of a socket written with MSG_ZEROCOPY.
+    struct zerocopy_state {
+        bool                    queued[2];  /// Queue has a payload for MSG_ZEROCOPY
+        std::vector<iovec>      iov;        /// Batch being written
+        size_t                  iov_pos;
+        uint32_t                seq;        /// Id of next MSG_ZEROCOPY send
+        uint32_t                sends;      /// MSG_ZEROCOPY sends of current batch
+        bool                    errq_armed;
+        /// Written batches held until the kernel reports completion (last send id, data)
+        std::deque<std::pair<uint32_t, std::deque<out_buf>>>
+                                pending;
+
+        zerocopy_state() : iov_pos(0), seq(0), sends(0), errq_armed(false) {
+            queued[0] = queued[1] = false;
+        }
+    };
+
+    std::unique_ptr<zerocopy_state>
+                                m_zc;               /// NULL - SO_ZEROCOPY is off
+#endif
+
+#ifdef EIXX_USE_IO_URING
+    /// Completion target of an io_uring operation.  Holds a reference to
+    /// the connection until the last completion of the operation.
+    struct uring_op : public uring_service::op {
+        connection* conn;
+        boost::shared_ptr<connection> self;
+        void (connection::*fun)(int, unsigned);
+
+        uring_op(connection* a_con, void (connection::*a_fun)(int, unsigned))
+            : conn(a_con), fun(a_fun)
+        {}
+
+        void complete(int a_res, unsigned a_flags) override {
+            boost::shared_ptr<connection> p(self);
+            if (!(a_flags & IORING_CQE_F_MORE))
+                self.reset();
+            (conn->*fun)(a_res, a_flags);
+        }
+        void abandon() override { self.reset(); }
+    };
+
+    /// State of a socket served by io_uring.
+    struct uring_state {
+        boost::shared_ptr<uring_service>
+                                ring;
+        uring_op                recv;
+        uring_op                send;
+        bool                    recv_armed;
+        bool                    send_fixed; /// Last send used the registered slab
+        bool                    fixed_ok;   /// Kernel supports sends from fixed buffers
+        int                     slot;       /// Slot of the slab in registered buffers
+        std::vector<iovec>      iov;        /// Batch being written
+        size_t                  iov_pos;
+        msghdr                  msg;
+
+        uring_state(const boost::shared_ptr<uring_service>& a_ring, connection* a_con)
+            : ring(a_ring)
+            , recv(a_con, &connection::handle_uring_recv)
+            , send(a_con, &connection::handle_uring_send)
+            , recv_armed(false), send_fixed(false), fixed_ok(true)
+            , slot(-1), iov_pos(0)
+        {}
+    };
+
+    std::unique_ptr<uring_state>
+                                m_uring;            /// NULL - use asio for socket I/O
+#endif
+
+    /// Target of the busy-polling loop.
+    struct poll_target : public busy_poller::target {
+        connection* conn;
+        explicit poll_target(connection* a_con) : conn(a_con) {}
+        bool poll() override { return conn->bp_poll(); }
+        void wait() override { conn->bp_wait(); }
+    };
+
+    /// State of a socket served by a busy-polling loop.
+    struct poll_state {
+        boost::shared_ptr<busy_poller>
+                                poller;
+        poll_target             target;
+        bool                    added;      /// Socket is polled by the poller
+        bool                    wait_rd;    /// Reactor waits for socket readability
+        bool                    wait_wr;
+        std::vector<iovec>      iov;        /// Unwritten part of the batch
+        size_t                  iov_pos;
+
+        poll_state(const boost::shared_ptr<busy_poller>& a_poller, connection* a_con)
+            : poller(a_poller), target(a_con)
+            , added(false), wait_rd(false), wait_wr(false), iov_pos(0)
+        {}
+    };
+
+    std::unique_ptr<poll_state> m_bp;               /// NULL - socket is not busy-polled
 
     /// Construct a connection
     connection(connection_type a_ct, boost::asio::io_service& a_svc, 
@@ -181,11 +491,34 @@ protected:
         , m_allocator(a_alloc)
         , m_got_header(false), m_packet_size(s_header_size)
         , m_in_msg_count(0), m_out_msg_count(0)
-        , m_rd_buf(16*1024), m_rd_ptr(&m_rd_buf[0]), m_rd_end(&m_rd_buf[0])
+        , m_rd_policy(a_h->rd_policy())
+        , m_rd_pool(a_h->rd_pool())
+        , m_rd_buf(NULL), m_rd_size(0), m_rd_ptr(NULL), m_rd_end(NULL)
+        , m_rd_small_count(0)
+        , m_rd_latency(a_h->rd_latency())
+        , m_rd_stamp(0)
+        , m_msg_pool(a_h->msg_pool())
+        , m_decoder(a_h->decode_service())
+        , m_dec(m_decoder ? new decode_state : NULL)
         , m_available_queue(0)
         , m_is_writing(false)
         , m_connection_aborted(false)
+        , m_wr_policy(a_h->wr_policy())
+        , m_wr_slab(m_wr_policy.slab_chunk_size, m_wr_policy.slab_chunks, a_alloc)
+        , m_wr_submit(m_wr_policy.submit_queue_size, a_alloc)
+        , m_wr_scheduled(false)
+        , m_wr_flush_req(false)
+        , m_wr_pending_bytes(0)
+        , m_wr_pending_count(0)
+        , m_wr_flush_timer(a_svc)
+        , m_wr_flush_armed(false)
+        , m_wr_corked(false)
+#ifdef EIXX_USE_IO_URING
+        , m_uring(make_uring(a_ct, a_svc, a_h))
+#endif
+        , m_bp(make_poll_state(a_svc, a_h))
     {
+        rd_resize(m_rd_policy.initial_size);
         if (unlikely(handler()->verbose() >= VERBOSE_TRACE)) {
             std::stringstream s;
             s << "Calling connection::connection(type=" << m_type << ')';
@@ -193,10 +526,165 @@ protected:
         }
     }
 
-    char* allocate(size_t a_sz)    {
-        char* p = m_allocator.allocate(a_sz+1);
-        *p++ = s_header_magic;
-        return p;
+    /// Allocate an output buffer from the slab.  Messages that don't fit
+    /// in the slab are allocated using the connection's allocator.
+    char* allocate(size_t a_sz) {
+        char* p = m_wr_slab.allocate(a_sz);
+        return likely(p != NULL) ? p : m_allocator.allocate(a_sz);
+    }
+
+    void deallocate(const char* a_buf, size_t a_sz) {
+        if (!m_wr_slab.release(a_buf, a_sz))
+            m_allocator.deallocate(const_cast<char*>(a_buf), a_sz);
+    }
+
+    /// Allocate a read buffer.  Buffers of the steady-state size come
+    /// from the node's pool.
+    char* rd_allocate(size_t a_sz) {
+        if (m_rd_pool && m_rd_pool->buffer_size() == a_sz)
+            return m_rd_pool->acquire();
+        return m_allocator.allocate(a_sz);
+    }
+
+    void rd_deallocate(char* a_buf, size_t a_sz) {
+        if (m_rd_pool && m_rd_pool->buffer_size() == a_sz)
+            m_rd_pool->release(a_buf);
+        else
+            m_allocator.deallocate(a_buf, a_sz);
+    }
+
+    /// Replace the read buffer with a buffer of \a a_sz bytes, moving
+    /// unprocessed data to its beginning.
+    void rd_resize(size_t a_sz) {
+        size_t len = rd_length();
+        BOOST_ASSERT(len <= a_sz);
+        char*  p   = rd_allocate(a_sz);
+        if (len)
+            memcpy(p, m_rd_ptr, len);
+        if (m_rd_buf)
+            rd_deallocate(m_rd_buf, m_rd_size);
+        m_rd_buf  = p;
+        m_rd_size = a_sz;
+        m_rd_ptr  = p;
+        m_rd_end  = p + len;
+        m_mem_stats.rd_buffer = a_sz;
+        if (a_sz > m_mem_stats.rd_peak)
+            m_mem_stats.rd_peak = a_sz;
+    }
+
+    /// Make sure that the read buffer can hold \a a_need bytes starting
+    /// at the current read position.
+    void rd_reserve(size_t a_need) {
+        if (likely(a_need <= static_cast<uintptr_t>(m_rd_buf + m_rd_size - m_rd_ptr)))
+            return;
+        if (a_need <= m_rd_size) {
+            size_t len = rd_length();
+            memmove(m_rd_buf, m_rd_ptr, len);
+            m_rd_ptr = m_rd_buf;
+            m_rd_end = m_rd_buf + len;
+            return;
+        }
+        // Large packets get a buffer of exactly their size, others grow
+        // the buffer to the next power of two.
+        size_t sz = m_rd_size;
+        if (a_need >= m_rd_policy.large_threshold) {
+            sz = a_need;
+            m_mem_stats.rd_large++;
+        } else
+            while (sz < a_need) sz <<= 1;
+        m_mem_stats.rd_grows++;
+        rd_resize(sz);
+    }
+
+    /// Return the read buffer to the pool while the connection is idle.
+    /// @return false if the buffer is not to be released.
+    bool rd_release_idle() {
+        if (!m_rd_policy.release_idle || !m_rd_pool || rd_length()
+                                      || m_rd_pool->buffer_size() != m_rd_size)
+            return false;
+        m_rd_pool->release(m_rd_buf);
+        m_rd_buf = m_rd_ptr = m_rd_end = NULL;
+        m_mem_stats.rd_buffer = 0;
+        m_mem_stats.rd_idle_releases++;
+        return true;
+    }
+
+    /// Issue a read of at least \a a_need bytes.  An idle connection waits
+    /// for the socket to become readable without holding a buffer.
+    void schedule_read(size_t a_need);
+
+    /// Called when the socket of an idle connection becomes readable.
+    void handle_read_ready(const boost::system::error_code& err);
+
+    /// Pass the packets in [a_begin, a_end) of the read buffer to the
+    /// decode workers.  The read buffer is handed over with the packets
+    /// and replaced by a new one.
+    void offload_packets(const char* a_begin, const char* a_end);
+
+    /// Decode the packets of a read batch \a a_seq and deliver them after
+    /// all preceding batches.  Called by a decode worker, so the handler's
+    /// on_messages() and on_error() and the latency histogram are invoked
+    /// on decode threads rather than on the connection's I/O thread.
+    /// Errors of delivery are reported through on_error().
+    void decode_packets(uint64_t a_seq, uint64_t a_stamp,
+                        const char* a_begin, const char* a_end);
+
+#ifdef EIXX_USE_IO_URING
+    /// Create the io_uring state of a socket served by the ring of \a a_svc
+    /// (NULL - asio is used).  Port descriptors need not be sockets and
+    /// shared memory rings aren't accessed with system calls.
+    uring_state* make_uring(connection_type a_ct, boost::asio::io_service& a_svc, Handler* a_h) {
+        if (a_ct == SHM || a_ct == PORT)
+            return NULL;
+        boost::shared_ptr<uring_service> r = a_h->uring(a_svc);
+        return r ? new uring_state(r, this) : NULL;
+    }
+    /// Start a multishot receive unless one is pending.
+    void uring_arm_recv();
+    /// Called for every completion of the multishot receive.  The data is
+    /// copied from the kernel-selected buffer to the read buffer and
+    /// framed by handle_read().
+    void handle_uring_recv(int a_res, unsigned a_flags);
+    /// Write the batch in the writing queue.
+    void uring_write();
+    void uring_send();
+    void handle_uring_send(int a_res, unsigned a_flags);
+    /// Cancel pending operations of the connection.
+    void uring_cancel();
+#endif
+
+    /// Create the busy-polling state of a connection whose socket is
+    /// polled by the poller of \a a_svc (NULL - the reactor is used).
+    poll_state* make_poll_state(boost::asio::io_service& a_svc, Handler* a_h) {
+        boost::shared_ptr<busy_poller> p = a_h->poller(a_svc);
+        return p ? new poll_state(p, this) : NULL;
+    }
+    /// Read and write the socket without blocking.  Called by the
+    /// busy-polling loop.
+    /// @return true if any data was transferred.
+    bool bp_poll();
+    /// Wait for the socket to become ready with the reactor.
+    void bp_wait();
+    /// Write the batch in the writing queue without blocking.  Data that
+    /// can't be written right away is written by bp_poll().
+    void bp_write();
+    bool bp_send();
+
+    /// Free the memory of a written queue entry.
+    void release(const out_buf& a_buf) {
+        switch (a_buf.release) {
+            case out_buf::RELEASE_BUF:
+                deallocate(a_buf.data, a_buf.size);
+                break;
+            case out_buf::RELEASE_GATHER: {
+                gather_msg* g = static_cast<gather_msg*>(a_buf.owner);
+                deallocate(g->data, g->size);
+                delete g;   // Drops the references to blobs
+                break;
+            }
+            default:
+                break;
+        }
     }
 
     /// Swap available and writing queue indexes.
@@ -208,27 +696,151 @@ protected:
 
     char*  rd_ptr()                 { return m_rd_ptr; }
     size_t rd_length()              { return static_cast<uintptr_t>(m_rd_end - m_rd_ptr); }
-    size_t rd_capacity()            { return m_rd_buf.capacity() - rd_length(); }
+    size_t rd_capacity()            { return static_cast<uintptr_t>(m_rd_buf + m_rd_size - m_rd_end); }
     /// Verboseness
     verbose_type verbose()    const { return m_handler->verbose(); }
 
-    void do_write(boost::asio::const_buffer& a_buf) {
-        m_out_msg_queue[available_queue()].push_back(a_buf);
-        do_write_internal();
+    /// Append the buffer to the available queue.  A buffer that is
+    /// adjacent to the preceding one in the slab is merged with it.
+    void enqueue_buffer(const out_buf& a_buf) {
+        auto&  q  = m_out_msg_queue[available_queue()];
+        size_t sz = a_buf.size;
+
+        if (unlikely(a_buf.release == out_buf::RELEASE_GATHER))
+            sz = enqueue_gathered(static_cast<gather_msg*>(a_buf.owner));
+        else if (!q.empty() && q.back().release == out_buf::RELEASE_BUF
+                            && q.back().data + q.back().size == a_buf.data
+                            && m_wr_slab.owns(a_buf.data)
+                            && m_wr_slab.owns(q.back().data))
+            q.back().size += sz;
+        else
+            q.push_back(a_buf);
+
+        m_wr_pending_bytes += sz;
+        m_wr_pending_count++;
+        m_out_msg_count++;
+    }
+
+    /// Write pending data now or arm the flush timer according to the
+    /// write policy.
+    void schedule_flush() {
+        if (m_is_writing)   // Pending data is written on completion of current write
+            return;
+
+        if (m_wr_policy.flush_delay_us == 0                 ||
+            m_wr_pending_bytes >= m_wr_policy.flush_bytes   ||
+            m_wr_pending_count >= m_wr_policy.flush_count)
+            do_write_internal();
+        else if (!m_wr_flush_armed) {
+            m_wr_flush_armed = true;
+            m_wr_flush_timer.expires_from_now(
+                std::chrono::microseconds(m_wr_policy.flush_delay_us));
+            auto pthis = this->shared_from_this();
+            m_wr_flush_timer.async_wait([pthis](const auto& ec) {
+                pthis->m_wr_flush_armed = false;
+                if (ec != boost::asio::error::operation_aborted)
+                    pthis->do_write_internal();
+            });
+        }
+    }
+
+    /// Append the gathered message to the available queue interleaving
+    /// its encoded parts with the payloads referenced from blobs.
+    /// @return total size of the message.
+    size_t enqueue_gathered(gather_msg* a_msg) {
+        size_t n   = available_queue();
+        auto&  q   = m_out_msg_queue[n];
+        size_t pos = 0;
+        for (auto& seg : a_msg->list.segments()) {
+            size_t off = a_msg->base + seg.offset;
+            q.push_back(out_buf(a_msg->data + pos, off - pos, out_buf::RELEASE_NONE));
+            q.push_back(out_buf(seg.data, seg.size, out_buf::RELEASE_NONE));
+#if defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+            if (m_zc && seg.size >= m_wr_policy.zerocopy_threshold)
+                m_zc->queued[n] = true;
+#endif
+            pos = off;
+        }
+        // The last entry releases the whole message when written
+        q.push_back(out_buf(a_msg->data + pos, a_msg->size - pos,
+                            out_buf::RELEASE_GATHER, a_msg));
+        return a_msg->size + a_msg->list.bytes();
+    }
+
+    void do_write(const out_buf& a_buf) {
+        enqueue_buffer(a_buf);
+        schedule_flush();
+    }
+
+    /// Hand over an encoded message to the I/O thread.  May be called by
+    /// any thread.  The I/O thread is only woken up if it is not already
+    /// scheduled to drain the submission queue.
+    void submit(const out_buf& a_buf, bool a_flush) {
+        if (unlikely(a_flush))
+            m_wr_flush_req.store(true, std::memory_order_relaxed);
+
+        while (unlikely(!m_wr_submit.try_push(a_buf))) {
+            // The queue is full - let the I/O thread catch up
+            if (m_io_service.get_executor().running_in_this_thread())
+                drain_submit_queue();
+            else
+                std::this_thread::yield();
+        }
+
+        // Pairs with the fence in drain_submit_queue()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (!m_wr_scheduled.load(std::memory_order_relaxed) &&
+            !m_wr_scheduled.exchange(true, std::memory_order_acq_rel))
+            post_drain();
+    }
+
+    void post_drain() {
+        auto pthis = this->shared_from_this();
+        m_io_service.post([pthis]() { pthis->drain_submit_queue(); });
+    }
+
+    /// Move all messages submitted by producers to the available queue.
+    void drain_submit_queue() {
+        m_wr_scheduled.store(false, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        out_buf b;
+        while (m_wr_submit.try_pop(b))
+            enqueue_buffer(b);
+
+        // A producer may be in the middle of a push - drain again later
+        if (unlikely(!m_wr_submit.empty()) &&
+            !m_wr_scheduled.exchange(true, std::memory_order_acq_rel))
+            post_drain();
+
+        if (m_wr_flush_req.exchange(false, std::memory_order_relaxed))
+            do_write_internal();
+        else
+            schedule_flush();
     }
 
     void do_write_internal() {
         if (!m_is_writing && !m_out_msg_queue[available_queue()].empty()) {
 #if BOOST_VERSION >= 106600
-            std::deque<boost::asio::const_buffer> buffers = m_out_msg_queue[available_queue()];
+            std::deque<out_buf> buffers = m_out_msg_queue[available_queue()];
 #else
             typedef boost::asio::detail::consuming_buffers<
                 boost::asio::const_buffer, 
-                std::deque<boost::asio::const_buffer> 
+                std::deque<out_buf> 
             > cb_t;
             cb_t buffers(m_out_msg_queue[available_queue()]);
 #endif            
             m_is_writing = true;
+            if (m_wr_flush_armed) {
+                boost::system::error_code ec;
+                m_wr_flush_timer.cancel(ec);
+            }
+            if (m_wr_policy.cork && !m_wr_corked &&
+                m_out_msg_queue[available_queue()].size() > 1)
+                m_wr_corked = set_cork(true);
+            m_wr_pending_bytes = 0;
+            m_wr_pending_count = 0;
             flip_queues(); // Work on the data accumulated in the available_queue.
             if (unlikely(verbose() >= VERBOSE_WIRE)) {
 #if BOOST_VERSION >= 106600
@@ -239,19 +851,70 @@ protected:
                 auto end = buffers.end();
 #endif
                 for(auto it=begin; it != end; ++it) {
+                    boost::asio::const_buffer b(*it);
                     std::stringstream s;
-                    s << "  async_write " << boost::asio::buffer_size(*it) << " bytes: " 
-                      << to_binary_string(boost::asio::buffer_cast<const char*>(*it),
-                                          boost::asio::buffer_size(*it));
+                    s << "  async_write " << boost::asio::buffer_size(b) << " bytes: " 
+                      << to_binary_string(boost::asio::buffer_cast<const char*>(b),
+                                          boost::asio::buffer_size(b));
                     m_handler->report_status(REPORT_INFO, s.str());
                 }
             }
+#ifdef EIXX_USE_IO_URING
+            if (m_uring) {
+                uring_write();
+                return;
+            }
+#endif
+            if (m_bp) {
+                bp_write();
+                return;
+            }
+#if defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+            if (m_zc && m_zc->queued[writing_queue()]) {
+                write_zerocopy();
+                return;
+            }
+#endif
             auto pthis = this->shared_from_this();
             async_write(buffers, boost::asio::transfer_all(), 
-                [pthis](auto& ec, std::size_t) { pthis->handle_write(ec); });
+                [pthis](const auto& ec, std::size_t) { pthis->handle_write(ec); });
         }
     }
 
+#if defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+    /// Allocate the MSG_ZEROCOPY state once SO_ZEROCOPY is set on the socket.
+    void enable_zerocopy() {
+        if (!m_zc)
+            m_zc.reset(new zerocopy_state);
+    }
+    void write_zerocopy();
+    void send_zerocopy();
+    void wait_zerocopy_completion();
+    void handle_zerocopy_completion();
+#endif
+
+    /// Enable/disable coalescing of partial frames by the kernel.
+    /// @return true if the socket option was set.
+    virtual bool set_cork(bool) { return false; }
+
+    /// Read available data without blocking.  Used by the busy-polling
+    /// backend.
+    /// @return number of bytes read, 0 on end of file, or -1 with errno set.
+    virtual ssize_t read_some(char* a_buf, size_t a_size) {
+        return ::recv(native_socket(), a_buf, a_size, MSG_DONTWAIT);
+    }
+
+    /// Write at most IOV_MAX buffers without blocking.  Used by the
+    /// busy-polling backend.
+    /// @return number of bytes written, or -1 with errno set.
+    virtual ssize_t write_some(const iovec* a_iov, size_t a_cnt) {
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov    = const_cast<iovec*>(a_iov);
+        msg.msg_iovlen = a_cnt;
+        return ::sendmsg(native_socket(), &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
+
     void handle_write(const boost::system::error_code& err);
     void handle_read (const boost::system::error_code& err, size_t bytes_transferred);
 
@@ -263,10 +926,36 @@ protected:
     /// @throws err_decode_exception
     int transport_msg_decode(const char *mbuf, size_t len, transport_msg<Alloc>& a_tm);
 
+    /// Decode a packet and add the message to m_rd_msgs.
     void process_message(const char* a_buf, size_t a_size);
 
+    /// Pass the messages decoded from one read to the handler at once.
+    /// The handler takes ownership of the messages, and \a a_msgs is
+    /// cleared.  \a a_stamp is the time the messages were read from the
+    /// socket.
+    void dispatch_messages(std::vector<transport_msg<Alloc>*>& a_msgs, uint64_t a_stamp);
+
+    transport_msg<Alloc>* msg_acquire() {
+        return m_msg_pool ? m_msg_pool->acquire() : new transport_msg<Alloc>();
+    }
+
+    void msg_release(transport_msg<Alloc>* a_msg) {
+        if (m_msg_pool) m_msg_pool->release(a_msg);
+        else            delete a_msg;
+    }
+
+    /// Reply to a TICK message from the remote node.  Port programs
+    /// have no ticks, and an empty packet is ignored.
+    void send_tock() {
+        if (m_type == PORT)
+            return;
+        char* data = allocate(s_header_size);
+        bzero(data, s_header_size);
+        do_write(out_buf(data, s_header_size));
+    }
+
     bool check_connected(const eterm<Alloc>* a_msg) {
-        if (likely(!m_connection_aborted))
+        if (likely(!m_connection_aborted.load(std::memory_order_acquire)))
             return true;
 
         ON_ERROR_CALLBACK(this, "Connection closed"
@@ -285,7 +974,6 @@ protected:
         char* data = allocate(sz);
         // Encode the packet to the allocated buffer.
         a_msg.encode(data, sz, s_header_size, true);
-        BOOST_ASSERT(*(data - 1) == s_header_magic);
 
         if (unlikely(verbose() >= VERBOSE_MESSAGE)) {
             m_handler->report_status(REPORT_INFO, "client -> agent: " + a_msg.to_string());
@@ -294,9 +982,7 @@ protected:
                     to_binary_string(data, sz));
         }
 
-        boost::asio::const_buffer b(data, sz);
-        auto pthis = this->shared_from_this();
-        m_io_service.post([pthis, b]() { pthis->do_write(b); });
+        submit(out_buf(data, sz), false);
     }
 
     /// Get connection type from string. If successful the string is 
@@ -322,36 +1008,35 @@ protected:
         m_cookie            = a_cookie;
     }
 
+public:
     /// Set the socket to non-blocking mode and issue on_connect() callback.
     ///
     /// When implementing a server this method is to be called after 
     /// accepting a new connection.  When implementing a client, call
     /// connect() method instead, which invokes start() automatically. 
     virtual void start() {
-        if (m_connection_aborted)
+        if (m_connection_aborted.load(std::memory_order_acquire))
             return;
 
         if (handler()->verbose() >= VERBOSE_TRACE)
             m_handler->report_status(REPORT_INFO, "Calling connection::start()");
 
-        m_connection_aborted = false;
+        m_connection_aborted.store(false, std::memory_order_release);
         m_handler->on_connect(this);
 
-        const boost::asio::mutable_buffers_1 buffers(m_rd_end, rd_capacity());
-        auto  pthis = this->shared_from_this();
-        async_read(
-            buffers,
-            boost::asio::transfer_at_least(s_header_size),
-            [pthis](auto& ec, auto bytes) { pthis->handle_read(ec, bytes); }
-        );
+        schedule_read(s_header_size);
     }
 
+protected:
     template <class MutableBuffers, class CompletionCondition, class ReadHandler>
     void async_read(const MutableBuffers& b, const CompletionCondition& c, ReadHandler h);
 
     template <class MutableBuffers, class CompletionCondition, class ReadHandler>
     void async_write(const MutableBuffers& b, const CompletionCondition& c, ReadHandler h);
 
+    template <class WaitHandler>
+    void async_wait(boost::asio::socket_base::wait_type a_type, WaitHandler h);
+
 public:
     using handler_type  = Handler;
     using pointer       = boost::shared_ptr<connection<Handler, Alloc>>;
@@ -381,6 +1066,35 @@ public:
     virtual ~connection() {
         if (handler()->verbose() >= VERBOSE_TRACE)
             m_handler->report_status(REPORT_INFO, "Calling ~connection::connection()");
+
+        // Free messages that were never written to the socket
+        out_buf b;
+        while (m_wr_submit.try_pop(b))
+            release(b);
+        for (auto& q : m_out_msg_queue)
+            for (auto& b : q)
+                release(b);
+#if defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+        if (m_zc)
+            for (auto& batch : m_zc->pending)
+                for (auto& b : batch.second)
+                    release(b);
+#endif
+        if (m_rd_buf)
+            rd_deallocate(m_rd_buf, m_rd_size);
+        for (auto p : m_rd_msgs)
+            msg_release(p);
+        if (m_dec)
+            for (auto& batch : m_dec->ready)
+                for (auto p : batch.second.second)
+                    msg_release(p);
+#ifdef EIXX_USE_IO_URING
+        if (m_uring && m_uring->slot >= 0) {
+            auto u    = m_uring->ring;
+            int  slot = m_uring->slot;
+            m_io_service.dispatch([u, slot]() { u->unregister_buffer(slot); });
+        }
+#endif
     }
 
     /// Close connection channel orderly by user. 
@@ -399,14 +1113,26 @@ public:
     /// on the socket.
     /// @param e is the disconnect reason.
     virtual void stop(const boost::system::error_code& e) {
-        if (m_connection_aborted)
+        if (m_connection_aborted.exchange(true, std::memory_order_acq_rel))
             return;
 
         if (handler()->verbose() >= VERBOSE_TRACE)
             m_handler->report_status(REPORT_INFO, 
                 std::string("Calling ~connection::connection()") + e.message());
 
-        m_connection_aborted = true;
+        if (m_wr_flush_armed) {
+            boost::system::error_code ec;
+            m_wr_flush_timer.cancel(ec);
+        }
+#ifdef EIXX_USE_IO_URING
+        if (m_uring)
+            uring_cancel();
+#endif
+        if (m_bp && m_bp->added) {
+            auto p = m_bp->poller;
+            auto t = &m_bp->target;
+            m_io_service.dispatch([p, t]() { p->remove(t); });
+        }
         m_handler->on_disconnect(this, e);
         //delete this;
     }
@@ -414,6 +1140,15 @@ public:
     virtual int native_socket() = 0;
     virtual uint64_t remote_flags() const = 0;
 
+    /// Returns true if the socket is written using MSG_ZEROCOPY.
+    bool zerocopy_enabled() const {
+#if defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+        return m_zc != NULL;
+#else
+        return false;
+#endif
+    }
+
     /// Address of connected peer.
     virtual std::string         peer_address()      const   { return ""; }
     atom                        remote_nodename()   const   { return m_remote_nodename; }
@@ -424,7 +1159,42 @@ public:
     boost::asio::io_service&    io_service()                { return m_io_service; }
 
     /// Send a message \a a_msg to the remote node.
-    void send(const transport_msg<Alloc>& a_msg);
+    /// @param a_flush if true, the message and all other pending messages
+    ///                are written to the socket without waiting for the
+    ///                flush delay of the write_policy to expire.
+    void send(const transport_msg<Alloc>& a_msg, bool a_flush = false);
+
+    /// Send a term \a a_term to the Erlang side of a port connection as a
+    /// {packet, 4} packet holding the term in the external format.
+    /// @param a_flush see send().
+    void send_term(const eterm<Alloc>& a_term, bool a_flush = false);
+
+    /// Write all pending outbound data to the socket without waiting for
+    /// the flush delay to expire.  Thread-safe.
+    void flush() {
+        auto pthis = this->shared_from_this();
+        m_io_service.post([pthis]() { pthis->do_write_internal(); });
+    }
+
+    /// Get outbound write coalescing policy.
+    const write_policy& wr_policy() const { return m_wr_policy; }
+
+    /// Number of outgoing messages that didn't fit in the output slab
+    /// and were allocated using the connection's allocator.
+    size_t wr_slab_misses()         const { return m_wr_slab.misses(); }
+
+    /// Get inbound read buffer policy.
+    const read_policy& rd_policy() const { return m_rd_policy; }
+
+    /// Memory held by the connection.  The values are updated by the
+    /// I/O thread and are approximate when read from other threads.
+    memory_stats mem_stats() const {
+        memory_stats s(m_mem_stats);
+        s.wr_slab        = m_wr_slab.capacity();
+        s.wr_slab_misses = m_wr_slab.misses();
+        s.wr_pending     = m_wr_pending_bytes;
+        return s;
+    }
 
     void on_error(const std::string& s) {
         m_handler->on_error(this,  s);
@@ -29,6 +29,8 @@ limitations under the License.
 
 #include <eixx/connect/transport_otp_connection_tcp.hpp>
 #include <eixx/connect/transport_otp_connection_uds.hpp>
+#include <eixx/connect/transport_otp_connection_shm.hpp>
+#include <eixx/connect/transport_otp_connection_port.hpp>
 #include <eixx/marshal/endian.hpp>
 #include <eixx/marshal/trace.hpp>
 #include <eixx/util/string_util.hpp>
@@ -43,9 +45,6 @@ using eixx::marshal::trace;
 template <class Handler, class Alloc>
 const size_t connection<Handler, Alloc>::s_header_size = 4;
 
-template <class Handler, class Alloc>
-const char   connection<Handler, Alloc>::s_header_magic = static_cast<char>(132);
-
 template <class Handler, class Alloc>
 const eterm<Alloc> connection<Handler, Alloc>::s_null_cookie;
 
@@ -73,6 +72,7 @@ connection<Handler, Alloc>::create(
                 THROW_RUNTIME_ERROR("Invalid node name " << a_node);
             break;
         case UDS:
+        case SHM:
             if (addr.find_last_of('/') == std::string::npos)
                 THROW_RUNTIME_ERROR("Invalid node name " << a_node);
             break;
@@ -84,6 +84,7 @@ connection<Handler, Alloc>::create(
     switch (con_type) {
         case TCP:  p.reset(new tcp_connection<Handler, Alloc>(a_svc, a_h, a_alloc));  break;
         case UDS:  p.reset(new uds_connection<Handler, Alloc>(a_svc, a_h, a_alloc));  break;
+        case SHM:  p.reset(new shm_connection<Handler, Alloc>(a_svc, a_h, a_alloc));  break;
         default:   THROW_RUNTIME_ERROR("Not implemented! (proto=" << con_type << ')');
     }
 
@@ -99,7 +100,7 @@ connection<Handler, Alloc>::parse_connection_type(std::string& s)
     if (pos == std::string::npos)
         return TCP;
     std::string a = s.substr(0, pos);
-    const char* types[] = {"UNDEFINED", "tcp", "uds"};
+    const char* types[] = {"UNDEFINED", "tcp", "uds", "shm"};
     for (size_t i=1; i < sizeof(types)/sizeof(char*); ++i)
         if (boost::iequals(a, types[i])) {
             s = s.substr(pos+1);
@@ -134,6 +135,12 @@ void connection<Handler, Alloc>::async_read(
             boost::asio::async_read(s, b, c, h);
             break;
         }
+        case SHM:
+            reinterpret_cast<shm_connection<Handler, Alloc>*>(this)->async_read(b, c, h);
+            break;
+        case PORT:
+            reinterpret_cast<port_connection<Handler, Alloc>*>(this)->async_read(b, c, h);
+            break;
         default:
             THROW_RUNTIME_ERROR("async_read: Not implemented! (type=" << m_type << ')');
     }
@@ -157,16 +164,180 @@ void connection<Handler, Alloc>::async_write(
             boost::asio::async_write(s, b, c, h);
             break;
         }
+        case SHM:
+            reinterpret_cast<shm_connection<Handler, Alloc>*>(this)->async_write(b, c, h);
+            break;
+        case PORT:
+            reinterpret_cast<port_connection<Handler, Alloc>*>(this)->async_write(b, c, h);
+            break;
         default:
             THROW_RUNTIME_ERROR("async_write: Not implemented! (type=" << m_type << ')');
     }
 }
 
+template <class Handler, class Alloc>
+template <class WaitHandler>
+void connection<Handler, Alloc>::async_wait(
+    boost::asio::socket_base::wait_type a_type, WaitHandler h)
+{
+    switch (m_type) {
+        case TCP:
+            reinterpret_cast<tcp_connection<Handler, Alloc>*>(this)->socket().async_wait(a_type, h);
+            break;
+        case UDS:
+            reinterpret_cast<uds_connection<Handler, Alloc>*>(this)->socket().async_wait(a_type, h);
+            break;
+        case SHM:
+            reinterpret_cast<shm_connection<Handler, Alloc>*>(this)->async_wait(a_type, h);
+            break;
+        case PORT:
+            reinterpret_cast<port_connection<Handler, Alloc>*>(this)->async_wait(a_type, h);
+            break;
+        default:
+            THROW_RUNTIME_ERROR("async_wait: Not implemented! (type=" << m_type << ')');
+    }
+}
+
+#if defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+
+// Write the batch in the writing queue using MSG_ZEROCOPY. The kernel
+// keeps referencing the user pages after sendmsg() returns, so the
+// buffers of the batch are released only after the completion
+// notification is read from the socket's error queue.
+template <class Handler, class Alloc>
+void connection<Handler, Alloc>::write_zerocopy()
+{
+    zerocopy_state& zc = *m_zc;
+    auto& q = m_out_msg_queue[writing_queue()];
+    zc.iov.clear();
+    for (auto& b : q)
+        if (b.size)
+            zc.iov.push_back(iovec{const_cast<char*>(b.data), b.size});
+    zc.iov_pos = 0;
+    zc.sends   = 0;
+    send_zerocopy();
+}
+
+template <class Handler, class Alloc>
+void connection<Handler, Alloc>::send_zerocopy()
+{
+    zerocopy_state& zc = *m_zc;
+    int flags = MSG_ZEROCOPY | MSG_DONTWAIT | MSG_NOSIGNAL;
+
+    while (zc.iov_pos < zc.iov.size()) {
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov    = &zc.iov[zc.iov_pos];
+        msg.msg_iovlen = std::min<size_t>(zc.iov.size() - zc.iov_pos, IOV_MAX);
+
+        ssize_t n = ::sendmsg(native_socket(), &msg, flags);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {
+                // Exceeded the locked memory limit - send the rest by copying
+                flags &= ~MSG_ZEROCOPY;
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                auto pthis = this->shared_from_this();
+                async_wait(boost::asio::socket_base::wait_write, [pthis](const auto& ec) {
+                    if (ec) pthis->handle_write(ec);
+                    else    pthis->send_zerocopy();
+                });
+                return;
+            }
+            handle_write(boost::system::error_code(errno, boost::system::system_category()));
+            return;
+        }
+
+        if (flags & MSG_ZEROCOPY)
+            zc.sends++;
+
+        for (size_t left = size_t(n); left; ) {
+            iovec& v = zc.iov[zc.iov_pos];
+            if (left >= v.iov_len) {
+                left -= v.iov_len;
+                ++zc.iov_pos;
+            } else {
+                v.iov_base = static_cast<char*>(v.iov_base) + left;
+                v.iov_len -= left;
+                left = 0;
+            }
+        }
+    }
+
+    // Hold the written buffers until the kernel is done with them
+    auto& q = m_out_msg_queue[writing_queue()];
+    if (zc.sends) {
+        zc.seq += zc.sends;
+        zc.pending.emplace_back(zc.seq - 1, std::deque<out_buf>());
+        zc.pending.back().second.swap(q);
+        wait_zerocopy_completion();
+    }
+    handle_write(boost::system::error_code());
+}
+
+template <class Handler, class Alloc>
+void connection<Handler, Alloc>::wait_zerocopy_completion()
+{
+    zerocopy_state& zc = *m_zc;
+    if (zc.errq_armed || m_connection_aborted.load(std::memory_order_acquire))
+        return;
+    zc.errq_armed = true;
+    auto pthis = this->shared_from_this();
+    async_wait(boost::asio::socket_base::wait_error, [pthis](const auto& ec) {
+        pthis->m_zc->errq_armed = false;
+        if (!ec)
+            pthis->handle_zerocopy_completion();
+    });
+}
+
+template <class Handler, class Alloc>
+void connection<Handler, Alloc>::handle_zerocopy_completion()
+{
+    zerocopy_state& zc = *m_zc;
+    for (;;) {
+        char    control[128];
+        msghdr  msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control    = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (::recvmsg(native_socket(), &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+            break;
+
+        for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!((cm->cmsg_level == SOL_IP   && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+                continue;
+            const sock_extended_err* ee =
+                reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cm));
+            if (ee->ee_errno != 0 || ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                continue;
+            // Notifications cover the range of send ids [ee_info, ee_data]
+            uint32_t hi = ee->ee_data;
+            while (!zc.pending.empty() &&
+                   int32_t(zc.pending.front().first - hi) <= 0) {
+                for (auto& b : zc.pending.front().second)
+                    release(b);
+                zc.pending.pop_front();
+            }
+        }
+    }
+
+    if (!zc.pending.empty())
+        wait_zerocopy_completion();
+}
+
+#endif // MSG_ZEROCOPY
+
 template <class Handler, class Alloc>
 void connection<Handler, Alloc>::
 handle_write(const boost::system::error_code& err)
 {
-    if (m_connection_aborted) {
+    if (m_connection_aborted.load(std::memory_order_acquire)) {
         if (unlikely(verbose() >= VERBOSE_TRACE))
             m_handler->report_status(REPORT_INFO,
                 "Connection aborted - exiting connection::handle_write");
@@ -188,15 +359,18 @@ handle_write(const boost::system::error_code& err)
         return;
     }
     auto& q = m_out_msg_queue[writing_queue()];
-    for (auto it  = q.begin(), end = q.end(); it != end; ++it) {
-        const char* p = boost::asio::buffer_cast<const char*>(*it);
-        // Don't forget to adjust for the header magic byte.
-        BOOST_ASSERT(*(p - 1) == s_header_magic);
-        m_allocator.deallocate(
-            const_cast<char*>(p-1), boost::asio::buffer_size(*it)+1);
-    }
-    m_out_msg_queue[writing_queue()].clear();
+    for (auto it  = q.begin(), end = q.end(); it != end; ++it)
+        release(*it);
+    q.clear();
+#if defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+    if (m_zc)
+        m_zc->queued[writing_queue()] = false;
+#endif
     m_is_writing = false;
+
+    if (m_wr_corked && m_out_msg_queue[available_queue()].empty())
+        m_wr_corked = !set_cork(false);
+
     do_write_internal();
 }
 
@@ -209,16 +383,16 @@ handle_read(const boost::system::error_code& err, size_t bytes_transferred)
         s << "connection::handle_read(transferred="
           << bytes_transferred << ", got_header="
           << (m_got_header ? "true" : "false")
-          << ", rd_buf.size=" << m_rd_buf.capacity()
-          << ", rd_ptr=" << (m_rd_ptr - &m_rd_buf[0])
-          << ", rd_end=" << (m_rd_end - &m_rd_buf[0])
+          << ", rd_buf.size=" << m_rd_size
+          << ", rd_ptr=" << (m_rd_ptr - m_rd_buf)
+          << ", rd_end=" << (m_rd_end - m_rd_buf)
           << ", rd_capacity=" << rd_capacity()
           << ", pkt_sz=" << m_packet_size << " (ec="
           << err.value() << ')';
         m_handler->report_status(REPORT_INFO, s.str());
     }
 
-    if (unlikely(m_connection_aborted)) {
+    if (unlikely(m_connection_aborted.load(std::memory_order_acquire))) {
         if (verbose() >= VERBOSE_WIRE) {
             m_handler->report_status(REPORT_INFO,
                 "Connection aborted - exiting connection::handle_read");
@@ -237,38 +411,38 @@ handle_read(const boost::system::error_code& err, size_t bytes_transferred)
 
     m_rd_end += bytes_transferred;
 
-    if (!m_got_header) {
-        size_t len = rd_length();
+    if (m_rd_latency)
+        m_rd_stamp = util::latency_histogram::now();
 
-        m_got_header = len >= s_header_size;
+    if (!m_got_header) {
+        m_got_header = rd_length() >= s_header_size;
 
         if (m_got_header) {
             // Make sure that the buffer size is large enouch to store
             // next message.
             m_packet_size = cast_be<uint32_t>(m_rd_ptr);
-            if (m_packet_size > m_rd_buf.capacity()-s_header_size) {
-                size_t begin_offset = static_cast<uintptr_t>(m_rd_ptr - &m_rd_buf[0]);
-                m_rd_buf.reserve(begin_offset + m_packet_size + s_header_size);
-                m_rd_ptr = &m_rd_buf[0] + begin_offset;
-                m_rd_end = m_rd_ptr + len;
-            }
+            rd_reserve(m_packet_size + s_header_size);
         }
     }
 
-    auto need_bytes = m_packet_size + s_header_size - rd_length();
+    long need_bytes = long(m_got_header ? m_packet_size + s_header_size : s_header_size)
+                    - long(rd_length());
 
     /*
     if (unlikely(verbose() >= VERBOSE_WIRE))
         std::cout << "  pkt_size=" << m_packet_size << ", need=" << need_bytes
-                  << ", rd_ptr=" << (m_rd_ptr - &m_rd_buf[0])
-                  << ", rd_end=" << (m_rd_end - &m_rd_buf[0])
+                  << ", rd_ptr=" << (m_rd_ptr - m_rd_buf)
+                  << ", rd_end=" << (m_rd_end - m_rd_buf)
                   << ", length=" << rd_length()
-                  << ", rd_buf.size=" << m_rd_buf.capacity()
+                  << ", rd_buf.size=" << m_rd_size
                   << ", got_header=" << (m_got_header ? "true" : "false")
                   << ", " << to_binary_string(m_rd_ptr, std::min(rd_length(), 25lu)) << "..."
                   << std::endl;
     */
 
+    // Start of the packets to be passed to the decode workers
+    const char* l_batch = NULL;
+
     // Process all messages in the buffer
     while (m_got_header && need_bytes <= 0) {
         m_rd_ptr += s_header_size;
@@ -278,9 +452,9 @@ handle_read(const boost::system::error_code& err, size_t bytes_transferred)
             if (unlikely(verbose() >= VERBOSE_WIRE)) {
                 std::cout << " MsgCnt=" << m_in_msg_count
                           << ", pkt_size=" << m_packet_size << ", need=" << need_bytes
-                          << ", rd_buf.size=" << m_rd_buf.capacity()
-                          << ", rd_ptr=" << (m_rd_ptr - &m_rd_buf[0])
-                          << ", rd_end=" << (m_rd_end - &m_rd_buf[0])
+                          << ", rd_buf.size=" << m_rd_size
+                          << ", rd_ptr=" << (m_rd_ptr - m_rd_buf)
+                          << ", rd_end=" << (m_rd_end - m_rd_buf)
                           << ", len=" << rd_length()
                           << ", rd_capacity=" << rd_capacity()
                           << std::endl;
@@ -288,33 +462,72 @@ handle_read(const boost::system::error_code& err, size_t bytes_transferred)
                     std::cout << "client <- server: ", m_rd_ptr, m_packet_size) << std::endl;
             }
 
-            // Decode the packet into a message and dispatch it.
-            process_message(m_rd_ptr, m_packet_size);
+            if (m_decoder) {
+                if (!m_packet_size)
+                    send_tock();
+                else if (!l_batch)
+                    l_batch = m_rd_ptr - s_header_size;
+            } else
+                // Decode the packet into a message and dispatch it.
+                process_message(m_rd_ptr, m_packet_size);
 
         } catch (std::exception& e) {
             ON_ERROR_CALLBACK(this,
                 "Error processing packet from server: " << e.what() << std::endl << "  ";
                 to_binary_string(m_rd_ptr, m_packet_size));
         }
+        if (m_packet_size + s_header_size <= m_rd_policy.initial_size)
+            m_rd_small_count++;
+        else
+            m_rd_small_count = 0;
         m_rd_ptr     += m_packet_size;
-        m_got_header  = rd_length() >= long(s_header_size);
+        m_got_header  = rd_length() >= s_header_size;
         if (m_got_header) {
             m_packet_size = cast_be<uint32_t>(m_rd_ptr);
-            need_bytes    = m_packet_size + s_header_size - rd_length();
-        }
+            need_bytes    = long(m_packet_size + s_header_size) - long(rd_length());
+        } else
+            need_bytes    = long(s_header_size) - long(rd_length());
     }
     bool crunched = false;
 
+    if (!m_rd_msgs.empty()) {
+        try {
+            dispatch_messages(m_rd_msgs, m_rd_stamp);
+        } catch (std::exception& e) {
+            ON_ERROR_CALLBACK(this, "Error dispatching messages from server: " << e.what());
+            m_rd_msgs.clear();
+        }
+    }
+
+    if (l_batch)
+        offload_packets(l_batch, m_rd_ptr);
+
+    // Return a grown buffer to the steady-state size unless the next
+    // packet needs it.  Dedicated buffers of large packets are released
+    // right away.
+    if (m_rd_size > m_rd_policy.initial_size && rd_length() <= m_rd_policy.initial_size
+        && (m_rd_size >= m_rd_policy.large_threshold ||
+            m_rd_small_count >= m_rd_policy.shrink_after)
+        && !(m_got_header && m_packet_size + s_header_size > m_rd_policy.initial_size))
+    {
+        rd_resize(m_rd_policy.initial_size);
+        m_mem_stats.rd_shrinks++;
+        crunched = true;
+    }
+
+    if (m_got_header)
+        rd_reserve(m_packet_size + s_header_size);
+
     if (m_rd_ptr == m_rd_end) {
-        m_rd_ptr = &m_rd_buf[0];
+        m_rd_ptr = m_rd_buf;
         m_rd_end = m_rd_ptr;
         m_packet_size = s_header_size;
         need_bytes    = m_packet_size;
-    } else if ((m_rd_ptr - (&m_rd_buf[0] + s_header_size)) > 0) {
+    } else if (m_rd_ptr != m_rd_buf) {
         // Crunch the buffer by copying leftover bytes to the beginning of the buffer.
         const size_t len = static_cast<uintptr_t>(m_rd_end - m_rd_ptr);
-        char* begin = &m_rd_buf[0];
-        if (likely(static_cast<uintptr_t>(m_rd_ptr - begin) < len))
+        char* begin = m_rd_buf;
+        if (likely(static_cast<uintptr_t>(m_rd_ptr - begin) >= len))
             memcpy(begin, m_rd_ptr, len);
         else
             memmove(begin, m_rd_ptr, len);
@@ -326,21 +539,332 @@ handle_read(const boost::system::error_code& err, size_t bytes_transferred)
     if (unlikely(verbose() >= VERBOSE_WIRE)) {
         std::stringstream s;
         s << "Scheduling connection::async_read(offset="
-          << (m_rd_end-&m_rd_buf[0])
+          << (m_rd_end-m_rd_buf)
           << ", capacity=" << rd_capacity() << ", pkt_size="
           << m_packet_size << ", need=" << need_bytes
           << ", got_header=" << (m_got_header ? "true" : "false")
           << ", crunched=" << (crunched ? "true" : "false")
-          << ", aborted=" << (m_connection_aborted ? "true" : "false") << ')';
+          << ", aborted=" << (m_connection_aborted.load(std::memory_order_acquire) ? "true" : "false") << ')';
         m_handler->report_status(REPORT_INFO, s.str());
     }
 
+    schedule_read(size_t(need_bytes));
+}
+
+template <class Handler, class Alloc>
+void connection<Handler, Alloc>::
+schedule_read(size_t a_need)
+{
+#ifdef EIXX_USE_IO_URING
+    if (m_uring) {
+        // The kernel selects buffers for received data, so the read
+        // buffer is only needed while a packet is partially read.
+        rd_release_idle();
+        uring_arm_recv();
+        return;
+    }
+#endif
+
+    if (m_bp) {
+        // The socket is read by the polling loop
+        if (!m_bp->added) {
+            m_bp->added = true;
+            m_bp->poller->add(&m_bp->target, native_socket(), this->shared_from_this());
+        }
+        return;
+    }
+
+    auto pthis = this->shared_from_this();
+
+    if (rd_release_idle()) {
+        async_wait(boost::asio::socket_base::wait_read,
+            [pthis](const auto& ec) { pthis->handle_read_ready(ec); });
+        return;
+    }
+
     boost::asio::mutable_buffers_1 buffers(m_rd_end, rd_capacity());
     async_read(
-        buffers, boost::asio::transfer_at_least(need_bytes),
-        std::bind(&connection<Handler, Alloc>::handle_read, this->shared_from_this(),
-            std::placeholders::_1,
-            std::placeholders::_2));
+        buffers, boost::asio::transfer_at_least(a_need),
+        [pthis](const auto& ec, auto bytes) { pthis->handle_read(ec, bytes); });
+}
+
+template <class Handler, class Alloc>
+void connection<Handler, Alloc>::
+handle_read_ready(const boost::system::error_code& err)
+{
+    if (unlikely(m_connection_aborted.load(std::memory_order_acquire)))
+        return;
+
+    if (unlikely(bool(err))) {
+        handle_read(err, 0);
+        return;
+    }
+
+    m_rd_buf = m_rd_ptr = m_rd_end = rd_allocate(m_rd_size);
+    m_mem_stats.rd_buffer = m_rd_size;
+
+    boost::asio::mutable_buffers_1 buffers(m_rd_end, rd_capacity());
+    auto pthis = this->shared_from_this();
+    async_read(
+        buffers, boost::asio::transfer_at_least(s_header_size),
+        [pthis](const auto& ec, auto bytes) { pthis->handle_read(ec, bytes); });
+}
+
+#ifdef EIXX_USE_IO_URING
+
+template <class Handler, class Alloc>
+void connection<Handler, Alloc>::
+uring_arm_recv()
+{
+    uring_state& u = *m_uring;
+    if (u.recv_armed || m_connection_aborted.load(std::memory_order_acquire))
+        return;
+    u.recv_armed = true;
+    u.recv.self  = this->shared_from_this();
+    u.ring->recv_multishot(native_socket(), &u.recv);
+}
+
+template <class Handler, class Alloc>
+void connection<Handler, Alloc>::
+handle_uring_recv(int a_res, unsigned a_flags)
+{
+    uring_state& u = *m_uring;
+    if (!(a_flags & IORING_CQE_F_MORE))
+        u.recv_armed = false;
+
+    if (a_res > 0) {
+        uint16_t bid = uint16_t(a_flags >> IORING_CQE_BUFFER_SHIFT);
+        if (unlikely(m_connection_aborted.load(std::memory_order_acquire))) {
+            u.ring->recycle(bid);
+            return;
+        }
+        if (!m_rd_buf) {
+            m_rd_buf = m_rd_ptr = m_rd_end = rd_allocate(m_rd_size);
+            m_mem_stats.rd_buffer = m_rd_size;
+        }
+        size_t n = size_t(a_res);
+        rd_reserve(rd_length() + n);
+        memcpy(m_rd_end, u.ring->recv_buffer(bid), n);
+        u.ring->recycle(bid);
+        handle_read(boost::system::error_code(), n);
+        return;
+    }
+
+    if (a_res == -ENOBUFS) {
+        // All receive buffers are in use - try again
+        if (!u.recv_armed)
+            uring_arm_recv();
+        return;
+    }
+
+    boost::system::error_code ec = a_res == 0
+        ? boost::system::error_code(boost::asio::error::eof)
+        : boost::system::error_code(-a_res, boost::system::system_category());
+    handle_read(ec, 0);
+}
+
+template <class Handler, class Alloc>
+void connection<Handler, Alloc>::
+uring_write()
+{
+    uring_state& u = *m_uring;
+    auto& q = m_out_msg_queue[writing_queue()];
+    u.iov.clear();
+    for (auto& b : q)
+        if (b.size)
+            u.iov.push_back(iovec{const_cast<char*>(b.data), b.size});
+    u.iov_pos = 0;
+
+    if (u.slot < 0 && u.fixed_ok)
+        u.slot = u.ring->register_buffer(m_wr_slab.data(), m_wr_slab.capacity());
+
+    uring_send();
+}
+
+template <class Handler, class Alloc>
+void connection<Handler, Alloc>::
+uring_send()
+{
+    uring_state& u = *m_uring;
+    if (u.iov_pos == u.iov.size()) {
+        handle_write(boost::system::error_code());
+        return;
+    }
+
+    u.send.self = this->shared_from_this();
+
+    // A batch of adjacent slab buffers is sent from the registered memory
+    iovec& v = u.iov[u.iov_pos];
+    u.send_fixed = u.fixed_ok && u.slot >= 0
+                && u.iov_pos + 1 == u.iov.size()
+                && m_wr_slab.owns(static_cast<const char*>(v.iov_base));
+    if (u.send_fixed) {
+        u.ring->send_fixed(native_socket(), static_cast<const char*>(v.iov_base),
+                           v.iov_len, u.slot, &u.send);
+        return;
+    }
+
+    memset(&u.msg, 0, sizeof(u.msg));
+    u.msg.msg_iov    = &v;
+    u.msg.msg_iovlen = std::min<size_t>(u.iov.size() - u.iov_pos, IOV_MAX);
+    u.ring->sendmsg(native_socket(), &u.msg, &u.send);
+}
+
+template <class Handler, class Alloc>
+void connection<Handler, Alloc>::
+handle_uring_send(int a_res, unsigned)
+{
+    uring_state& u = *m_uring;
+    if (a_res < 0) {
+        if (a_res == -EINVAL && u.send_fixed) {
+            // The kernel can't send from registered buffers
+            u.fixed_ok = false;
+            uring_send();
+            return;
+        }
+        if (a_res == -EINTR || a_res == -EAGAIN) {
+            uring_send();
+            return;
+        }
+        handle_write(boost::system::error_code(-a_res, boost::system::system_category()));
+        return;
+    }
+
+    for (size_t left = size_t(a_res); left; ) {
+        iovec& v = u.iov[u.iov_pos];
+        if (left >= v.iov_len) {
+            left -= v.iov_len;
+            ++u.iov_pos;
+        } else {
+            v.iov_base = static_cast<char*>(v.iov_base) + left;
+            v.iov_len -= left;
+            left = 0;
+        }
+    }
+
+    if (m_connection_aborted.load(std::memory_order_acquire))
+        return;
+
+    uring_send();
+}
+
+template <class Handler, class Alloc>
+void connection<Handler, Alloc>::
+uring_cancel()
+{
+    // Operations of the ring may only be prepared by the thread serving it
+    if (!m_io_service.get_executor().running_in_this_thread()) {
+        auto pthis = this->shared_from_this();
+        m_io_service.post([pthis]() { pthis->uring_cancel(); });
+        return;
+    }
+    uring_state& u = *m_uring;
+    if (u.recv.self)
+        u.ring->cancel(&u.recv);
+    if (u.send.self)
+        u.ring->cancel(&u.send);
+}
+
+#endif // EIXX_USE_IO_URING
+
+template <class Handler, class Alloc>
+bool connection<Handler, Alloc>::
+bp_poll()
+{
+    poll_state& bp = *m_bp;
+    bool busy = bp.iov_pos < bp.iov.size() && bp_send();
+
+    if (unlikely(m_connection_aborted.load(std::memory_order_acquire)))
+        return busy;
+
+    ssize_t n = read_some(m_rd_end, rd_capacity());
+    if (n > 0) {
+        handle_read(boost::system::error_code(), size_t(n));
+        return true;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return busy;
+
+    boost::system::error_code ec = n == 0
+        ? boost::system::error_code(boost::asio::error::eof)
+        : boost::system::error_code(errno, boost::system::system_category());
+    handle_read(ec, 0);
+    return true;
+}
+
+template <class Handler, class Alloc>
+void connection<Handler, Alloc>::
+bp_wait()
+{
+    // Errors are detected by the next bp_poll()
+    poll_state& bp = *m_bp;
+    auto pthis = this->shared_from_this();
+    if (!bp.wait_rd) {
+        bp.wait_rd = true;
+        async_wait(boost::asio::socket_base::wait_read,
+            [pthis](const auto&) { pthis->m_bp->wait_rd = false; });
+    }
+    if (!bp.wait_wr && bp.iov_pos < bp.iov.size()) {
+        bp.wait_wr = true;
+        async_wait(boost::asio::socket_base::wait_write,
+            [pthis](const auto&) { pthis->m_bp->wait_wr = false; });
+    }
+}
+
+template <class Handler, class Alloc>
+void connection<Handler, Alloc>::
+bp_write()
+{
+    poll_state& bp = *m_bp;
+    auto& q = m_out_msg_queue[writing_queue()];
+    bp.iov.clear();
+    for (auto& b : q)
+        if (b.size)
+            bp.iov.push_back(iovec{const_cast<char*>(b.data), b.size});
+    bp.iov_pos = 0;
+    bp_send();
+}
+
+template <class Handler, class Alloc>
+bool connection<Handler, Alloc>::
+bp_send()
+{
+    poll_state& bp = *m_bp;
+    bool sent = false;
+
+    while (bp.iov_pos < bp.iov.size()) {
+        ssize_t n = write_some(&bp.iov[bp.iov_pos],
+                               std::min<size_t>(bp.iov.size() - bp.iov_pos, IOV_MAX));
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return sent;    // The rest is written by the polling loop
+            boost::system::error_code ec(errno, boost::system::system_category());
+            bp.iov.clear();
+            bp.iov_pos = 0;
+            handle_write(ec);
+            return true;
+        }
+
+        sent = true;
+        for (size_t left = size_t(n); left; ) {
+            iovec& v = bp.iov[bp.iov_pos];
+            if (left >= v.iov_len) {
+                left -= v.iov_len;
+                ++bp.iov_pos;
+            } else {
+                v.iov_base = static_cast<char*>(v.iov_base) + left;
+                v.iov_len -= left;
+                left = 0;
+            }
+        }
+    }
+
+    bp.iov.clear();
+    bp.iov_pos = 0;
+    handle_write(boost::system::error_code());
+    return true;
 }
 
 /// Decode distributed Erlang message.  The message must be fully
@@ -360,6 +884,16 @@ transport_msg_decode(const char *mbuf, size_t len, transport_msg<Alloc>& a_tm)
     if (unlikely(len == 0)) // This is TICK message
         return ERL_TICK;
 
+    // A packet of a port program is a term in the external format
+    if (m_type == PORT) {
+        if (unlikely(ei_decode_version(s, (int*)&index, &version) || version != ERL_VERSION_MAGIC))
+            throw err_decode_exception("Invalid message magic number", index, version);
+        eterm<Alloc> msg(s, index, len, m_allocator);
+        a_tm.set(ERL_SEND, tuple<Alloc>::make(ERL_SEND, atom(), am_undefined, m_allocator),
+                 std::move(msg));
+        return ERL_SEND;
+    }
+
     /* now decode header */
     /* pass-through, version, control tuple header, control message type */
     if (unlikely(get8(s) != ERL_PASS_THROUGH)) {
@@ -391,9 +925,9 @@ transport_msg_decode(const char *mbuf, size_t len, transport_msg<Alloc>& a_tm)
             throw err_decode_exception("Invalid message magic number", index, version);
 
         eterm<Alloc> msg(s, index, len, m_allocator);
-        a_tm.set(msgtype, cntrl, &msg);
+        a_tm.set(msgtype, std::move(cntrl), std::move(msg));
     } else {
-        a_tm.set(msgtype, cntrl);
+        a_tm.set(msgtype, std::move(cntrl), eterm<Alloc>());
     }
 
     return msgtype;
@@ -403,18 +937,21 @@ template <class Handler, class Alloc>
 void connection<Handler, Alloc>::
 process_message(const char* a_buf, size_t a_size)
 {
-    transport_msg<Alloc> tm;
-    int msgtype = transport_msg_decode(a_buf, a_size, tm);
+    transport_msg<Alloc>* tm = msg_acquire();
+    int msgtype;
+    try {
+        msgtype = transport_msg_decode(a_buf, a_size, *tm);
+    } catch (...) {
+        msg_release(tm);
+        throw;
+    }
 
     switch (msgtype) {
-        case ERL_TICK: {
+        case ERL_TICK:
             // Reply with TOCK packet
-            char* data = allocate(s_header_size);
-            bzero(data, s_header_size);
-            boost::asio::const_buffer b(data, s_header_size);
-            do_write(b);
+            msg_release(tm);
+            send_tock();
             break;
-        }
         /*
         case ERL_SEND:
         case ERL_REG_SEND:
@@ -431,43 +968,187 @@ process_message(const char* a_buf, size_t a_size)
             break;
         */
         default:
-            if (unlikely(verbose() >= VERBOSE_MESSAGE)) {
-                if (unlikely(verbose() >= VERBOSE_WIRE)) {
-                    std::stringstream s;
-                    s << "Got transport msg - (cntrl): " << tm.cntrl();
-                    m_handler->report_status(REPORT_INFO, s.str());
-                }
-                if (tm.has_msg()) {
-                    std::stringstream s;
-                    s << "Got transport msg - (msg):   " << tm.msg();
-                    m_handler->report_status(REPORT_INFO, s.str());
-                }
+            // Dispatched with the other messages of the read cycle
+            m_rd_msgs.push_back(tm);
+            break;
+    }
+}
+
+template <class Handler, class Alloc>
+void connection<Handler, Alloc>::
+dispatch_messages(std::vector<transport_msg<Alloc>*>& a_msgs, uint64_t a_stamp)
+{
+    if (unlikely(verbose() >= VERBOSE_MESSAGE)) {
+        for (auto tm : a_msgs) {
+            if (unlikely(verbose() >= VERBOSE_WIRE)) {
+                std::stringstream s;
+                s << "Got transport msg - (cntrl): " << tm->cntrl();
+                m_handler->report_status(REPORT_INFO, s.str());
+            }
+            if (tm->has_msg()) {
+                std::stringstream s;
+                s << "Got transport msg - (msg):   " << tm->msg();
+                m_handler->report_status(REPORT_INFO, s.str());
             }
-            m_handler->on_message(this, tm);
+        }
     }
+    size_t n = a_msgs.size();
+    m_handler->on_messages(this, a_msgs);
+    a_msgs.clear();
+    if (m_rd_latency)
+        for (size_t i = 0; i < n; ++i)
+            m_rd_latency->record_since(a_stamp);
+}
+
+template <class Handler, class Alloc>
+void connection<Handler, Alloc>::
+offload_packets(const char* a_begin, const char* a_end)
+{
+    // Hand the buffer over to the decoder.  Leftover bytes of a partially
+    // read packet are moved to a new buffer.
+    char*  buf = m_rd_buf;
+    size_t sz  = m_rd_size;
+    m_rd_buf   = NULL;
+    rd_resize(rd_length() > m_rd_policy.initial_size ? m_rd_size : m_rd_policy.initial_size);
+
+    uint64_t seq   = m_dec->seq++;
+    uint64_t stamp = m_rd_stamp;
+    auto     pthis = this->shared_from_this();
+    m_decoder->post([pthis, seq, stamp, buf, sz, a_begin, a_end]() {
+        pthis->decode_packets(seq, stamp, a_begin, a_end);
+        pthis->rd_deallocate(buf, sz);
+    });
 }
 
 template <class Handler, class Alloc>
 void connection<Handler, Alloc>::
-send(const transport_msg<Alloc>& a_msg)
+decode_packets(uint64_t a_seq, uint64_t a_stamp, const char* a_begin, const char* a_end)
+{
+    std::vector<transport_msg<Alloc>*> msgs;
+
+    for (const char* p = a_begin; p < a_end; ) {
+        size_t n = cast_be<uint32_t>(p);
+        p += s_header_size;
+        if (n) {    // Ticks are answered by the I/O thread
+            transport_msg<Alloc>* tm = msg_acquire();
+            try {
+                transport_msg_decode(p, n, *tm);
+                msgs.push_back(tm);
+            } catch (std::exception& e) {
+                msg_release(tm);
+                ON_ERROR_CALLBACK(this,
+                    "Error processing packet from server: " << e.what() << std::endl << "  ";
+                    to_binary_string(p, n));
+            }
+        }
+        p += n;
+    }
+
+    // Deliver decoded batches in the order they were read.  Only one
+    // worker at a time delivers messages of the connection.
+    decode_state& d = *m_dec;
+    std::unique_lock<std::mutex> guard(d.lock);
+    d.ready.emplace(a_seq, std::make_pair(a_stamp, std::move(msgs)));
+    if (d.delivering)
+        return;
+    d.delivering = true;
+
+    // Let the next batch be delivered even if this worker bails out
+    struct delivering_guard {
+        std::unique_lock<std::mutex>& lock;
+        bool&                         flag;
+        ~delivering_guard() {
+            if (!lock.owns_lock())
+                lock.lock();
+            flag = false;
+        }
+    } reset{guard, d.delivering};
+
+    while (!d.ready.empty() && d.ready.begin()->first == d.next) {
+        auto batch = std::move(d.ready.begin()->second);
+        d.ready.erase(d.ready.begin());
+        d.next++;
+        guard.unlock();
+        try {
+            dispatch_messages(batch.second, batch.first);
+        } catch (std::exception& e) {
+            ON_ERROR_CALLBACK(this, "Error dispatching messages from server: " << e.what());
+        } catch (...) {
+            ON_ERROR_CALLBACK(this, "Unknown error dispatching messages from server");
+        }
+        guard.lock();
+    }
+}
+
+template <class Handler, class Alloc>
+void connection<Handler, Alloc>::
+send_term(const eterm<Alloc>& a_term, bool a_flush)
+{
+    if (!check_connected(&a_term))
+        return;
+
+    marshal::gather_list l_gather(m_wr_policy.gather_threshold);
+
+    size_t msg_sz;
+    {
+        marshal::gather_list::scope guard(l_gather);
+        msg_sz = a_term.encode_size(0, true);
+    }
+    size_t sz   = msg_sz + 4 /*len*/;
+    char*  data = allocate(sz);
+    {
+        marshal::gather_list::scope guard(l_gather);
+        a_term.encode(data + 4, msg_sz, 0, true);
+    }
+    BOOST_ASSERT(msg_sz + l_gather.bytes() <= UINT32_MAX);
+    char* s = data;
+    put32be(s, (uint32_t)(msg_sz + l_gather.bytes()));
+
+    if (unlikely(verbose() >= VERBOSE_MESSAGE))
+        m_handler->report_status(REPORT_INFO, "SEND term=" + a_term.to_string());
+
+    if (likely(l_gather.empty())) {
+        submit(out_buf(data, sz), a_flush);
+        return;
+    }
+
+    gather_msg* g = new gather_msg(data, sz, 4 /*len*/, m_wr_policy.gather_threshold);
+    g->list.swap(l_gather);
+    submit(out_buf(data, sz, out_buf::RELEASE_GATHER, g), a_flush);
+}
+
+template <class Handler, class Alloc>
+void connection<Handler, Alloc>::
+send(const transport_msg<Alloc>& a_msg, bool a_flush)
 {
     if (!check_connected(&a_msg.msg()))
         return;
 
+    // Large binaries in the message are referenced by the gather list
+    // rather than copied to the encoded buffer.
+    marshal::gather_list l_gather(m_wr_policy.gather_threshold);
+
     eterm<Alloc> l_cntrl(a_msg.cntrl());
     bool   l_has_msg= a_msg.has_msg();
     size_t cntrl_sz = l_cntrl.encode_size(0, true);
-    size_t msg_sz   = l_has_msg ? a_msg.msg().encode_size(0, true) : 0;
+    size_t msg_sz   = 0;
+    if (l_has_msg) {
+        marshal::gather_list::scope guard(l_gather);
+        msg_sz = a_msg.msg().encode_size(0, true);
+    }
     size_t sz       = cntrl_sz + msg_sz + 1 /*passthrough*/ + 4 /*len*/;
     char*  data     = allocate(sz);
-    char*  s        = data;
-    BOOST_ASSERT(sz-4 <= UINT32_MAX);
-    uint32_t len = (uint32_t)sz - 4;
-    put32be(s, len);
+    char*  s        = data + 4;
     *s++ = ERL_PASS_THROUGH;
     l_cntrl.encode(s, cntrl_sz, 0, true);
-    if (l_has_msg)
+    if (l_has_msg) {
+        marshal::gather_list::scope guard(l_gather);
         a_msg.msg().encode(s + cntrl_sz, msg_sz, 0, true);
+    }
+    BOOST_ASSERT(sz-4 + l_gather.bytes() <= UINT32_MAX);
+    uint32_t len = (uint32_t)(sz - 4 + l_gather.bytes());
+    s = data;
+    put32be(s, len);
 
     if (unlikely(verbose() >= VERBOSE_MESSAGE)) {
         std::stringstream ss;
@@ -479,9 +1160,15 @@ send(const transport_msg<Alloc>& a_msg)
     //if (unlikely(verbose() >= VERBOSE_WIRE))
     //    std::cout << "SEND " << sz << " bytes " << to_binary_string(data, sz) << std::endl;
 
-    boost::asio::const_buffer b(data, sz);
-    m_io_service.post(
-        std::bind(&connection<Handler, Alloc>::do_write, this->shared_from_this(), b));
+    if (likely(l_gather.empty())) {
+        submit(out_buf(data, sz), a_flush);
+        return;
+    }
+
+    gather_msg* g = new gather_msg(data, sz, 4 /*len*/ + 1 /*passthrough*/ + cntrl_sz,
+                                   m_wr_policy.gather_threshold);
+    g->list.swap(l_gather);
+    submit(out_buf(data, sz, out_buf::RELEASE_GATHER, g), a_flush);
 }
 
 } // namespace connect
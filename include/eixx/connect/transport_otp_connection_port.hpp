@@ -0,0 +1,126 @@
+//----------------------------------------------------------------------------
+/// \file transport_otp_connection_port.hpp
+//----------------------------------------------------------------------------
+/// \brief Implementation of connection of an Erlang port program talking
+///        to its Erlang owner over a pair of file descriptors.
+//----------------------------------------------------------------------------
+// Copyright (c) 2010 Serge Aleynikov <saleyn@gmail.com>
+// Created: 2021-11-18
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+
+#ifndef _EIXX_TRANSPORT_OTP_CONNECTION_PORT_HPP_
+#define _EIXX_TRANSPORT_OTP_CONNECTION_PORT_HPP_
+
+#include <sys/uio.h>
+#include <eixx/connect/transport_otp_connection.hpp>
+
+namespace eixx {
+namespace connect {
+
+//----------------------------------------------------------------------------
+/// \class port_connection
+/// \brief Connection of a port program opened by Erlang with
+///        open_port({spawn, Cmd}, [{packet, 4}, binary]).
+///
+/// Every packet is a 4-byte big-endian length followed by a term in the
+/// external format (as produced by term_to_binary/1).  There is no
+/// handshake and no ticks.  Received terms are passed to the handler's
+/// on_message() as ERL_SEND messages with the term in transport_msg::msg().
+///
+/// The port reads from descriptor 0 and writes to descriptor 1, or uses
+/// descriptors 3 and 4 if the port was opened with the nouse_stdio option.
+//----------------------------------------------------------------------------
+template <class Handler, class Alloc>
+class port_connection
+    : public connection<Handler, Alloc>
+{
+public:
+    typedef connection<Handler, Alloc> base_t;
+
+    /// Create a connection reading from \a a_in and writing to \a a_out.
+    /// The connection takes ownership of the descriptors, which may be the
+    /// same descriptor (e.g. a socket).  Call start() to begin reading.
+    port_connection(boost::asio::io_service& a_svc, Handler* a_h,
+                    int a_in, int a_out, const Alloc& a_alloc = Alloc())
+        : connection<Handler, Alloc>(PORT, a_svc, a_h, a_alloc)
+        , m_in(a_svc, a_in)
+        , m_out(a_svc, a_in == a_out ? ::dup(a_out) : a_out)
+    {
+        m_in.non_blocking(true);
+        m_out.non_blocking(true);
+        this->m_remote_nodename = atom("port");
+        std::stringstream s;
+        s << "fd:" << m_in.native_handle() << '/' << m_out.native_handle();
+        m_address = s.str();
+    }
+
+    using base_t::stop;
+
+    void stop(const boost::system::error_code& e) {
+        boost::system::error_code ec;
+        m_in.close(ec);
+        m_out.close(ec);
+        base_t::stop(e);
+    }
+
+    std::string peer_address() const { return m_address; }
+
+    int native_socket() { return m_in.native_handle(); }
+
+    uint64_t remote_flags() const { return 0; }
+
+    template <class MutableBuffers, class CompletionCondition, class ReadHandler>
+    void async_read(const MutableBuffers& a_buf, const CompletionCondition& a_cond, ReadHandler h) {
+        boost::asio::async_read(m_in, a_buf, a_cond, h);
+    }
+
+    template <class ConstBuffers, class CompletionCondition, class WriteHandler>
+    void async_write(const ConstBuffers& a_bufs, const CompletionCondition& a_cond, WriteHandler h) {
+        boost::asio::async_write(m_out, a_bufs, a_cond, h);
+    }
+
+    template <class WaitHandler>
+    void async_wait(boost::asio::socket_base::wait_type a_type, WaitHandler h) {
+        if (a_type == boost::asio::socket_base::wait_read)
+            m_in.async_wait(posix::stream_descriptor::wait_read, h);
+        else
+            m_out.async_wait(posix::stream_descriptor::wait_write, h);
+    }
+
+    ssize_t read_some(char* a_buf, size_t a_size) override {
+        return ::read(m_in.native_handle(), a_buf, a_size);
+    }
+
+    ssize_t write_some(const iovec* a_iov, size_t a_cnt) override {
+        return ::writev(m_out.native_handle(), a_iov, int(a_cnt));
+    }
+
+private:
+    posix::stream_descriptor m_in;
+    posix::stream_descriptor m_out;
+    std::string              m_address;
+};
+
+} // namespace connect
+} // namespace eixx
+
+#endif // _EIXX_TRANSPORT_OTP_CONNECTION_PORT_HPP_
@@ -0,0 +1,711 @@
+//----------------------------------------------------------------------------
+/// \file transport_otp_connection_shm.hpp
+//----------------------------------------------------------------------------
+/// \brief Implementation of connection communicating with a co-located
+///        eixx node through rings in shared memory.
+//----------------------------------------------------------------------------
+// Copyright (c) 2010 Serge Aleynikov <saleyn@gmail.com>
+// Created: 2021-11-17
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+
+#ifndef _EIXX_TRANSPORT_OTP_CONNECTION_SHM_HPP_
+#define _EIXX_TRANSPORT_OTP_CONNECTION_SHM_HPP_
+
+#include <functional>
+#include <sys/eventfd.h>
+#include <eixx/connect/transport_otp_connection.hpp>
+#include <eixx/util/shm_ring.hpp>
+
+namespace eixx {
+namespace connect {
+
+/**
+ * Rendezvous of shm:// connections.
+ *
+ * A node accepting shm:// connections listens on a Unix domain socket
+ * of SOCK_SEQPACKET type.  The connecting side creates a shared memory
+ * segment with two rings (client to server and server to client) and an
+ * eventfd(2) used to wake it up, and sends them with its node name and
+ * cookie in a hello message.  The accepting side replies with its node
+ * name and its own eventfd.  The socket stays open for the life of the
+ * connection, so that either side detects the exit of its peer.
+ */
+struct shm_handshake {
+    static const size_t s_max_msg = 1024;
+
+    struct hello_hdr {
+        char     magic[8];
+        uint32_t capacity;      // Size of each ring
+        uint32_t creation;
+        uint16_t node_len;
+        uint16_t cookie_len;
+    };
+
+    struct reply_hdr {
+        char     magic[8];
+        int32_t  status;        // 0 or errno value
+        uint16_t node_len;
+    };
+
+    static const char* magic() { return "EIXXSHM1"; }
+
+    /// Offset of the second ring in the segment.
+    static size_t ring_stride(size_t a_capacity) {
+        return (util::shm_ring::footprint(a_capacity) + 63) & ~size_t(63);
+    }
+
+    /// Send a message with file descriptors \a a_fds.
+    static bool send(int a_sock, const std::string& a_msg, const int* a_fds, size_t a_nfds) {
+        iovec  iov = {const_cast<char*>(a_msg.data()), a_msg.size()};
+        union { cmsghdr h; char buf[CMSG_SPACE(sizeof(int) * 2)]; } ctl;
+        msghdr m;
+        memset(&m, 0, sizeof(m));
+        m.msg_iov    = &iov;
+        m.msg_iovlen = 1;
+        if (a_nfds) {
+            memset(&ctl, 0, sizeof(ctl));
+            m.msg_control    = ctl.buf;
+            m.msg_controllen = CMSG_SPACE(sizeof(int) * a_nfds);
+            cmsghdr* c    = CMSG_FIRSTHDR(&m);
+            c->cmsg_level = SOL_SOCKET;
+            c->cmsg_type  = SCM_RIGHTS;
+            c->cmsg_len   = CMSG_LEN(sizeof(int) * a_nfds);
+            memcpy(CMSG_DATA(c), a_fds, sizeof(int) * a_nfds);
+        }
+        return ::sendmsg(a_sock, &m, MSG_NOSIGNAL) == ssize_t(a_msg.size());
+    }
+
+    /// Receive a message with up to two file descriptors.  Descriptors
+    /// that are not received are set to -1.
+    /// @return size of the message, 0 on end of file or -1 on error.
+    static ssize_t recv(int a_sock, char* a_buf, size_t a_size, int (&a_fds)[2]) {
+        iovec  iov = {a_buf, a_size};
+        union { cmsghdr h; char buf[CMSG_SPACE(sizeof(int) * 2)]; } ctl;
+        msghdr m;
+        memset(&m, 0, sizeof(m));
+        m.msg_iov        = &iov;
+        m.msg_iovlen     = 1;
+        m.msg_control    = ctl.buf;
+        m.msg_controllen = sizeof(ctl.buf);
+        a_fds[0] = a_fds[1] = -1;
+        ssize_t n = ::recvmsg(a_sock, &m, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+        if (n < 0)
+            return -1;
+        size_t k = 0;
+        for (cmsghdr* c = CMSG_FIRSTHDR(&m); c; c = CMSG_NXTHDR(&m, c)) {
+            if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+                continue;
+            const int* p = reinterpret_cast<const int*>(CMSG_DATA(c));
+            for (size_t i = 0, e = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int); i < e; ++i)
+                if (k < 2) a_fds[k++] = p[i];
+                else       ::close(p[i]);
+        }
+        return n;
+    }
+
+    static std::string hello(size_t a_capacity, uint32_t a_creation,
+                             const std::string& a_node, const std::string& a_cookie) {
+        hello_hdr h;
+        memcpy(h.magic, magic(), sizeof(h.magic));
+        h.capacity   = uint32_t(a_capacity);
+        h.creation   = a_creation;
+        h.node_len   = uint16_t(a_node.size());
+        h.cookie_len = uint16_t(a_cookie.size());
+        return std::string(reinterpret_cast<const char*>(&h), sizeof(h)) + a_node + a_cookie;
+    }
+
+    static std::string reply(int a_status, const std::string& a_node) {
+        reply_hdr h;
+        memcpy(h.magic, magic(), sizeof(h.magic));
+        h.status   = a_status;
+        h.node_len = uint16_t(a_node.size());
+        return std::string(reinterpret_cast<const char*>(&h), sizeof(h)) + a_node;
+    }
+};
+
+/**
+ * Accepts shm:// connections on a Unix domain socket.  For every valid
+ * hello message the handler is called with the peer's parameters.  The
+ * handler takes ownership of the descriptors of the peer that it uses
+ * by setting them to -1, and replies to the peer.
+ */
+class shm_listener : private boost::noncopyable {
+public:
+    typedef boost::asio::generic::seq_packet_protocol protocol;
+
+    /// Protocol of SOCK_SEQPACKET Unix domain sockets.
+    static protocol unix_protocol() { return protocol(AF_UNIX, 0); }
+
+    static protocol::endpoint endpoint(const std::string& a_path) {
+        return protocol::endpoint(boost::asio::local::stream_protocol::endpoint(a_path));
+    }
+
+    /// Connecting peer.
+    struct peer {
+        int         sock;       ///< Rendezvous socket
+        int         seg;        ///< Shared memory segment
+        int         bell;       ///< Wakes up the peer
+        size_t      capacity;   ///< Size of each ring
+        uint32_t    creation;
+        std::string node;
+        std::string cookie;
+
+        peer() : sock(-1), seg(-1), bell(-1), capacity(0), creation(0) {}
+        ~peer() {
+            for (int fd : {sock, seg, bell})
+                if (fd >= 0) ::close(fd);
+        }
+
+        /// Reject the connection with error \a a_status.
+        void reject(int a_status) {
+            shm_handshake::send(sock, shm_handshake::reply(a_status, std::string()), NULL, 0);
+        }
+    };
+
+    typedef std::function<void (peer&)> handler;
+
+    /// Listen on the socket file \a a_path, which is replaced if it exists.
+    /// @throws boost::system::system_error
+    shm_listener(boost::asio::io_service& a_svc, const std::string& a_path, const handler& a_h)
+        : m_acceptor(a_svc), m_path(a_path), m_handler(a_h)
+    {
+        ::unlink(a_path.c_str());
+        m_acceptor.open(unix_protocol());
+        m_acceptor.bind(endpoint(a_path));
+        m_acceptor.listen();
+        accept();
+    }
+
+    ~shm_listener() {
+        boost::system::error_code ec;
+        m_acceptor.close(ec);
+        ::unlink(m_path.c_str());
+    }
+
+    const std::string& path() const { return m_path; }
+
+private:
+    typedef boost::shared_ptr<protocol::socket> socket_ptr;
+
+    boost::asio::basic_socket_acceptor<protocol> m_acceptor;
+    std::string         m_path;
+    handler             m_handler;
+
+    void accept() {
+        socket_ptr s(new protocol::socket(m_acceptor.get_executor()));
+        m_acceptor.async_accept(*s, [this, s](const boost::system::error_code& ec) {
+            if (ec == boost::asio::error::operation_aborted)
+                return;
+            if (!ec)
+                read_hello(s);
+            accept();
+        });
+    }
+
+    void read_hello(const socket_ptr& a_sock) {
+        handler h = m_handler;
+        a_sock->async_wait(protocol::socket::wait_read,
+            [h, a_sock](const boost::system::error_code& ec) {
+                if (ec)
+                    return;
+                char buf[shm_handshake::s_max_msg];
+                int  fds[2];
+                ssize_t n = shm_handshake::recv(a_sock->native_handle(), buf, sizeof(buf), fds);
+                peer p;
+                p.seg  = fds[0];
+                p.bell = fds[1];
+                const shm_handshake::hello_hdr* hdr =
+                    reinterpret_cast<const shm_handshake::hello_hdr*>(buf);
+                if (n < ssize_t(sizeof(*hdr)) || memcmp(hdr->magic, shm_handshake::magic(), 8)
+                    || size_t(n) != sizeof(*hdr) + hdr->node_len + hdr->cookie_len
+                    || p.seg < 0 || p.bell < 0)
+                    return;
+                p.sock     = a_sock->release();
+                p.capacity = hdr->capacity;
+                p.creation = hdr->creation;
+                p.node.assign(buf + sizeof(*hdr), hdr->node_len);
+                p.cookie.assign(buf + sizeof(*hdr) + hdr->node_len, hdr->cookie_len);
+                h(p);
+            });
+    }
+};
+
+//----------------------------------------------------------------------------
+/// \class shm_connection
+/// \brief Connection to a co-located eixx node through shared memory.
+///
+/// The distribution packets are passed through a pair of lock-free
+/// single-producer single-consumer rings in a shared memory segment.  A
+/// side that finds its input ring empty (or output ring full) announces
+/// that it sleeps and waits for its eventfd, which the other side
+/// signals after moving data.  With the busy-polling backend the rings
+/// are polled and eventfds are not used while the data flows.
+///
+/// The address of the remote node is "shm://<path>", where <path> is
+/// the socket passed to basic_otp_node::shm_listen() by the remote node.
+//----------------------------------------------------------------------------
+template <class Handler, class Alloc>
+class shm_connection
+    : public connection<Handler, Alloc>
+{
+public:
+    typedef connection<Handler, Alloc>              base_t;
+    typedef shm_listener::protocol                  protocol;
+    typedef typename base_t::pointer                pointer;
+
+    shm_connection(boost::asio::io_service& a_svc, Handler* a_h, const Alloc& a_alloc)
+        : connection<Handler, Alloc>(SHM, a_svc, a_h, a_alloc)
+        , m_socket(a_svc)
+        , m_bell(a_svc)
+        , m_peer_bell(-1)
+        , m_bell_waiting(false)
+    {
+    }
+
+    ~shm_connection() {
+        if (m_peer_bell >= 0)
+            ::close(m_peer_bell);
+    }
+
+    /// Create a connection accepted by shm_listener and reply to the peer.
+    /// The connection is to be started by calling start() in the thread
+    /// of \a a_svc.
+    /// @throws std::runtime_error
+    static pointer accept(boost::asio::io_service& a_svc, Handler* a_h,
+                          uint32_t a_this_creation, atom a_this_node, atom a_cookie,
+                          shm_listener::peer& a_peer, const Alloc& a_alloc = Alloc());
+
+    /// Get the rendezvous socket of the connection.
+    protocol::socket& socket() { return m_socket; }
+
+    void start() {
+        base_t::start();
+        watch_peer();
+    }
+
+    using base_t::stop;
+
+    void stop(const boost::system::error_code& e) {
+        boost::system::error_code ec;
+        m_socket.close(ec);
+        m_bell.close(ec);
+        release_handlers();
+        base_t::stop(e);
+    }
+
+    std::string peer_address() const { return m_path; }
+
+    int native_socket() { return m_socket.native_handle(); }
+
+    uint64_t remote_flags() const { return 0; }
+
+    /// Read from the input ring to \a a_buf until \a a_cond is satisfied.
+    template <class MutableBuffers, class CompletionCondition, class ReadHandler>
+    void async_read(const MutableBuffers& a_buf, const CompletionCondition& a_cond, ReadHandler h) {
+        boost::asio::mutable_buffer b(*boost::asio::buffer_sequence_begin(a_buf));
+        m_rd.data    = static_cast<char*>(b.data());
+        m_rd.size    = b.size();
+        m_rd.done    = 0;
+        m_rd.cond    = a_cond;
+        m_rd.handler = h;
+        do_read();
+    }
+
+    /// Write \a a_bufs to the output ring.
+    template <class ConstBuffers, class CompletionCondition, class WriteHandler>
+    void async_write(const ConstBuffers& a_bufs, const CompletionCondition& a_cond, WriteHandler h) {
+        m_wr.iov.clear();
+        for (auto it  = boost::asio::buffer_sequence_begin(a_bufs),
+                  end = boost::asio::buffer_sequence_end(a_bufs); it != end; ++it) {
+            boost::asio::const_buffer b(*it);
+            if (b.size())
+                m_wr.iov.push_back(iovec{const_cast<void*>(b.data()), b.size()});
+        }
+        m_wr.pos     = 0;
+        m_wr.done    = 0;
+        m_wr.cond    = a_cond;
+        m_wr.handler = h;
+        do_write();
+    }
+
+    /// Wait for the input ring to have data or the output ring to have space.
+    template <class WaitHandler>
+    void async_wait(boost::asio::socket_base::wait_type a_type, WaitHandler h) {
+        if (a_type == boost::asio::socket_base::wait_read) {
+            m_wait_rd = h;
+            check_wait_rd();
+        } else {
+            m_wait_wr = h;
+            check_wait_wr();
+        }
+    }
+
+    ssize_t read_some(char* a_buf, size_t a_size) override {
+        size_t n = m_in.read(a_buf, a_size);
+        if (!n) {
+            errno = EAGAIN;
+            return -1;
+        }
+        if (m_in.wake_writer())
+            ring_bell();
+        return ssize_t(n);
+    }
+
+    ssize_t write_some(const iovec* a_iov, size_t a_cnt) override {
+        size_t n = m_out.write(a_iov, a_cnt);
+        if (!n) {
+            errno = EAGAIN;
+            return -1;
+        }
+        if (m_out.wake_reader())
+            ring_bell();
+        return ssize_t(n);
+    }
+
+private:
+    typedef std::function<void (const boost::system::error_code&, size_t)> io_handler;
+    typedef std::function<size_t (const boost::system::error_code&, size_t)> io_condition;
+    typedef std::function<void (const boost::system::error_code&)> wait_handler;
+
+    struct read_op {
+        char*           data;
+        size_t          size;
+        size_t          done;
+        io_condition    cond;
+        io_handler      handler;
+    };
+
+    struct write_op {
+        std::vector<iovec>  iov;
+        size_t              pos;
+        size_t              done;
+        io_condition        cond;
+        io_handler          handler;
+    };
+
+    protocol::socket            m_socket;       ///< Rendezvous socket
+    posix::stream_descriptor    m_bell;         ///< Signaled by the peer
+    int                         m_peer_bell;    ///< Wakes up the peer
+    util::shm_segment           m_seg;
+    util::shm_ring              m_in;
+    util::shm_ring              m_out;
+    std::string                 m_path;
+    bool                        m_bell_waiting;
+    read_op                     m_rd;
+    write_op                    m_wr;
+    wait_handler                m_wait_rd;
+    wait_handler                m_wait_wr;
+
+    /// @throws std::runtime_error
+    void connect(uint32_t a_this_creation, atom a_this_node, atom a_remote_nodename, atom a_cookie);
+
+    void handle_reply(const boost::system::error_code& ec);
+
+    /// Attach to the rings of segment \a a_fd.  The client writes the
+    /// first ring and reads the second one.
+    void attach(int a_fd, size_t a_capacity, bool a_client, bool a_init);
+
+    /// Wait for the peer to close the rendezvous socket.
+    void watch_peer();
+
+    void ring_bell() {
+        uint64_t one = 1;
+        if (::write(m_peer_bell, &one, sizeof(one)) < 0 && errno != EAGAIN)
+            this->on_error(std::string("Cannot wake up peer: ") + strerror(errno));
+    }
+
+    void wait_bell();
+    void handle_bell(const boost::system::error_code& ec);
+
+    void do_read();
+    void do_write();
+    void check_wait_rd();
+    void check_wait_wr();
+
+    /// Complete an operation through the io_service to avoid recursion
+    /// between the handler and the next operation.
+    void post_completion(io_handler& a_h, size_t a_bytes) {
+        io_handler h;
+        h.swap(a_h);
+        this->m_io_service.post([h, a_bytes]() { h(boost::system::error_code(), a_bytes); });
+    }
+
+    void release_handlers() {
+        m_rd.handler = nullptr;
+        m_wr.handler = nullptr;
+        m_wait_rd    = nullptr;
+        m_wait_wr    = nullptr;
+    }
+};
+
+//------------------------------------------------------------------------------
+// shm_connection implementation
+//------------------------------------------------------------------------------
+
+template <class Handler, class Alloc>
+typename shm_connection<Handler, Alloc>::pointer
+shm_connection<Handler, Alloc>::
+accept(boost::asio::io_service& a_svc, Handler* a_h,
+       uint32_t a_this_creation, atom a_this_node, atom a_cookie,
+       shm_listener::peer& a_peer, const Alloc& a_alloc)
+{
+    size_t cap = a_peer.capacity;
+    if (!cap || (cap & (cap - 1)))
+        THROW_RUNTIME_ERROR("Invalid shm ring size " << cap << " of " << a_peer.node);
+
+    boost::shared_ptr<shm_connection<Handler, Alloc>> p(
+        new shm_connection<Handler, Alloc>(a_svc, a_h, a_alloc));
+    p->base_t::connect(a_this_creation, a_this_node, atom(a_peer.node), a_cookie);
+    p->attach(a_peer.seg, cap, false, false);
+    a_peer.seg = -1;
+    p->m_peer_bell = a_peer.bell;
+    a_peer.bell = -1;
+
+    int bell = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (bell < 0)
+        THROW_RUNTIME_ERROR("Cannot create eventfd: " << strerror(errno));
+    p->m_bell.assign(bell);
+    p->m_socket.assign(shm_listener::unix_protocol(), a_peer.sock);
+    a_peer.sock = -1;
+
+    std::string reply = shm_handshake::reply(0, a_this_node.to_string());
+    if (!shm_handshake::send(p->native_socket(), reply, &bell, 1))
+        THROW_RUNTIME_ERROR("Cannot reply to " << a_peer.node << ": " << strerror(errno));
+
+    return p;
+}
+
+template <class Handler, class Alloc>
+void shm_connection<Handler, Alloc>::
+connect(uint32_t a_this_creation, atom a_this_node, atom a_remote_nodename, atom a_cookie)
+{
+    base_t::connect(a_this_creation, a_this_node, a_remote_nodename, a_cookie);
+
+    std::string addr = a_remote_nodename.to_string();
+    size_t pos = addr.find("://");
+    m_path = pos == std::string::npos ? addr : addr.substr(pos + 3);
+
+    boost::system::error_code err;
+    m_socket.connect(shm_listener::endpoint(m_path), err);
+    if (err)
+        THROW_RUNTIME_ERROR("Error connecting to: " << m_path << ':' << err.message());
+
+    size_t cap = this->m_wr_policy.shm_ring_size;
+    if (!cap || (cap & (cap - 1)))
+        THROW_RUNTIME_ERROR("shm ring size must be a power of two: " << cap);
+
+    m_seg.create(shm_handshake::ring_stride(cap) + util::shm_ring::footprint(cap));
+    attach(-1, cap, true, true);
+
+    int bell = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (bell < 0)
+        THROW_RUNTIME_ERROR("Cannot create eventfd: " << strerror(errno));
+    m_bell.assign(bell);
+
+    int fds[2] = {m_seg.fd(), bell};
+    std::string hello = shm_handshake::hello(cap, a_this_creation,
+                                             a_this_node.to_string(), a_cookie.to_string());
+    if (!shm_handshake::send(native_socket(), hello, fds, 2))
+        THROW_RUNTIME_ERROR("Error sending hello to: " << m_path << ':' << strerror(errno));
+
+    auto pthis = this->shared_from_this();
+    m_socket.async_wait(protocol::socket::wait_read, [pthis](const auto& ec) {
+        static_cast<shm_connection<Handler, Alloc>*>(pthis.get())->handle_reply(ec);
+    });
+}
+
+template <class Handler, class Alloc>
+void shm_connection<Handler, Alloc>::
+handle_reply(const boost::system::error_code& ec)
+{
+    if (ec == boost::asio::error::operation_aborted)
+        return;
+
+    char buf[shm_handshake::s_max_msg];
+    int  fds[2] = {-1, -1};
+    ssize_t n = ec ? -1 : shm_handshake::recv(native_socket(), buf, sizeof(buf), fds);
+    const shm_handshake::reply_hdr* hdr = reinterpret_cast<const shm_handshake::reply_hdr*>(buf);
+
+    std::string err;
+    if (ec)
+        err = ec.message();
+    else if (n < ssize_t(sizeof(*hdr)) || memcmp(hdr->magic, shm_handshake::magic(), 8)
+             || size_t(n) != sizeof(*hdr) + hdr->node_len)
+        err = n == 0 ? "Connection closed by peer" : "Invalid reply";
+    else if (hdr->status)
+        err = strerror(hdr->status);
+    else if (fds[0] < 0)
+        err = "No eventfd in reply";
+
+    if (fds[1] >= 0)
+        ::close(fds[1]);
+
+    if (!err.empty()) {
+        if (fds[0] >= 0)
+            ::close(fds[0]);
+        boost::system::error_code e;
+        m_socket.close(e);
+        this->m_handler->on_connect_failure(this, "shm connection to " + m_path + " failed: " + err);
+        return;
+    }
+
+    m_peer_bell = fds[0];
+    this->m_remote_nodename = atom(std::string(buf + sizeof(*hdr), hdr->node_len));
+    start();
+}
+
+template <class Handler, class Alloc>
+void shm_connection<Handler, Alloc>::
+attach(int a_fd, size_t a_capacity, bool a_client, bool a_init)
+{
+    size_t stride = shm_handshake::ring_stride(a_capacity);
+    if (a_fd >= 0)
+        m_seg.attach(a_fd, stride + util::shm_ring::footprint(a_capacity));
+    util::shm_ring r0(m_seg.data(),          a_capacity, a_init);
+    util::shm_ring r1(m_seg.data() + stride, a_capacity, a_init);
+    m_out = a_client ? r0 : r1;
+    m_in  = a_client ? r1 : r0;
+}
+
+template <class Handler, class Alloc>
+void shm_connection<Handler, Alloc>::
+watch_peer()
+{
+    auto pthis = this->shared_from_this();
+    m_socket.async_wait(protocol::socket::wait_read, [pthis](const auto& ec) {
+        if (ec == boost::asio::error::operation_aborted)
+            return;
+        // The peer doesn't send anything after the handshake
+        pthis->stop(ec ? ec : boost::system::error_code(boost::asio::error::eof));
+    });
+}
+
+template <class Handler, class Alloc>
+void shm_connection<Handler, Alloc>::
+wait_bell()
+{
+    if (m_bell_waiting)
+        return;
+    m_bell_waiting = true;
+    auto pthis = this->shared_from_this();
+    m_bell.async_wait(posix::stream_descriptor::wait_read, [pthis](const auto& ec) {
+        static_cast<shm_connection<Handler, Alloc>*>(pthis.get())->handle_bell(ec);
+    });
+}
+
+template <class Handler, class Alloc>
+void shm_connection<Handler, Alloc>::
+handle_bell(const boost::system::error_code& ec)
+{
+    m_bell_waiting = false;
+    if (ec || this->m_connection_aborted.load(std::memory_order_acquire)) {
+        release_handlers();
+        return;
+    }
+    uint64_t n;
+    while (::read(m_bell.native_handle(), &n, sizeof(n)) > 0);
+
+    if (m_rd.handler) do_read();
+    if (m_wr.handler) do_write();
+    if (m_wait_rd)    check_wait_rd();
+    if (m_wait_wr)    check_wait_wr();
+}
+
+template <class Handler, class Alloc>
+void shm_connection<Handler, Alloc>::
+do_read()
+{
+    while (true) {
+        size_t n = m_in.read(m_rd.data + m_rd.done, m_rd.size - m_rd.done);
+        m_rd.done += n;
+        if (n && m_in.wake_writer())
+            ring_bell();
+        if (m_rd.done == m_rd.size || !m_rd.cond(boost::system::error_code(), m_rd.done)) {
+            post_completion(m_rd.handler, m_rd.done);
+            return;
+        }
+        if (!n && m_in.prepare_rd_wait()) {
+            wait_bell();
+            return;
+        }
+    }
+}
+
+template <class Handler, class Alloc>
+void shm_connection<Handler, Alloc>::
+do_write()
+{
+    while (true) {
+        size_t n = m_out.write(m_wr.iov.data() + m_wr.pos, m_wr.iov.size() - m_wr.pos);
+        m_wr.done += n;
+        for (size_t left = n; left; ) {
+            iovec& v = m_wr.iov[m_wr.pos];
+            if (left >= v.iov_len) {
+                left -= v.iov_len;
+                ++m_wr.pos;
+            } else {
+                v.iov_base = static_cast<char*>(v.iov_base) + left;
+                v.iov_len -= left;
+                left = 0;
+            }
+        }
+        if (n && m_out.wake_reader())
+            ring_bell();
+        if (m_wr.pos == m_wr.iov.size() || !m_wr.cond(boost::system::error_code(), m_wr.done)) {
+            post_completion(m_wr.handler, m_wr.done);
+            return;
+        }
+        if (!n && m_out.prepare_wr_wait()) {
+            wait_bell();
+            return;
+        }
+    }
+}
+
+template <class Handler, class Alloc>
+void shm_connection<Handler, Alloc>::
+check_wait_rd()
+{
+    if (m_in.readable() || !m_in.prepare_rd_wait()) {
+        wait_handler h;
+        h.swap(m_wait_rd);
+        this->m_io_service.post([h]() { h(boost::system::error_code()); });
+    } else
+        wait_bell();
+}
+
+template <class Handler, class Alloc>
+void shm_connection<Handler, Alloc>::
+check_wait_wr()
+{
+    if (m_out.writable() || !m_out.prepare_wr_wait()) {
+        wait_handler h;
+        h.swap(m_wait_wr);
+        this->m_io_service.post([h]() { h(boost::system::error_code()); });
+    } else
+        wait_bell();
+}
+
+} // namespace connect
+} // namespace eixx
+
+#endif // _EIXX_TRANSPORT_OTP_CONNECTION_SHM_HPP_
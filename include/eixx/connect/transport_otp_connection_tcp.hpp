@@ -29,7 +29,15 @@ limitations under the License.
 #ifndef _EIXX_TRANSPORT_OTP_CONNECTION_TCP_HPP_
 #define _EIXX_TRANSPORT_OTP_CONNECTION_TCP_HPP_
 
+#include <array>
+#include <atomic>
+#include <vector>
+#include <functional>
 #include <eixx/connect/transport_otp_connection.hpp>
+#include <eixx/connect/epmd_cache.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/make_shared.hpp>
+#include <netinet/tcp.h>
 #include <ei.h>
 
 #ifdef HAVE_CONFIG_H
@@ -39,6 +47,194 @@ limitations under the License.
 namespace eixx {
 namespace connect {
 
+/**
+ * Accepts connections of Erlang nodes on a TCP port.  An accepted socket
+ * is read up to the send_name message of the distribution handshake,
+ * after which the handler is called with the peer's parameters.  The
+ * handler either passes the peer to tcp_connection::accept(), which
+ * continues the handshake, or rejects it.
+ *
+ * The port may be served by several acceptors bound with SO_REUSEPORT,
+ * each running on its own service, so that the kernel spreads a storm
+ * of reconnecting nodes over several threads.
+ */
+class tcp_listener : private boost::noncopyable {
+public:
+    typedef boost::asio::ip::tcp::socket    socket;
+    typedef boost::shared_ptr<socket>       socket_ptr;
+
+    /// Connecting peer.
+    struct peer {
+        socket_ptr  sock;
+        std::string node;
+        uint64_t    flags;
+        uint32_t    creation;
+        char        tag;        ///< 'n' (version 5) or 'N' (version 6) send_name
+
+        peer() : flags(0), creation(0), tag(0) {}
+
+        /// Reject the connection with handshake status \a a_status
+        /// (e.g. "nok", "not_allowed").
+        void reject(const std::string& a_status) {
+            char buf[32];
+            char* w = buf;
+            size_t n = std::min(a_status.size(), sizeof(buf) - 3);
+            put16be(w, uint16_t(n + 1));
+            put8(w, 's');
+            memcpy(w, a_status.c_str(), n);
+            boost::system::error_code ec;
+            boost::asio::write(*sock, boost::asio::buffer(buf, n + 3), ec);
+            sock->close(ec);
+        }
+    };
+
+    typedef std::function<void (peer&)> handler;
+
+    /// Listen on \a a_endpoint with one acceptor per service in \a a_svcs.
+    /// If the port of \a a_endpoint is 0, an ephemeral port is chosen.
+    /// @throws boost::system::system_error
+    tcp_listener(const std::vector<boost::asio::io_service*>& a_svcs,
+                 const boost::asio::ip::tcp::endpoint& a_endpoint, const handler& a_h)
+        : m_endpoint(a_endpoint)
+    {
+        BOOST_ASSERT(!a_svcs.empty());
+        bool reuse_port = a_svcs.size() > 1;
+        for (auto svc : a_svcs) {
+            boost::shared_ptr<acceptor> a(new acceptor(*svc, a_h));
+            a->open(m_endpoint, reuse_port);
+            // The other acceptors bind to the port chosen for the first one
+            m_endpoint.port(a->m_acceptor.local_endpoint().port());
+            m_acceptors.push_back(a);
+        }
+        for (auto& a : m_acceptors)
+            a->accept();
+    }
+
+    ~tcp_listener() {
+        for (auto& a : m_acceptors)
+            a->close();
+    }
+
+    /// Port the listener is bound to.
+    uint16_t port() const { return m_endpoint.port(); }
+
+    /// Number of acceptors serving the port.
+    size_t acceptors() const { return m_acceptors.size(); }
+
+private:
+    /// Max size of the send_name message
+    static const size_t s_max_name_msg = 2 + 1 + 8 + 4 + 2 + MAXNODELEN;
+
+    struct acceptor : public boost::enable_shared_from_this<acceptor> {
+        typedef std::array<char, s_max_name_msg> name_buf;
+
+        boost::asio::ip::tcp::acceptor  m_acceptor;
+        handler                         m_handler;
+        std::atomic<bool>               m_closed;
+
+        acceptor(boost::asio::io_service& a_svc, const handler& a_h)
+            : m_acceptor(a_svc), m_handler(a_h), m_closed(false)
+        {}
+
+        void open(const boost::asio::ip::tcp::endpoint& a_ep, bool a_reuse_port) {
+            m_acceptor.open(a_ep.protocol());
+            m_acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+#ifdef SO_REUSEPORT
+            if (a_reuse_port) {
+                int on = 1;
+                if (::setsockopt(m_acceptor.native_handle(), SOL_SOCKET, SO_REUSEPORT,
+                                 &on, sizeof(on)) < 0)
+                    throw boost::system::system_error(errno, boost::system::system_category(),
+                                                      "SO_REUSEPORT");
+            }
+#else
+            if (a_reuse_port)
+                throw boost::system::system_error(ENOTSUP, boost::system::system_category(),
+                                                  "SO_REUSEPORT");
+#endif
+            m_acceptor.bind(a_ep);
+            m_acceptor.listen();
+        }
+
+        /// Close the acceptor in the thread serving it.  Handlers that
+        /// are already queued complete without calling m_handler.
+        void close() {
+            m_closed = true;
+            auto pthis = this->shared_from_this();
+            auto& svc  = static_cast<boost::asio::io_service&>(m_acceptor.get_executor().context());
+            auto  stop = [pthis]() {
+                boost::system::error_code ec;
+                pthis->m_acceptor.close(ec);
+            };
+            if (svc.stopped())
+                stop();
+            else
+                svc.post(stop);
+        }
+
+        void accept() {
+            auto pthis = this->shared_from_this();
+            socket_ptr s(new socket(m_acceptor.get_executor()));
+            m_acceptor.async_accept(*s, [pthis, s](const boost::system::error_code& ec) {
+                if (ec == boost::asio::error::operation_aborted || pthis->m_closed)
+                    return;
+                if (!ec)
+                    pthis->read_name(s);
+                pthis->accept();
+            });
+        }
+
+        void read_name(const socket_ptr& a_sock) {
+            auto pthis = this->shared_from_this();
+            boost::shared_ptr<name_buf> buf(new name_buf);
+            boost::asio::async_read(*a_sock, boost::asio::buffer(buf->data(), 2),
+                [pthis, a_sock, buf](const boost::system::error_code& ec, size_t) {
+                    if (ec)
+                        return;
+                    const char* p = buf->data();
+                    size_t len = get16be(p);
+                    if (len < 8 || len > buf->size() - 2)
+                        return;
+                    boost::asio::async_read(*a_sock, boost::asio::buffer(buf->data() + 2, len),
+                        [pthis, a_sock, buf, len](const boost::system::error_code& ec, size_t) {
+                            if (!ec && !pthis->m_closed)
+                                pthis->on_name(a_sock, buf->data() + 2, len);
+                        });
+                });
+        }
+
+        /// Parse the send_name message \a a_msg of \a a_len bytes.
+        void on_name(const socket_ptr& a_sock, const char* a_msg, size_t a_len) {
+            const char* end = a_msg + a_len;
+            peer p;
+            p.sock = a_sock;
+            p.tag  = char(get8(a_msg));
+            size_t nlen;
+            if (p.tag == 'n') {
+                a_msg += 2;     // Version (always 5)
+                p.flags = get32be(a_msg);
+                nlen    = size_t(end - a_msg);
+            } else if (p.tag == 'N' && a_len >= 15) {
+                p.flags    = get64be(a_msg);
+                p.creation = get32be(a_msg);
+                nlen       = get16be(a_msg);
+            } else
+                return;
+            if (nlen > size_t(end - a_msg))
+                return;
+            p.node.assign(a_msg, nlen);
+            if (p.node.find('@') == std::string::npos) {
+                p.reject("not_allowed");
+                return;
+            }
+            m_handler(p);
+        }
+    };
+
+    boost::asio::ip::tcp::endpoint              m_endpoint;
+    std::vector<boost::shared_ptr<acceptor>>    m_acceptors;
+};
+
 //----------------------------------------------------------------------------
 /// TCP connection channel
 //----------------------------------------------------------------------------
@@ -48,14 +244,27 @@ class tcp_connection
 {
 public:
     typedef connection<Handler, Alloc> base_t;
+    typedef typename base_t::pointer   pointer;
 
     tcp_connection(boost::asio::io_service& a_svc, Handler* a_h, const Alloc& a_alloc)
         : connection<Handler, Alloc>(TCP, a_svc, a_h, a_alloc)
         , m_socket(a_svc)
         , m_resolver(a_svc)
         , m_state(CS_INIT)
+        , m_complement(false)
+        , m_cache(NULL)
+        , m_node_port(0)
     {}
 
+    /// Create a connection of a peer accepted by tcp_listener.  The rest
+    /// of the handshake (status, challenge, challenge reply and ack) is
+    /// done by start(), which calls the handler's on_connect() when the
+    /// peer is authenticated.  The connection is run by \a a_svc.
+    /// @throws std::runtime_error if the peer lacks required capabilities
+    static pointer accept(boost::asio::io_service& a_svc, Handler* a_h,
+                          uint32_t a_this_creation, atom a_this_node, atom a_cookie,
+                          tcp_listener::peer& a_peer, const Alloc& a_alloc = Alloc());
+
     /// Get the socket associated with the connection.
     boost::asio::ip::tcp::socket& socket() { return m_socket; }
 
@@ -84,6 +293,17 @@ public:
 
     uint64_t remote_flags() const { return m_remote_flags; }
 
+    /// Enable/disable TCP_CORK on the socket (Linux only).
+    bool set_cork(bool a_on) override {
+#ifdef TCP_CORK
+        int v = a_on ? 1 : 0;
+        return ::setsockopt(native_socket(), IPPROTO_TCP, TCP_CORK, &v, sizeof(v)) == 0;
+#else
+        (void)a_on;
+        return false;
+#endif
+    }
+
 private:
     /// Authentication state
     enum connect_state {
@@ -98,6 +318,10 @@ private:
         , CS_WAIT_CHALLENGE
         , CS_WAIT_WRITE_CHALLENGE_REPLY_DONE
         , CS_WAIT_CHALLENGE_ACK
+        , CS_ACCEPTED
+        , CS_WAIT_WRITE_STATUS_DONE
+        , CS_WAIT_CHALLENGE_REPLY
+        , CS_WAIT_WRITE_CHALLENGE_ACK_DONE
         , CS_CONNECTED
     };
 
@@ -106,6 +330,9 @@ private:
     boost::asio::ip::tcp::resolver  m_resolver;
     boost::asio::ip::tcp::endpoint  m_peer_endpoint;
     connect_state                   m_state;  // Async connection state
+    bool                            m_complement;   // Accepted peer sends complement
+    epmd_cache*                     m_cache;        // Ports of nodes or NULL
+    uint16_t                        m_node_port;    // Port of the node if not looked up in epmd
 
     size_t       m_expect_size;
     char         m_buf_epmd[EPMDBUF];
@@ -151,12 +378,21 @@ private:
         return s.substr(s.find('@')+1);
     }
 
+    typedef void (tcp_connection<Handler, Alloc>::*connect_handler)(
+        const boost::system::error_code& err);
+
+    /// Connect the socket to the first of \a a_endpoints accepting the
+    /// connection.  All endpoints are tried in parallel, so that an
+    /// unreachable address (e.g. IPv6 without a route) doesn't delay the
+    /// connection.  \a a_next is called with the error of the last
+    /// attempt if none succeeds.
+    void connect_any(const std::vector<boost::asio::ip::tcp::endpoint>& a_endpoints,
+                     connect_handler a_next);
+
     void handle_resolve(
         const boost::system::error_code& err, 
         boost::asio::ip::tcp::resolver::iterator ep_iterator);
-    void handle_epmd_connect(
-        const boost::system::error_code& err,
-        boost::asio::ip::tcp::resolver::iterator ep_iterator);
+    void handle_epmd_connect(const boost::system::error_code& err);
     void handle_epmd_write(const boost::system::error_code& err);
     void handle_epmd_read_header(
         const boost::system::error_code& err, size_t bytes_transferred);
@@ -178,6 +414,17 @@ private:
     void handle_read_challenge_ack_body(
         const boost::system::error_code& err, size_t bytes_transferred);
 
+    // Handshake of an accepted connection
+    void send_challenge();
+    void handle_write_status(const boost::system::error_code& err);
+    void read_challenge_reply();
+    void handle_read_challenge_reply_header(
+        const boost::system::error_code& err, size_t bytes_transferred);
+    void handle_read_challenge_reply_body(
+        const boost::system::error_code& err, size_t bytes_transferred);
+    void handle_write_challenge_ack(const boost::system::error_code& err);
+    void accept_failure(const std::string& a_error);
+
     uint32_t gen_challenge(void);
     void     gen_digest(unsigned challenge, const char cookie[], uint8_t digest[16]);
     uint32_t md_32(char* string, size_t length);
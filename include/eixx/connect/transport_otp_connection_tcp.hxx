@@ -42,6 +42,12 @@ namespace connect {
 template <class Handler, class Alloc>
 void tcp_connection<Handler, Alloc>::start() 
 {
+    if (m_state == CS_ACCEPTED) {
+        // Authenticate the accepted peer first
+        send_challenge();
+        return;
+    }
+
 #if BOOST_VERSION >= 104700
     m_socket.non_blocking(true);
 #else
@@ -49,6 +55,14 @@ void tcp_connection<Handler, Alloc>::start()
     m_socket.io_control(nb);
 #endif
 
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+    if (this->m_wr_policy.zerocopy_threshold) {
+        int on = 1;
+        if (::setsockopt(native_socket(), SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == 0)
+            this->enable_zerocopy();
+    }
+#endif
+
     base_t::start(); // trigger on_connect callback
 }
 
@@ -72,6 +86,26 @@ void tcp_connection<Handler, Alloc>::connect(
     boost::system::error_code ec;
     m_socket.close(ec);
 
+    // Skip epmd if the node's port is known
+    m_cache     = this->handler()->port_cache();
+    m_node_port = 0;
+    epmd_cache::entry e;
+    if (m_cache && m_cache->lookup(a_remote_node, e)) {
+        m_dist_version = (e.dist_version > EI_DIST_HIGH ? EI_DIST_HIGH : e.dist_version);
+        m_node_port    = e.port;
+        if (this->handler()->verbose() >= VERBOSE_TRACE) {
+            std::stringstream ss;
+            ss << "<- cached port of node '" << a_remote_node << "': port=" << e.port
+               << ",dist_high=" << e.dist_version << ",addresses=" << e.endpoints.size();
+            this->handler()->report_status(REPORT_INFO, ss.str());
+        }
+        if (!e.endpoints.empty()) {
+            m_state = CS_WAIT_CONNECT;
+            connect_any(e.endpoints, &tcp_connection<Handler, Alloc>::handle_connect);
+            return;
+        }
+    }
+
     // First resolve remote host name and connect to EPMD to find out the
     // node's port number.
 
@@ -80,10 +114,10 @@ void tcp_connection<Handler, Alloc>::connect(
     auto epmd_port = (epmd_port_s != NULL) ? epmd_port_s : std::to_string(EPMD_PORT);
     auto host      = remote_hostname();
 
-    tcp::resolver::query q(host, epmd_port);
+    tcp::resolver::query q(host, m_node_port ? std::to_string(m_node_port) : epmd_port);
     m_state    = CS_WAIT_RESOLVE;
     auto pthis = this->shared_from_this();
-    m_resolver.async_resolve(q, [pthis](auto& err, auto& ep_iterator) {
+    m_resolver.async_resolve(q, [pthis](const auto& err, const auto& ep_iterator) {
         pthis->handle_resolve(err, ep_iterator);
     });
 }
@@ -100,20 +134,82 @@ void tcp_connection<Handler, Alloc>::handle_resolve(
         this->handler()->on_connect_failure(this, ss.str());
         return;
     }
-    // Attempt a connection to the first endpoint in the list. Each endpoint
-    // will be tried until we successfully establish a connection.
-    m_peer_endpoint = *ep_iterator;
-    m_state     = CS_WAIT_EPMD_CONNECT;
-    auto pthis  = this->shared_from_this();
-    auto epnext = ++ep_iterator;
-    m_socket.async_connect(m_peer_endpoint, [pthis, epnext](auto& a_err) {
-        pthis->handle_epmd_connect(a_err, epnext);
-    });
+    // Attempt a connection to all endpoints in the list.  The node is
+    // connected directly if its port is static.
+    std::vector<boost::asio::ip::tcp::endpoint> eps(ep_iterator, {});
+    if (m_node_port) {
+        m_state = CS_WAIT_CONNECT;
+        connect_any(eps, &tcp_connection<Handler, Alloc>::handle_connect);
+    } else {
+        m_state = CS_WAIT_EPMD_CONNECT;
+        connect_any(eps, &tcp_connection<Handler, Alloc>::handle_epmd_connect);
+    }
 }
 
 template <class Handler, class Alloc>
-void tcp_connection<Handler, Alloc>::handle_epmd_connect(
-    const boost::system::error_code& err, boost::asio::ip::tcp::resolver::iterator ep_iterator)
+void tcp_connection<Handler, Alloc>::connect_any(
+    const std::vector<boost::asio::ip::tcp::endpoint>& a_endpoints, connect_handler a_next)
+{
+    using boost::asio::ip::tcp;
+    BOOST_ASSERT(!a_endpoints.empty());
+
+    auto pthis = this->shared_from_this();
+
+    if (a_endpoints.size() == 1) {
+        m_peer_endpoint = a_endpoints.front();
+        m_socket.async_connect(m_peer_endpoint, [pthis, a_next](const auto& a_err) {
+            ((*pthis).*a_next)(a_err);
+        });
+        return;
+    }
+
+    struct race {
+        std::vector<boost::shared_ptr<tcp::socket>> sockets;
+        size_t pending;
+        bool   done;
+    };
+    auto r = boost::make_shared<race>();
+    r->pending = a_endpoints.size();
+    r->done    = false;
+    for (size_t i = 0; i < a_endpoints.size(); ++i)
+        r->sockets.emplace_back(new tcp::socket(m_socket.get_executor()));
+
+    for (size_t i = 0; i < a_endpoints.size(); ++i) {
+        auto s  = r->sockets[i];
+        auto ep = a_endpoints[i];
+        s->async_connect(ep, [pthis, a_next, r, s, ep](const boost::system::error_code& a_err) {
+            --r->pending;
+            if (r->done)
+                return;
+            // The connection was stopped while connecting
+            if (pthis->m_state == CS_INIT) {
+                r->done = true;
+                for (auto& o : r->sockets) {
+                    boost::system::error_code ec;
+                    o->close(ec);
+                }
+                return;
+            }
+            if (!a_err) {
+                r->done = true;
+                for (auto& o : r->sockets)
+                    if (o != s) {
+                        boost::system::error_code ec;
+                        o->close(ec);
+                    }
+                pthis->m_socket        = std::move(*s);
+                pthis->m_peer_endpoint = ep;
+                ((*pthis).*a_next)(a_err);
+            } else if (!r->pending) {
+                pthis->m_peer_endpoint = ep;
+                ((*pthis).*a_next)(a_err);
+            }
+        });
+    }
+}
+
+template <class Handler, class Alloc>
+void tcp_connection<Handler, Alloc>::handle_epmd_connect(const boost::system::error_code& err)
 {
     BOOST_ASSERT(m_state == CS_WAIT_EPMD_CONNECT);
     if (!err) {
@@ -138,22 +234,11 @@ void tcp_connection<Handler, Alloc>::handle_epmd_connect(
         auto pthis = this->shared_from_this();
         /*
         boost::asio::async_write(m_socket, boost::asio::buffer(m_buf_epmd, len+2),
-            [pthis](auto& err) { pthis->handle_epmd_write(err); });
+            [pthis](const auto& err) { pthis->handle_epmd_write(err); });
         */
         boost::asio::async_write(m_socket, boost::asio::buffer(m_buf_epmd, len+2),
             std::bind(&tcp_connection<Handler, Alloc>::handle_epmd_write, pthis,
                       std::placeholders::_1));
-    } else if (ep_iterator != boost::asio::ip::tcp::resolver::iterator()) {
-        // The connection failed. Try the next endpoint in the list.
-        boost::system::error_code ec;
-        m_socket.close(ec);
-        m_peer_endpoint = *ep_iterator;
-        auto pthis      = this->shared_from_this();
-        auto epnext     = ++ep_iterator;
-        m_socket.async_connect(m_peer_endpoint,
-                               [pthis, epnext](auto& a_err) {
-                                   pthis->handle_epmd_connect(a_err, epnext);
-                               });
     } else {
         std::stringstream ss;
         ss << "Error connecting to epmd at host '" 
@@ -297,6 +382,9 @@ void tcp_connection<Handler, Alloc>::handle_epmd_read_body(
     boost::system::error_code ec;
     m_socket.close(ec);
 
+    if (m_cache)
+        m_cache->store(this->remote_nodename(), {m_peer_endpoint}, dist_high);
+
     if (m_dist_version <= 4) {
         std::stringstream ss;
         ss << "Incompatible version " << m_dist_version
@@ -318,6 +406,9 @@ void tcp_connection<Handler, Alloc>::handle_connect(const boost::system::error_c
 {
     BOOST_ASSERT(m_state == CS_WAIT_CONNECT);
     if (err) {
+        // The node may have been restarted at another port
+        if (m_cache)
+            m_cache->invalidate(this->remote_nodename());
         std::stringstream ss;
         ss << "Cannot connect to node " << this->remote_nodename() 
            << " at port " << m_peer_endpoint.port() << ": " << err.message();
@@ -333,6 +424,10 @@ void tcp_connection<Handler, Alloc>::handle_connect(const boost::system::error_c
         this->handler()->report_status(REPORT_INFO, ss.str());
     }
 
+    // Remember the address of a node with a static port
+    if (m_cache && m_node_port)
+        m_cache->store(this->remote_nodename(), {m_peer_endpoint}, m_dist_version);
+
     m_our_challenge = gen_challenge();
 
     auto flags = LOCAL_FLAGS;
@@ -866,7 +961,7 @@ void tcp_connection<Handler, Alloc>::handle_read_challenge_ack_body(
         return;
     }
 
-    m_socket.set_option(boost::asio::ip::tcp::no_delay(true));
+    m_socket.set_option(boost::asio::ip::tcp::no_delay(this->m_wr_policy.no_delay));
     m_socket.set_option(boost::asio::socket_base::keep_alive(true));
 
     m_state = CS_CONNECTED;
@@ -874,6 +969,223 @@ void tcp_connection<Handler, Alloc>::handle_read_challenge_ack_body(
     this->start();
 }
 
+template <class Handler, class Alloc>
+typename tcp_connection<Handler, Alloc>::pointer
+tcp_connection<Handler, Alloc>::
+accept(boost::asio::io_service& a_svc, Handler* a_h,
+       uint32_t a_this_creation, atom a_this_node, atom a_cookie,
+       tcp_listener::peer& a_peer, const Alloc& a_alloc)
+{
+    static const uint64_t s_required =
+        DFLAG_EXTENDED_REFERENCES | DFLAG_EXTENDED_PIDS_PORTS | DFLAG_NEW_FLOATS;
+    if ((a_peer.flags & s_required) != s_required)
+        THROW_RUNTIME_ERROR("Node " << a_peer.node << " lacks required capabilities: "
+                            << std::hex << a_peer.flags);
+
+    boost::shared_ptr<tcp_connection<Handler, Alloc>> p(
+        new tcp_connection<Handler, Alloc>(a_svc, a_h, a_alloc));
+    p->base_t::connect(a_this_creation, a_this_node, atom(a_peer.node), a_cookie);
+
+    // The socket may have been accepted by a service other than a_svc
+    boost::system::error_code ec;
+    p->m_peer_endpoint = a_peer.sock->remote_endpoint(ec);
+    auto proto = a_peer.sock->local_endpoint().protocol();
+    p->m_socket.assign(proto, a_peer.sock->release());
+
+    p->m_remote_flags = a_peer.flags;
+#ifdef EI_DIST_6
+    // A peer supporting the new handshake gets the new challenge
+    // and sends the high flags and creation in a complement
+    p->m_dist_version = (a_peer.tag == 'N' || (a_peer.flags & DFLAG_HANDSHAKE_23))
+                      ? EI_DIST_6 : EI_DIST_5;
+    p->m_complement   = a_peer.tag == 'n' && p->m_dist_version == EI_DIST_6;
+#else
+    p->m_dist_version = EI_DIST_5;
+#endif
+    p->m_state = CS_ACCEPTED;
+    return p;
+}
+
+template <class Handler, class Alloc>
+void tcp_connection<Handler, Alloc>::send_challenge()
+{
+    const std::string& name = this->local_nodename().to_string();
+    bool   is_new = m_dist_version != EI_DIST_5;
+    size_t siz    = 5 + (is_new ? 2 + 1 + 8 + 4 + 4 + 2 : 2 + 1 + 2 + 4 + 4) + name.size();
+
+    if (siz > sizeof(m_buf_node)) {
+        accept_failure("-> SEND_CHALLENGE (error) nodename too long: " + name);
+        return;
+    }
+
+    m_our_challenge = gen_challenge();
+
+    char* w = m_buf_node;
+    put16be(w, 3);
+    put8(w, 's');
+    memcpy(w, "ok", 2);
+    w += 2;
+    put16be(w, uint16_t(siz - 7));
+    if (is_new) {
+        put8(w, 'N');
+        put64be(w, LOCAL_FLAGS);
+        put32be(w, m_our_challenge);
+        put32be(w, this->local_creation());
+        put16be(w, name.size());
+    } else {
+        put8(w, 'n');
+        put16be(w, EI_DIST_5);
+        put32be(w, LOCAL_FLAGS & 0xffffffff);
+        put32be(w, m_our_challenge);
+    }
+    memcpy(w, name.c_str(), name.size());
+
+    if (this->handler()->verbose() >= VERBOSE_TRACE) {
+        std::stringstream ss;
+        ss << "-> SEND_CHALLENGE sending status and challenge to node '"
+           << this->remote_nodename() << "': " << to_binary_string(m_buf_node, siz);
+        this->handler()->report_status(REPORT_INFO, ss.str());
+    }
+
+    m_state = CS_WAIT_WRITE_STATUS_DONE;
+    boost::asio::async_write(m_socket, boost::asio::buffer(m_buf_node, siz),
+        std::bind(&tcp_connection<Handler, Alloc>::handle_write_status, shared_from_this(),
+                  std::placeholders::_1));
+}
+
+template <class Handler, class Alloc>
+void tcp_connection<Handler, Alloc>::handle_write_status(const boost::system::error_code& err)
+{
+    if (err) {
+        accept_failure("-> SEND_CHALLENGE (error) sending challenge to node '"
+                       + this->remote_nodename().to_string() + "': " + err.message());
+        return;
+    }
+    m_state = CS_WAIT_CHALLENGE_REPLY;
+    read_challenge_reply();
+}
+
+template <class Handler, class Alloc>
+void tcp_connection<Handler, Alloc>::read_challenge_reply()
+{
+    // Read exactly one message, so that no distribution data is consumed
+    boost::asio::async_read(m_socket, boost::asio::buffer(m_buf_node, 2),
+        std::bind(&tcp_connection<Handler, Alloc>::handle_read_challenge_reply_header,
+            shared_from_this(), std::placeholders::_1, std::placeholders::_2));
+}
+
+template <class Handler, class Alloc>
+void tcp_connection<Handler, Alloc>::handle_read_challenge_reply_header(
+    const boost::system::error_code& err, size_t)
+{
+    if (err) {
+        accept_failure("<- RECV_CHALLENGE_REPLY (error) reading reply header from node '"
+                       + this->remote_nodename().to_string() + "': " + err.message());
+        return;
+    }
+    m_node_rd = m_buf_node;
+    m_expect_size = get16be(m_node_rd);
+    if (m_expect_size != (m_complement ? 9 : 21)) {
+        std::stringstream ss;
+        ss << "<- RECV_CHALLENGE_REPLY (error) in reply length from node '"
+           << this->remote_nodename() << "': " << m_expect_size;
+        accept_failure(ss.str());
+        return;
+    }
+    boost::asio::async_read(m_socket, boost::asio::buffer(m_buf_node, m_expect_size),
+        std::bind(&tcp_connection<Handler, Alloc>::handle_read_challenge_reply_body,
+            shared_from_this(), std::placeholders::_1, std::placeholders::_2));
+}
+
+template <class Handler, class Alloc>
+void tcp_connection<Handler, Alloc>::handle_read_challenge_reply_body(
+    const boost::system::error_code& err, size_t)
+{
+    if (err) {
+        accept_failure("<- RECV_CHALLENGE_REPLY (error) reading reply from node '"
+                       + this->remote_nodename().to_string() + "': " + err.message());
+        return;
+    }
+
+    m_node_rd = m_buf_node;
+    const char tag = static_cast<char>(get8(m_node_rd));
+
+    if (m_complement) {
+        if (tag != 'c') {
+            accept_failure(std::string("<- RECV_COMPLEMENT (error) incorrect tag, expected 'c' got '")
+                           + tag + "' from node '" + this->remote_nodename().to_string() + "'");
+            return;
+        }
+        uint64_t flags_high = get32be(m_node_rd);
+        m_remote_flags |= flags_high << 32;
+        m_complement = false;
+        read_challenge_reply();
+        return;
+    }
+
+    if (tag != 'r') {
+        accept_failure(std::string("<- RECV_CHALLENGE_REPLY (error) incorrect tag, expected 'r' got '")
+                       + tag + "' from node '" + this->remote_nodename().to_string() + "'");
+        return;
+    }
+
+    m_remote_challenge = get32be(m_node_rd);
+
+    uint8_t expected_digest[16];
+    gen_digest(m_our_challenge, this->m_cookie.c_str(), expected_digest);
+    if (memcmp(m_node_rd, expected_digest, 16) != 0) {
+        accept_failure("<- RECV_CHALLENGE_REPLY authorization failure for node '"
+                       + this->remote_nodename().to_string() + "'!");
+        return;
+    }
+
+    if (this->handler()->verbose() >= VERBOSE_TRACE) {
+        std::stringstream ss;
+        ss << "<- RECV_CHALLENGE_REPLY (ok) version=" << m_dist_version
+           << ", flags=" << m_remote_flags << ", challenge=" << m_remote_challenge;
+        this->handler()->report_status(REPORT_INFO, ss.str());
+    }
+
+    char* w = m_buf_node;
+    put16be(w, 17);
+    put8(w, 'a');
+    gen_digest(m_remote_challenge, this->m_cookie.c_str(), reinterpret_cast<uint8_t*>(w));
+
+    m_state = CS_WAIT_WRITE_CHALLENGE_ACK_DONE;
+    boost::asio::async_write(m_socket, boost::asio::buffer(m_buf_node, 19),
+        std::bind(&tcp_connection<Handler, Alloc>::handle_write_challenge_ack, shared_from_this(),
+                  std::placeholders::_1));
+}
+
+template <class Handler, class Alloc>
+void tcp_connection<Handler, Alloc>::handle_write_challenge_ack(const boost::system::error_code& err)
+{
+    if (err) {
+        accept_failure("-> SEND_CHALLENGE_ACK (error) sending ack to node '"
+                       + this->remote_nodename().to_string() + "': " + err.message());
+        return;
+    }
+
+    m_socket.set_option(boost::asio::ip::tcp::no_delay(this->m_wr_policy.no_delay));
+    m_socket.set_option(boost::asio::socket_base::keep_alive(true));
+
+    m_state = CS_CONNECTED;
+
+    this->start();
+}
+
+template <class Handler, class Alloc>
+void tcp_connection<Handler, Alloc>::accept_failure(const std::string& a_error)
+{
+    // The connection may have been stopped while waiting for I/O
+    if (m_state == CS_INIT)
+        return;
+    m_state = CS_INIT;
+    this->handler()->on_connect_failure(this, a_error);
+    boost::system::error_code ec;
+    m_socket.close(ec);
+}
+
 template <class Handler, class Alloc>
 uint32_t tcp_connection<Handler, Alloc>::gen_challenge(void)
 {
@@ -0,0 +1,302 @@
+//----------------------------------------------------------------------------
+/// \file  uring_service.hpp
+//----------------------------------------------------------------------------
+/// \brief io_uring based I/O backend of connections.
+//----------------------------------------------------------------------------
+// Copyright (c) 2010 Serge Aleynikov <saleyn@gmail.com>
+// Created: 2021-11-14
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+#ifndef _EIXX_URING_SERVICE_HPP_
+#define _EIXX_URING_SERVICE_HPP_
+
+#include <vector>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <eixx/util/uring.hpp>
+
+namespace eixx {
+namespace connect {
+
+/**
+ * An io_uring instance serving the connections of one io_service.
+ *
+ * Operations prepared while an io_service handler runs are submitted
+ * together with a single io_uring_enter(2) call from a handler posted
+ * to the io_service.  Completions are detected by waiting on the ring's
+ * file descriptor with the io_service's reactor, and are dispatched to
+ * the op objects passed when preparing the operations.
+ *
+ * Receive operations are multishot and select buffers from a group of
+ * buffers provided to the kernel.  Output buffers of connections
+ * can be registered with register_buffer() and written with send_fixed().
+ *
+ * All methods must be called by the thread running the io_service.
+ */
+class uring_service
+    : private boost::noncopyable
+    , public boost::enable_shared_from_this<uring_service>
+{
+public:
+    /// Target of completions.
+    struct op {
+        virtual ~op() {}
+        /// Called with the result and the flags of a completion.
+        virtual void complete(int a_res, unsigned a_flags) = 0;
+        /// Called instead of complete() on the last completion of the
+        /// operation when the service is shut down.
+        virtual void abandon() = 0;
+    };
+
+    /// Buffer group of receive buffers
+    static const uint16_t s_recv_group = 0;
+
+    /// @throws std::runtime_error if io_uring is not supported.
+    uring_service(boost::asio::io_service& a_svc,
+                  unsigned a_entries   = 256,
+                  unsigned a_recv_bufs = 256,
+                  size_t   a_recv_size = 16*1024,
+                  unsigned a_slots     = 1024)
+        : m_io(a_svc)
+        , m_ring(a_entries, IORING_SETUP_COOP_TASKRUN)
+        , m_recv_bufs(m_ring, s_recv_group, a_recv_bufs, a_recv_size)
+        , m_ring_fd(a_svc, ::dup(m_ring.fd()))
+        , m_inflight(0)
+        , m_submit_posted(false)
+        , m_waiting(false)
+        , m_shutdown(false)
+        , m_submits(0)
+    {
+        io_uring_rsrc_register reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.nr    = a_slots;
+        reg.flags = IORING_RSRC_REGISTER_SPARSE;
+        if (m_ring.register_op(IORING_REGISTER_BUFFERS2, &reg, sizeof(reg)) == 0)
+            for (unsigned i = a_slots; i > 0; --i)
+                m_free_slots.push_back(int(i-1));
+    }
+
+    ~uring_service() { shutdown(); }
+
+    boost::asio::io_service& io_service() { return m_io; }
+
+    /// Number of io_uring_enter(2) calls made to submit operations.
+    size_t submits() const { return m_submits; }
+
+    /// Get the data of receive buffer \a a_bid.
+    const char* recv_buffer(uint16_t a_bid) const { return m_recv_bufs.buffer(a_bid); }
+
+    /// Return receive buffer \a a_bid to the kernel.  The buffer is
+    /// provided with the next batch of submissions.
+    void recycle(uint16_t a_bid) {
+        io_uring_sqe* e = sqe(nullptr);
+        m_recv_bufs.provide(e, a_bid);
+        if (m_ring.features() & IORING_FEAT_CQE_SKIP)
+            e->flags |= IOSQE_CQE_SKIP_SUCCESS;
+    }
+
+    /// Start a multishot receive on socket \a a_fd.
+    void recv_multishot(int a_fd, op* a_op) {
+        io_uring_sqe* e = sqe(a_op);
+        e->opcode    = IORING_OP_RECV;
+        e->fd        = a_fd;
+        e->ioprio    = IORING_RECV_MULTISHOT;
+        e->flags     = IOSQE_BUFFER_SELECT;
+        e->buf_group = s_recv_group;
+    }
+
+    /// Send the data described by \a a_msg, which must stay valid until
+    /// the operation completes.
+    void sendmsg(int a_fd, const msghdr* a_msg, op* a_op) {
+        io_uring_sqe* e = sqe(a_op);
+        e->opcode    = IORING_OP_SENDMSG;
+        e->fd        = a_fd;
+        e->addr      = reinterpret_cast<uint64_t>(a_msg);
+        e->len       = 1;
+        e->msg_flags = MSG_NOSIGNAL;
+    }
+
+    /// Send \a a_size bytes from a buffer registered in slot \a a_slot.
+    void send_fixed(int a_fd, const char* a_data, size_t a_size, int a_slot, op* a_op) {
+        io_uring_sqe* e = sqe(a_op);
+        e->opcode    = IORING_OP_SEND;
+        e->fd        = a_fd;
+        e->addr      = reinterpret_cast<uint64_t>(a_data);
+        e->len       = unsigned(a_size);
+        e->ioprio    = IORING_RECVSEND_FIXED_BUF;
+        e->buf_index = uint16_t(a_slot);
+        e->msg_flags = MSG_NOSIGNAL;
+    }
+
+    /// Cancel all pending operations of \a a_op.
+    void cancel(op* a_op) {
+        io_uring_sqe* e = sqe(nullptr);
+        e->opcode       = IORING_OP_ASYNC_CANCEL;
+        e->addr         = reinterpret_cast<uint64_t>(a_op);
+        e->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+    }
+
+    /// Register the memory \a a_data of \a a_size bytes for send_fixed().
+    /// @return slot number or -1 if the buffer cannot be registered.
+    int register_buffer(const char* a_data, size_t a_size) {
+        if (m_free_slots.empty())
+            return -1;
+        int slot = m_free_slots.back();
+        if (update_slot(slot, a_data, a_size) < 0)
+            return -1;
+        m_free_slots.pop_back();
+        return slot;
+    }
+
+    void unregister_buffer(int a_slot) {
+        if (a_slot < 0)
+            return;
+        update_slot(a_slot, NULL, 0);
+        m_free_slots.push_back(a_slot);
+    }
+
+    /// Cancel all operations and drop references of their op objects
+    /// without calling their completion handlers.
+    void shutdown() {
+        if (m_shutdown)
+            return;
+        m_shutdown = true;
+        boost::system::error_code ec;
+        m_ring_fd.close(ec);
+        if (!m_inflight)
+            return;
+        io_uring_sqe* e = sqe(nullptr);
+        e->opcode       = IORING_OP_ASYNC_CANCEL;
+        e->cancel_flags = IORING_ASYNC_CANCEL_ANY | IORING_ASYNC_CANCEL_ALL;
+        for (int i = 0; m_inflight && i < 100; ++i) {
+            // Only wait for the completion of the cancellation request
+            if (m_ring.submit(i == 0) <= 0 && i)
+                std::this_thread::yield();
+            m_ring.reap([this](const io_uring_cqe& c) {
+                op* o = reinterpret_cast<op*>(c.user_data);
+                if (!o)
+                    return;
+                if (!(c.flags & IORING_CQE_F_MORE)) {
+                    --m_inflight;
+                    o->abandon();
+                }
+            });
+        }
+    }
+
+private:
+    boost::asio::io_service&                m_io;
+    util::uring                             m_ring;
+    util::uring_buf_group                   m_recv_bufs;
+    boost::asio::posix::stream_descriptor   m_ring_fd;
+    std::vector<int>                        m_free_slots;
+    size_t                                  m_inflight;     // Ops awaiting the last completion
+    bool                                    m_submit_posted;
+    bool                                    m_waiting;
+    bool                                    m_shutdown;
+    size_t                                  m_submits;
+
+    int update_slot(int a_slot, const char* a_data, size_t a_size) {
+        iovec iov;
+        iov.iov_base = const_cast<char*>(a_data);
+        iov.iov_len  = a_size;
+        io_uring_rsrc_update2 upd;
+        memset(&upd, 0, sizeof(upd));
+        upd.offset = unsigned(a_slot);
+        upd.data   = reinterpret_cast<uint64_t>(&iov);
+        upd.nr     = 1;
+        return m_ring.register_op(IORING_REGISTER_BUFFERS_UPDATE, &upd, sizeof(upd));
+    }
+
+    io_uring_sqe* sqe(op* a_op) {
+        io_uring_sqe* e = m_ring.get_sqe();
+        if (unlikely(!e)) {
+            submit();
+            while (!(e = m_ring.get_sqe()))
+                m_ring.submit(1);   // Wait for the kernel to consume SQEs
+        }
+        e->user_data = reinterpret_cast<uint64_t>(a_op);
+        if (a_op)
+            ++m_inflight;
+        if (!m_submit_posted && !m_shutdown) {
+            m_submit_posted = true;
+            auto pthis = shared_from_this();
+            m_io.post([pthis]() {
+                pthis->m_submit_posted = false;
+                pthis->submit();
+            });
+        }
+        return e;
+    }
+
+    void submit() {
+        if (m_ring.pending() || m_ring.cq_overflow()) {
+            m_ring.submit();
+            ++m_submits;
+        }
+        arm();
+    }
+
+    /// Wait for the ring's file descriptor to report completions.
+    void arm() {
+        if (m_waiting || !m_inflight || m_shutdown)
+            return;
+        m_waiting = true;
+        auto pthis = shared_from_this();
+        m_ring_fd.async_wait(boost::asio::posix::descriptor_base::wait_read,
+            [pthis](const boost::system::error_code& ec) {
+                pthis->m_waiting = false;
+                if (!ec)
+                    pthis->on_completions();
+            });
+        // The reactor only reports new events, so check for completions
+        // that arrived before the wait was registered.
+        if (m_ring.has_completions())
+            m_io.post([pthis]() { pthis->on_completions(); });
+    }
+
+    void on_completions() {
+        if (m_shutdown)
+            return;
+        do {
+            m_ring.reap([this](const io_uring_cqe& c) {
+                op* o = reinterpret_cast<op*>(c.user_data);
+                if (!o)
+                    return;
+                if (!(c.flags & IORING_CQE_F_MORE))
+                    --m_inflight;
+                o->complete(c.res, c.flags);
+            });
+            // Completions that didn't fit in the queue are only moved to
+            // it by io_uring_enter(2)
+        } while (m_ring.cq_overflow() && m_ring.submit() >= 0);
+        submit();
+    }
+};
+
+} // namespace connect
+} // namespace eixx
+
+#endif // _EIXX_URING_SERVICE_HPP_
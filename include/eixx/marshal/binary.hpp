@@ -34,6 +34,7 @@ limitations under the License.
 #include <eixx/marshal/alloc_base.hpp>
 #include <eixx/marshal/string.hpp>
 #include <eixx/marshal/varbind.hpp>
+#include <eixx/marshal/gather.hpp>
 #include <eixx/eterm_exception.hpp>
 #include <string.h>
 
@@ -130,8 +131,13 @@ public:
     /** Encode binary to a flat buffer. */
     void encode(char* buf, uintptr_t& idx, size_t size) const;
 
-    /** Size of binary buffer needed to hold encoded binary. */
-    size_t encode_size() const { return 5 + size(); }
+    /** Size of binary buffer needed to hold encoded binary.
+     * If the binary's payload is referenced by the active gather_list,
+     * it's not included in the size. */
+    size_t encode_size() const {
+        gather_list* g = gather_list::current();
+        return unlikely(g != nullptr) && g->external(size()) ? 5 : 5 + size();
+    }
 
     std::ostream& dump(std::ostream& out, const varbind<Alloc>* =NULL) const {
         bool printable = size() > 1;
@@ -62,8 +62,16 @@ void binary<Alloc>::encode(char* buf, uintptr_t& idx, [[maybe_unused]] size_t si
         throw err_encode_exception("BINARY_EXT length exceeds maximum");
     uint32_t len = (uint32_t)sz;
     put32be(s, len);
-    memmove(s, this->data(), len);
-    s += len;
+    gather_list* g = gather_list::current();
+    if (unlikely(g != nullptr) && g->external(sz)) {
+        // The payload is written by reference from the blob
+        m_blob->inc_rc();
+        g->add(idx + 5, m_blob->data(), sz, m_blob,
+               [](void* b) { static_cast<blob<char, Alloc>*>(b)->release(); });
+    } else {
+        memmove(s, this->data(), len);
+        s += len;
+    }
     idx += static_cast<uintptr_t>(s - s0);
     BOOST_ASSERT((size_t)idx <= size);
 }
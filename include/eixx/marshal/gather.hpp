@@ -0,0 +1,121 @@
+//----------------------------------------------------------------------------
+/// \file  gather.hpp
+//----------------------------------------------------------------------------
+/// \brief Scatter-gather encoding of large binaries.
+//----------------------------------------------------------------------------
+// Copyright (c) 2010 Serge Aleynikov <saleyn@gmail.com>
+// Created: 2021-11-06
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+#ifndef _IMPL_GATHER_HPP_
+#define _IMPL_GATHER_HPP_
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <boost/noncopyable.hpp>
+
+namespace eixx {
+namespace marshal {
+
+/**
+ * Collects references to large binaries while a term is being encoded.
+ *
+ * While a gather_list is active in the current thread (see
+ * gather_list::scope), binaries of at least threshold() bytes encode only
+ * their 5-byte header, and their payload is recorded as an external
+ * segment referencing the binary's blob.  The encoded buffer together
+ * with the segments forms an iovec list which can be written to a socket
+ * without copying the payload.  The blobs are kept alive until
+ * release() is called.
+ */
+class gather_list : private boost::noncopyable {
+public:
+    struct segment {
+        size_t      offset;     ///< Offset in the encoded buffer where payload goes
+        const char* data;
+        size_t      size;
+        void*       blob;
+        void      (*release)(void*);
+    };
+
+    explicit gather_list(size_t a_threshold)
+        : m_threshold(a_threshold), m_bytes(0)
+    {}
+
+    ~gather_list() { release(); }
+
+    /// Sets the gather list of the current thread for the lifetime of
+    /// this object.
+    class scope : private boost::noncopyable {
+        gather_list* m_saved;
+    public:
+        explicit scope(gather_list& a_list) : m_saved(current()) { current() = &a_list; }
+        ~scope() { current() = m_saved; }
+    };
+
+    /// Gather list active in the current thread or NULL.
+    static gather_list*& current() {
+        static thread_local gather_list* s_current = nullptr;
+        return s_current;
+    }
+
+    /// Returns true if a payload of \a a_size bytes is to be sent by reference.
+    bool external(size_t a_size) const { return m_threshold && a_size >= m_threshold; }
+
+    /// Record a payload to be written at \a a_offset of the encoded buffer.
+    void add(size_t a_offset, const char* a_data, size_t a_size,
+             void* a_blob, void (*a_release)(void*))
+    {
+        m_segments.push_back(segment{a_offset, a_data, a_size, a_blob, a_release});
+        m_bytes += a_size;
+    }
+
+    size_t                      threshold() const { return m_threshold; }
+    /// Total size of external payloads.
+    size_t                      bytes()     const { return m_bytes;     }
+    bool                        empty()     const { return m_segments.empty(); }
+    const std::vector<segment>& segments()  const { return m_segments;  }
+
+    void swap(gather_list& a_rhs) {
+        std::swap(m_threshold, a_rhs.m_threshold);
+        std::swap(m_bytes,     a_rhs.m_bytes);
+        m_segments.swap(a_rhs.m_segments);
+    }
+
+    /// Drop references to the blobs of all recorded segments.
+    void release() {
+        for (auto& s : m_segments)
+            s.release(s.blob);
+        m_segments.clear();
+        m_bytes = 0;
+    }
+
+private:
+    size_t               m_threshold;
+    size_t               m_bytes;
+    std::vector<segment> m_segments;
+};
+
+} // namespace marshal
+} // namespace eixx
+
+#endif // _IMPL_GATHER_HPP_
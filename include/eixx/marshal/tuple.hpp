@@ -62,7 +62,7 @@ class tuple {
 
     void release(blob<eterm<Alloc>, Alloc>* p) {
         if (p && p->release(false)) {
-            for(size_t i=0, n=size(); i < n; i++)
+            for(size_t i=0, n=p->size()-1; i < n; i++)
                 p->data()[i].~eterm();
             p->free();
         }
@@ -27,45 +27,211 @@ limitations under the License.
 */
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <stdexcept>
 #include <functional>
 #include <limits>
-#include <boost/lockfree/queue.hpp>
+#include <memory>
+#include <thread>
 #include <boost/asio/system_timer.hpp>
 #include <boost/asio.hpp>
 #include <boost/concept_check.hpp>
+#include <boost/enable_shared_from_this.hpp>
 
 #include <eixx/util/timeout.hpp>
+#include <eixx/util/bounded_queue.hpp>
+#include <eixx/util/spsc_queue.hpp>
+#include <eixx/util/timer_wheel.hpp>
 
 namespace eixx {
 namespace util {
 
 using namespace boost::system::errc;
 
+/// What async_queue::enqueue() does when the queue is full.
+enum class overflow_policy {
+    drop_newest,    ///< Reject the new item
+    drop_oldest,    ///< Evict the oldest queued item to make room
+    block,          ///< Wait for the consumer to make room
+    signal          ///< Reject the new item and call async_queue::on_overflow
+};
+
+//----------------------------------------------------------------------------
+/// Size and kind of the ring buffer of an async_queue.
+//----------------------------------------------------------------------------
+struct queue_policy {
+    size_t                    capacity;         ///< Max queued items (rounded up to a power of 2)
+    bool                      single_producer;  ///< Only one thread ever enqueues
+    overflow_policy           overflow;         ///< Action on a full queue
+    std::chrono::milliseconds block_timeout;    ///< Max wait of overflow_policy::block (-1 - infinite)
+
+    queue_policy()
+        : capacity(1024)
+        , single_producer(false)
+        , overflow(overflow_policy::drop_newest)
+        , block_timeout(-1)
+    {}
+};
+
 /**
  * Implements an asyncronous multiple-writer-single-reader queue
  * for use with BOOST ASIO.
+ *
+ * Items are stored in a preallocated ring buffer of a fixed capacity, so a
+ * slow consumer doesn't make the queue grow.  The ring is single-producer
+ * when queue_policy::single_producer is set (unless the overflow policy is
+ * overflow_policy::drop_oldest, which needs the producer to dequeue), and
+ * multi-producer otherwise.  A full queue is handled as defined by the
+ * queue_policy::overflow.  The queue keeps count of items it rejected or
+ * evicted and of the highest number of items it held.
  */
 template<typename T, typename Alloc = std::allocator<char>>
 struct async_queue : boost::enable_shared_from_this<async_queue<T, Alloc>>
 {
-    using queue_type = boost::lockfree::queue
-        <T, boost::lockfree::allocator<Alloc>, boost::lockfree::capacity<1023>,
-            boost::lockfree::fixed_sized<false>>;
-
     using async_handler =
         std::function<bool (T&, const boost::system::error_code& ec)>;
+
+    /// Called by enqueue() when the queue is full and the overflow policy
+    /// is overflow_policy::signal, or waiting under overflow_policy::block
+    /// timed out.  The argument is the depth of the queue.
+    std::function<void (size_t)>  on_overflow;
+
+    /// Called on items evicted by overflow_policy::drop_oldest and on
+    /// items discarded by reset() (e.g. to free pointers).
+    std::function<void (T&)>      on_drop;
+
+    /// Called by the producer that finds the consumer parked with
+    /// park_ready() (e.g. to schedule the consumer on a thread pool).
+    std::function<void ()>        on_ready;
+
+    /// Consumer parked with park_waiter(), such as a suspended coroutine.
+    struct waiter {
+        void (*ready)(waiter*);     ///< Called by the producer that wakes it up
+    };
+
 private:
+    using mpsc_type = bounded_queue<T, Alloc>;
+    using spsc_type = spsc_queue<T, Alloc>;
+
     boost::asio::io_service&        m_io;
-    queue_type                      m_queue;
+    queue_policy                    m_policy;
+    std::unique_ptr<mpsc_type>      m_mpsc;         // One of m_mpsc or m_spsc is set
+    std::unique_ptr<spsc_type>      m_spsc;
     int                             m_batch_size;
     boost::asio::system_timer       m_timer;
+    std::atomic<bool>               m_wake_pending; // Cancel of m_timer is posted
+    std::unique_ptr<timer_wheel::timer> m_timeout;  // Receive timeout (see timers())
+    std::atomic<uint32_t>           m_wait_gen;     // Wait of m_timer m_timeout is for
+    std::atomic<uint8_t>            m_parked;       // PARKED_* flags of the consumer
+    std::atomic<waiter*>            m_waiter;       // Consumer parked with park_waiter()
+    std::mutex                      m_wait_lock;    // Guards m_wait_cv
+    std::condition_variable         m_wait_cv;      // Consumer blocked in wait()
+    std::atomic<size_t>             m_high_watermark;
+    std::atomic<size_t>             m_dropped;
+
+    bool push(const T& a) { return m_spsc ? m_spsc->try_push(a) : m_mpsc->try_push(a); }
+    bool pop(T& a)        { return m_spsc ? m_spsc->try_pop(a)  : m_mpsc->try_pop(a);  }
+
+    void update_watermark() {
+        size_t n = depth();
+        size_t h = m_high_watermark.load(std::memory_order_relaxed);
+        while (n > h && !m_high_watermark.compare_exchange_weak(h, n, std::memory_order_relaxed));
+    }
+
+    // Handle a full queue according to the overflow policy
+    bool overflow(T const& data);
+
+    enum {
+        PARKED_ASYNC = 1,   // Consumer waits on m_timer
+        PARKED_SYNC  = 2,   // Consumer waits on m_wait_cv
+        PARKED_READY = 4,   // Consumer waits for on_ready()
+        PARKED_WAITER= 8    // Consumer waits in m_waiter
+    };
+
+    // Called by the consumer after arming m_timer to wait for items.  The
+    // fences of park() and notify() order the consumer's store of m_parked
+    // before its check of the queue and the producer's push before its
+    // load of m_parked, so either the consumer sees the item or the
+    // producer sees the consumer parked.
+    void park() {
+        m_parked.fetch_or(PARKED_ASYNC, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!empty())
+            unpark();
+    }
+
+    // Called by a producer after queueing items
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_parked.load(std::memory_order_relaxed))
+            unpark();
+    }
+
+    // Only the first of the threads racing to wake up the consumer does it
+    void unpark() {
+        uint8_t parked = m_parked.exchange(0, std::memory_order_acq_rel);
+        if (parked & PARKED_ASYNC)
+            wakeup();
+        if (parked & PARKED_SYNC) {
+            std::lock_guard<std::mutex> guard(m_wait_lock);
+            m_wait_cv.notify_one();
+        }
+        if (parked & PARKED_READY)
+            on_ready();
+        if (parked & PARKED_WAITER)
+            if (waiter* w = m_waiter.exchange(nullptr, std::memory_order_acq_rel))
+                w->ready(w);
+    }
+
+    // Retry pushing until the queue has room or block_timeout expires
+    bool wait_push(T const& data);
 
     int dec_repeat_count(int n) {
         return n == std::numeric_limits<int>::max() || !n ? n : n-1;
     }
 
+    // Wait on m_timer for items or a_timeout.  With a timer wheel, m_timer
+    // is set to never expire and is cancelled by m_timeout.
+    template <typename Handler>
+    void async_wait(const Handler& h, std::chrono::milliseconds a_timeout,
+                    std::chrono::milliseconds repeat, int repeat_count) {
+        boost::system::error_code ec;
+        m_timer.cancel(ec);
+        if (m_timeout && a_timeout != std::chrono::milliseconds::max()) {
+            m_timer.expires_at(boost::asio::system_timer::time_point::max());
+            m_timeout->arm(a_timeout);
+        } else
+            m_timer.expires_from_now(a_timeout);
+        auto pthis = this->shared_from_this();
+        m_timer.async_wait(
+            [pthis, h, repeat, repeat_count](const boost::system::error_code& e) {
+                (*pthis)(h, e, repeat, repeat_count);
+            });
+        park();
+    }
+
+    // Called by the timer wheel when the wait of the consumer timed out
+    void on_timeout() {
+        boost::system::error_code ec;
+        if (m_io.get_executor().running_in_this_thread()) {
+            m_timer.cancel(ec);
+            return;
+        }
+        auto pthis = this->weak_from_this().lock();
+        if (!pthis)
+            return;
+        // The consumer may wait again before the cancellation runs
+        uint32_t gen = m_wait_gen.load(std::memory_order_acquire);
+        m_io.post([pthis, gen]() {
+            boost::system::error_code e;
+            if (pthis->m_wait_gen.load(std::memory_order_acquire) == gen)
+                pthis->m_timer.cancel(e);
+        });
+    }
+
     // Dequeue up to m_batch_size of items and for each one call
     // m_wait_handler
     template <typename Handler>
@@ -77,7 +243,7 @@ private:
         int  i = 0;        // Number of handler invocations
 
         T value;
-        while (i < m_batch_size && m_queue.pop(value)) {
+        while (i < m_batch_size && pop(value)) {
             i++;
             repeat_count = dec_repeat_count(repeat_count);
             if (!h(value, boost::system::error_code()))
@@ -91,7 +257,7 @@ private:
 
         // If we reached the batch size and queue has more data
         // to process - give up the time slice and reschedule the handler
-        if (i == m_batch_size && !m_queue.empty()) {
+        if (i == m_batch_size && !empty()) {
             m_io.post([pthis, h, repeat, repeat_count]() {
                 (*pthis)(h, boost::asio::error::operation_aborted, repeat, repeat_count);
             });
@@ -105,66 +271,219 @@ private:
         int n = dec_repeat_count(repeat_count);
 
         // If requested repeated timer, schedule new timer invocation
-        if (repeat > std::chrono::milliseconds(0) && n > 0) {
-            m_timer.cancel();
-            m_timer.expires_from_now(repeat);
-            m_timer.async_wait(
-                [pthis, h, repeat, n]
-                (const boost::system::error_code& a_ec) {
-                    (*pthis)(h, a_ec, repeat, n);
-                });
-        }
+        if (repeat > std::chrono::milliseconds(0) && n > 0)
+            async_wait(h, repeat, repeat, n);
     }
 
     // Called by io_service on timeout of m_timer
     template <typename Handler>
     void operator() (const Handler& h, const boost::system::error_code& ec,
                      std::chrono::milliseconds repeat, int repeat_count) {
+        m_parked.fetch_and(uint8_t(~PARKED_ASYNC), std::memory_order_relaxed);
+        if (m_timeout) {
+            m_timeout->cancel();
+            m_wait_gen.fetch_add(1, std::memory_order_release);
+        }
         process_queue(h, ec, repeat, repeat_count);
     }
 
 public:
     async_queue(boost::asio::io_service& a_io,
+        int a_batch_size = 16, const Alloc& a_alloc = Alloc())
+        : async_queue(a_io, queue_policy(), a_batch_size, a_alloc)
+    {}
+
+    async_queue(boost::asio::io_service& a_io, const queue_policy& a_policy,
         int a_batch_size = 16, const Alloc& a_alloc = Alloc())
         : m_io(a_io)
-        , m_queue(a_alloc)
+        , m_policy(a_policy)
         , m_batch_size(a_batch_size)
         , m_timer(a_io)
-    {}
+        , m_wake_pending(false)
+        , m_wait_gen(0)
+        , m_parked(0)
+        , m_waiter(nullptr)
+        , m_high_watermark(0)
+        , m_dropped(0)
+    {
+        if (m_policy.single_producer && m_policy.overflow != overflow_policy::drop_oldest)
+            m_spsc.reset(new spsc_type(m_policy.capacity, a_alloc));
+        else
+            m_mpsc.reset(new mpsc_type(m_policy.capacity, a_alloc));
+    }
 
     ~async_queue() {
+        m_timeout.reset();
         reset();
     }
 
+    /// Use \a a_wheel for the timeouts of async_dequeue() instead of the
+    /// timer heap of the I/O service.  The wheel must be run by the queue's
+    /// I/O service.  Must be called before async_dequeue().
+    void timers(const boost::shared_ptr<timer_wheel>& a_wheel) {
+        m_timeout.reset(a_wheel
+            ? new timer_wheel::timer(a_wheel, [this]() { on_timeout(); })
+            : nullptr);
+    }
+
+    /// Discard all queued items.
     void reset() {
         cancel();
 
         T value;
-        while (m_queue.pop(value));
+        while (pop(value))
+            if (on_drop) on_drop(value);
     }
 
     int  batch_size() const { return m_batch_size; }
     void batch_size(int sz) { m_batch_size = sz;   }
 
+    const queue_policy& policy() const { return m_policy; }
+
+    /// Max number of items in the queue.
+    size_t capacity() const { return m_spsc ? m_spsc->capacity() : m_mpsc->capacity(); }
+
+    /// Approximate number of items in the queue.
+    size_t depth()    const { return m_spsc ? m_spsc->size() : m_mpsc->size(); }
+
+    bool   empty()    const { return depth() == 0; }
+
+    /// Highest depth of the queue seen by enqueue().
+    size_t high_watermark() const { return m_high_watermark.load(std::memory_order_relaxed); }
+    void   reset_high_watermark() { m_high_watermark.store(0, std::memory_order_relaxed); }
+
+    /// Number of items rejected or evicted because the queue was full.
+    size_t dropped()  const { return m_dropped.load(std::memory_order_relaxed); }
+
+    /// True if the consumer waits for items and the next enqueue() will
+    /// wake it up.
+    bool   waiting()  const { return m_parked.load(std::memory_order_relaxed) != 0; }
+
     bool cancel() {
+        if (m_timeout)
+            m_timeout->cancel();
         boost::system::error_code ec;
         return m_timer.cancel(ec);
     }
 
+    /// Put \a data in the queue.  With a single-producer queue, the call
+    /// must not be made by two threads concurrently.  The consumer is only
+    /// woken up if it's waiting for items.
+    /// @param notify when false, the consumer is not woken up and will see
+    ///        the item once it's woken up by another call.
+    /// @return false if the queue was full and \a data was not queued, in
+    ///         which case the caller keeps the ownership of \a data.
     bool enqueue(T const& data, bool notify = true) {
-        if (!m_queue.push(data))
+        if (unlikely(!push(data)) && !overflow(data))
             return false;
 
-        if (!notify) return true;
-
-        boost::system::error_code ec;
-        m_timer.cancel(ec);
+        update_watermark();
 
+        if (notify)
+            this->notify();
         return true;
     }
 
+    /// Put items [\a first, \a last) in the queue, waking up the consumer
+    /// at most once.  Stops at the first item that was not queued.
+    /// @return the number of queued items.
+    template <typename It>
+    size_t enqueue(It first, It last, bool notify = true) {
+        size_t n = 0;
+        for (; first != last; ++first, ++n)
+            if (unlikely(!push(*first)) && !overflow(*first))
+                break;
+
+        if (n) {
+            update_watermark();
+            if (notify)
+                this->notify();
+        }
+        return n;
+    }
+
+    /// Wake up the consumer waiting on the queue.  The timer may only be
+    /// touched by the thread running the queue's I/O service, so a
+    /// producer on another thread posts the cancellation.  Concurrent
+    /// producers share a single posted wakeup.
+    void wakeup() {
+        boost::system::error_code ec;
+        if (m_io.get_executor().running_in_this_thread()) {
+            m_timer.cancel(ec);
+            return;
+        }
+        auto pthis = this->weak_from_this().lock();
+        if (!pthis) {   // Not owned by a boost::shared_ptr
+            m_timer.cancel(ec);
+            return;
+        }
+        if (m_wake_pending.exchange(true, std::memory_order_acq_rel))
+            return;
+        m_io.post([pthis]() {
+            pthis->m_wake_pending.store(false, std::memory_order_release);
+            boost::system::error_code e;
+            pthis->m_timer.cancel(e);
+        });
+    }
+
     bool dequeue(T& value) {
-        return m_queue.pop(value);
+        return pop(value);
+    }
+
+    /// Dequeue up to \a a_max items to \a a_out.
+    /// @return the number of dequeued items.
+    size_t dequeue(T* a_out, size_t a_max) {
+        size_t n = 0;
+        while (n < a_max && pop(a_out[n]))
+            ++n;
+        return n;
+    }
+
+    /// Wait until the queue has items without involving the I/O service,
+    /// for a consumer polling the queue in its own thread.  The queue is
+    /// polled for \a a_spin before the thread goes to sleep until a
+    /// producer enqueues an item.
+    /// @param a_timeout is the max time to wait (-1 - infinite).
+    /// @return false on timeout.
+    bool wait(std::chrono::microseconds a_spin,
+              std::chrono::milliseconds a_timeout = std::chrono::milliseconds(-1));
+
+    /// Wait for items without involving the I/O service or blocking: the
+    /// first enqueue() after this call (or this call if the queue has
+    /// items) calls on_ready once.  Called by a consumer run by a thread
+    /// pool after it emptied the queue.
+    void park_ready() {
+        // Release the consumer's state to the producer calling on_ready
+        m_parked.fetch_or(PARKED_READY, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!empty())
+            unpark();
+    }
+
+    /// Wait for items without involving the I/O service: the first
+    /// enqueue() after this call calls \a a_waiter->ready() in the
+    /// producer's thread.  The waiter is not parked if the queue has items
+    /// at the time of the call.
+    /// @return true if the waiter was parked.  The waiter may already have
+    ///         been woken up by the time the call returns.
+    bool park_waiter(waiter* a_waiter) {
+        m_waiter.store(a_waiter, std::memory_order_release);
+        m_parked.fetch_or(PARKED_WAITER, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return empty() || !unpark_waiter(a_waiter);
+    }
+
+    /// Remove \a a_waiter parked with park_waiter().
+    /// @return false if it was already taken by a producer to be woken up.
+    bool unpark_waiter(waiter* a_waiter) {
+        return m_waiter.compare_exchange_strong(a_waiter, nullptr, std::memory_order_acq_rel);
+    }
+
+    /// Remove the waiter parked with park_waiter() (e.g. to wake it up on
+    /// closing the queue).
+    /// @return the waiter or NULL.
+    waiter* take_waiter() {
+        return m_waiter.exchange(nullptr, std::memory_order_acq_rel);
     }
 
     /// Call \a a_on_data handler asyncronously on next message in the queue.
@@ -176,6 +495,7 @@ public:
     }
 
     /// Call \a a_on_data handler asyncronously on next message in the queue.
+    /// The handler is copied if the call is not handled synchronously.
     ///
     /// @returns true if the call was handled synchronously
     template <typename Handler>
@@ -184,7 +504,7 @@ public:
         int repeat_count = 0)
     {
         T value;
-        if (m_queue.pop(value)) {
+        if (pop(value)) {
             if (!a_on_data(value, boost::system::error_code()))
                 return true;
             if (repeat_count > 0) --repeat_count;
@@ -201,26 +521,101 @@ public:
                 : a_wait_duration;
 
         if (timeout == std::chrono::milliseconds(0))
-            m_io.post([this, &a_on_data, timeout, rep]() {
-                (*this->shared_from_this())(
-                    a_on_data, boost::system::error_code(), timeout, rep);
+            m_io.post([pthis = this->shared_from_this(), a_on_data, timeout, rep]() {
+                (*pthis)(a_on_data, boost::system::error_code(), timeout, rep);
             });
-        else {
-            boost::system::error_code ec;
-            m_timer.cancel(ec);
-            m_timer.expires_from_now(timeout);
-            auto pthis = this->shared_from_this();
-            m_timer.async_wait(
-                [pthis, &a_on_data, timeout, rep]
-                (const boost::system::error_code& e) {
-                    (*pthis)(a_on_data, e, timeout, rep);
-                }
-            );
-        }
+        else
+            async_wait(a_on_data, timeout, timeout, rep);
 
         return false;
     }
 };
 
+template<typename T, typename Alloc>
+bool async_queue<T, Alloc>::overflow(T const& data)
+{
+    switch (m_policy.overflow) {
+        case overflow_policy::drop_oldest: {
+            // The ring is multi-consumer, so the producer may evict items
+            T old;
+            while (!push(data)) {
+                if (pop(old)) {
+                    m_dropped.fetch_add(1, std::memory_order_relaxed);
+                    if (on_drop) on_drop(old);
+                } else
+                    std::this_thread::yield();
+            }
+            return true;
+        }
+        case overflow_policy::block:
+            // Waiting in the thread running the consumer would never end
+            if (!m_io.get_executor().running_in_this_thread() && wait_push(data))
+                return true;
+            break;
+        case overflow_policy::signal:
+            break;
+        case overflow_policy::drop_newest:
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+    }
+
+    m_dropped.fetch_add(1, std::memory_order_relaxed);
+    if (on_overflow)
+        on_overflow(depth());
+    return false;
+}
+
+template<typename T, typename Alloc>
+bool async_queue<T, Alloc>::
+wait(std::chrono::microseconds a_spin, std::chrono::milliseconds a_timeout)
+{
+    using clock = std::chrono::steady_clock;
+
+    if (likely(!empty()))
+        return true;
+
+    auto now      = clock::now();
+    auto deadline = a_timeout.count() < 0 ? clock::time_point::max() : now + a_timeout;
+    auto spin_end = std::min(now + a_spin, deadline);
+
+    // Check the clock every few polls
+    while (clock::now() < spin_end)
+        for (int i = 0; i < 64; ++i)
+            if (!empty())
+                return true;
+
+    std::unique_lock<std::mutex> guard(m_wait_lock);
+    for (;;) {
+        m_parked.fetch_or(PARKED_SYNC, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // A producer seeing the flag takes m_wait_lock to notify, so it
+        // can't miss the consumer between this check and the wait
+        if (!empty() || clock::now() >= deadline) {
+            m_parked.fetch_and(uint8_t(~PARKED_SYNC), std::memory_order_relaxed);
+            return !empty();
+        }
+        if (deadline == clock::time_point::max())
+            m_wait_cv.wait(guard);
+        else
+            m_wait_cv.wait_until(guard, deadline);
+    }
+}
+
+template<typename T, typename Alloc>
+bool async_queue<T, Alloc>::wait_push(T const& data)
+{
+    auto deadline = m_policy.block_timeout.count() < 0
+        ? std::chrono::steady_clock::time_point::max()
+        : std::chrono::steady_clock::now() + m_policy.block_timeout;
+    for (int i = 0; !push(data); ++i) {
+        if (i < 64)
+            continue;
+        if (std::chrono::steady_clock::now() >= deadline)
+            return false;
+        std::this_thread::yield();
+    }
+    return true;
+}
+
 } // namespace util
 } // namespace eixx
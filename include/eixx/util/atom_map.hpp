@@ -0,0 +1,177 @@
+//----------------------------------------------------------------------------
+/// \file   atom_map.hpp
+/// \author Serge Aleynikov
+//----------------------------------------------------------------------------
+/// \brief Read-mostly map from atoms to objects with wait-free lookups.
+//----------------------------------------------------------------------------
+// Created: 2021-11-20
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <boost/assert.hpp>
+#include <boost/noncopyable.hpp>
+#include <eixx/marshal/atom.hpp>
+#include <eixx/util/compiler_hints.hpp>
+
+namespace eixx {
+namespace util {
+
+/**
+ * Open-addressing hash table keyed by the index of an atom in the atom
+ * table, holding pointers to objects owned elsewhere.
+ *
+ * find() is wait-free and may be called by any number of threads
+ * concurrently with set() and erase().  Writers must be serialized by
+ * the caller.
+ *
+ * Keys are never removed from the table: erase() clears the value of a
+ * key, and setting the key again reuses its slot.  When the table gets
+ * half full it is copied to a table twice the size.  Replaced tables are
+ * kept until clear() or destruction, since readers may still be probing
+ * them, which bounds the overhead by the size of the current table.
+ * clear() hands them to the caller along with the current table.  A
+ * reader racing with a resize may see a value set before the resize, so
+ * the objects must outlive their removal from the map.
+ */
+template <typename T>
+class atom_map : private boost::noncopyable {
+    struct slot {
+        std::atomic<uint32_t> key;
+        std::atomic<T*>       value;
+
+        slot() : key(0), value(nullptr) {}
+    };
+
+    struct table {
+        size_t                  mask;
+        std::unique_ptr<slot[]> slots;
+
+        explicit table(size_t a_size) : mask(a_size-1), slots(new slot[a_size]) {}
+
+        size_t start(uint32_t a_key) const {
+            // Fibonacci hashing spreads sequential atom indexes
+            return size_t((uint64_t(a_key) * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+        }
+    };
+
+    std::atomic<table*>                 m_table;
+    std::vector<std::unique_ptr<table>> m_tables;   // Last one is current
+    size_t                              m_used;
+
+    // Find the slot of a_key or the empty slot where it belongs
+    static slot* probe(const table* a_tab, uint32_t a_key) {
+        for (size_t i = a_tab->start(a_key);; i = (i+1) & a_tab->mask) {
+            slot* s = &a_tab->slots[i];
+            uint32_t k = s->key.load(std::memory_order_acquire);
+            if (k == a_key || k == 0)
+                return s;
+        }
+    }
+
+    void grow() {
+        const table* old = m_tables.back().get();
+        std::unique_ptr<table> t(new table(2*(old->mask+1)));
+        for (size_t i = 0; i <= old->mask; ++i) {
+            uint32_t k = old->slots[i].key.load(std::memory_order_relaxed);
+            if (!k) continue;
+            slot* s = probe(t.get(), k);
+            s->value.store(old->slots[i].value.load(std::memory_order_relaxed),
+                           std::memory_order_relaxed);
+            s->key.store(k, std::memory_order_relaxed);
+        }
+        m_table.store(t.get(), std::memory_order_release);
+        m_tables.push_back(std::move(t));
+    }
+
+public:
+    /// @param a_capacity is the initial number of slots (rounded up to a
+    ///        power of two).
+    explicit atom_map(size_t a_capacity = 64) : m_used(0) {
+        size_t n = 8;
+        while (n < a_capacity) n <<= 1;
+        m_tables.emplace_back(new table(n));
+        m_table.store(m_tables.back().get(), std::memory_order_release);
+    }
+
+    /// Get the value of \a a_key or NULL if it's not set.
+    T* find(marshal::atom a_key) const {
+        uint32_t k = a_key.index();
+        if (unlikely(!k))
+            return nullptr;
+        const table* t = m_table.load(std::memory_order_acquire);
+        slot* s = probe(t, k);
+        T* v = s->value.load(std::memory_order_acquire);
+        // An empty slot may be filled with another key while it's read
+        return s->key.load(std::memory_order_acquire) == k ? v : nullptr;
+    }
+
+    /// Set the value of \a a_key (writers only).
+    void set(marshal::atom a_key, T* a_value) {
+        uint32_t k = a_key.index();
+        BOOST_ASSERT(k);
+        slot* s = probe(m_tables.back().get(), k);
+        if (s->key.load(std::memory_order_relaxed) == k) {
+            s->value.store(a_value, std::memory_order_release);
+            return;
+        }
+        // The key is published after its value
+        s->value.store(a_value, std::memory_order_relaxed);
+        s->key.store(k, std::memory_order_release);
+        if (2*++m_used > m_tables.back()->mask+1)
+            grow();
+    }
+
+    /// Clear the value of \a a_key (writers only).
+    void erase(marshal::atom a_key) {
+        if (!a_key.index()) return;
+        slot* s = probe(m_tables.back().get(), a_key.index());
+        if (s->key.load(std::memory_order_relaxed) == a_key.index())
+            s->value.store(nullptr, std::memory_order_release);
+    }
+
+    /// Tables replaced by clear() that readers may still be probing.
+    class retired {
+        friend class atom_map;
+        std::vector<std::unique_ptr<table>> m_tables;
+    };
+
+    /// Replace the table with an empty one (writers only).  The replaced
+    /// tables are returned to be freed once no reader may be probing them
+    /// (see epoch_reclaimer).
+    std::unique_ptr<retired> clear() {
+        std::unique_ptr<retired> old(new retired);
+        old->m_tables.swap(m_tables);
+        m_tables.emplace_back(new table(old->m_tables.front()->mask+1));
+        m_table.store(m_tables.back().get(), std::memory_order_release);
+        m_used = 0;
+        return old;
+    }
+
+    /// Number of slots of the current table.
+    size_t capacity() const { return m_table.load(std::memory_order_relaxed)->mask+1; }
+};
+
+} // namespace util
+} // namespace eixx
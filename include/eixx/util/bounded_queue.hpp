@@ -0,0 +1,147 @@
+//----------------------------------------------------------------------------
+/// \file   bounded_queue.hpp
+/// \author Serge Aleynikov
+//----------------------------------------------------------------------------
+/// \brief Lock-free bounded multi-producer queue.
+//----------------------------------------------------------------------------
+// Created: 2021-11-04
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <boost/assert.hpp>
+#include <boost/noncopyable.hpp>
+#include <eixx/util/compiler_hints.hpp>
+
+namespace eixx {
+namespace util {
+
+/**
+ * Bounded lock-free queue based on an array of cells tagged with sequence
+ * numbers (D. Vyukov's algorithm).  Any number of threads may push and pop
+ * concurrently.  Neither operation allocates memory.
+ *
+ * The capacity is rounded up to a power of two.
+ */
+template <typename T, typename Alloc = std::allocator<char>>
+class bounded_queue : private boost::noncopyable {
+    struct cell {
+        std::atomic<size_t> seq;
+        T                   data;
+    };
+
+    using cell_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<cell>;
+
+    static constexpr size_t s_cache_line = 64;
+
+    cell_alloc                              m_alloc;
+    cell*                                   m_cells;
+    size_t                                  m_mask;
+    alignas(s_cache_line) std::atomic<size_t> m_tail;   // Enqueue position
+    alignas(s_cache_line) std::atomic<size_t> m_head;   // Dequeue position
+
+    static size_t round_up(size_t n) {
+        size_t r = 2;
+        while (r < n) r <<= 1;
+        return r;
+    }
+
+public:
+    explicit bounded_queue(size_t a_capacity, const Alloc& a_alloc = Alloc())
+        : m_alloc(a_alloc)
+        , m_mask(round_up(a_capacity) - 1)
+        , m_tail(0), m_head(0)
+    {
+        m_cells = m_alloc.allocate(m_mask+1);
+        for (size_t i = 0; i <= m_mask; ++i) {
+            new (&m_cells[i]) cell();
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~bounded_queue() {
+        for (size_t i = 0; i <= m_mask; ++i)
+            m_cells[i].~cell();
+        m_alloc.deallocate(m_cells, m_mask+1);
+    }
+
+    size_t capacity() const { return m_mask + 1; }
+
+    /// Approximate number of items in the queue.
+    size_t size() const {
+        size_t t = m_tail.load(std::memory_order_acquire);
+        size_t h = m_head.load(std::memory_order_acquire);
+        return t > h ? t - h : 0;
+    }
+
+    /// Returns true if there are no items in the queue, including the
+    /// ones being pushed by producers that haven't completed the push yet.
+    bool empty() const { return size() == 0; }
+
+    /// @return false if the queue is full.
+    bool try_push(const T& a_value) {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        for (;;) {
+            cell&    c   = m_cells[pos & m_mask];
+            size_t   seq = c.seq.load(std::memory_order_acquire);
+            intptr_t d   = intptr_t(seq) - intptr_t(pos);
+            if (d == 0) {
+                if (m_tail.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed))
+                {
+                    c.data = a_value;
+                    c.seq.store(pos+1, std::memory_order_release);
+                    return true;
+                }
+            } else if (d < 0)
+                return false;
+            else
+                pos = m_tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    /// @return false if the queue is empty or the next item is not yet
+    ///         fully published by its producer.
+    bool try_pop(T& a_value) {
+        size_t pos = m_head.load(std::memory_order_relaxed);
+        for (;;) {
+            cell&    c   = m_cells[pos & m_mask];
+            size_t   seq = c.seq.load(std::memory_order_acquire);
+            intptr_t d   = intptr_t(seq) - intptr_t(pos+1);
+            if (d == 0) {
+                if (m_head.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed))
+                {
+                    a_value = std::move(c.data);
+                    c.seq.store(pos + m_mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (d < 0)
+                return false;
+            else
+                pos = m_head.load(std::memory_order_relaxed);
+        }
+    }
+};
+
+} // namespace util
+} // namespace eixx
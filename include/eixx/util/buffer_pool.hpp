@@ -0,0 +1,93 @@
+//----------------------------------------------------------------------------
+/// \file   buffer_pool.hpp
+/// \author Serge Aleynikov
+//----------------------------------------------------------------------------
+/// \brief Lock-free pool of fixed-size buffers.
+//----------------------------------------------------------------------------
+// Created: 2021-11-08
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <boost/noncopyable.hpp>
+#include <eixx/util/bounded_queue.hpp>
+
+namespace eixx {
+namespace util {
+
+/**
+ * Pool of buffers of buffer_size() bytes shared by several owners.
+ * Up to \a a_capacity released buffers are kept for reuse, the rest are
+ * returned to the allocator.  acquire() and release() may be called
+ * concurrently from any number of threads.
+ */
+template <typename Alloc = std::allocator<char>>
+class buffer_pool : private boost::noncopyable {
+    Alloc                       m_alloc;
+    size_t                      m_buf_size;
+    bounded_queue<char*, Alloc> m_free;
+    std::atomic<size_t>         m_hits;
+    std::atomic<size_t>         m_misses;
+
+public:
+    buffer_pool(size_t a_buf_size, size_t a_capacity, const Alloc& a_alloc = Alloc())
+        : m_alloc(a_alloc), m_buf_size(a_buf_size)
+        , m_free(a_capacity, a_alloc)
+        , m_hits(0), m_misses(0)
+    {}
+
+    ~buffer_pool() {
+        char* p;
+        while (m_free.try_pop(p))
+            m_alloc.deallocate(p, m_buf_size);
+    }
+
+    size_t buffer_size() const { return m_buf_size; }
+    /// Approximate number of idle buffers in the pool.
+    size_t idle()        const { return m_free.size(); }
+    /// Number of acquire() calls satisfied by the pool.
+    size_t hits()        const { return m_hits.load(std::memory_order_relaxed); }
+    /// Number of acquire() calls that allocated a new buffer.
+    size_t misses()      const { return m_misses.load(std::memory_order_relaxed); }
+
+    /// Get a buffer of buffer_size() bytes.
+    char* acquire() {
+        char* p;
+        if (m_free.try_pop(p)) {
+            m_hits.fetch_add(1, std::memory_order_relaxed);
+            return p;
+        }
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        return m_alloc.allocate(m_buf_size);
+    }
+
+    /// Return a buffer obtained from acquire() to the pool.
+    void release(char* a_buf) {
+        if (!m_free.try_push(a_buf))
+            m_alloc.deallocate(a_buf, m_buf_size);
+    }
+};
+
+} // namespace util
+} // namespace eixx
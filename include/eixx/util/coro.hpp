@@ -0,0 +1,142 @@
+//----------------------------------------------------------------------------
+/// \file   coro.hpp
+/// \author Serge Aleynikov
+//----------------------------------------------------------------------------
+/// \brief C++20 coroutine support: detached tasks with pooled frames.
+//----------------------------------------------------------------------------
+// Created: 2021-11-25
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+#pragma once
+
+// The coroutine API is available when the compiler implements C++20
+// coroutines (e.g. g++ -std=c++20).  Define EIXX_NO_COROUTINES to disable it.
+#if !defined(EIXX_HAVE_COROUTINES) && !defined(EIXX_NO_COROUTINES) \
+    && defined(__cpp_impl_coroutine) && defined(__has_include)
+#  if __cpp_impl_coroutine >= 201902L && __has_include(<coroutine>)
+#    define EIXX_HAVE_COROUTINES 1
+#  endif
+#endif
+
+#ifdef EIXX_HAVE_COROUTINES
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <eixx/util/compiler_hints.hpp>
+
+namespace eixx {
+namespace util {
+
+/**
+ * Allocator of coroutine frames.  Freed frames are kept in lists of the
+ * freeing thread by size (in steps of 64 bytes, up to 2KB) for reuse by
+ * that thread, up to 64 frames per size.  Larger frames are allocated
+ * with operator new.
+ */
+class frame_pool {
+    static constexpr size_t s_step    = 64;
+    static constexpr size_t s_classes = 32;
+    static constexpr size_t s_max     = 64;   // Frames kept per size
+
+    struct node { node* next; };
+
+    struct cache {
+        node*  heads[s_classes] = {};
+        size_t counts[s_classes] = {};
+
+        ~cache() {
+            for (auto h : heads)
+                while (h) { node* n = h->next; ::operator delete(h); h = n; }
+        }
+    };
+
+    static cache& local() {
+        static thread_local cache s_cache;
+        return s_cache;
+    }
+
+    static size_t size_class(size_t n) { return (n + s_step - 1) / s_step - 1; }
+
+public:
+    static void* allocate(size_t n) {
+        size_t c = size_class(n);
+        if (unlikely(c >= s_classes))
+            return ::operator new(n);
+        cache& l = local();
+        if (node* p = l.heads[c]) {
+            l.heads[c] = p->next;
+            --l.counts[c];
+            return p;
+        }
+        return ::operator new((c+1) * s_step);
+    }
+
+    static void deallocate(void* p, size_t n) noexcept {
+        size_t c = size_class(n);
+        if (c >= s_classes) {
+            ::operator delete(p);
+            return;
+        }
+        cache& l = local();
+        if (l.counts[c] >= s_max) {
+            ::operator delete(p);
+            return;
+        }
+        node* f = static_cast<node*>(p);
+        f->next = l.heads[c];
+        l.heads[c] = f;
+        ++l.counts[c];
+    }
+};
+
+/**
+ * Return type of a detached coroutine, which starts running when called
+ * and frees its frame when it returns.  Frames are allocated from the
+ * frame_pool.  Like with std::thread, an exception escaping the coroutine
+ * calls std::terminate().
+ * \code
+ * util::task serve(otp_mailbox& a_mbox) {
+ *     while (transport_msg* m = co_await a_mbox.co_receive(std::chrono::seconds(5))) {
+ *         ...
+ *         a_mbox.release(m);
+ *     }
+ * }
+ * \endcode
+ */
+struct task {
+    struct promise_type {
+        task                get_return_object()   noexcept { return task(); }
+        std::suspend_never  initial_suspend()     noexcept { return {}; }
+        std::suspend_never  final_suspend()       noexcept { return {}; }
+        void                return_void()         noexcept {}
+        void                unhandled_exception() noexcept { std::terminate(); }
+
+        static void* operator new(size_t n)             { return frame_pool::allocate(n); }
+        static void  operator delete(void* p, size_t n) { frame_pool::deallocate(p, n); }
+    };
+};
+
+} // namespace util
+} // namespace eixx
+
+#endif // EIXX_HAVE_COROUTINES
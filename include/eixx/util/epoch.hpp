@@ -0,0 +1,115 @@
+//----------------------------------------------------------------------------
+/// \file   epoch.hpp
+/// \author Serge Aleynikov
+//----------------------------------------------------------------------------
+/// \brief Epoch-based reclamation of objects read without locks.
+//----------------------------------------------------------------------------
+// Created: 2021-11-26
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <eixx/util/compiler_hints.hpp>
+
+namespace eixx {
+namespace util {
+
+/**
+ * Deferred destruction of objects that readers may reach without taking
+ * a lock, e.g. through an atom_map.
+ *
+ * Readers hold a guard while they use the objects.  A guard registers
+ * with the current epoch in one of two counters selected by the parity
+ * of the epoch.  A writer unlinks an object so that new readers can't
+ * find it and passes it to retire(), which tags it with the current
+ * epoch.  The epoch advances when no reader of the previous epoch is
+ * left, at which point no reader can still use an object retired two
+ * epochs ago, and such objects are destroyed.
+ *
+ * Guards are cheap and may be taken by any number of threads.  retire()
+ * and reclaim() must be serialized by the caller.  An object is only
+ * destroyed by a later retire() or reclaim() call or by the destructor,
+ * so a writer that retires rarely keeps a few objects around.
+ */
+template <typename T>
+class epoch_reclaimer : private boost::noncopyable {
+    std::atomic<uint64_t>               m_epoch;
+    std::atomic<size_t>                 m_readers[2];
+    std::vector<std::pair<uint64_t, T>> m_retired;  // (epoch, object)
+
+public:
+    /// Keeps the objects retired after its creation alive while in scope.
+    class guard : private boost::noncopyable {
+        std::atomic<size_t>* m_count;
+    public:
+        explicit guard(epoch_reclaimer& a_owner) {
+            while (true) {
+                uint64_t e = a_owner.m_epoch.load();
+                m_count    = &a_owner.m_readers[e & 1];
+                m_count->fetch_add(1);
+                // The epoch may have advanced past the counter's epoch
+                if (likely(a_owner.m_epoch.load() == e))
+                    break;
+                m_count->fetch_sub(1);
+            }
+        }
+        ~guard() { m_count->fetch_sub(1, std::memory_order_release); }
+    };
+
+    epoch_reclaimer() : m_epoch(2) {
+        m_readers[0] = 0;
+        m_readers[1] = 0;
+    }
+
+    /// Destroy \a a_obj once no reader may be using it.  The object must
+    /// already be unreachable by new readers (writers only).
+    void retire(T&& a_obj) {
+        m_retired.emplace_back(m_epoch.load(), std::move(a_obj));
+        reclaim();
+    }
+
+    /// Advance the epoch if possible and destroy the objects no reader
+    /// may be using (writers only).
+    void reclaim() {
+        uint64_t e = m_epoch.load();
+        if (m_readers[(e+1) & 1].load() == 0)
+            m_epoch.store(++e);
+        size_t n = 0;
+        for (size_t i = 0; i < m_retired.size(); ++i)
+            if (m_retired[i].first + 2 > e) {
+                if (n != i)
+                    m_retired[n] = std::move(m_retired[i]);
+                n++;
+            }
+        m_retired.erase(m_retired.begin() + n, m_retired.end());
+    }
+
+    /// Number of retired objects not destroyed yet.
+    size_t retired() const { return m_retired.size(); }
+};
+
+} // namespace util
+} // namespace eixx
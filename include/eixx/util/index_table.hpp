@@ -0,0 +1,185 @@
+//----------------------------------------------------------------------------
+/// \file   index_table.hpp
+/// \author Serge Aleynikov
+//----------------------------------------------------------------------------
+/// \brief Table of objects indexed by small integers with generation
+///        checks and wait-free lookups.
+//----------------------------------------------------------------------------
+// Created: 2021-11-20
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <boost/assert.hpp>
+#include <boost/noncopyable.hpp>
+#include <eixx/util/compiler_hints.hpp>
+
+namespace eixx {
+namespace util {
+
+/**
+ * Table of pointers to objects owned elsewhere, addressed by an index
+ * and a serial number, similar to the process table of the Erlang VM.
+ *
+ * An index is obtained with reserve() and is owned by the caller until
+ * put() stores an object there.  put() increments the serial of the slot,
+ * so a stale (index, serial) pair doesn't find the new object.  remove()
+ * returns the ownership of the index to the caller that succeeded in
+ * removing the object, who may put() another object there.  Reusing
+ * indexes is up to the caller.
+ *
+ * All methods are lock-free and may be called by any number of threads,
+ * and find() is wait-free.  Slots live in chunks allocated on first use
+ * and never moved or freed before destruction, so a reader never touches
+ * freed memory.  An object found by a reader racing with remove() may be
+ * returned after it was removed, so objects must outlive their removal
+ * from the table.
+ *
+ * Serials are in the range [1, MaxSerial].  Index 0 is not used.
+ */
+template <typename T, uint32_t MaxSerial = (1u << 13) - 1>
+class index_table : private boost::noncopyable {
+    static constexpr size_t s_chunk_bits = 10;
+    static constexpr size_t s_chunk_size = size_t(1) << s_chunk_bits;
+    static constexpr size_t s_chunk_mask = s_chunk_size - 1;
+
+    struct slot {
+        std::atomic<T*>       value;
+        std::atomic<uint32_t> serial;
+
+        slot() : value(nullptr), serial(0) {}
+    };
+
+    struct chunk {
+        slot slots[s_chunk_size];
+    };
+
+    const uint32_t                          m_max_index;
+    const size_t                            m_nchunks;
+    std::unique_ptr<std::atomic<chunk*>[]>  m_chunks;
+    std::atomic<uint32_t>                   m_next;     // Next never used index
+    std::atomic<size_t>                     m_count;
+
+    slot* at(uint32_t a_idx) const {
+        size_t c = a_idx >> s_chunk_bits;
+        if (unlikely(c >= m_nchunks))
+            return nullptr;
+        chunk* ch = m_chunks[c].load(std::memory_order_acquire);
+        return likely(ch != nullptr) ? &ch->slots[a_idx & s_chunk_mask] : nullptr;
+    }
+
+public:
+    /// @param a_max_index is the largest index handed out by reserve().
+    explicit index_table(uint32_t a_max_index = (1u << 20) - 1)
+        : m_max_index(a_max_index)
+        , m_nchunks((size_t(a_max_index) >> s_chunk_bits) + 1)
+        , m_chunks(new std::atomic<chunk*>[m_nchunks])
+        , m_next(1), m_count(0)
+    {
+        for (size_t i = 0; i < m_nchunks; ++i)
+            m_chunks[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    ~index_table() {
+        for (size_t i = 0; i < m_nchunks; ++i)
+            delete m_chunks[i].load(std::memory_order_relaxed);
+    }
+
+    /// Get the object at \a a_idx with serial \a a_serial or NULL.
+    T* find(uint32_t a_idx, uint32_t a_serial) const {
+        const slot* s = at(a_idx);
+        if (unlikely(!s))
+            return nullptr;
+        T* p = s->value.load(std::memory_order_acquire);
+        return p && s->serial.load(std::memory_order_relaxed) == a_serial ? p : nullptr;
+    }
+
+    /// Get an index that was never used before.
+    /// @return 0 if all indexes were used.
+    uint32_t reserve() {
+        uint32_t i = m_next.load(std::memory_order_relaxed);
+        do {
+            if (i > m_max_index)
+                return 0;
+        } while (!m_next.compare_exchange_weak(i, i+1, std::memory_order_relaxed));
+
+        std::atomic<chunk*>& c = m_chunks[i >> s_chunk_bits];
+        if (!c.load(std::memory_order_acquire)) {
+            chunk* ch = new chunk, *exp = nullptr;
+            if (!c.compare_exchange_strong(exp, ch, std::memory_order_acq_rel))
+                delete ch;  // Installed by another thread
+        }
+        return i;
+    }
+
+    /// Store \a a_obj at the index \a a_idx owned by the caller.
+    /// @return the new serial of the index.
+    uint32_t put(uint32_t a_idx, T* a_obj) {
+        BOOST_ASSERT(a_obj);
+        slot* s = at(a_idx);
+        BOOST_ASSERT(s && !s->value.load(std::memory_order_relaxed));
+        uint32_t serial = s->serial.load(std::memory_order_relaxed) % MaxSerial + 1;
+        // The serial is published with the value
+        s->serial.store(serial, std::memory_order_relaxed);
+        s->value.store(a_obj, std::memory_order_release);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        return serial;
+    }
+
+    /// Remove the object at \a a_idx if its serial is \a a_serial.  On
+    /// success the caller owns the index.
+    /// @return the removed object or NULL.
+    T* remove(uint32_t a_idx, uint32_t a_serial) {
+        slot* s = a_idx ? at(a_idx) : nullptr;
+        if (!s || s->serial.load(std::memory_order_acquire) != a_serial)
+            return nullptr;
+        T* p = s->value.load(std::memory_order_acquire);
+        if (!p || !s->value.compare_exchange_strong(p, nullptr, std::memory_order_acq_rel))
+            return nullptr;
+        m_count.fetch_sub(1, std::memory_order_relaxed);
+        return p;
+    }
+
+    /// Call \a a_fun(index, serial, object) for every object.  Objects put
+    /// or removed during the call may be missed or included.
+    template <typename F>
+    void for_each(F a_fun) const {
+        uint32_t n = std::min(m_next.load(std::memory_order_acquire), m_max_index+1);
+        for (uint32_t i = 1; i < n; ++i) {
+            const slot* s = at(i);
+            T* p = s ? s->value.load(std::memory_order_acquire) : nullptr;
+            if (p)
+                a_fun(i, s->serial.load(std::memory_order_relaxed), p);
+        }
+    }
+
+    /// Number of objects in the table.
+    size_t size() const { return m_count.load(std::memory_order_relaxed); }
+
+    /// Largest index handed out by reserve().
+    uint32_t max_index() const { return m_max_index; }
+};
+
+} // namespace util
+} // namespace eixx
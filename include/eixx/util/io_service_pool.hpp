@@ -0,0 +1,164 @@
+//----------------------------------------------------------------------------
+/// \file   io_service_pool.hpp
+/// \author Serge Aleynikov
+//----------------------------------------------------------------------------
+/// \brief Pool of I/O services each run by a dedicated thread.
+//----------------------------------------------------------------------------
+// Created: 2021-11-10
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+#include <eixx/util/common.hpp>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace eixx {
+namespace util {
+
+/**
+ * A fixed set of I/O services, each of which is run by \a a_threads
+ * threads (one by default).  The i-th thread started by the pool is
+ * pinned to CPU a_cpus[i % a_cpus.size()] (no pinning if \a a_cpus is
+ * empty).
+ *
+ * With one thread per service, objects bound to one service (sockets,
+ * timers, queues) are only ever accessed by that service's thread, so no
+ * locking is needed among them.
+ */
+class io_service_pool : private boost::noncopyable {
+    typedef boost::asio::io_service::work work;
+
+    std::vector<std::unique_ptr<boost::asio::io_service>>   m_services;
+    std::vector<std::unique_ptr<work>>                      m_work;
+    std::vector<std::thread>                                m_threads;
+    std::vector<int>                                        m_cpus;
+    size_t                                                  m_nthreads;
+    std::atomic<size_t>                                     m_next;
+    std::function<void(boost::asio::io_service&)>           m_runner;
+
+    static void pin(std::thread& a_thread, int a_cpu) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(a_cpu, &set);
+        int rc = pthread_setaffinity_np(a_thread.native_handle(), sizeof(set), &set);
+        if (rc)
+            THROW_RUNTIME_ERROR("Cannot pin I/O thread to CPU " << a_cpu
+                                << ": " << strerror(rc));
+#else
+        (void)a_thread; (void)a_cpu;
+#endif
+    }
+
+public:
+    explicit io_service_pool(size_t a_size,
+                             const std::vector<int>& a_cpus = std::vector<int>(),
+                             size_t a_threads = 1)
+        : m_cpus(a_cpus), m_nthreads(a_threads), m_next(0)
+    {
+        if (!a_size || !a_threads)
+            THROW_RUNTIME_ERROR("I/O service pool size must be positive");
+        for (size_t i = 0; i < a_size; ++i)
+            m_services.emplace_back(new boost::asio::io_service(int(a_threads)));
+    }
+
+    ~io_service_pool() { stop(); }
+
+    size_t size()    const { return m_services.size(); }
+    /// Number of threads running each service.
+    size_t threads() const { return m_nthreads; }
+    bool   running() const { return !m_threads.empty(); }
+
+    /// Get the i-th service of the pool.
+    boost::asio::io_service& get(size_t i) { return *m_services[i % size()]; }
+
+    /// Get the services in round-robin order.
+    boost::asio::io_service& next() {
+        return get(m_next.fetch_add(1, std::memory_order_relaxed));
+    }
+
+    /// Set the function run by the threads instead of io_service::run().
+    /// It must return when the service is stopped.
+    void runner(const std::function<void(boost::asio::io_service&)>& a_fun) {
+        m_runner = a_fun;
+    }
+
+    /// Start the threads running the services.  The call returns immediately.
+    void start() {
+        if (running())
+            return;
+        for (size_t i = 0; i < size(); ++i) {
+            auto& svc = *m_services[i];
+            svc.reset();
+            m_work.emplace_back(new work(svc));
+            for (size_t j = 0; j < m_nthreads; ++j) {
+                m_threads.emplace_back([this, &svc]() {
+                    if (m_runner)
+                        m_runner(svc);
+                    else
+                        svc.run();
+                });
+                if (!m_cpus.empty())
+                    pin(m_threads.back(), m_cpus[(m_threads.size()-1) % m_cpus.size()]);
+            }
+        }
+    }
+
+    /// Run the handlers that are ready on the services of a stopped pool,
+    /// e.g. completions of operations cancelled after stop().
+    void poll() {
+        if (running())
+            return;
+        for (auto& s : m_services) {
+            s->reset();
+            while (s->poll());
+        }
+    }
+
+    /// Stop the services and wait for their threads to exit.
+    void stop() {
+        m_work.clear();
+        for (auto& s : m_services)
+            s->stop();
+        for (auto& t : m_threads)
+            if (t.joinable() && t.get_id() != std::this_thread::get_id())
+                t.join();
+            else if (t.joinable())
+                t.detach();
+        m_threads.clear();
+    }
+};
+
+} // namespace util
+} // namespace eixx
@@ -0,0 +1,138 @@
+//----------------------------------------------------------------------------
+/// \file   latency_histogram.hpp
+/// \author Serge Aleynikov
+//----------------------------------------------------------------------------
+/// \brief Lock-free histogram of latencies.
+//----------------------------------------------------------------------------
+// Created: 2021-11-16
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <boost/noncopyable.hpp>
+
+namespace eixx {
+namespace util {
+
+/**
+ * Histogram of latencies in nanoseconds.  Each power of two range of
+ * values is split into s_sub_buckets linear buckets, so percentiles are
+ * reported with a relative error below 1/s_sub_buckets.  record() may be
+ * called concurrently from any number of threads.
+ */
+class latency_histogram : private boost::noncopyable {
+    static const unsigned s_sub_bits    = 4;
+    static const unsigned s_sub_buckets = 1u << s_sub_bits;
+    static const unsigned s_buckets     = (64 - s_sub_bits + 1) * s_sub_buckets;
+
+    std::atomic<uint64_t> m_buckets[s_buckets];
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_max;
+
+    static unsigned index(uint64_t a_ns) {
+        if (a_ns < s_sub_buckets)
+            return unsigned(a_ns);
+        unsigned e = 63 - unsigned(__builtin_clzll(a_ns));
+        return (e - s_sub_bits + 1) * s_sub_buckets
+             + unsigned(a_ns >> (e - s_sub_bits)) - s_sub_buckets;
+    }
+
+    /// Largest value that falls in bucket \a a_idx.
+    static uint64_t upper_bound(unsigned a_idx) {
+        if (a_idx < s_sub_buckets)
+            return a_idx;
+        unsigned e   = a_idx / s_sub_buckets + s_sub_bits - 1;
+        uint64_t sub = a_idx % s_sub_buckets;
+        return ((s_sub_buckets + sub + 1) << (e - s_sub_bits)) - 1;
+    }
+
+public:
+    latency_histogram() { reset(); }
+
+    /// Current time in nanoseconds to be passed to record().
+    static uint64_t now() {
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    /// Add a sample of \a a_ns nanoseconds.
+    void record(uint64_t a_ns) {
+        m_buckets[index(a_ns)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        uint64_t m = m_max.load(std::memory_order_relaxed);
+        while (a_ns > m && !m_max.compare_exchange_weak(m, a_ns, std::memory_order_relaxed));
+    }
+
+    /// Add a sample of the time elapsed since \a a_start obtained by now().
+    void record_since(uint64_t a_start) {
+        uint64_t t = now();
+        record(t > a_start ? t - a_start : 0);
+    }
+
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+    uint64_t max()   const { return m_max.load(std::memory_order_relaxed); }
+
+    /// Latency in nanoseconds below which \a a_pct percent of the samples
+    /// fall (e.g. 99.9).  Returns 0 if there are no samples.
+    uint64_t percentile(double a_pct) const {
+        uint64_t n = count();
+        if (!n)
+            return 0;
+        uint64_t rank = uint64_t(double(n) * a_pct / 100.0 + 0.5);
+        if (rank < 1) rank = 1;
+        uint64_t seen = 0;
+        for (unsigned i = 0; i < s_buckets; ++i) {
+            seen += m_buckets[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                uint64_t v = upper_bound(i);
+                return v < max() ? v : max();
+            }
+        }
+        return max();
+    }
+
+    void reset() {
+        for (auto& b : m_buckets)
+            b.store(0, std::memory_order_relaxed);
+        m_count.store(0, std::memory_order_relaxed);
+        m_max.store(0, std::memory_order_relaxed);
+    }
+
+    /// Summary of the distribution in microseconds.
+    std::string to_string() const {
+        std::stringstream s;
+        s << "count=" << count()
+          << " p50="   << double(percentile(50))   / 1000.0
+          << " p90="   << double(percentile(90))   / 1000.0
+          << " p99="   << double(percentile(99))   / 1000.0
+          << " p99.9=" << double(percentile(99.9)) / 1000.0
+          << " max="   << double(max())            / 1000.0 << "us";
+        return s.str();
+    }
+};
+
+} // namespace util
+} // namespace eixx
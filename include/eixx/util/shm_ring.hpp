@@ -0,0 +1,251 @@
+//----------------------------------------------------------------------------
+/// \file   shm_ring.hpp
+/// \author Serge Aleynikov
+//----------------------------------------------------------------------------
+/// \brief Single-producer single-consumer byte ring in shared memory.
+//----------------------------------------------------------------------------
+// Created: 2021-11-17
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstdio>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <boost/noncopyable.hpp>
+#include <eixx/util/common.hpp>
+
+namespace eixx {
+namespace util {
+
+/**
+ * A stream of bytes passed from one process to another through a ring
+ * buffer in shared memory.  The ring is lock-free with a single writer
+ * and a single reader.
+ *
+ * A side that finds the ring empty (reader) or full (writer) may go to
+ * sleep after announcing it with prepare_rd_wait() / prepare_wr_wait().
+ * The other side checks wake_reader() / wake_writer() after moving data
+ * and wakes it up by other means (e.g. an eventfd).
+ */
+class shm_ring {
+    struct header {
+        alignas(64) std::atomic<uint64_t> head;         // Consumed by the reader
+        alignas(64) std::atomic<uint64_t> tail;         // Produced by the writer
+        alignas(64) std::atomic<uint32_t> rd_waiting;   // Reader sleeps on empty ring
+                    std::atomic<uint32_t> wr_waiting;   // Writer sleeps on full ring
+    };
+
+    header* m_hdr;
+    char*   m_data;
+    size_t  m_mask;
+
+public:
+    /// Bytes of memory needed for a ring of \a a_capacity bytes.
+    static size_t footprint(size_t a_capacity) { return sizeof(header) + a_capacity; }
+
+    shm_ring() : m_hdr(NULL), m_data(NULL), m_mask(0) {}
+
+    /// Attach to the ring in \a a_mem of footprint(a_capacity) bytes.
+    /// @param a_capacity must be a power of two.
+    /// @param a_init if true the ring is initialized as empty.
+    shm_ring(void* a_mem, size_t a_capacity, bool a_init)
+        : m_hdr(static_cast<header*>(a_mem))
+        , m_data(static_cast<char*>(a_mem) + sizeof(header))
+        , m_mask(a_capacity - 1)
+    {
+        if (a_capacity & m_mask)
+            THROW_RUNTIME_ERROR("Ring capacity must be a power of two: " << a_capacity);
+        if (a_init) {
+            m_hdr->head.store(0, std::memory_order_relaxed);
+            m_hdr->tail.store(0, std::memory_order_relaxed);
+            m_hdr->rd_waiting.store(0, std::memory_order_relaxed);
+            m_hdr->wr_waiting.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    size_t capacity() const { return m_mask + 1; }
+
+    /// Number of bytes available to the reader.
+    size_t readable() const {
+        return size_t(m_hdr->tail.load(std::memory_order_acquire)
+                    - m_hdr->head.load(std::memory_order_relaxed));
+    }
+
+    /// Number of bytes that can be written.
+    size_t writable() const {
+        return capacity() - size_t(m_hdr->tail.load(std::memory_order_relaxed)
+                                 - m_hdr->head.load(std::memory_order_acquire));
+    }
+
+    /// Copy up to \a a_size bytes from the ring.  Called by the reader.
+    /// @return number of bytes copied.
+    size_t read(char* a_buf, size_t a_size) {
+        uint64_t head = m_hdr->head.load(std::memory_order_relaxed);
+        size_t   n    = std::min(a_size, size_t(m_hdr->tail.load(std::memory_order_acquire) - head));
+        if (!n)
+            return 0;
+        size_t   off  = size_t(head) & m_mask;
+        size_t   l    = std::min(n, capacity() - off);
+        memcpy(a_buf, m_data + off, l);
+        memcpy(a_buf + l, m_data, n - l);
+        m_hdr->head.store(head + n, std::memory_order_release);
+        return n;
+    }
+
+    /// Copy as much of the \a a_cnt buffers \a a_iov as fits to the ring.
+    /// Called by the writer.
+    /// @return number of bytes copied.
+    size_t write(const iovec* a_iov, size_t a_cnt) {
+        uint64_t tail  = m_hdr->tail.load(std::memory_order_relaxed);
+        size_t   space = capacity() - size_t(tail - m_hdr->head.load(std::memory_order_acquire));
+        size_t   total = 0;
+        for (size_t i = 0; i < a_cnt && space; ++i) {
+            const char* p = static_cast<const char*>(a_iov[i].iov_base);
+            size_t      n = std::min(space, a_iov[i].iov_len);
+            size_t      off = size_t(tail + total) & m_mask;
+            size_t      l   = std::min(n, capacity() - off);
+            memcpy(m_data + off, p, l);
+            memcpy(m_data, p + l, n - l);
+            total += n;
+            space -= n;
+        }
+        if (total)
+            m_hdr->tail.store(tail + total, std::memory_order_release);
+        return total;
+    }
+
+    /// Announce that the reader is going to sleep.
+    /// @return false if data arrived meanwhile and the reader must not sleep.
+    bool prepare_rd_wait() {
+        m_hdr->rd_waiting.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!readable())
+            return true;
+        m_hdr->rd_waiting.store(0, std::memory_order_relaxed);
+        return false;
+    }
+
+    /// Announce that the writer is going to sleep.
+    /// @return false if space was freed meanwhile and the writer must not sleep.
+    bool prepare_wr_wait() {
+        m_hdr->wr_waiting.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!writable())
+            return true;
+        m_hdr->wr_waiting.store(0, std::memory_order_relaxed);
+        return false;
+    }
+
+    /// Called by the writer after write().
+    /// @return true if the reader sleeps and must be woken up.
+    bool wake_reader() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return m_hdr->rd_waiting.load(std::memory_order_relaxed)
+            && m_hdr->rd_waiting.exchange(0, std::memory_order_relaxed);
+    }
+
+    /// Called by the reader after read().
+    /// @return true if the writer sleeps and must be woken up.
+    bool wake_writer() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return m_hdr->wr_waiting.load(std::memory_order_relaxed)
+            && m_hdr->wr_waiting.exchange(0, std::memory_order_relaxed);
+    }
+};
+
+/**
+ * Anonymous shared memory mapped by this process.  The memory is shared
+ * with other processes by passing fd() over a Unix domain socket.
+ */
+class shm_segment : private boost::noncopyable {
+    int     m_fd;
+    void*   m_addr;
+    size_t  m_size;
+
+public:
+    shm_segment() : m_fd(-1), m_addr(NULL), m_size(0) {}
+    ~shm_segment() { close(); }
+
+    /// Create a segment of \a a_size bytes.
+    /// @throws std::runtime_error
+    void create(size_t a_size) {
+        close();
+#ifdef __linux__
+        int fd = ::memfd_create("eixx-shm", MFD_CLOEXEC);
+#else
+        char name[64];
+        snprintf(name, sizeof(name), "/eixx-shm.%d.%p", ::getpid(), (void*)this);
+        int fd = ::shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0)
+            ::shm_unlink(name);
+#endif
+        if (fd < 0)
+            THROW_RUNTIME_ERROR("Cannot create shared memory: " << strerror(errno));
+        if (::ftruncate(fd, off_t(a_size)) < 0) {
+            int e = errno;
+            ::close(fd);
+            THROW_RUNTIME_ERROR("Cannot size shared memory: " << strerror(e));
+        }
+        attach(fd, a_size);
+    }
+
+    /// Map the segment \a a_fd of \a a_size bytes created by another process.
+    /// The segment takes ownership of the descriptor.
+    /// @throws std::runtime_error
+    void attach(int a_fd, size_t a_size) {
+        close();
+        m_fd = a_fd;
+        struct stat st;
+        if (::fstat(a_fd, &st) < 0 || size_t(st.st_size) < a_size)
+            THROW_RUNTIME_ERROR("Invalid shared memory segment of " << a_size << " bytes");
+        m_addr = ::mmap(NULL, a_size, PROT_READ | PROT_WRITE, MAP_SHARED, a_fd, 0);
+        if (m_addr == MAP_FAILED) {
+            m_addr = NULL;
+            THROW_RUNTIME_ERROR("Cannot map shared memory: " << strerror(errno));
+        }
+        m_size = a_size;
+    }
+
+    void close() {
+        if (m_addr)
+            ::munmap(m_addr, m_size);
+        if (m_fd >= 0)
+            ::close(m_fd);
+        m_fd   = -1;
+        m_addr = NULL;
+        m_size = 0;
+    }
+
+    int     fd()    const { return m_fd;   }
+    char*   data()  const { return static_cast<char*>(m_addr); }
+    size_t  size()  const { return m_size; }
+};
+
+} // namespace util
+} // namespace eixx
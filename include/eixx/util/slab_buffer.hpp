@@ -0,0 +1,226 @@
+//----------------------------------------------------------------------------
+/// \file   slab_buffer.hpp
+/// \author Serge Aleynikov
+//----------------------------------------------------------------------------
+/// \brief Lock-free multi-producer slab of reusable output memory.
+//----------------------------------------------------------------------------
+// Created: 2021-11-02
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+#pragma once
+
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <boost/assert.hpp>
+#include <boost/noncopyable.hpp>
+#include <eixx/util/compiler_hints.hpp>
+
+namespace eixx {
+namespace util {
+
+/**
+ * A contiguous memory region split into \a a_chunks chunks of \a a_chunk_size
+ * bytes.  Producers carve buffers out of the current chunk using a single
+ * CAS, so consecutive allocations are adjacent in memory.  A chunk that
+ * can't satisfy a request is sealed and replaced by a free chunk.  Once all
+ * bytes allocated from a sealed chunk are released, the chunk is returned
+ * to the free list.
+ *
+ * allocate() may be called concurrently from any number of threads.
+ * release() may be called from any thread, and a single release() call
+ * may cover several adjacent allocations.  When no free chunk is
+ * available or the request is larger than a chunk, allocate() returns
+ * NULL and the caller is expected to fall back to a heap allocation.
+ */
+template <typename Alloc = std::allocator<char>>
+class slab_buffer : private boost::noncopyable {
+    static constexpr uint64_t s_lo_mask = 0xFFFFFFFFu;
+    static constexpr int64_t  s_bias    = int64_t(1) << 48;
+
+    struct chunk {
+        std::atomic<uint64_t>   state;  // (generation << 32) | offset
+        std::atomic<int64_t>    refs;   // s_bias - sealed_size - released
+        std::atomic<uint32_t>   next;   // Free list link (index+1)
+    };
+
+    Alloc                   m_alloc;
+    char*                   m_base;
+    chunk*                  m_chunks;
+    size_t                  m_chunk_size;
+    size_t                  m_nchunks;
+    std::atomic<uint64_t>   m_current;  // (generation << 32) | (index+1)
+    std::atomic<uint64_t>   m_free;     // (tag << 32) | (index+1)
+    std::atomic<size_t>     m_misses;   // Allocation requests not satisfied
+
+    static uint32_t gen(uint64_t a) { return uint32_t(a >> 32); }
+    static uint32_t low(uint64_t a) { return uint32_t(a & s_lo_mask); }
+
+    void push_free(uint32_t a_idx) {
+        uint64_t h = m_free.load(std::memory_order_relaxed);
+        uint64_t n;
+        do {
+            m_chunks[a_idx].next.store(low(h), std::memory_order_relaxed);
+            n = (uint64_t(gen(h)+1) << 32) | (a_idx+1);
+        } while (!m_free.compare_exchange_weak(h, n, std::memory_order_release,
+                                                     std::memory_order_relaxed));
+    }
+
+    bool pop_free(uint32_t& a_idx) {
+        uint64_t h = m_free.load(std::memory_order_acquire);
+        while (low(h)) {
+            uint32_t i = low(h) - 1;
+            uint64_t n = (uint64_t(gen(h)+1) << 32)
+                       | m_chunks[i].next.load(std::memory_order_relaxed);
+            if (m_free.compare_exchange_weak(h, n, std::memory_order_acquire,
+                                                   std::memory_order_acquire)) {
+                a_idx = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void release_chunk(uint32_t a_idx, int64_t a_bytes) {
+        chunk& c = m_chunks[a_idx];
+        if (c.refs.fetch_sub(a_bytes, std::memory_order_acq_rel) != a_bytes)
+            return;
+        // All allocated bytes were released and the chunk is sealed.
+        // Reset the offset keeping the generation bumped by the sealer
+        // so that stale producers fail their CAS.
+        c.refs.store(s_bias, std::memory_order_relaxed);
+        uint64_t st = c.state.load(std::memory_order_relaxed);
+        c.state.store(st & ~s_lo_mask, std::memory_order_relaxed);
+        push_free(a_idx);
+    }
+
+    /// Replace current chunk \a a_expected with a free chunk.
+    /// @return false if there are no free chunks.
+    bool install(uint64_t a_expected) {
+        uint32_t i;
+        if (!pop_free(i)) {
+            m_current.compare_exchange_strong(a_expected, 0, std::memory_order_acq_rel);
+            return false;
+        }
+        uint64_t cur = (m_chunks[i].state.load(std::memory_order_relaxed) & ~s_lo_mask) | (i+1);
+        if (!m_current.compare_exchange_strong(a_expected, cur, std::memory_order_acq_rel))
+            push_free(i);   // Another producer installed a chunk first
+        return true;
+    }
+
+public:
+    slab_buffer(size_t a_chunk_size, size_t a_chunks, const Alloc& a_alloc = Alloc())
+        : m_alloc(a_alloc), m_base(NULL), m_chunks(NULL)
+        , m_chunk_size(a_chunk_size), m_nchunks(a_chunk_size ? a_chunks : 0)
+        , m_current(0), m_free(0), m_misses(0)
+    {
+        BOOST_ASSERT(a_chunk_size < s_lo_mask);
+        if (!m_nchunks)
+            return;
+        m_base   = m_alloc.allocate(m_chunk_size * m_nchunks);
+        m_chunks = new chunk[m_nchunks];
+        for (size_t i = m_nchunks; i > 0; --i) {
+            m_chunks[i-1].state.store(0, std::memory_order_relaxed);
+            m_chunks[i-1].refs.store(s_bias, std::memory_order_relaxed);
+            push_free(uint32_t(i-1));
+        }
+    }
+
+    ~slab_buffer() {
+        if (m_base)
+            m_alloc.deallocate(m_base, m_chunk_size * m_nchunks);
+        delete [] m_chunks;
+    }
+
+    size_t chunk_size()  const { return m_chunk_size; }
+    size_t chunks()      const { return m_nchunks;    }
+    size_t capacity()    const { return m_chunk_size * m_nchunks; }
+    /// Start of the memory managed by the slab.
+    const char* data()   const { return m_base; }
+    /// Number of allocation requests that couldn't be satisfied by the slab.
+    size_t misses()      const { return m_misses.load(std::memory_order_relaxed); }
+
+    /// Returns true if \a p belongs to the memory managed by the slab.
+    bool owns(const char* p) const {
+        return p >= m_base && p < m_base + capacity();
+    }
+
+    /// Allocate \a a_sz bytes.
+    /// @return NULL if the slab has no space for the request.
+    char* allocate(size_t a_sz) {
+        if (unlikely(a_sz > m_chunk_size || !a_sz)) {
+            if (a_sz) m_misses.fetch_add(1, std::memory_order_relaxed);
+            return NULL;
+        }
+
+        for (;;) {
+            uint64_t cur = m_current.load(std::memory_order_acquire);
+            if (!cur) {
+                if (!install(0)) {
+                    m_misses.fetch_add(1, std::memory_order_relaxed);
+                    return NULL;
+                }
+                continue;
+            }
+            uint32_t i  = low(cur) - 1;
+            chunk&   c  = m_chunks[i];
+            uint64_t st = c.state.load(std::memory_order_acquire);
+            if (gen(st) != gen(cur))
+                continue;   // The chunk is being replaced by another producer
+
+            uint32_t off = low(st);
+            if (off + a_sz <= m_chunk_size) {
+                if (c.state.compare_exchange_weak(st, st + a_sz, std::memory_order_acq_rel))
+                    return m_base + i*m_chunk_size + off;
+                continue;
+            }
+
+            // Seal the chunk - the bytes [0, off) is all that it will ever hold.
+            if (!c.state.compare_exchange_strong(st, (uint64_t(gen(st)+1) << 32) | off,
+                                                 std::memory_order_acq_rel))
+                continue;
+            release_chunk(i, s_bias - off);
+            install(cur);
+        }
+    }
+
+    /// Return \a a_sz bytes starting at \a p to the slab.  The range may
+    /// span several adjacent allocations.
+    /// @return false if \a p is not owned by the slab.
+    bool release(const char* p, size_t a_sz) {
+        if (!owns(p))
+            return false;
+        while (a_sz) {
+            size_t i   = size_t(p - m_base) / m_chunk_size;
+            size_t end = (i+1) * m_chunk_size;
+            size_t n   = std::min(a_sz, end - size_t(p - m_base));
+            release_chunk(uint32_t(i), int64_t(n));
+            p    += n;
+            a_sz -= n;
+        }
+        return true;
+    }
+};
+
+} // namespace util
+} // namespace eixx
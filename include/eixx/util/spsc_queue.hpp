@@ -0,0 +1,126 @@
+//----------------------------------------------------------------------------
+/// \file   spsc_queue.hpp
+/// \author Serge Aleynikov
+//----------------------------------------------------------------------------
+/// \brief Bounded single-producer single-consumer ring buffer.
+//----------------------------------------------------------------------------
+// Created: 2021-11-21
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <boost/noncopyable.hpp>
+#include <eixx/util/compiler_hints.hpp>
+
+namespace eixx {
+namespace util {
+
+/**
+ * Bounded wait-free queue with one producer thread and one consumer
+ * thread.  Each side keeps a cached copy of the other side's position,
+ * so the cache line of the other side is only read when the queue looks
+ * full (or empty).  Neither operation allocates memory.
+ *
+ * The capacity is rounded up to a power of two.
+ */
+template <typename T, typename Alloc = std::allocator<char>>
+class spsc_queue : private boost::noncopyable {
+    using value_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<T>;
+
+    static constexpr size_t s_cache_line = 64;
+
+    value_alloc                                 m_alloc;
+    T*                                          m_data;
+    size_t                                      m_mask;
+    alignas(s_cache_line) std::atomic<size_t>   m_tail;         // Written by the producer
+    size_t                                      m_head_cache;   // Producer's copy of m_head
+    alignas(s_cache_line) std::atomic<size_t>   m_head;         // Written by the consumer
+    size_t                                      m_tail_cache;   // Consumer's copy of m_tail
+
+    static size_t round_up(size_t n) {
+        size_t r = 2;
+        while (r < n) r <<= 1;
+        return r;
+    }
+
+public:
+    explicit spsc_queue(size_t a_capacity, const Alloc& a_alloc = Alloc())
+        : m_alloc(a_alloc)
+        , m_mask(round_up(a_capacity) - 1)
+        , m_tail(0), m_head_cache(0)
+        , m_head(0), m_tail_cache(0)
+    {
+        m_data = m_alloc.allocate(m_mask+1);
+        for (size_t i = 0; i <= m_mask; ++i)
+            new (&m_data[i]) T();
+    }
+
+    ~spsc_queue() {
+        for (size_t i = 0; i <= m_mask; ++i)
+            m_data[i].~T();
+        m_alloc.deallocate(m_data, m_mask+1);
+    }
+
+    size_t capacity() const { return m_mask + 1; }
+
+    /// Approximate number of items in the queue.
+    size_t size() const {
+        size_t h = m_head.load(std::memory_order_acquire);
+        size_t t = m_tail.load(std::memory_order_acquire);
+        return t > h ? t - h : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    /// Called by the producer.
+    /// @return false if the queue is full.
+    bool try_push(const T& a_value) {
+        size_t t = m_tail.load(std::memory_order_relaxed);
+        if (unlikely(t - m_head_cache > m_mask)) {
+            m_head_cache = m_head.load(std::memory_order_acquire);
+            if (t - m_head_cache > m_mask)
+                return false;
+        }
+        m_data[t & m_mask] = a_value;
+        m_tail.store(t+1, std::memory_order_release);
+        return true;
+    }
+
+    /// Called by the consumer.
+    /// @return false if the queue is empty.
+    bool try_pop(T& a_value) {
+        size_t h = m_head.load(std::memory_order_relaxed);
+        if (unlikely(h == m_tail_cache)) {
+            m_tail_cache = m_tail.load(std::memory_order_acquire);
+            if (h == m_tail_cache)
+                return false;
+        }
+        a_value = std::move(m_data[h & m_mask]);
+        m_head.store(h+1, std::memory_order_release);
+        return true;
+    }
+};
+
+} // namespace util
+} // namespace eixx
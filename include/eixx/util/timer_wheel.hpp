@@ -0,0 +1,316 @@
+//----------------------------------------------------------------------------
+/// \file   timer_wheel.hpp
+/// \author Serge Aleynikov
+//----------------------------------------------------------------------------
+/// \brief Hierarchical timing wheel driven by a single asio timer.
+//----------------------------------------------------------------------------
+// Created: 2021-11-24
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <eixx/util/compiler_hints.hpp>
+
+namespace eixx {
+namespace util {
+
+/**
+ * Hierarchical timing wheel for large numbers of timers, such as receive
+ * timeouts of mailboxes and reconnect timers of connections.
+ *
+ * Time is divided in ticks of \a a_resolution.  A timer is kept in a slot
+ * of one of four wheels of 256 slots: the first wheel holds timers
+ * expiring within 256 ticks, the next one within 2^16 ticks, etc.  Every
+ * 256 ticks the timers of the next slot of a higher wheel are moved to the
+ * lower wheels.  Arming and cancelling a timer is an O(1) list operation,
+ * and the I/O service only holds one timer that wakes up the wheel when
+ * its next slot is due (and none when no timer is armed, so the wheel
+ * doesn't keep the service's run() from returning).  Delays are rounded
+ * up to the resolution (a timer never expires early) and capped at 2^32
+ * ticks.
+ *
+ * Timers may be armed and cancelled by any thread.  Expired timers are
+ * called in the thread running the wheel's I/O service.  The wheel must be
+ * owned by a boost::shared_ptr.
+ */
+class timer_wheel
+    : public boost::enable_shared_from_this<timer_wheel>
+    , private boost::noncopyable
+{
+    static constexpr int      s_bits   = 8;
+    static constexpr int      s_levels = 4;
+    static constexpr uint64_t s_slots  = uint64_t(1) << s_bits;
+    static constexpr uint64_t s_mask   = s_slots - 1;
+    static constexpr uint64_t s_max    = (uint64_t(1) << (s_bits*s_levels)) - 1;
+
+    struct link {
+        link* prev;
+        link* next;
+
+        link() : prev(nullptr), next(nullptr) {}
+        void init()         { prev = next = this;       }
+        bool empty() const  { return next == this;      }
+        bool linked() const { return next != nullptr;   }
+
+        void push_back(link* a) {
+            a->prev = prev; a->next = this;
+            prev->next = a; prev = a;
+        }
+        void unlink() {
+            prev->next = next; next->prev = prev;
+            prev = next = nullptr;
+        }
+        // Move the items of this list to the end of a_to
+        void splice(link& a_to) {
+            if (empty()) return;
+            next->prev = a_to.prev; a_to.prev->next = next;
+            prev->next = &a_to;     a_to.prev = prev;
+            init();
+        }
+    };
+
+public:
+    using clock = std::chrono::steady_clock;
+
+    /// Timer of a wheel.  The callback given to the constructor is called
+    /// every time the timer expires.  The timer is cancelled when
+    /// destroyed.
+    class timer : private link, private boost::noncopyable {
+        friend class timer_wheel;
+
+        boost::shared_ptr<timer_wheel>  m_wheel;
+        uint64_t                        m_expire;   // Tick of expiration
+        std::function<void()>           m_on_expire;
+    public:
+        timer(const boost::shared_ptr<timer_wheel>& a_wheel, std::function<void()> a_on_expire)
+            : m_wheel(a_wheel), m_expire(0), m_on_expire(std::move(a_on_expire))
+        {}
+
+        ~timer() { cancel(); }
+
+        /// (Re)arm the timer to expire in \a a_delay.
+        void arm(clock::duration a_delay) { m_wheel->arm(*this, a_delay); }
+
+        /// Cancel the timer.  If it's expiring in another thread, waits
+        /// until its callback returns.
+        /// @return true if the timer was armed.
+        bool cancel() { return m_wheel->cancel(*this); }
+
+        const boost::shared_ptr<timer_wheel>& wheel() const { return m_wheel; }
+    };
+
+    /// @param a_svc is the service calling expired timers.
+    /// @param a_resolution is the duration of a tick.
+    explicit timer_wheel(boost::asio::io_service& a_svc,
+                         std::chrono::microseconds a_resolution = std::chrono::milliseconds(1))
+        : m_svc(a_svc)
+        , m_timer(a_svc)
+        , m_resolution(a_resolution.count() > 0 ? a_resolution : std::chrono::microseconds(1))
+        , m_start(clock::now())
+        , m_now(0)
+        , m_wake(s_never)
+        , m_count(0)
+        , m_firing(nullptr)
+        , m_resched_pending(false)
+    {
+        for (auto& level : m_wheels)
+            for (auto& slot : level)
+                slot.init();
+        m_expired.init();
+    }
+
+    boost::asio::io_service&  io_service()  { return m_svc;        }
+    std::chrono::microseconds resolution() const { return m_resolution; }
+
+    /// Number of armed timers.
+    size_t size() const {
+        std::lock_guard<std::mutex> guard(m_lock);
+        return m_count;
+    }
+
+private:
+    static constexpr uint64_t s_never = std::numeric_limits<uint64_t>::max();
+
+    boost::asio::io_service&    m_svc;
+    boost::asio::steady_timer   m_timer;
+    std::chrono::microseconds   m_resolution;
+    clock::time_point           m_start;        // Time of tick 0
+    mutable std::mutex          m_lock;         // Guards the members below
+    link                        m_wheels[s_levels][s_slots];
+    link                        m_expired;      // Timers being called by expire()
+    uint64_t                    m_now;          // Next tick to process
+    uint64_t                    m_wake;         // Tick m_timer is set to
+    size_t                      m_count;
+    timer*                      m_firing;       // Timer being called by expire()
+    std::thread::id             m_firing_thread;
+    std::atomic<bool>           m_resched_pending;
+
+    uint64_t current_tick() const {
+        return uint64_t((clock::now() - m_start) / m_resolution);
+    }
+
+    // Put a_t in the slot of its expiration
+    void place(timer& a_t) {
+        if (a_t.m_expire < m_now)
+            a_t.m_expire = m_now;
+        uint64_t delta = a_t.m_expire - m_now;
+        if (unlikely(delta > s_max)) {
+            a_t.m_expire = m_now + s_max;
+            delta = s_max;
+        }
+        int level = 0;
+        while (delta >= (uint64_t(1) << (s_bits*(level+1))))
+            ++level;
+        m_wheels[level][(a_t.m_expire >> (s_bits*level)) & s_mask].push_back(&a_t);
+    }
+
+    // Move the timers of the current slot of a_level to the lower levels
+    uint64_t cascade(int a_level) {
+        uint64_t idx = (m_now >> (s_bits*a_level)) & s_mask;
+        link list; list.init();
+        m_wheels[a_level][idx].splice(list);
+        while (!list.empty()) {
+            timer& t = static_cast<timer&>(*list.next);
+            list.next->unlink();
+            place(t);
+        }
+        return idx;
+    }
+
+    // Tick at which the timer of the service needs to wake up the wheel
+    uint64_t next_tick() const {
+        if (!m_count)
+            return s_never;
+        if (!m_expired.empty() || (m_now & s_mask) == 0)
+            return m_now;
+        uint64_t boundary = (m_now | s_mask) + 1;
+        for (uint64_t t = m_now; t < boundary; ++t)
+            if (!m_wheels[0][t & s_mask].empty())
+                return t;
+        return boundary;
+    }
+
+    // Set the timer of the service to the next due tick (service thread)
+    void reschedule() {
+        uint64_t next = next_tick();
+        if (next == m_wake)
+            return;
+        m_wake = next;
+        boost::system::error_code ec;
+        if (next == s_never) {
+            m_timer.cancel(ec);
+            return;
+        }
+        m_timer.expires_at(m_start + next * m_resolution);
+        auto pthis = shared_from_this();
+        m_timer.async_wait([pthis](const boost::system::error_code& e) {
+            if (e != boost::asio::error::operation_aborted)
+                pthis->expire();
+        });
+    }
+
+    void arm(timer& a_t, clock::duration a_delay) {
+        // The timer expires at the first tick not earlier than the deadline
+        auto deadline = clock::now() - m_start + std::max(a_delay, clock::duration(0));
+        uint64_t expire = uint64_t((deadline + m_resolution - clock::duration(1)) / m_resolution);
+        std::lock_guard<std::mutex> guard(m_lock);
+        if (a_t.linked())
+            a_t.unlink();
+        else if (!m_count++)
+            m_now = std::max(m_now, current_tick());    // Skip the ticks of an idle wheel
+        a_t.m_expire = expire;
+        place(a_t);
+        if (a_t.m_expire >= m_wake)
+            return;
+        if (m_svc.get_executor().running_in_this_thread())
+            reschedule();
+        else if (!m_resched_pending.exchange(true, std::memory_order_acq_rel)) {
+            auto pthis = shared_from_this();
+            m_svc.post([pthis]() {
+                pthis->m_resched_pending.store(false, std::memory_order_release);
+                std::lock_guard<std::mutex> g(pthis->m_lock);
+                pthis->reschedule();
+            });
+        }
+    }
+
+    bool cancel(timer& a_t) {
+        std::unique_lock<std::mutex> guard(m_lock);
+        if (a_t.linked()) {
+            a_t.unlink();
+            --m_count;
+            return true;
+        }
+        // The callback may be using the owner of the timer
+        while (m_firing == &a_t && m_firing_thread != std::this_thread::get_id()) {
+            guard.unlock();
+            std::this_thread::yield();
+            guard.lock();
+        }
+        return false;
+    }
+
+    // Call the timers that expired by now (service thread)
+    void expire() {
+        std::unique_lock<std::mutex> guard(m_lock);
+        m_wake = s_never;
+        for (uint64_t cur = current_tick(); m_now <= cur; ++m_now) {
+            if ((m_now & s_mask) == 0)
+                for (int level = 1; level < s_levels && cascade(level) == 0; ++level);
+            m_wheels[0][m_now & s_mask].splice(m_expired);
+        }
+
+        m_firing_thread = std::this_thread::get_id();
+        while (!m_expired.empty()) {
+            timer& t = static_cast<timer&>(*m_expired.next);
+            t.unlink();
+            --m_count;
+            m_firing = &t;
+            guard.unlock();
+            try {
+                t.m_on_expire();
+            } catch (...) {
+                guard.lock();
+                m_firing = nullptr;
+                reschedule();
+                throw;
+            }
+            guard.lock();
+            m_firing = nullptr;
+        }
+        reschedule();
+    }
+};
+
+} // namespace util
+} // namespace eixx
@@ -0,0 +1,296 @@
+//----------------------------------------------------------------------------
+/// \file   uring.hpp
+/// \author Serge Aleynikov
+//----------------------------------------------------------------------------
+/// \brief Minimal wrapper of the Linux io_uring interface.
+//----------------------------------------------------------------------------
+// Created: 2021-11-14
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <boost/noncopyable.hpp>
+#include <eixx/util/common.hpp>
+
+namespace eixx {
+namespace util {
+
+/**
+ * Submission and completion queues of an io_uring instance accessed
+ * through raw system calls (no liburing dependency).
+ *
+ * The ring is not thread-safe: SQEs must be prepared and completions
+ * reaped by one thread.
+ */
+class uring : private boost::noncopyable {
+    int             m_fd;
+    void*           m_sq_ptr;
+    size_t          m_sq_len;
+    void*           m_cq_ptr;
+    size_t          m_cq_len;
+    io_uring_sqe*   m_sqes;
+    size_t          m_sqes_len;
+
+    unsigned        m_features;
+
+    unsigned*       m_sq_head;
+    unsigned*       m_sq_tail;
+    unsigned*       m_sq_flags;
+    unsigned*       m_sq_array;
+    unsigned        m_sq_mask;
+    unsigned        m_sq_entries;
+    unsigned        m_sq_local_tail;    // Tail including unpublished SQEs
+
+    unsigned*       m_cq_head;
+    unsigned*       m_cq_tail;
+    unsigned        m_cq_mask;
+    io_uring_cqe*   m_cqes;
+
+    static unsigned load_acquire(const unsigned* p) {
+        return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+    }
+    static void store_release(unsigned* p, unsigned v) {
+        __atomic_store_n(p, v, __ATOMIC_RELEASE);
+    }
+
+    void unmap() {
+        if (m_sqes)
+            ::munmap(m_sqes, m_sqes_len);
+        if (m_cq_ptr && m_cq_ptr != m_sq_ptr)
+            ::munmap(m_cq_ptr, m_cq_len);
+        if (m_sq_ptr)
+            ::munmap(m_sq_ptr, m_sq_len);
+        if (m_fd >= 0)
+            ::close(m_fd);
+    }
+
+public:
+    /// Create a ring with \a a_entries submission queue entries.
+    /// @throws std::runtime_error if io_uring is not available.
+    explicit uring(unsigned a_entries, unsigned a_flags = 0)
+        : m_fd(-1), m_sq_ptr(NULL), m_sq_len(0), m_cq_ptr(NULL), m_cq_len(0)
+        , m_sqes(NULL), m_sqes_len(0), m_features(0)
+    {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        p.flags = a_flags;
+        m_fd = int(::syscall(__NR_io_uring_setup, a_entries, &p));
+        if (m_fd < 0 && a_flags) {  // Retry without optional flags
+            memset(&p, 0, sizeof(p));
+            m_fd = int(::syscall(__NR_io_uring_setup, a_entries, &p));
+        }
+        if (m_fd < 0)
+            THROW_RUNTIME_ERROR("io_uring_setup failed: " << strerror(errno));
+
+        m_features = p.features;
+        m_sq_len   = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        m_cq_len   = p.cq_off.cqes  + p.cq_entries * sizeof(io_uring_cqe);
+        m_sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+
+        bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single)
+            m_sq_len = m_cq_len = std::max(m_sq_len, m_cq_len);
+
+        m_sq_ptr = ::mmap(NULL, m_sq_len, PROT_READ|PROT_WRITE,
+                          MAP_SHARED|MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+        if (m_sq_ptr == MAP_FAILED) {
+            m_sq_ptr = NULL;
+            unmap();
+            THROW_RUNTIME_ERROR("Cannot map io_uring SQ ring: " << strerror(errno));
+        }
+        m_cq_ptr = single ? m_sq_ptr
+                 : ::mmap(NULL, m_cq_len, PROT_READ|PROT_WRITE,
+                          MAP_SHARED|MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        if (m_cq_ptr == MAP_FAILED) {
+            m_cq_ptr = NULL;
+            unmap();
+            THROW_RUNTIME_ERROR("Cannot map io_uring CQ ring: " << strerror(errno));
+        }
+        void* sqes = ::mmap(NULL, m_sqes_len, PROT_READ|PROT_WRITE,
+                            MAP_SHARED|MAP_POPULATE, m_fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            unmap();
+            THROW_RUNTIME_ERROR("Cannot map io_uring SQEs: " << strerror(errno));
+        }
+        m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+        char* sq = static_cast<char*>(m_sq_ptr);
+        char* cq = static_cast<char*>(m_cq_ptr);
+        m_sq_head       = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        m_sq_tail       = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        m_sq_flags      = reinterpret_cast<unsigned*>(sq + p.sq_off.flags);
+        m_sq_array      = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        m_sq_mask       = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        m_sq_entries    = p.sq_entries;
+        m_sq_local_tail = *m_sq_tail;
+        m_cq_head       = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        m_cq_tail       = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        m_cq_mask       = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        m_cqes          = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+    }
+
+    ~uring() { unmap(); }
+
+    int fd() const { return m_fd; }
+
+    /// IORING_FEAT_* flags supported by the kernel.
+    unsigned features() const { return m_features; }
+
+    /// Returns true if completions didn't fit in the completion queue.
+    /// They are moved to the queue by the next submit().
+    bool cq_overflow() const { return load_acquire(m_sq_flags) & IORING_SQ_CQ_OVERFLOW; }
+
+    /// Number of prepared SQEs not yet consumed by the kernel.
+    unsigned pending() const { return m_sq_local_tail - load_acquire(m_sq_head); }
+
+    /// Get a zeroed SQE to fill in.
+    /// @return NULL if the submission queue is full.
+    io_uring_sqe* get_sqe() {
+        unsigned head = load_acquire(m_sq_head);
+        if (m_sq_local_tail - head >= m_sq_entries)
+            return NULL;
+        unsigned idx = m_sq_local_tail & m_sq_mask;
+        io_uring_sqe* sqe = &m_sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        m_sq_array[idx] = idx;
+        ++m_sq_local_tail;
+        return sqe;
+    }
+
+    /// Pass all prepared SQEs to the kernel with a single system call,
+    /// optionally waiting for \a a_wait_nr completions.  Overflown
+    /// completions are flushed to the completion queue.  SQEs that the
+    /// kernel doesn't accept (e.g. -EBUSY while the completion queue is
+    /// overflown) are passed again by the next call.
+    /// @return number of submitted SQEs or -errno.
+    int submit(unsigned a_wait_nr = 0) {
+        unsigned n     = pending();
+        bool     flush = a_wait_nr || cq_overflow();
+        if (!n && !flush)
+            return 0;
+        store_release(m_sq_tail, m_sq_local_tail);
+        long rc = ::syscall(__NR_io_uring_enter, m_fd, n, a_wait_nr,
+                            flush ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        return rc < 0 ? -errno : int(rc);
+    }
+
+    /// Returns true if the completion queue is not empty.
+    bool has_completions() const {
+        return load_acquire(m_cq_tail) != *m_cq_head;
+    }
+
+    /// Call \a a_fun(const io_uring_cqe&) for every available completion.
+    /// @return number of reaped completions.
+    template <typename Fun>
+    unsigned reap(Fun&& a_fun) {
+        unsigned head = *m_cq_head;
+        unsigned tail = load_acquire(m_cq_tail);
+        unsigned n    = tail - head;
+        for (; head != tail; ++head) {
+            io_uring_cqe cqe = m_cqes[head & m_cq_mask];
+            // Free the slot before calling the handler that may submit more
+            store_release(m_cq_head, head+1);
+            a_fun(cqe);
+        }
+        return n;
+    }
+
+    /// Call io_uring_register(2).
+    /// @return 0 on success or -errno.
+    int register_op(unsigned a_opcode, const void* a_arg, unsigned a_nr) {
+        long rc = ::syscall(__NR_io_uring_register, m_fd, a_opcode, a_arg, a_nr);
+        return rc < 0 ? -errno : int(rc);
+    }
+};
+
+/**
+ * Group of buffers provided to the kernel for buffer-selecting receive
+ * operations (IORING_OP_PROVIDE_BUFFERS).  The kernel picks a buffer for
+ * each completion, and the application gives it back with provide().
+ *
+ * The group must be destroyed after all operations selecting its buffers
+ * have completed.
+ */
+class uring_buf_group : private boost::noncopyable {
+    char*               m_bufs;
+    size_t              m_buf_size;
+    unsigned            m_count;
+    uint16_t            m_group;
+
+public:
+    /// Provide \a a_count buffers of \a a_buf_size bytes to the kernel as
+    /// buffer group \a a_group.  Must be called before any other operation
+    /// is submitted to \a a_ring.
+    /// @throws std::runtime_error
+    uring_buf_group(uring& a_ring, uint16_t a_group, unsigned a_count, size_t a_buf_size)
+        : m_bufs(NULL), m_buf_size(a_buf_size), m_count(a_count), m_group(a_group)
+    {
+        void* p = ::mmap(NULL, a_count * a_buf_size, PROT_READ|PROT_WRITE,
+                         MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
+        if (p == MAP_FAILED)
+            THROW_RUNTIME_ERROR("Cannot allocate io_uring buffers: " << strerror(errno));
+        m_bufs = static_cast<char*>(p);
+
+        io_uring_sqe* sqe = a_ring.get_sqe();
+        int rc = -EBUSY;
+        if (sqe) {
+            prepare(sqe, 0, a_count);
+            rc = a_ring.submit(1);
+            if (rc >= 0)
+                a_ring.reap([&rc](const io_uring_cqe& c) { rc = c.res; });
+        }
+        if (rc < 0) {
+            ::munmap(m_bufs, m_count * m_buf_size);
+            THROW_RUNTIME_ERROR("Cannot provide io_uring buffers: " << strerror(-rc));
+        }
+    }
+
+    ~uring_buf_group() { ::munmap(m_bufs, m_count * m_buf_size); }
+
+    uint16_t    group()       const { return m_group;    }
+    size_t      buffer_size() const { return m_buf_size; }
+    const char* buffer(uint16_t a_bid) const { return m_bufs + a_bid * m_buf_size; }
+
+    /// Fill in \a a_sqe to give buffer \a a_bid back to the kernel.
+    void provide(io_uring_sqe* a_sqe, uint16_t a_bid) { prepare(a_sqe, a_bid, 1); }
+
+private:
+    void prepare(io_uring_sqe* a_sqe, uint16_t a_bid, unsigned a_count) {
+        a_sqe->opcode    = IORING_OP_PROVIDE_BUFFERS;
+        a_sqe->fd        = int(a_count);
+        a_sqe->addr      = reinterpret_cast<uint64_t>(m_bufs + a_bid * m_buf_size);
+        a_sqe->len       = unsigned(m_buf_size);
+        a_sqe->off       = a_bid;
+        a_sqe->buf_group = m_group;
+    }
+};
+
+} // namespace util
+} // namespace eixx
@@ -0,0 +1,281 @@
+//----------------------------------------------------------------------------
+/// \file   work_stealing_pool.hpp
+/// \author Serge Aleynikov
+//----------------------------------------------------------------------------
+/// \brief Pool of threads running tasks with work stealing.
+//----------------------------------------------------------------------------
+// Created: 2021-11-23
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <eixx/util/common.hpp>
+#include <eixx/util/compiler_hints.hpp>
+#include <eixx/util/bounded_queue.hpp>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace eixx {
+namespace util {
+
+/**
+ * Threads running tasks, such as mailboxes with pending messages, with
+ * work stealing.
+ *
+ * Every worker has a ring of runnable tasks.  A task scheduled by a
+ * worker goes to the worker's own ring, and a task scheduled by another
+ * thread goes to the rings of the workers in turn (or to a shared list if
+ * the ring is full).  A worker runs the tasks of its ring and when it's
+ * empty steals tasks from the rings of the other workers, so that busy
+ * workers are relieved by idle ones without placing tasks by hand.  Idle
+ * workers poll for \a a_spin and then sleep until a task is scheduled.
+ *
+ * A task is run with a budget (e.g. a number of messages).  A task that
+ * has more work after spending its budget is put at the back of the
+ * worker's ring, so that tasks sharing a worker take turns.
+ *
+ * The pool never runs a task concurrently with itself as long as the
+ * task is scheduled again only after it's run (see task::run()).
+ */
+class work_stealing_pool : private boost::noncopyable {
+public:
+    /// Unit of work run by the pool.
+    struct task {
+        virtual ~task() {}
+        /// Do up to \a a_budget units of work.
+        /// @return true to be run again.
+        virtual bool run(size_t a_budget) = 0;
+        /// Called on a task left scheduled when the pool is destroyed.
+        virtual void discard() {}
+    };
+
+    /// @param a_threads is the number of workers (0 - number of CPUs).
+    /// @param a_budget is passed to task::run().
+    /// @param a_ring_size is the capacity of the ring of a worker.
+    /// @param a_spin is the time an idle worker polls for tasks.
+    /// @param a_cpus is the list of CPUs to pin the workers to (in turn).
+    explicit work_stealing_pool(size_t a_threads = 0, size_t a_budget = 64,
+                                size_t a_ring_size = 4096,
+                                std::chrono::microseconds a_spin = std::chrono::microseconds(50),
+                                const std::vector<int>& a_cpus = std::vector<int>())
+        : m_budget(a_budget ? a_budget : 1)
+        , m_spin(a_spin)
+        , m_cpus(a_cpus)
+        , m_next(0)
+        , m_overflow_size(0)
+        , m_sleeping(0)
+        , m_stop(false)
+        , m_executed(0)
+        , m_stolen(0)
+    {
+        size_t n = a_threads ? a_threads : std::max(1u, std::thread::hardware_concurrency());
+        for (size_t i = 0; i < n; ++i)
+            m_workers.emplace_back(new worker(a_ring_size));
+    }
+
+    ~work_stealing_pool() {
+        stop();
+        task* t;
+        for (auto& w : m_workers)
+            while (w->ring.try_pop(t))
+                t->discard();
+        for (auto p : m_overflow)
+            p->discard();
+    }
+
+    size_t threads()  const { return m_workers.size(); }
+    size_t budget()   const { return m_budget; }
+    bool   running()  const { return !m_threads.empty(); }
+    /// Number of task runs.
+    size_t executed() const { return m_executed.load(std::memory_order_relaxed); }
+    /// Number of tasks taken from the ring of another worker.
+    size_t stolen()   const { return m_stolen.load(std::memory_order_relaxed); }
+
+    /// Start the workers.  The call returns immediately.
+    void start() {
+        if (running())
+            return;
+        m_stop.store(false, std::memory_order_relaxed);
+        for (size_t i = 0; i < m_workers.size(); ++i) {
+            m_threads.emplace_back([this, i]() { work(i); });
+            if (!m_cpus.empty())
+                pin(m_threads.back(), m_cpus[i % m_cpus.size()]);
+        }
+    }
+
+    /// Stop the workers and wait for them to exit.  Scheduled tasks are
+    /// kept until start() is called again.
+    void stop() {
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_stop.store(true, std::memory_order_relaxed);
+            m_cv.notify_all();
+        }
+        for (auto& t : m_threads)
+            if (t.joinable() && t.get_id() != std::this_thread::get_id())
+                t.join();
+            else if (t.joinable())
+                t.detach();
+        m_threads.clear();
+    }
+
+    /// Make \a a_task runnable.  May be called from any thread.
+    void schedule(task* a_task) {
+        const current& c = this_worker();
+        size_t i = c.pool == this ? c.index
+                 : m_next.fetch_add(1, std::memory_order_relaxed) % m_workers.size();
+        if (unlikely(!m_workers[i]->ring.try_push(a_task))) {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_overflow.push_back(a_task);
+            m_overflow_size.store(m_overflow.size(), std::memory_order_relaxed);
+        }
+        // Pairs with the fence of a worker going to sleep
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleeping.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_cv.notify_one();
+        }
+    }
+
+private:
+    struct worker {
+        bounded_queue<task*> ring;
+        explicit worker(size_t a_size) : ring(a_size) {}
+    };
+
+    struct current {
+        work_stealing_pool* pool;
+        size_t              index;
+    };
+
+    size_t                                  m_budget;
+    std::chrono::microseconds               m_spin;
+    std::vector<int>                        m_cpus;
+    std::vector<std::unique_ptr<worker>>    m_workers;
+    std::vector<std::thread>                m_threads;
+    std::atomic<size_t>                     m_next;
+    std::mutex                              m_lock;             // Guards m_overflow and m_cv
+    std::condition_variable                 m_cv;
+    std::deque<task*>                       m_overflow;         // Tasks that didn't fit in a ring
+    std::atomic<size_t>                     m_overflow_size;
+    std::atomic<size_t>                     m_sleeping;         // Number of sleeping workers
+    std::atomic<bool>                       m_stop;
+    std::atomic<size_t>                     m_executed;
+    std::atomic<size_t>                     m_stolen;
+
+    static current& this_worker() {
+        static thread_local current s_current{nullptr, 0};
+        return s_current;
+    }
+
+    static void pin(std::thread& a_thread, int a_cpu) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(a_cpu, &set);
+        int rc = pthread_setaffinity_np(a_thread.native_handle(), sizeof(set), &set);
+        if (rc)
+            THROW_RUNTIME_ERROR("Cannot pin worker thread to CPU " << a_cpu
+                                << ": " << strerror(rc));
+#else
+        (void)a_thread; (void)a_cpu;
+#endif
+    }
+
+    // Find a task in the worker's ring, in the shared list or in the rings
+    // of the other workers
+    task* next(size_t a_idx) {
+        task* t;
+        if (m_workers[a_idx]->ring.try_pop(t))
+            return t;
+        if (m_overflow_size.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> guard(m_lock);
+            if (!m_overflow.empty()) {
+                t = m_overflow.front();
+                m_overflow.pop_front();
+                m_overflow_size.store(m_overflow.size(), std::memory_order_relaxed);
+                return t;
+            }
+        }
+        size_t n = m_workers.size();
+        for (size_t i = 1; i < n; ++i)
+            if (m_workers[(a_idx + i) % n]->ring.try_pop(t)) {
+                m_stolen.fetch_add(1, std::memory_order_relaxed);
+                return t;
+            }
+        return nullptr;
+    }
+
+    bool has_work() const {
+        if (m_overflow_size.load(std::memory_order_relaxed))
+            return true;
+        for (auto& w : m_workers)
+            if (!w->ring.empty())
+                return true;
+        return false;
+    }
+
+    void work(size_t a_idx) {
+        this_worker() = current{this, a_idx};
+        while (!m_stop.load(std::memory_order_relaxed)) {
+            task* t = next(a_idx);
+            if (likely(t != nullptr)) {
+                m_executed.fetch_add(1, std::memory_order_relaxed);
+                if (t->run(m_budget) && !m_workers[a_idx]->ring.try_push(t))
+                    schedule(t);
+                continue;
+            }
+
+            // Poll for a while before going to sleep
+            auto spin_end = std::chrono::steady_clock::now() + m_spin;
+            while (!has_work() && std::chrono::steady_clock::now() < spin_end)
+                std::this_thread::yield();
+            if (has_work())
+                continue;
+
+            std::unique_lock<std::mutex> guard(m_lock);
+            m_sleeping.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            // A thread scheduling a task seeing the counter takes m_lock
+            // to notify, so it can't miss this worker going to sleep
+            if (!has_work() && !m_stop.load(std::memory_order_relaxed))
+                m_cv.wait(guard);
+            m_sleeping.fetch_sub(1, std::memory_order_relaxed);
+        }
+        this_worker() = current{nullptr, 0};
+    }
+};
+
+} // namespace util
+} // namespace eixx
@@ -31,10 +31,14 @@ limitations under the License.
 //#define BOOST_ASIO_ENABLE_HANDLER_TRACKING
 
 #include <atomic>
+#include <deque>
+#include <mutex>
 #include <thread>
 #include <boost/test/included/unit_test.hpp>
 #include <boost/thread.hpp>
 #include <eixx/util/async_queue.hpp>
+#include <eixx/util/bounded_queue.hpp>
+#include <eixx/util/slab_buffer.hpp>
 #include <eixx/connect/test_helper.hpp>
 
 using namespace eixx::util;
@@ -171,3 +175,422 @@ BOOST_AUTO_TEST_CASE( test_async_queue_concurrent )
         std::cout << "Done!" << std::endl;
 }
 
+
+BOOST_AUTO_TEST_CASE( test_async_queue_overflow )
+{
+    boost::asio::io_service io;
+
+    {
+        queue_policy p;
+        p.capacity = 4;
+        async_queue<int> q(io, p);
+        for (int j = 0; j < 4; j++)
+            BOOST_REQUIRE(q.enqueue(j, false));
+        BOOST_REQUIRE(!q.enqueue(4, false));
+        BOOST_REQUIRE_EQUAL(4u, q.depth());
+        BOOST_REQUIRE_EQUAL(4u, q.high_watermark());
+        BOOST_REQUIRE_EQUAL(1u, q.dropped());
+        int v;
+        BOOST_REQUIRE(q.dequeue(v));
+        BOOST_REQUIRE_EQUAL(0, v);
+        BOOST_REQUIRE_EQUAL(3u, q.depth());
+        BOOST_REQUIRE_EQUAL(4u, q.high_watermark());
+    }
+    {
+        queue_policy p;
+        p.capacity        = 4;
+        p.single_producer = true;
+        p.overflow        = overflow_policy::drop_oldest;
+        async_queue<int> q(io, p);
+        std::vector<int> dropped;
+        q.on_drop = [&dropped](int& a) { dropped.push_back(a); };
+        for (int j = 0; j < 6; j++)
+            BOOST_REQUIRE(q.enqueue(j, false));
+        BOOST_REQUIRE_EQUAL(2u, q.dropped());
+        BOOST_REQUIRE_EQUAL(2u, dropped.size());
+        BOOST_REQUIRE_EQUAL(0, dropped[0]);
+        BOOST_REQUIRE_EQUAL(1, dropped[1]);
+        int v;
+        BOOST_REQUIRE(q.dequeue(v));
+        BOOST_REQUIRE_EQUAL(2, v);
+        q.reset();
+        BOOST_REQUIRE_EQUAL(5u, dropped.size());
+        BOOST_REQUIRE(q.empty());
+    }
+    {
+        queue_policy p;
+        p.capacity = 2;
+        p.overflow = overflow_policy::signal;
+        async_queue<int> q(io, p);
+        size_t depth = 0;
+        q.on_overflow = [&depth](size_t n) { depth = n; };
+        BOOST_REQUIRE(q.enqueue(1, false));
+        BOOST_REQUIRE(q.enqueue(2, false));
+        BOOST_REQUIRE(!q.enqueue(3, false));
+        BOOST_REQUIRE_EQUAL(2u, depth);
+    }
+    {
+        // A blocked producer waits for the consumer
+        queue_policy p;
+        p.capacity        = 8;
+        p.single_producer = true;
+        p.overflow        = overflow_policy::block;
+        async_queue<int> q(io, p);
+        const int count = 10000;
+        int rejected = 0;
+        std::thread producer([&q, &rejected]() {
+            for (int j = 0; j < count; j++)
+                if (!q.enqueue(j, false))
+                    ++rejected;
+        });
+        for (int j = 0; j < count;) {
+            int v;
+            if (q.dequeue(v))
+                BOOST_REQUIRE_EQUAL(j++, v);
+        }
+        producer.join();
+        BOOST_REQUIRE_EQUAL(0, rejected);
+        BOOST_REQUIRE_EQUAL(0u, q.dropped());
+        BOOST_REQUIRE(q.high_watermark() <= 8u);
+
+        p.block_timeout = std::chrono::milliseconds(1);
+        async_queue<int> q2(io, p);
+        for (int j = 0; j < 8; j++)
+            BOOST_REQUIRE(q2.enqueue(j, false));
+        BOOST_REQUIRE(!q2.enqueue(8, false));
+        BOOST_REQUIRE_EQUAL(1u, q2.dropped());
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_async_queue_batch )
+{
+    boost::asio::io_service io;
+    boost::shared_ptr<async_queue<int>> q(new async_queue<int>(io, 64));
+
+    std::vector<int> items(100);
+    for (int j = 0; j < 100; j++)
+        items[j] = j;
+
+    int count = 0;
+    auto on_data = [&count](int& a, const boost::system::error_code& ec) {
+        if (ec) return false;
+        BOOST_REQUIRE_EQUAL(count++, a);
+        return count < 200;
+    };
+
+    BOOST_REQUIRE(!q->async_dequeue(on_data, std::chrono::milliseconds(5000), -1));
+    BOOST_REQUIRE(q->waiting());
+
+    size_t queued = 0;
+    std::thread producer([&q, &items, &queued]() {
+        queued = q->enqueue(items.begin(), items.end());
+    });
+    producer.join();
+    BOOST_REQUIRE_EQUAL(100u, queued);
+    // The consumer was woken up, so the next batch doesn't wake it up
+    BOOST_REQUIRE(!q->waiting());
+    for (int j = 0; j < 100; j++)
+        items[j] = 100 + j;
+    BOOST_REQUIRE_EQUAL(100u, q->enqueue(items.begin(), items.end()));
+
+    io.run();
+    BOOST_REQUIRE_EQUAL(200, count);
+    BOOST_REQUIRE(!q->waiting());
+
+    BOOST_REQUIRE_EQUAL(8u, q->enqueue(items.begin(), items.begin()+8));
+    int out[16];
+    BOOST_REQUIRE_EQUAL(8u, q->dequeue(out, 16));
+    BOOST_REQUIRE_EQUAL(100, out[0]);
+    BOOST_REQUIRE_EQUAL(107, out[7]);
+}
+
+BOOST_AUTO_TEST_CASE( test_slab_buffer )
+{
+    slab_buffer<> slab(1024, 4);
+    BOOST_REQUIRE_EQUAL(4096u, slab.capacity());
+
+    // Consecutive allocations are adjacent
+    char* p = slab.allocate(100);
+    char* q = slab.allocate(50);
+    BOOST_REQUIRE(p);
+    BOOST_REQUIRE(q == p + 100);
+    BOOST_REQUIRE(slab.owns(q));
+
+    // Requests larger than a chunk are left to the caller
+    BOOST_REQUIRE(!slab.allocate(1025));
+    BOOST_REQUIRE(!slab.allocate(0));
+    BOOST_REQUIRE_EQUAL(1u, slab.misses());
+
+    // A request that doesn't fit is served by the next chunk
+    char* r = slab.allocate(900);
+    BOOST_REQUIRE(r);
+    BOOST_REQUIRE(r != q + 50);
+    BOOST_REQUIRE_EQUAL(0u, size_t(r - slab.data()) % 1024);
+
+    char c;
+    BOOST_REQUIRE(!slab.release(&c, 1));
+    BOOST_REQUIRE(slab.release(p, 150));    // Spans both allocations
+    BOOST_REQUIRE(slab.release(r, 900));
+
+    // All chunks are free again once their memory is released
+    char* full[4];
+    for (auto& f : full) {
+        f = slab.allocate(1024);
+        BOOST_REQUIRE(f);
+    }
+    BOOST_REQUIRE(!slab.allocate(1));
+    BOOST_REQUIRE_EQUAL(2u, slab.misses());
+    for (auto f : full)
+        slab.release(f, 1024);
+    BOOST_REQUIRE(slab.allocate(1024));
+}
+
+namespace {
+    /// Memory allocated from a slab and filled with \a tag.
+    struct slab_block {
+        char*   data;
+        size_t  size;
+        char    tag;
+
+        bool intact() const {
+            for (size_t i = 0; i < size; i++)
+                if (data[i] != tag)
+                    return false;
+            return true;
+        }
+    };
+
+    /// Pseudo-random allocation size in [1, 256].
+    size_t slab_size(uint32_t& a_seed) {
+        a_seed = a_seed * 1103515245 + 12345;
+        return 1 + (a_seed >> 16) % 256;
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_slab_buffer_single_producer )
+{
+    // A producer encodes messages and the consumer releases runs of
+    // adjacent ones with a single call, like a connection's I/O thread
+    slab_buffer<> slab(4096, 4);
+    std::mutex               lock;
+    std::deque<slab_block>   queue;
+    std::atomic<bool>        done(false);
+    const int                count = 100000;
+
+    std::thread producer([&]() {
+        uint32_t seed     = 1;
+        auto     deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        for (int i = 0; i < count; i++) {
+            size_t n = slab_size(seed);
+            char*  p;
+            // Wait for the consumer to catch up
+            while (!(p = slab.allocate(n)) && std::chrono::steady_clock::now() < deadline)
+                std::this_thread::yield();
+            if (!p)
+                break;  // Released memory is not reused
+            slab_block b{p, n, char(i)};
+            memset(p, b.tag, n);
+            std::lock_guard<std::mutex> g(lock);
+            queue.push_back(b);
+        }
+        done = true;
+    });
+
+    int released = 0, corrupt = 0;
+    for (;;) {
+        std::deque<slab_block> batch;
+        {
+            std::lock_guard<std::mutex> g(lock);
+            batch.swap(queue);
+        }
+        if (batch.empty()) {
+            if (done.load())
+                break;
+            std::this_thread::yield();
+            continue;
+        }
+        char*  run  = batch.front().data;
+        size_t size = 0;
+        for (auto& b : batch) {
+            if (!b.intact())
+                corrupt++;
+            if (b.data != run + size) {
+                BOOST_REQUIRE(slab.release(run, size));
+                run  = b.data;
+                size = 0;
+            }
+            size += b.size;
+            released++;
+        }
+        BOOST_REQUIRE(slab.release(run, size));
+    }
+    producer.join();
+
+    BOOST_REQUIRE_EQUAL(0, corrupt);
+    BOOST_REQUIRE_EQUAL(count, released);
+    for (size_t i = 0; i < slab.chunks(); i++)
+        BOOST_REQUIRE(slab.allocate(slab.chunk_size()));
+}
+
+BOOST_AUTO_TEST_CASE( test_slab_buffer_multi_producer )
+{
+    // Producers race for the current chunk and release blocks allocated
+    // by each other
+    slab_buffer<> slab(4096, 8);
+    std::mutex               lock;
+    std::deque<slab_block>   shared;
+    std::atomic<int>         corrupt(0);
+    const int                threads = 4;
+    const int                count   = 50000;
+
+    auto release = [&](const slab_block& b) {
+        if (!b.intact())
+            corrupt++;
+        if (!slab.release(b.data, b.size))
+            corrupt++;
+    };
+
+    std::vector<std::thread> producers;
+    for (int t = 0; t < threads; t++)
+        producers.emplace_back([&, t]() {
+            uint32_t seed = uint32_t(t + 1);
+            std::deque<slab_block> mine;
+            for (int i = 0; i < count; i++) {
+                size_t n = slab_size(seed);
+                char*  p = slab.allocate(n);
+                if (p) {
+                    // A block handed out twice would lose its tag
+                    slab_block b{p, n, char('a' + t)};
+                    memset(p, b.tag, n);
+                    if (i & 1)
+                        mine.push_back(b);
+                    else {
+                        std::lock_guard<std::mutex> g(lock);
+                        shared.push_back(b);
+                    }
+                }
+                if (mine.size() > 8) {
+                    release(mine.front());
+                    mine.pop_front();
+                }
+                slab_block o;
+                bool found = false;
+                {
+                    std::lock_guard<std::mutex> g(lock);
+                    if (shared.size() > 8) {
+                        o = shared.front();
+                        shared.pop_front();
+                        found = true;
+                    }
+                }
+                if (found)
+                    release(o);
+            }
+            for (auto& b : mine)
+                release(b);
+        });
+    for (auto& t : producers)
+        t.join();
+    for (auto& b : shared)
+        release(b);
+
+    BOOST_REQUIRE_EQUAL(0, corrupt.load());
+    for (size_t i = 0; i < slab.chunks(); i++)
+        BOOST_REQUIRE(slab.allocate(slab.chunk_size()));
+}
+
+BOOST_AUTO_TEST_CASE( test_bounded_queue )
+{
+    bounded_queue<int> q(5);
+    BOOST_REQUIRE_EQUAL(8u, q.capacity());
+    BOOST_REQUIRE(q.empty());
+
+    int v;
+    BOOST_REQUIRE(!q.try_pop(v));
+    for (int j = 0; j < 8; j++)
+        BOOST_REQUIRE(q.try_push(j));
+    BOOST_REQUIRE(!q.try_push(8));
+    BOOST_REQUIRE_EQUAL(8u, q.size());
+
+    // Cells are reused after wrapping around
+    for (int j = 0; j < 20; j++) {
+        BOOST_REQUIRE(q.try_pop(v));
+        BOOST_REQUIRE_EQUAL(j, v);
+        BOOST_REQUIRE(q.try_push(j + 8));
+    }
+    for (int j = 20; j < 28; j++) {
+        BOOST_REQUIRE(q.try_pop(v));
+        BOOST_REQUIRE_EQUAL(j, v);
+    }
+    BOOST_REQUIRE(q.empty());
+}
+
+BOOST_AUTO_TEST_CASE( test_bounded_queue_single_producer )
+{
+    bounded_queue<int> q(64);
+    const int count = 200000;
+
+    std::thread producer([&q]() {
+        for (int j = 0; j < count; j++)
+            while (!q.try_push(j))
+                std::this_thread::yield();
+    });
+    int errors = 0;
+    for (int j = 0; j < count;) {
+        int v;
+        if (!q.try_pop(v)) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (v != j++)
+            errors++;
+    }
+    producer.join();
+
+    BOOST_REQUIRE_EQUAL(0, errors);
+    BOOST_REQUIRE(q.empty());
+}
+
+BOOST_AUTO_TEST_CASE( test_bounded_queue_multi_producer )
+{
+    // Items are (producer << 24 | sequence).  Every item is popped once,
+    // and each consumer sees the items of a producer in order.
+    bounded_queue<int> q(16);
+    const int producers = 4, consumers = 2, count = 50000;
+    std::vector<std::atomic<int>> seen(producers * count);
+    for (auto& s : seen)
+        s = 0;
+    std::atomic<int> popped(0), unordered(0);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < producers; t++)
+        threads.emplace_back([&q, t]() {
+            for (int j = 0; j < count; j++)
+                while (!q.try_push(t << 24 | j))
+                    std::this_thread::yield();
+        });
+    for (int t = 0; t < consumers; t++)
+        threads.emplace_back([&]() {
+            std::vector<int> last(producers, -1);
+            while (popped.load() < producers * count) {
+                int v;
+                if (!q.try_pop(v)) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                int p = v >> 24, j = v & 0xFFFFFF;
+                if (j <= last[p])
+                    unordered++;
+                last[p] = j;
+                seen[p * count + j]++;
+                popped++;
+            }
+        });
+    for (auto& t : threads)
+        t.join();
+
+    BOOST_REQUIRE_EQUAL(0, unordered.load());
+    for (auto& s : seen)
+        BOOST_REQUIRE_EQUAL(1, s.load());
+    BOOST_REQUIRE(q.empty());
+}
@@ -29,6 +29,7 @@ limitations under the License.
 #include <boost/test/unit_test.hpp>
 #include "test_alloc.hpp"
 #include <eixx/eixx.hpp>
+#include <thread>
 
 using namespace eixx;
 
@@ -61,3 +62,502 @@ BOOST_AUTO_TEST_CASE( test_mailbox )
     }
     //std::cerr << "mailbox count " << node.registry().count() << std::endl;
 }
+
+BOOST_AUTO_TEST_CASE( test_mailbox_overflow )
+{
+    boost::asio::io_service io;
+    otp_node node(io, "a");
+
+    util::queue_policy qp;
+    qp.capacity = 2;
+    qp.overflow = util::overflow_policy::signal;
+    otp_mailbox::pointer mbox(node.create_mailbox(atom(), NULL, &qp));
+    size_t overflows = 0;
+    mbox->on_overflow = [&overflows](otp_mailbox&, size_t) { ++overflows; };
+
+    connect::transport_msg<allocator_t> tm;
+    tm.set_send(mbox->self(), eterm(atom("hello")));
+    BOOST_REQUIRE(mbox->deliver(tm));
+    BOOST_REQUIRE(mbox->deliver(tm));
+    BOOST_REQUIRE(!mbox->deliver(tm));
+    BOOST_REQUIRE_EQUAL(1u, overflows);
+    BOOST_REQUIRE_EQUAL(2u, mbox->depth());
+    BOOST_REQUIRE_EQUAL(2u, mbox->high_watermark());
+    BOOST_REQUIRE_EQUAL(1u, mbox->dropped());
+
+    delete mbox->receive();
+    BOOST_REQUIRE_EQUAL(1u, mbox->depth());
+    // The queued message is freed when the mailbox is closed
+}
+
+BOOST_AUTO_TEST_CASE( test_mailbox_send_local_full )
+{
+    boost::asio::io_service io;
+    otp_node node(io, "a");
+
+    util::queue_policy qp;
+    qp.capacity = 2;
+    qp.overflow = util::overflow_policy::drop_newest;
+    otp_mailbox::pointer a(node.create_mailbox());
+    otp_mailbox::pointer b(node.create_mailbox(atom("b"), NULL, &qp));
+
+    // Sends to a full local mailbox report the dropped message
+    BOOST_REQUIRE(a->send(b->self(), eterm(1)));
+    BOOST_REQUIRE(a->send(atom("b"), eterm(2)));
+    BOOST_REQUIRE(!a->send(b->self(), eterm(3)));
+    BOOST_REQUIRE(!a->send(atom("b"), eterm(4)));
+    BOOST_REQUIRE(!node.send(b->self(), eterm(5)));
+    BOOST_REQUIRE(!node.send(node.nodename(), b->self(), eterm(6)));
+    BOOST_REQUIRE(!a->send(node.nodename(), atom("b"), eterm(7)));
+    BOOST_REQUIRE_EQUAL(2u, b->depth());
+    BOOST_REQUIRE_EQUAL(5u, b->dropped());
+
+    delete b->receive();
+    BOOST_REQUIRE(a->send(b->self(), eterm(8)));
+    BOOST_REQUIRE_EQUAL(2u, b->depth());
+}
+
+BOOST_AUTO_TEST_CASE( test_mailbox_batch )
+{
+    boost::asio::io_service io;
+    otp_node node(io, "a");
+    node.on_status = [](otp_node&, const otp_connection*, connect::report_level, const std::string&) {};
+
+    otp_mailbox::pointer a(node.create_mailbox());
+    otp_mailbox::pointer b(node.create_mailbox(atom("b")));
+
+    std::vector<connect::transport_msg<allocator_t>*> msgs;
+    for (int i = 0; i < 7; i++)
+        msgs.push_back(node.msg_pool()->acquire());
+    for (int i = 0; i < 6; i++)
+        if (i % 2)
+            msgs[i]->set_send(a->self(), eterm(i));
+        else
+            msgs[i]->set_reg_send(a->self(), atom("b"), eterm(i));
+    msgs[6]->set_send(epid(node.nodename(), 1000, 1, 0), eterm(6)); // No such process
+    node.deliver(msgs);
+    BOOST_REQUIRE(msgs.empty());
+    BOOST_REQUIRE_EQUAL(1u, node.msg_pool()->idle());
+
+    BOOST_REQUIRE_EQUAL(3u, a->depth());
+    BOOST_REQUIRE_EQUAL(3u, b->depth());
+
+    std::vector<long> got;
+    bool sync = b->async_receive_batch(
+        [&got](otp_mailbox&, connect::transport_msg<allocator_t>** a_msgs, size_t n) {
+            for (size_t i = 0; i < n; i++)
+                got.push_back(a_msgs[i]->msg().to_long());
+            return true;
+        }, std::chrono::milliseconds(0), 1);
+    BOOST_REQUIRE(sync);
+    BOOST_REQUIRE_EQUAL(3u, got.size());
+    BOOST_REQUIRE_EQUAL(0, got[0]);
+    BOOST_REQUIRE_EQUAL(2, got[1]);
+    BOOST_REQUIRE_EQUAL(4, got[2]);
+    BOOST_REQUIRE_EQUAL(0u, b->depth());
+
+    for (long i = 1; i < 6; i += 2) {
+        std::unique_ptr<connect::transport_msg<allocator_t>> m(a->receive());
+        BOOST_REQUIRE(m.get());
+        BOOST_REQUIRE_EQUAL(i, m->msg().to_long());
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_mailbox_msg_pool )
+{
+    boost::asio::io_service io;
+    otp_node node(io, "a");
+    otp_mailbox::pointer mbox(node.create_mailbox());
+    auto pool = node.msg_pool();
+
+    // Received messages given back to the mailbox are reused by the
+    // following deliveries
+    std::vector<connect::transport_msg<allocator_t>*> msgs;
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 4; i++) {
+            msgs.push_back(pool->acquire());
+            msgs.back()->set_send(mbox->self(), eterm(i));
+        }
+        node.deliver(msgs);
+        connect::transport_msg<allocator_t>* got[8];
+        size_t n = mbox->try_receive_batch(got, 8);
+        BOOST_REQUIRE_EQUAL(4u, n);
+        for (size_t i = 0; i < n; i++)
+            BOOST_REQUIRE_EQUAL(long(i), got[i]->msg().to_long());
+        mbox->release(got, n);
+    }
+    BOOST_REQUIRE_EQUAL(4u, pool->misses());
+    BOOST_REQUIRE_EQUAL(8u, pool->hits());
+    BOOST_REQUIRE_EQUAL(4u, pool->idle());
+
+    // Idle messages don't hold on to their terms
+    connect::transport_msg<allocator_t>* p = pool->acquire();
+    BOOST_REQUIRE(!p->has_msg());
+    BOOST_REQUIRE_EQUAL(connect::transport_msg<allocator_t>::UNDEFINED, p->type());
+    pool->release(p);
+}
+
+BOOST_AUTO_TEST_CASE( test_mailbox_local_send )
+{
+    typedef connect::transport_msg<allocator_t> msg_t;
+
+    boost::asio::io_service io;
+    otp_node node(io, "a");
+    otp_mailbox::pointer a(node.create_mailbox());
+    otp_mailbox::pointer b(node.create_mailbox(atom("b")));
+
+    // Messages between mailboxes of a node don't carry a control message
+    a->send(b->self(), eterm(1));
+    a->send(atom("b"), eterm(2));
+    node.send(b->self(), eterm(3));
+    BOOST_REQUIRE_EQUAL(3u, b->depth());
+
+    msg_t* got[4];
+    BOOST_REQUIRE_EQUAL(3u, b->try_receive_batch(got, 4));
+    for (int i = 0; i < 3; i++) {
+        BOOST_REQUIRE(got[i]->is_local());
+        BOOST_REQUIRE_EQUAL(i+1, got[i]->msg().to_long());
+        BOOST_REQUIRE_THROW(got[i]->recipient(), err_wrong_type);
+    }
+    BOOST_REQUIRE_EQUAL(msg_t::SEND,     got[0]->type());
+    BOOST_REQUIRE_EQUAL(msg_t::REG_SEND, got[1]->type());
+    BOOST_REQUIRE(a->self() == got[0]->sender_pid());
+    BOOST_REQUIRE(a->self() == got[1]->sender_pid());
+    BOOST_REQUIRE_THROW(got[2]->sender(), err_wrong_type);
+    b->release(got, 3);
+
+    // Envelopes are reused
+    size_t misses = node.msg_pool()->misses();
+    for (int i = 0; i < 10; i++) {
+        a->send(b->self(), eterm(i));
+        b->release(b->receive());
+    }
+    BOOST_REQUIRE_EQUAL(misses, node.msg_pool()->misses());
+
+    BOOST_REQUIRE_THROW(a->send(atom("c"), eterm(1)), err_no_process);
+}
+
+BOOST_AUTO_TEST_CASE( test_mailbox_receive_timeout )
+{
+    boost::asio::io_service io;
+    otp_node node(io, "a");
+    BOOST_REQUIRE(node.timers());
+
+    // Receive timeouts are kept by the node's timing wheel
+    const int n = 100;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<otp_mailbox::pointer> mbs;
+    int timeouts = 0, received = 0;
+    for (int i = 0; i < n; i++) {
+        mbs.emplace_back(node.create_mailbox());
+        mbs.back()->async_receive([&](otp_mailbox&, transport_msg*& a_msg) {
+            if (a_msg) received++; else timeouts++;
+            return true;
+        }, std::chrono::milliseconds(20 + i % 5), 1);
+    }
+    BOOST_REQUIRE_EQUAL(size_t(n), node.timers()->size());
+
+    // A message cancels the timeout of its mailbox
+    io.post([&]() { node.send(mbs[0]->self(), eterm(1)); });
+    io.run();
+    BOOST_REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(20));
+    BOOST_REQUIRE_EQUAL(1, received);
+    BOOST_REQUIRE_EQUAL(n-1, timeouts);
+    BOOST_REQUIRE_EQUAL(0u, node.timers()->size());
+
+    // Timers beyond the first wheel are moved down as their time comes
+    auto wheel = boost::make_shared<util::timer_wheel>(io, std::chrono::microseconds(100));
+    std::vector<int> fired;
+    util::timer_wheel::timer t1(wheel, [&]() { fired.push_back(1); });
+    util::timer_wheel::timer t2(wheel, [&]() { fired.push_back(2); });
+    util::timer_wheel::timer t3(wheel, [&]() { fired.push_back(3); });
+    start = std::chrono::steady_clock::now();
+    t2.arm(std::chrono::milliseconds(40));
+    t1.arm(std::chrono::milliseconds(1));
+    t3.arm(std::chrono::milliseconds(30));
+    BOOST_REQUIRE(t3.cancel());
+    BOOST_REQUIRE(!t3.cancel());
+    io.restart();
+    io.run();
+    BOOST_REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(40));
+    BOOST_REQUIRE_EQUAL(2u, fired.size());
+    BOOST_REQUIRE_EQUAL(1, fired[0]);
+    BOOST_REQUIRE_EQUAL(2, fired[1]);
+}
+
+#ifdef EIXX_HAVE_COROUTINES
+static util::task co_collect(otp_mailbox& a_mbox, std::vector<long>& a_got, int& a_ends)
+{
+    while (transport_msg* m = co_await a_mbox.co_receive(std::chrono::milliseconds(20))) {
+        a_got.push_back(m->msg().to_long());
+        a_mbox.release(m);
+    }
+    a_ends++;
+}
+
+static util::task co_match_ok(otp_mailbox& a_mbox, eterm& a_value)
+{
+    varbind binding;
+    if (transport_msg* m = co_await a_mbox.co_match(eterm::format("{ok, X}"), &binding)) {
+        a_value = *binding.find("X");
+        a_mbox.release(m);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_mailbox_coroutine )
+{
+    boost::asio::io_service io;
+    otp_node node(io, "a");
+    otp_mailbox::pointer a(node.create_mailbox());
+    otp_mailbox::pointer b(node.create_mailbox());
+
+    // A waiting coroutine is resumed by the delivering thread
+    std::vector<long> got;
+    int ends = 0;
+    co_collect(*b, got, ends);
+    BOOST_REQUIRE(got.empty());
+    BOOST_REQUIRE_EQUAL(1u, node.timers()->size());
+    a->send(b->self(), eterm(1));
+    BOOST_REQUIRE_EQUAL(1u, got.size());
+    a->send(b->self(), eterm(2));
+    a->send(b->self(), eterm(3));
+    BOOST_REQUIRE_EQUAL(3u, got.size());
+    BOOST_REQUIRE_EQUAL(3, got[2]);
+    BOOST_REQUIRE_EQUAL(0, ends);
+
+    // The timeout is fired by the node's service
+    io.run();
+    BOOST_REQUIRE_EQUAL(1, ends);
+    BOOST_REQUIRE_EQUAL(0u, node.timers()->size());
+
+    // Messages not matching the pattern stay in the mailbox in order
+    eterm value;
+    co_match_ok(*b, value);
+    a->send(b->self(), eterm(5));
+    BOOST_REQUIRE(value.empty());
+    a->send(b->self(), eterm(6));
+    a->send(b->self(), eterm::format("{ok, 7}"));
+    BOOST_REQUIRE_EQUAL(7, value.to_long());
+    BOOST_REQUIRE_EQUAL(2u, b->depth());
+
+    // A later match looks at the skipped messages first
+    a->send(b->self(), eterm(8));
+    a->send(b->self(), eterm::format("{ok, 9}"));
+    co_match_ok(*b, value);
+    BOOST_REQUIRE_EQUAL(9, value.to_long());
+    BOOST_REQUIRE_EQUAL(3u, b->depth());
+    transport_msg* m = b->receive();
+    BOOST_REQUIRE_EQUAL(5, m->msg().to_long());
+    b->release(m);
+    co_collect(*b, got, ends);
+    BOOST_REQUIRE_EQUAL(5u, got.size());
+    BOOST_REQUIRE_EQUAL(6, got[3]);
+    BOOST_REQUIRE_EQUAL(8, got[4]);
+    BOOST_REQUIRE_EQUAL(0u, b->depth());
+    io.restart();
+    io.run();
+    BOOST_REQUIRE_EQUAL(2, ends);
+
+    // Closing the mailbox resumes the coroutine
+    co_collect(*b, got, ends);
+    b.reset();
+    BOOST_REQUIRE_EQUAL(3, ends);
+    BOOST_REQUIRE_EQUAL(5u, got.size());
+}
+#endif
+
+BOOST_AUTO_TEST_CASE( test_mailbox_receive_batch )
+{
+    // Messages cross threads, so the node uses the thread-safe allocator
+    typedef connect::basic_otp_node<std::allocator<char>, std::mutex> node_t;
+    typedef connect::basic_otp_mailbox<std::allocator<char>, std::mutex> mailbox_t;
+    typedef connect::transport_msg<std::allocator<char>>             msg_t;
+    typedef marshal::eterm<std::allocator<char>>                     term_t;
+
+    boost::asio::io_service io;
+    node_t node(io, "a");
+    std::unique_ptr<mailbox_t> mbox(node.create_mailbox());
+
+    msg_t* msgs[16];
+    BOOST_REQUIRE_EQUAL(0u, mbox->try_receive_batch(msgs, 16));
+    BOOST_REQUIRE_EQUAL(0u, mbox->receive_batch(msgs, 16, std::chrono::milliseconds(1)));
+
+    // The consumer spins briefly, then sleeps until the producer delivers
+    const long count = 1000;
+    long got = 0, errors = 0;
+    std::thread consumer([&]() {
+        msg_t* batch[16];
+        while (got < count) {
+            size_t n = mbox->receive_batch(batch, 16, std::chrono::milliseconds(-1),
+                                           std::chrono::microseconds(10));
+            for (size_t i = 0; i < n; i++)
+                if (batch[i]->msg().to_long() != got++)
+                    errors++;
+            mbox->release(batch, n);
+        }
+    });
+    msg_t tm;
+    for (long i = 0; i < count; i++) {
+        tm.set_send(mbox->self(), term_t(i));
+        while (!mbox->deliver(tm))
+            std::this_thread::yield();
+        if (i % 100 == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    consumer.join();
+    BOOST_REQUIRE_EQUAL(count, got);
+    BOOST_REQUIRE_EQUAL(0, errors);
+
+    for (long i = 0; i < 100; i++) {
+        tm.set_send(mbox->self(), term_t(i));
+        mbox->deliver(tm);
+    }
+    long sum = 0;
+    BOOST_REQUIRE_EQUAL(100u, mbox->drain([&sum](msg_t& m) { sum += m.msg().to_long(); }));
+    BOOST_REQUIRE_EQUAL(4950, sum);
+    BOOST_REQUIRE(mbox->empty());
+}
+
+BOOST_AUTO_TEST_CASE( test_mailbox_schedule )
+{
+    typedef connect::basic_otp_node<std::allocator<char>, std::mutex> node_t;
+    typedef connect::basic_otp_mailbox<std::allocator<char>, std::mutex> mailbox_t;
+    typedef connect::transport_msg<std::allocator<char>>             msg_t;
+    typedef marshal::eterm<std::allocator<char>>                     term_t;
+
+    boost::asio::io_service io;
+    node_t node(io, "a");
+    std::unique_ptr<mailbox_t> mbox(node.create_mailbox());
+    auto handler = [](mailbox_t&, msg_t*&) { return true; };
+    BOOST_REQUIRE_THROW(mbox->schedule(handler), err_bad_argument);
+
+    node.sched_threads(2, 8);
+    BOOST_REQUIRE_EQUAL(2u, node.scheduler()->threads());
+    node.scheduler()->start();
+
+    // Each mailbox is run by one worker at a time, in delivery order
+    const int nmbox = 8, count = 1000;
+    std::vector<std::unique_ptr<mailbox_t>> mbs;
+    std::vector<long> next(nmbox, 0);
+    std::unique_ptr<std::atomic<int>[]> running(new std::atomic<int>[nmbox]);
+    std::atomic<long> done(0), errors(0);
+    for (int i = 0; i < nmbox; i++) {
+        running[i] = 0;
+        mbs.emplace_back(node.create_mailbox());
+        mbs.back()->schedule([&, i](mailbox_t&, msg_t*& a_msg) {
+            if (running[i]++ != 0)
+                errors++;
+            if (a_msg->msg().to_long() != next[i]++)
+                errors++;
+            running[i]--;
+            done++;
+            return true;
+        });
+    }
+    BOOST_REQUIRE_THROW(mbs[0]->schedule(handler), err_bad_argument);
+
+    msg_t tm;
+    for (long j = 0; j < count; j++)
+        for (int i = 0; i < nmbox; i++) {
+            tm.set_send(mbs[i]->self(), term_t(j));
+            while (!mbs[i]->deliver(tm))
+                std::this_thread::yield();
+        }
+    for (int k = 0; k < 5000 && done < nmbox*count; k++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    BOOST_REQUIRE_EQUAL(nmbox*count, done.load());
+    BOOST_REQUIRE_EQUAL(0, errors.load());
+    for (int i = 0; i < nmbox; i++)
+        BOOST_REQUIRE_EQUAL(count, next[i]);
+
+    // A handler returning false stops the mailbox
+    std::atomic<int> calls(0);
+    std::unique_ptr<mailbox_t> once(node.create_mailbox());
+    once->schedule([&](mailbox_t&, msg_t*&) { calls++; return false; });
+    for (long j = 0; j < 3; j++) {
+        tm.set_send(once->self(), term_t(j));
+        once->deliver(tm);
+    }
+    for (int k = 0; k < 5000 && !calls; k++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    BOOST_REQUIRE_EQUAL(1, calls.load());
+    BOOST_REQUIRE_EQUAL(2u, once->depth());
+
+    mbs.clear();
+    node.scheduler()->stop();
+}
+
+BOOST_AUTO_TEST_CASE( test_mailbox_pid_reuse )
+{
+    boost::asio::io_service io;
+    otp_node node(io, "a");
+
+    // A pid is not reused within the retention time
+    otp_mailbox::pointer a(node.create_mailbox());
+    epid first(a->self());
+    a.reset();
+    otp_mailbox::pointer a2(node.create_mailbox());
+    BOOST_REQUIRE_NE(first.id(), a2->self().id());
+
+    connect::mailbox_policy pol;
+    BOOST_REQUIRE_THROW(node.mb_policy(pol), err_bad_argument);
+    a2.reset();
+    pol.retention = std::chrono::milliseconds(0);
+    pol.pools     = 1;
+    node.mb_policy(pol);
+
+    a.reset(node.create_mailbox());
+    epid stale(a->self());
+    BOOST_REQUIRE_EQUAL(a.get(), node.get_mailbox(stale));
+    a.reset();
+    BOOST_REQUIRE_THROW(node.get_mailbox(stale), err_no_process);
+
+    // The index of a closed mailbox is reused with a new serial
+    otp_mailbox::pointer b(node.create_mailbox(atom("b")));
+    BOOST_REQUIRE_EQUAL(stale.id(), b->self().id());
+    BOOST_REQUIRE_NE(stale.serial(), b->self().serial());
+    BOOST_REQUIRE_THROW(node.get_mailbox(stale), err_no_process);
+    BOOST_REQUIRE_EQUAL(b.get(), node.get_mailbox(b->self()));
+    BOOST_REQUIRE_EQUAL(b.get(), node.get_mailbox(atom("b")));
+    BOOST_REQUIRE_EQUAL(b.get(), node.create_mailbox(atom("b")));
+
+    // Pids not made for mailboxes don't reach them
+    BOOST_REQUIRE_THROW(node.get_mailbox(node.create_pid()), err_no_process);
+    BOOST_REQUIRE_EQUAL(1u, node.registry().count());
+}
+
+BOOST_AUTO_TEST_CASE( test_mailbox_churn )
+{
+    // The allocator of the test suite is single-threaded
+    typedef connect::basic_otp_node<std::allocator<char>, std::mutex> node_t;
+    typedef connect::basic_otp_mailbox<std::allocator<char>, std::mutex> mailbox_t;
+
+    boost::asio::io_service io;
+    node_t node(io, "a");
+    connect::mailbox_policy pol;
+    pol.retention = std::chrono::milliseconds(0);
+    pol.pools     = 4;
+    pol.pool_size = 16;
+    node.mb_policy(pol);
+
+    // Threads creating and closing mailboxes never see each other's pids
+    std::atomic<int> bad(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+        threads.emplace_back([&]() {
+            for (int i = 0; i < 500; ++i) {
+                std::vector<std::unique_ptr<mailbox_t>> mbs;
+                for (int j = 0; j < 1 + i % 40; ++j)
+                    mbs.emplace_back(node.create_mailbox());
+                for (auto& m : mbs)
+                    if (node.get_mailbox(m->self()) != m.get())
+                        bad++;
+            }
+        });
+    for (auto& t : threads)
+        t.join();
+
+    BOOST_REQUIRE_EQUAL(0, bad.load());
+    BOOST_REQUIRE_EQUAL(0u, node.registry().count());
+}
@@ -27,9 +27,12 @@ limitations under the License.
 */
 
 #include <eixx/util/async_wait_timeout.hpp>
+#include <eixx/util/atom_map.hpp>
+#include <eixx/util/epoch.hpp>
 #include <boost/test/unit_test.hpp>
 #include "test_alloc.hpp"
 #include <eixx/eixx.hpp>
+#include <thread>
 
 using namespace eixx;
 
@@ -54,3 +57,176 @@ BOOST_AUTO_TEST_CASE( test_node )
     BOOST_REQUIRE(l_same);
     BOOST_REQUIRE_EQUAL(std::string(), l_resolved);
 }
+
+BOOST_AUTO_TEST_CASE( test_epmd_cache )
+{
+    using boost::asio::ip::tcp;
+    connect::epmd_cache cache;
+    connect::epmd_cache::entry e;
+    atom a("a@localhost"), b("b@localhost");
+    tcp::endpoint ep(boost::asio::ip::address_v4::loopback(), 5000);
+
+    BOOST_REQUIRE(!cache.lookup(a, e));
+    cache.store(a, {ep}, 6);
+    BOOST_REQUIRE(cache.lookup(a, e));
+    BOOST_REQUIRE_EQUAL(1u, e.endpoints.size());
+    BOOST_REQUIRE_EQUAL(5000, e.port);
+    BOOST_REQUIRE_EQUAL(6, e.dist_version);
+
+    // A failed connect sends the next lookup to epmd
+    cache.invalidate(a);
+    BOOST_REQUIRE(!cache.lookup(a, e));
+
+    // A static port is never looked up in epmd
+    cache.add_static(b, 4370, 5);
+    BOOST_REQUIRE(cache.lookup(b, e));
+    BOOST_REQUIRE(e.endpoints.empty());
+    BOOST_REQUIRE_EQUAL(4370, e.port);
+    cache.store(b, {ep}, 6);
+    BOOST_REQUIRE(cache.lookup(b, e));
+    BOOST_REQUIRE_EQUAL(1u, e.endpoints.size());
+    BOOST_REQUIRE_EQUAL(4370, e.port);
+    BOOST_REQUIRE_EQUAL(5, e.dist_version);
+    cache.invalidate(b);
+    BOOST_REQUIRE(cache.lookup(b, e));
+    BOOST_REQUIRE(e.endpoints.empty());
+    cache.remove_static(b);
+    BOOST_REQUIRE(!cache.lookup(b, e));
+
+    // Lookups expire after ttl()
+    cache.ttl(std::chrono::milliseconds(1));
+    cache.store(a, {ep}, 6);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    BOOST_REQUIRE(!cache.lookup(a, e));
+}
+
+BOOST_AUTO_TEST_CASE( test_atom_map )
+{
+    util::atom_map<int> map(8);
+    std::vector<atom>   keys;
+    std::vector<int>    vals(1000);
+    std::vector<atom>   missing;
+    for (int i = 0; i < 1000; ++i) {
+        keys.push_back(atom("node" + std::to_string(i) + "@host"));
+        missing.push_back(atom("none" + std::to_string(i) + "@host"));
+        vals[i] = i;
+    }
+
+    // Readers see every key either unset or with its value while the
+    // table grows, and never get the value of another key from a slot
+    // being filled
+    std::atomic<bool> done(false);
+    std::atomic<int>  bad(0);
+    std::thread reader([&]() {
+        while (!done.load())
+            for (int i = 0; i < 1000; ++i) {
+                int* p = map.find(keys[i]);
+                if (p && *p != i) bad++;
+                if (map.find(missing[i])) bad++;
+            }
+    });
+    for (int i = 0; i < 1000; ++i)
+        map.set(keys[i], &vals[i]);
+    done = true;
+    reader.join();
+
+    BOOST_REQUIRE_EQUAL(0, bad.load());
+    BOOST_REQUIRE(map.capacity() >= 2000);
+    for (int i = 0; i < 1000; ++i)
+        BOOST_REQUIRE_EQUAL(&vals[i], map.find(keys[i]));
+    BOOST_REQUIRE(!map.find(atom("unknown@host")));
+
+    map.erase(keys[5]);
+    BOOST_REQUIRE(!map.find(keys[5]));
+    map.set(keys[5], &vals[5]);
+    BOOST_REQUIRE_EQUAL(&vals[5], map.find(keys[5]));
+
+    // The replaced tables are handed over to the caller
+    size_t cap = map.capacity();
+    auto old = map.clear();
+    BOOST_REQUIRE(old);
+    BOOST_REQUIRE(!map.find(keys[0]));
+    BOOST_REQUIRE(map.capacity() < cap);
+    map.set(keys[0], &vals[0]);
+    BOOST_REQUIRE_EQUAL(&vals[0], map.find(keys[0]));
+}
+
+BOOST_AUTO_TEST_CASE( test_epoch_reclaimer )
+{
+    struct obj {
+        std::atomic<int>& live;
+        int               val;
+        obj(std::atomic<int>& a_live, int a_val) : live(a_live), val(a_val) { live++; }
+        ~obj() { val = -1; live--; }
+    };
+    std::atomic<int> live(0);
+
+    {
+        util::epoch_reclaimer<std::unique_ptr<obj>> rec;
+
+        // An object is kept while a guard taken before its retirement lives
+        {
+            util::epoch_reclaimer<std::unique_ptr<obj>>::guard g(rec);
+            rec.retire(std::unique_ptr<obj>(new obj(live, 1)));
+            rec.reclaim();
+            rec.reclaim();
+            BOOST_REQUIRE_EQUAL(1, live.load());
+        }
+        rec.reclaim();
+        rec.reclaim();
+        BOOST_REQUIRE_EQUAL(0, live.load());
+        BOOST_REQUIRE_EQUAL(0u, rec.retired());
+
+        // Readers never see a freed object while a writer replaces it
+        std::atomic<obj*> cur(new obj(live, 0));
+        std::atomic<bool> done(false);
+        std::atomic<int>  bad(0);
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 3; ++t)
+            readers.emplace_back([&]() {
+                while (!done.load()) {
+                    util::epoch_reclaimer<std::unique_ptr<obj>>::guard g(rec);
+                    obj* p = cur.load(std::memory_order_acquire);
+                    if (p->val < 0) bad++;
+                }
+            });
+        for (int i = 1; i <= 20000; ++i) {
+            obj* p = cur.exchange(new obj(live, i), std::memory_order_acq_rel);
+            rec.retire(std::unique_ptr<obj>(p));
+        }
+        done = true;
+        for (auto& t : readers) t.join();
+        BOOST_REQUIRE_EQUAL(0, bad.load());
+        // The writer doesn't fall behind while readers come and go
+        BOOST_REQUIRE(rec.retired() < 20000u);
+        delete cur.load();
+    }
+    BOOST_REQUIRE_EQUAL(0, live.load());
+}
+
+BOOST_AUTO_TEST_CASE( test_alias_conflict )
+{
+    // Nothing listens on this epmd port, so the connection to b fails
+    setenv("ERL_EPMD_PORT", "14370", 1);
+    boost::asio::io_service svc;
+    otp_node a(svc, "a@localhost", "cookie"), b(svc, "b@localhost", "cookie");
+    a.on_status = [](otp_node&, const otp_connection*, connect::report_level, const std::string&) {};
+    b.shm_listen("/tmp/eixx_test_alias.sock");
+
+    // The name b@localhost that the shm peer reports in the handshake is
+    // already routed to another connection and must not be taken over
+    std::string l_tcp("?"), l_shm("?");
+    a.connect([&](otp_connection*, const std::string& e) { l_tcp = e; },
+              atom("b@localhost"), 0);
+    a.connect([&](otp_connection*, const std::string& e) { l_shm = e; },
+              atom("shm:///tmp/eixx_test_alias.sock"), 0);
+
+    boost::asio::deadline_timer t(svc, boost::posix_time::milliseconds(500));
+    t.async_wait([&](const boost::system::error_code&) { svc.stop(); });
+    svc.run();
+    unsetenv("ERL_EPMD_PORT");
+
+    BOOST_REQUIRE(l_shm.find("already in use") != std::string::npos);
+    BOOST_REQUIRE(l_tcp != "?");
+    BOOST_REQUIRE(!a.connection(atom("b@localhost")).connected());
+}
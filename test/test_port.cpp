@@ -0,0 +1,108 @@
+//----------------------------------------------------------------------------
+/// \file  test_port.cpp
+//----------------------------------------------------------------------------
+/// \brief Test cases for basic_otp_port.
+//----------------------------------------------------------------------------
+// Copyright (c) 2010 Serge Aleynikov <saleyn@gmail.com>
+// Created: 2021-11-18
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+
+#include <boost/test/unit_test.hpp>
+#include "test_alloc.hpp"
+#include <eixx/eixx.hpp>
+#include <thread>
+#include <unistd.h>
+
+using namespace eixx;
+
+namespace {
+    // Read a {packet, 4} frame from a_fd and decode its term
+    eterm read_term(int a_fd) {
+        std::string buf(4, '\0');
+        size_t n = 0, need = 4;
+        while (n < need) {
+            ssize_t k = ::read(a_fd, &buf[n], need - n);
+            BOOST_REQUIRE(k > 0);
+            n += size_t(k);
+            if (n == 4) {
+                const char* s = buf.c_str();
+                need += get32be(s);
+                buf.resize(need);
+            }
+        }
+        return eterm(buf.c_str() + 4, buf.size() - 4);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_port_echo )
+{
+    int to_port[2], from_port[2];
+    BOOST_REQUIRE_EQUAL(0, ::pipe(to_port));
+    BOOST_REQUIRE_EQUAL(0, ::pipe(from_port));
+
+    boost::asio::io_service io;
+    otp_port port(io);
+    port.open(to_port[0], from_port[1]);
+
+    bool closed = false;
+    port.on_close = [&](otp_port&, const boost::system::error_code&) { closed = true; };
+
+    int received = 0;
+    port.async_receive([&](otp_port& p, transport_msg*& a_msg) {
+        if (!a_msg)
+            return true;
+        received++;
+        p.send(eterm::format("{reply, ~w}", a_msg->msg()), true);
+        return true;
+    }, std::chrono::milliseconds(-1), -1);
+
+    std::thread th([&]() { io.run(); });
+
+    // A large binary is written by reference rather than copied
+    std::string big(256*1024, 'x');
+    std::vector<eterm> terms = {
+        eterm(atom("hello")),
+        eterm::format("{1, \"abc\", [a, b]}"),
+        eterm(binary(big.c_str(), big.size()))
+    };
+
+    for (auto& t : terms) {
+        auto s = t.encode(4, true);
+        BOOST_REQUIRE_EQUAL(ssize_t(s.size()), ::write(to_port[1], s.c_str(), s.size()));
+        eterm reply = read_term(from_port[0]);
+        BOOST_REQUIRE(reply.match(eterm::format("{reply, _}")));
+        BOOST_REQUIRE_EQUAL(t, reply.to_tuple()[1]);
+    }
+
+    // Closing the pipe is seen as the exit of the Erlang side
+    ::close(to_port[1]);
+    for (int i = 0; i < 500 && !closed; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    io.stop();
+    th.join();
+
+    BOOST_REQUIRE_EQUAL(3, received);
+    BOOST_REQUIRE(closed);
+    BOOST_REQUIRE(!port.connected());
+    ::close(from_port[0]);
+}
@@ -0,0 +1,644 @@
+//----------------------------------------------------------------------------
+/// \file  test_transport.cpp
+//----------------------------------------------------------------------------
+/// \brief Loopback test cases of connection transports and I/O backends.
+//----------------------------------------------------------------------------
+// Copyright (c) 2021 Serge Aleynikov <saleyn@gmail.com>
+// Created: 2021-11-28
+//----------------------------------------------------------------------------
+/*
+***** BEGIN LICENSE BLOCK *****
+
+Copyright 2010 Serge Aleynikov <saleyn at gmail dot com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+***** END LICENSE BLOCK *****
+*/
+
+#include <boost/test/unit_test.hpp>
+#include "test_alloc.hpp"
+#include <eixx/eixx.hpp>
+#include <eixx/util/shm_ring.hpp>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+using namespace eixx;
+using boost::asio::ip::tcp;
+
+namespace {
+
+// Connections may be served by threads of their own, so the nodes use
+// the thread-safe allocator
+typedef connect::basic_otp_node<std::allocator<char>, std::mutex>       node_t;
+typedef connect::basic_otp_mailbox<std::allocator<char>, std::mutex>    mailbox_t;
+typedef connect::basic_otp_connection<std::allocator<char>, std::mutex> connection_t;
+typedef marshal::eterm<std::allocator<char>>                            term_t;
+typedef marshal::binary<std::allocator<char>>                           binary_t;
+typedef marshal::tuple<std::allocator<char>>                            tuple_t;
+
+/// Minimal epmd serving ALIVE2 and PORT2 requests on a thread of its own.
+/// A node stays registered while its ALIVE2 connection is open.
+class fake_epmd {
+    boost::asio::io_service                     m_svc;
+    tcp::acceptor                               m_acceptor;
+    std::mutex                                  m_lock;
+    std::map<std::string, uint16_t>             m_names;
+    std::vector<std::shared_ptr<tcp::socket>>   m_alive;
+    std::thread                                 m_thread;
+
+    void accept() {
+        auto s = std::make_shared<tcp::socket>(m_svc);
+        m_acceptor.async_accept(*s, [this, s](const boost::system::error_code& ec) {
+            if (ec)
+                return;
+            handle(s);
+            accept();
+        });
+    }
+
+    void handle(const std::shared_ptr<tcp::socket>& s) {
+        unsigned char h[2];
+        boost::asio::read(*s, boost::asio::buffer(h, 2));
+        std::vector<unsigned char> b(size_t(h[0] << 8 | h[1]));
+        boost::asio::read(*s, boost::asio::buffer(b));
+
+        std::lock_guard<std::mutex> guard(m_lock);
+        if (b[0] == EI_EPMD_ALIVE2_REQ) {
+            std::string name((const char*)&b[11], size_t(b[9] << 8 | b[10]));
+            m_names[name] = uint16_t(b[1] << 8 | b[2]);
+            unsigned char r[] = {EI_EPMD_ALIVE2_RESP, 0, 0, 0, 0, 1};
+            boost::asio::write(*s, boost::asio::buffer(r));
+            m_alive.push_back(s);
+            auto c = std::make_shared<char>();
+            s->async_read_some(boost::asio::buffer(c.get(), 1),
+                [this, name, s, c](const boost::system::error_code&, size_t) {
+                    std::lock_guard<std::mutex> guard(m_lock);
+                    m_names.erase(name);
+                });
+        } else if (b[0] == EI_EPMD_PORT2_REQ) {
+            std::string name((const char*)&b[1], b.size() - 1);
+            auto it = m_names.find(name);
+            if (it == m_names.end()) {
+                unsigned char r[] = {EI_EPMD_PORT2_RESP, 1};
+                boost::asio::write(*s, boost::asio::buffer(r));
+                return;
+            }
+            std::vector<unsigned char> r = {
+                EI_EPMD_PORT2_RESP, 0, uint8_t(it->second >> 8), uint8_t(it->second),
+                'H', 0, 0, EI_DIST_HIGH, 0, EI_DIST_LOW, 0, uint8_t(name.size())};
+            r.insert(r.end(), name.begin(), name.end());
+            r.push_back(0);
+            r.push_back(0);
+            boost::asio::write(*s, boost::asio::buffer(r));
+        }
+    }
+
+public:
+    static const uint16_t s_port = 14371;
+
+    fake_epmd()
+        : m_acceptor(m_svc, tcp::endpoint(boost::asio::ip::address_v4::loopback(), s_port))
+    {
+        setenv("ERL_EPMD_PORT", std::to_string(s_port).c_str(), 1);
+        accept();
+        m_thread = std::thread([this]() { m_svc.run(); });
+    }
+
+    ~fake_epmd() {
+        m_svc.stop();
+        m_thread.join();
+        unsetenv("ERL_EPMD_PORT");
+    }
+
+    /// Port registered by the node \a a_alive (0 - the node isn't registered).
+    uint16_t port(const std::string& a_alive) {
+        std::lock_guard<std::mutex> guard(m_lock);
+        auto it = m_names.find(a_alive);
+        return it == m_names.end() ? 0 : it->second;
+    }
+};
+
+/// Runs a service on a thread of its own while in scope.
+class service_thread {
+    boost::asio::io_service&        m_svc;
+    boost::asio::io_service::work   m_work;
+    std::thread                     m_thread;
+public:
+    explicit service_thread(boost::asio::io_service& a_svc)
+        : m_svc(a_svc), m_work(a_svc), m_thread([&a_svc]() { a_svc.run(); })
+    {}
+    ~service_thread() {
+        m_svc.stop();
+        m_thread.join();
+    }
+};
+
+/// Closes the nodes and completes their cancelled operations before the
+/// nodes go out of scope, as pending handlers keep connections that refer
+/// to the nodes.  Must be declared after the nodes.
+class node_closer {
+    boost::asio::io_service&    m_svc;
+    std::vector<node_t*>        m_nodes;
+public:
+    node_closer(boost::asio::io_service& a_svc, std::initializer_list<node_t*> a_nodes)
+        : m_svc(a_svc), m_nodes(a_nodes)
+    {}
+    ~node_closer() {
+        for (auto n : m_nodes)
+            n->close();
+        m_svc.reset();
+        while (m_svc.poll());
+    }
+};
+
+/// Runs the node's dispatch on a thread of its own while in scope.
+class node_thread {
+    node_t&         m_node;
+    std::thread     m_thread;
+public:
+    explicit node_thread(node_t& a_node)
+        : m_node(a_node), m_thread([&a_node]() { a_node.run(); })
+    {}
+    ~node_thread() {
+        m_node.stop();
+        m_thread.join();
+    }
+};
+
+void quiet(node_t& a_node) {
+    a_node.on_status = [](node_t&, const connection_t*, connect::report_level,
+                          const std::string&) {};
+}
+
+/// Connect \a a_node to \a a_remote and send \a a_count terms made by
+/// \a a_make to the mailbox "echo" of \a a_peer, which returns them to the
+/// sender.  \a a_svc is run until all replies arrive or 5 seconds pass.
+/// @return the replies in the order they were received.
+template <class Make>
+std::vector<term_t> echo(boost::asio::io_service& a_svc, node_t& a_node, node_t& a_peer,
+                         const atom& a_remote, size_t a_count, Make a_make)
+{
+    std::unique_ptr<mailbox_t> l_echo(a_peer.create_mailbox(atom("echo")));
+    std::unique_ptr<mailbox_t> l_self(a_node.create_mailbox());
+    std::vector<term_t>        l_replies;
+    std::string                l_err("?");
+
+    a_node.connect([&](connection_t*, const std::string& e) {
+        l_err = e;
+        if (e.empty())
+            for (size_t i = 0; i < a_count; i++)
+                a_node.send(l_self->self(), a_peer.nodename(), atom("echo"), a_make(i));
+    }, a_remote, 0);
+
+    boost::asio::deadline_timer t(a_svc);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    std::function<void(const boost::system::error_code&)> poll =
+        [&](const boost::system::error_code&) {
+            while (auto* m = l_echo->receive()) {
+                a_peer.send(m->sender_pid(), m->msg());
+                delete m;
+            }
+            while (auto* m = l_self->receive()) {
+                l_replies.push_back(m->msg());
+                delete m;
+            }
+            if (l_replies.size() == a_count || std::chrono::steady_clock::now() > deadline) {
+                a_svc.stop();
+                return;
+            }
+            t.expires_from_now(boost::posix_time::milliseconds(2));
+            t.async_wait(poll);
+        };
+    t.expires_from_now(boost::posix_time::milliseconds(2));
+    t.async_wait(poll);
+    a_svc.run();
+    a_svc.reset();
+
+    BOOST_REQUIRE_EQUAL(std::string(), l_err);
+    return l_replies;
+}
+
+/// Contents of the binary of the i-th message made by make_blob().
+std::string blob_data(size_t i) {
+    std::string s(i % 3 ? 256 * 1024 + i : 100, '\0');
+    for (size_t j = 0; j < s.size(); j++)
+        s[j] = char(i * 31 + j * 7);
+    return s;
+}
+
+/// The i-th of messages {i, Binary} where two of three binaries are large.
+term_t make_blob(size_t i) {
+    std::string s = blob_data(i);
+    return term_t(tuple_t::make(long(i), binary_t(s.data(), s.size())));
+}
+
+/// Check that \a a_replies are the \a a_count messages made by make_blob().
+void check_blobs(const std::vector<term_t>& a_replies, size_t a_count) {
+    BOOST_REQUIRE_EQUAL(a_count, a_replies.size());
+    for (size_t i = 0; i < a_count; i++) {
+        const tuple_t& t = a_replies[i].to_tuple();
+        std::string    s = blob_data(i);
+        BOOST_REQUIRE_EQUAL(long(i), t[0].to_long());
+        BOOST_REQUIRE_EQUAL(s.size(), t[1].to_binary().size());
+        BOOST_REQUIRE(memcmp(s.data(), t[1].to_binary().data(), s.size()) == 0);
+    }
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( test_transport_coalesce )
+{
+    fake_epmd epmd;
+    boost::asio::io_service svc;
+    node_t a(svc, "a@localhost", "cookie"), b(svc, "b@localhost", "cookie");
+    node_closer closer(svc, {&a, &b});
+    quiet(a);
+    quiet(b);
+
+    // Hold small messages until 16 are pending or 2ms pass, and cork the
+    // socket while a batch is written
+    connect::write_policy wp;
+    wp.flush_count    = 16;
+    wp.flush_delay_us = 2000;
+    wp.cork           = true;
+    a.wr_policy(wp);
+    b.wr_policy(wp);
+    b.start_server();
+
+    // The count isn't a multiple of flush_count, so the tail of the burst
+    // is written by the flush timer
+    const size_t count = 250;
+    auto replies = echo(svc, a, b, atom("b@localhost"), count,
+                        [](size_t i) { return term_t(long(i)); });
+    BOOST_REQUIRE_EQUAL(count, replies.size());
+    for (size_t i = 0; i < count; i++)
+        BOOST_REQUIRE_EQUAL(long(i), replies[i].to_long());
+}
+
+BOOST_AUTO_TEST_CASE( test_transport_submit )
+{
+    fake_epmd epmd;
+    boost::asio::io_service svc;
+    node_t a(svc, "a@localhost", "cookie"), b(svc, "b@localhost", "cookie");
+    node_closer closer(svc, {&a, &b});
+    quiet(a);
+    quiet(b);
+
+    // A short submission queue and a small slab make the producers wait
+    // for the I/O thread and encode some messages into heap buffers
+    connect::write_policy wp;
+    wp.submit_queue_size = 8;
+    wp.slab_chunk_size   = 1024;
+    wp.slab_chunks       = 2;
+    a.wr_policy(wp);
+    b.start_server();
+    std::unique_ptr<mailbox_t> sink(b.create_mailbox(atom("sink")));
+
+    std::atomic<bool> connected(false);
+    a.connect([&](connection_t*, const std::string& e) { connected = e.empty(); },
+              atom("b@localhost"), 0);
+
+    service_thread io(svc);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!connected && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    BOOST_REQUIRE(connected);
+
+    // Messages are (producer << 24 | sequence)
+    const int producers = 4, count = 5000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < producers; t++)
+        threads.emplace_back([&a, t]() {
+            std::unique_ptr<mailbox_t> self(a.create_mailbox());
+            for (int j = 0; j < count; j++)
+                a.send(self->self(), atom("b@localhost"), atom("sink"), term_t(long(t << 24 | j)));
+        });
+
+    // Messages of each producer arrive in the order they were sent
+    std::vector<long> next(producers, 0);
+    int got = 0, unordered = 0;
+    while (got < producers * count && std::chrono::steady_clock::now() < deadline) {
+        connect::transport_msg<std::allocator<char>>* batch[64];
+        size_t n = sink->receive_batch(batch, 64, std::chrono::milliseconds(100));
+        for (size_t i = 0; i < n; i++) {
+            long v = batch[i]->msg().to_long();
+            if ((v & 0xFFFFFF) != next[v >> 24]++)
+                unordered++;
+            got++;
+        }
+        sink->release(batch, n);
+    }
+    for (auto& t : threads)
+        t.join();
+
+    BOOST_REQUIRE_EQUAL(producers * count, got);
+    BOOST_REQUIRE_EQUAL(0, unordered);
+}
+
+BOOST_AUTO_TEST_CASE( test_transport_gather )
+{
+    fake_epmd epmd;
+    boost::asio::io_service svc;
+    node_t a(svc, "a@localhost", "cookie"), b(svc, "b@localhost", "cookie");
+    node_closer closer(svc, {&a, &b});
+    quiet(a);
+    quiet(b);
+
+    // Binaries over 64K are written by reference, and with MSG_ZEROCOPY
+    // where the kernel supports it.  Small terms between them are copied
+    // to the slab, so each message mixes both kinds of buffers
+    connect::write_policy wp;
+    wp.gather_threshold   = 64 * 1024;
+    wp.zerocopy_threshold = 64 * 1024;
+    a.wr_policy(wp);
+    b.wr_policy(wp);
+    b.start_server();
+
+    const size_t count = 24;
+    check_blobs(echo(svc, a, b, atom("b@localhost"), count, make_blob), count);
+}
+
+BOOST_AUTO_TEST_CASE( test_transport_io_threads )
+{
+    fake_epmd epmd;
+    boost::asio::io_service svc, bsvc;
+    node_t a(svc, "a@localhost", "cookie"), b(bsvc, "b@localhost", "cookie");
+    node_closer closer(svc, {&a, &b});
+    quiet(a);
+    quiet(b);
+
+    // The connections of b are accepted and served by the pool's threads,
+    // while the echo mailbox is read on this thread
+    b.io_threads(2);
+    b.start_server();
+    node_thread bt(b);
+
+    const size_t count = 1000;
+    auto replies = echo(svc, a, b, atom("b@localhost"), count,
+                        [](size_t i) { return term_t(long(i)); });
+    BOOST_REQUIRE_EQUAL(count, replies.size());
+    for (size_t i = 0; i < count; i++)
+        BOOST_REQUIRE_EQUAL(long(i), replies[i].to_long());
+}
+
+BOOST_AUTO_TEST_CASE( test_transport_busy_poll )
+{
+    fake_epmd epmd;
+    boost::asio::io_service svc, bsvc;
+    node_t a(svc, "a@localhost", "cookie");
+    node_t b(bsvc, "b@localhost", "cookie", std::allocator<char>(), -1,
+             connect::IO_BACKEND_BUSY_POLL);
+    node_closer closer(svc, {&a, &b});
+    quiet(a);
+    quiet(b);
+
+    // A short spin makes the pollers of b block between the bursts of
+    // the echo loop, so messages are read both by polling and after
+    // waiting for the socket
+    connect::busy_poll_policy bp;
+    bp.spin_us = 1000;
+    b.bp_policy(bp);
+    b.io_threads(2);
+    b.start_server();
+    node_thread bt(b);
+
+    const size_t count = 60;
+    check_blobs(echo(svc, a, b, atom("b@localhost"), count, make_blob), count);
+}
+
+BOOST_AUTO_TEST_CASE( test_shm_ring )
+{
+    std::vector<char> mem(util::shm_ring::footprint(16));
+    util::shm_ring w(mem.data(), 16, true);
+    util::shm_ring r(mem.data(), 16, false);    // The peer's view
+
+    BOOST_REQUIRE_THROW(util::shm_ring(mem.data(), 12, true), std::runtime_error);
+    BOOST_REQUIRE_EQUAL(16u, w.writable());
+    BOOST_REQUIRE_EQUAL(0u,  r.readable());
+
+    char buf[32];
+    iovec iov[2] = {{(void*)"0123456789", 10}, {(void*)"abcdefghijkl", 12}};
+    BOOST_REQUIRE_EQUAL(10u, w.write(iov, 1));
+    BOOST_REQUIRE_EQUAL(10u, r.read(buf, sizeof(buf)));
+    BOOST_REQUIRE_EQUAL(std::string("0123456789"), std::string(buf, 10));
+
+    // The ring is empty at offset 10: a write of 22 bytes is cut at the
+    // capacity and wraps around the end of the ring
+    BOOST_REQUIRE_EQUAL(16u, w.write(iov, 2));
+    BOOST_REQUIRE_EQUAL(0u,  w.writable());
+    BOOST_REQUIRE_EQUAL(0u,  w.write(iov, 1));
+    BOOST_REQUIRE_EQUAL(4u,  r.read(buf, 4));
+    BOOST_REQUIRE_EQUAL(4u,  w.writable());
+    BOOST_REQUIRE_EQUAL(12u, r.read(buf + 4, sizeof(buf)));
+    BOOST_REQUIRE_EQUAL(std::string("0123456789abcdef"), std::string(buf, 16));
+    BOOST_REQUIRE_EQUAL(0u,  r.read(buf, sizeof(buf)));
+}
+
+BOOST_AUTO_TEST_CASE( test_shm_ring_wake )
+{
+    std::vector<char> mem(util::shm_ring::footprint(16));
+    util::shm_ring w(mem.data(), 16, true);
+    util::shm_ring r(mem.data(), 16, false);
+    char  buf[16] = {0};
+    iovec iov = {buf, 1};
+
+    // Nothing to wake until a side announces that it sleeps
+    BOOST_REQUIRE_EQUAL(1u, w.write(&iov, 1));
+    BOOST_REQUIRE(!w.wake_reader());
+    BOOST_REQUIRE_EQUAL(1u, r.read(buf, sizeof(buf)));
+    BOOST_REQUIRE(!r.wake_writer());
+
+    // A reader of an empty ring sleeps and is woken once by the writer
+    BOOST_REQUIRE(r.prepare_rd_wait());
+    iov.iov_len = 4;
+    BOOST_REQUIRE_EQUAL(4u, w.write(&iov, 1));
+    BOOST_REQUIRE(w.wake_reader());
+    BOOST_REQUIRE(!w.wake_reader());
+
+    // A reader finding data after the announcement must not sleep
+    BOOST_REQUIRE(!r.prepare_rd_wait());
+    BOOST_REQUIRE(!w.wake_reader());
+
+    // A writer of a full ring sleeps and is woken once by the reader
+    iov.iov_len = 16;
+    BOOST_REQUIRE_EQUAL(12u, w.write(&iov, 1));
+    BOOST_REQUIRE(w.prepare_wr_wait());
+    BOOST_REQUIRE_EQUAL(8u, r.read(buf, 8));
+    BOOST_REQUIRE(r.wake_writer());
+    BOOST_REQUIRE(!r.wake_writer());
+    BOOST_REQUIRE(!w.prepare_wr_wait());
+    BOOST_REQUIRE(!r.wake_writer());
+}
+
+namespace {
+
+/// Wakes a sleeping side of a ring, the role of the eventfd of shm
+/// connections.  Rings before wait() are not lost.
+class bell {
+    std::mutex              m_lock;
+    std::condition_variable m_cond;
+    int                     m_count = 0;
+public:
+    void ring() {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_count++;
+        m_cond.notify_one();
+    }
+    /// @return false if nobody rang within a second.
+    bool wait() {
+        std::unique_lock<std::mutex> guard(m_lock);
+        if (!m_cond.wait_for(guard, std::chrono::seconds(1), [this]() { return m_count > 0; }))
+            return false;
+        m_count--;
+        return true;
+    }
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( test_shm_ring_stream )
+{
+    // A stream passed through a small ring in chunks of varying size by
+    // two threads that sleep on an empty or full ring.  A lost wake-up
+    // leaves a side asleep until its bell times out, which ends the test.
+    const size_t cap = 64, total = 1 << 20;
+    std::vector<char> mem(util::shm_ring::footprint(cap));
+    util::shm_ring w(mem.data(), cap, true);
+    util::shm_ring r(mem.data(), cap, false);
+    bell rd_bell, wr_bell;
+    std::atomic<int> rd_lost(0), wr_lost(0);
+
+    std::thread writer([&]() {
+        char chunk[cap + 7];
+        for (size_t sent = 0, n = 1; sent < total && !rd_lost; n = n * 7 % (sizeof(chunk) - 1) + 1) {
+            size_t len = std::min(n, total - sent);
+            for (size_t i = 0; i < len; i++)
+                chunk[i] = char((sent + i) % 251);
+            for (size_t off = 0; off < len && !rd_lost; ) {
+                iovec iov = {chunk + off, len - off};
+                size_t k  = w.write(&iov, 1);
+                if (k && w.wake_reader())
+                    rd_bell.ring();
+                off += k;
+                if (!k && w.prepare_wr_wait() && !wr_bell.wait()) {
+                    wr_lost++;
+                    return;
+                }
+            }
+            sent += len;
+        }
+    });
+
+    size_t got = 0, bad = 0;
+    while (got < total && !wr_lost) {
+        char buf[cap / 2 + 3];
+        size_t k = r.read(buf, std::min(sizeof(buf), got % 29 + 1));
+        if (k && r.wake_writer())
+            wr_bell.ring();
+        for (size_t i = 0; i < k; i++)
+            if (buf[i] != char((got + i) % 251))
+                bad++;
+        got += k;
+        if (!k && r.prepare_rd_wait() && !rd_bell.wait()) {
+            rd_lost++;
+            break;
+        }
+    }
+    writer.join();
+
+    BOOST_REQUIRE_EQUAL(0,  rd_lost.load());
+    BOOST_REQUIRE_EQUAL(0,  wr_lost.load());
+    BOOST_REQUIRE_EQUAL(total, got);
+    BOOST_REQUIRE_EQUAL(0u, bad);
+}
+
+BOOST_AUTO_TEST_CASE( test_transport_shm )
+{
+    fake_epmd epmd;
+    boost::asio::io_service svc;
+    node_t a(svc, "a@localhost", "cookie"), b(svc, "b@localhost", "cookie");
+    node_closer closer(svc, {&a, &b});
+    quiet(a);
+    quiet(b);
+
+    // Rings smaller than the large binaries make both sides wait for
+    // each other and wrap around many times
+    connect::write_policy wp;
+    wp.shm_ring_size = 64 * 1024;
+    a.wr_policy(wp);
+    b.shm_listen("/tmp/eixx_test_transport.sock");
+
+    const size_t count = 24;
+    check_blobs(echo(svc, a, b, atom("shm:///tmp/eixx_test_transport.sock"),
+                     count, make_blob), count);
+}
+
+BOOST_AUTO_TEST_CASE( test_transport_accept )
+{
+    fake_epmd epmd;
+    boost::asio::io_service svc;
+    node_t a(svc, "a@localhost", "cookie"), b(svc, "b@localhost", "cookie");
+    node_closer closer(svc, {&a, &b});
+    quiet(a);
+    quiet(b);
+
+    // An unpublished server isn't known to epmd
+    b.start_server(0, 1, false);
+    BOOST_REQUIRE(b.listen_port() != 0);
+    BOOST_REQUIRE_EQUAL(0, epmd.port("b"));
+
+    // A published port is registered by the time start_server() returns
+    b.start_server(0, 3);
+    BOOST_REQUIRE(b.listen_port() != 0);
+    BOOST_REQUIRE_EQUAL(b.listen_port(), epmd.port("b"));
+
+    // a finds b through epmd and is accepted by one of the acceptors
+    const size_t count = 10;
+    auto replies = echo(svc, a, b, atom("b@localhost"), count,
+                        [](size_t i) { return term_t(long(i)); });
+    BOOST_REQUIRE_EQUAL(count, replies.size());
+    BOOST_REQUIRE(b.connection(atom("a@localhost")).connected());
+
+    // epmd forgets the node when its registration connection is closed
+    b.stop_server();
+    BOOST_REQUIRE_EQUAL(0, b.listen_port());
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (epmd.port("b") && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    BOOST_REQUIRE_EQUAL(0, epmd.port("b"));
+}
+
+#ifdef EIXX_USE_IO_URING
+BOOST_AUTO_TEST_CASE( test_transport_uring )
+{
+    fake_epmd epmd;
+    boost::asio::io_service svc;
+    node_t a(svc, "a@localhost", "cookie", std::allocator<char>(), -1, connect::IO_BACKEND_URING);
+    node_t b(svc, "b@localhost", "cookie", std::allocator<char>(), -1, connect::IO_BACKEND_URING);
+    node_closer closer(svc, {&a, &b});
+    quiet(a);
+    quiet(b);
+    b.start_server();
+
+    if (!a.uring(svc))
+        BOOST_TEST_MESSAGE("io_uring is not available, connections use asio");
+
+    // Small messages are sent from the registered slab and large binaries
+    // are gathered from the terms
+    const size_t count = 24;
+    check_blobs(echo(svc, a, b, atom("b@localhost"), count, make_blob), count);
+}
+#endif